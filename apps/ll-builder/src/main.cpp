@@ -8,6 +8,7 @@
 #include "linglong/builder/config.h"
 #include "linglong/builder/linglong_builder.h"
 #include "linglong/package/architecture.h"
+#include "linglong/package/layer_packager.h"
 #include "linglong/repo/config.h"
 #include "linglong/utils/command/env.h"
 #include "linglong/utils/configure.h"
@@ -539,12 +540,34 @@ int main(int argc, char **argv)
               parser.clearPositionalArguments();
 
               auto execVerbose = QCommandLineOption("exec", "run exec than build script", "command");
-              parser.addOptions({ execVerbose });
+              auto layerFileOpt =
+                QCommandLineOption("layer", "run the layer file without importing it", "path");
+              parser.addOptions({ execVerbose, layerFileOpt });
 
               parser.addPositionalArgument("run", "run project", "build");
 
               parser.process(app);
 
+              QStringList exec;
+              if (parser.isSet(execVerbose)) {
+                  exec = splitExec(parser.value(execVerbose));
+              }
+
+              if (parser.isSet(layerFileOpt)) {
+                  linglong::builder::Builder builder(linglong::api::types::v1::BuilderProject{},
+                                                     QDir::current(),
+                                                     repo,
+                                                     *containerBuidler,
+                                                     *builderCfg);
+                  auto result = builder.runLayerFile(parser.value(layerFileOpt), exec);
+                  if (!result) {
+                      qCritical() << result.error();
+                      return -1;
+                  }
+
+                  return 0;
+              }
+
               auto project =
                 linglong::utils::serialize::LoadYAMLFile<linglong::api::types::v1::BuilderProject>(
                   QDir().absoluteFilePath("linglong.yaml"));
@@ -558,10 +581,6 @@ int main(int argc, char **argv)
                                                  repo,
                                                  *containerBuidler,
                                                  *builderCfg);
-              QStringList exec;
-              if (parser.isSet(execVerbose)) {
-                  exec = splitExec(parser.value(execVerbose));
-              }
 
               auto result = builder.run(exec);
               if (!result) {
@@ -575,6 +594,20 @@ int main(int argc, char **argv)
           [&](QCommandLineParser &parser) -> int {
               LINGLONG_TRACE("command export");
               parser.clearPositionalArguments();
+
+              auto compressionOpt = QCommandLineOption(
+                "compression",
+                "compression profile of the layer files, one of "
+                  + linglong::package::compressionProfiles.join(", "),
+                "profile",
+                linglong::package::defaultCompressionProfile);
+              auto deltaFromOpt = QCommandLineOption(
+                "delta-from",
+                "only export the files changed since another version, given as its layer file "
+                "or reference",
+                "layer|ref");
+              parser.addOptions({ compressionOpt, deltaFromOpt });
+
               parser.process(app);
 
               auto project =
@@ -590,7 +623,9 @@ int main(int argc, char **argv)
                                                  repo,
                                                  *containerBuidler,
                                                  *builderCfg);
-              auto result = builder.exportLayer(QDir().absolutePath());
+              auto result = builder.exportLayer(QDir().absolutePath(),
+                                                parser.value(compressionOpt),
+                                                parser.value(deltaFromOpt));
               if (!result) {
                   qCritical() << result.error();
                   return -1;
@@ -691,7 +726,9 @@ int main(int argc, char **argv)
               auto optRepoChannel =
                 QCommandLineOption("channel", "remote repo channel", "--channel", "main");
               auto optNoDevel = QCommandLineOption("no-develop", "push without develop", "");
-              parser.addOptions({ optRepoUrl, optRepoName, optRepoChannel, optNoDevel });
+              auto optObjects =
+                QCommandLineOption("objects", "upload only objects missing on the remote repo", "");
+              parser.addOptions({ optRepoUrl, optRepoName, optRepoChannel, optNoDevel, optObjects });
 
               parser.process(app);
 
@@ -713,7 +750,8 @@ int main(int argc, char **argv)
                                                  repo,
                                                  *containerBuidler,
                                                  *builderCfg);
-              auto result = builder.push(pushWithDevel, repoUrl, repoName);
+              auto result =
+                builder.push(pushWithDevel, repoUrl, repoName, parser.isSet(optObjects));
               if (!result) {
                   qCritical() << result.error();
                   return -1;
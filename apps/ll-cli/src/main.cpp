@@ -233,7 +233,10 @@ int main(int argc, char **argv)
                               { "list", &Cli::list },
                               { "repo", &Cli::repo },
                               { "info", &Cli::info },
-                              { "content", &Cli::content } };
+                              { "content", &Cli::content },
+                              { "prune", &Cli::prune },
+                              { "verify", &Cli::verify },
+                              { "repair", &Cli::repair } };
 
           if (!QObject::connect(QCoreApplication::instance(),
                                 &QCoreApplication::aboutToQuit,
@@ -8,16 +8,66 @@
 #include "linglong/package_manager/package_manager.h"
 #include "linglong/repo/config.h"
 #include "linglong/repo/ostree_repo.h"
+#include "linglong/repo/peer_server.h"
 #include "linglong/utils/configure.h"
 #include "linglong/utils/dbus/register.h"
 #include "linglong/utils/global/initialize.h"
 
 #include <QCoreApplication>
+#include <QNetworkInterface>
+#include <QThread>
+
+#include <algorithm>
 
 using namespace linglong::utils::global;
 using namespace linglong::utils::dbus;
 
 namespace {
+// Peers are served by another thread, which never waits for the main thread.
+void shareObjectsWithPeers(linglong::repo::OSTreeRepo *ostreeRepo, const QString &interfaceName)
+{
+    // NOTE: Objects are only shared in the network of the configured interface.
+    const auto interface = QNetworkInterface::interfaceFromName(interfaceName);
+    const auto entries = interface.addressEntries();
+    const auto network =
+      std::find_if(entries.cbegin(), entries.cend(), [](const QNetworkAddressEntry &entry) {
+          return entry.ip().protocol() == QAbstractSocket::IPv4Protocol
+            && !entry.broadcast().isNull();
+      });
+    if (!interface.isValid() || network == entries.cend()) {
+        qWarning() << "peer sharing is disabled: no IPv4 network on interface" << interfaceName;
+        return;
+    }
+
+    auto thread = new QThread(QCoreApplication::instance());
+    thread->setObjectName("peer-server");
+
+    auto server = new linglong::repo::PeerServer(QDir(LINGLONG_ROOT "/repo"));
+    server->setSharedCommits([ostreeRepo]() {
+        return ostreeRepo->sharedCommits();
+    });
+    server->moveToThread(thread);
+    QObject::connect(thread, &QThread::started, server, [server, network = *network]() {
+        auto result = server->listen(network.ip());
+        if (result) {
+            result = server->startDiscovery(network);
+        }
+        if (!result) {
+            qWarning() << "peer sharing is disabled:" << result.error();
+        }
+    });
+    QObject::connect(thread, &QThread::finished, server, &QObject::deleteLater);
+    QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [thread]() {
+        thread->quit();
+        thread->wait();
+    });
+
+    ostreeRepo->setPeers([server]() {
+        return server->peers();
+    });
+    thread->start();
+}
+
 void withDBusDaemon()
 {
     auto config = linglong::repo::loadConfig(
@@ -36,6 +86,10 @@ void withDBusDaemon()
 
     auto ostreeRepo = new linglong::repo::OSTreeRepo(QDir(LINGLONG_ROOT), *config, *api);
     ostreeRepo->setParent(QCoreApplication::instance());
+    if (config->peerSharing.value_or(false)) {
+        shareObjectsWithPeers(ostreeRepo,
+                              QString::fromStdString(config->peerInterface.value_or("")));
+    }
 
     auto packageManager =
       new linglong::service::PackageManager(*ostreeRepo, QCoreApplication::instance());
@@ -89,6 +143,10 @@ void withoutDBusDaemon()
 
     auto ostreeRepo = new linglong::repo::OSTreeRepo(QDir(LINGLONG_ROOT), *config, *api);
     ostreeRepo->setParent(QCoreApplication::instance());
+    if (config->peerSharing.value_or(false)) {
+        shareObjectsWithPeers(ostreeRepo,
+                              QString::fromStdString(config->peerInterface.value_or("")));
+    }
 
     auto packageManager =
       new linglong::service::PackageManager(*ostreeRepo, QCoreApplication::instance());
@@ -20,7 +20,12 @@ inline bool operator==(const linglong::api::types::v1::RepoConfig &cfg1,
                        const linglong::api::types::v1::RepoConfig &cfg2) noexcept
 {
     return cfg1.version == cfg2.version && cfg1.repos == cfg2.repos
-      && cfg1.defaultRepo == cfg2.defaultRepo;
+      && cfg1.defaultRepo == cfg2.defaultRepo && cfg1.mirrors == cfg2.mirrors
+      && cfg1.remoteCacheTimeout == cfg2.remoteCacheTimeout
+      && cfg1.backgroundBandwidthLimit == cfg2.backgroundBandwidthLimit
+      && cfg1.backgroundIOPriority == cfg2.backgroundIOPriority
+      && cfg1.backgroundNice == cfg2.backgroundNice && cfg1.peerSharing == cfg2.peerSharing
+      && cfg1.peerInterface == cfg2.peerInterface;
 }
 
 inline bool operator!=(const linglong::api::types::v1::RepoConfig &cfg1,
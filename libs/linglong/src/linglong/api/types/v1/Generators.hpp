@@ -25,6 +25,9 @@
 #include "linglong/api/types/v1/PackageManager1SearchParameters.hpp"
 #include "linglong/api/types/v1/PackageManager1ModifyRepoParameters.hpp"
 #include "linglong/api/types/v1/PackageManager1ResultWithTaskID.hpp"
+#include "linglong/api/types/v1/PackageManager1PruneResult.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyParameters.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyResult.hpp"
 #include "linglong/api/types/v1/PackageManager1InstallParameters.hpp"
 #include "linglong/api/types/v1/PackageManager1Package.hpp"
 #include "linglong/api/types/v1/PackageManager1GetRepoInfoResult.hpp"
@@ -32,6 +35,7 @@
 #include "linglong/api/types/v1/PackageInfo.hpp"
 #include "linglong/api/types/v1/OciConfigurationPatch.hpp"
 #include "linglong/api/types/v1/LayerInfo.hpp"
+#include "linglong/api/types/v1/LayerInfoDelta.hpp"
 #include "linglong/api/types/v1/CommonResult.hpp"
 #include "linglong/api/types/v1/CliContainer.hpp"
 #include "linglong/api/types/v1/BuilderProject.hpp"
@@ -77,6 +81,9 @@ void to_json(json & j, const CliContainer & x);
 void from_json(const json & j, CommonResult & x);
 void to_json(json & j, const CommonResult & x);
 
+void from_json(const json & j, LayerInfoDelta & x);
+void to_json(json & j, const LayerInfoDelta & x);
+
 void from_json(const json & j, LayerInfo & x);
 void to_json(json & j, const LayerInfo & x);
 
@@ -104,6 +111,15 @@ void to_json(json & j, const PackageManager1ResultWithTaskID & x);
 void from_json(const json & j, PackageManager1ModifyRepoParameters & x);
 void to_json(json & j, const PackageManager1ModifyRepoParameters & x);
 
+void from_json(const json & j, PackageManager1PruneResult & x);
+void to_json(json & j, const PackageManager1PruneResult & x);
+
+void from_json(const json & j, PackageManager1VerifyParameters & x);
+void to_json(json & j, const PackageManager1VerifyParameters & x);
+
+void from_json(const json & j, PackageManager1VerifyResult & x);
+void to_json(json & j, const PackageManager1VerifyResult & x);
+
 void from_json(const json & j, PackageManager1SearchParameters & x);
 void to_json(json & j, const PackageManager1SearchParameters & x);
 
@@ -324,13 +340,36 @@ j["code"] = x.code;
 j["message"] = x.message;
 }
 
+inline void from_json(const json & j, LayerInfoDelta& x) {
+x.base = j.at("base").get<std::string>();
+x.checksum = j.at("checksum").get<std::string>();
+x.removed = get_stack_optional<std::vector<std::string>>(j, "removed");
+}
+
+inline void to_json(json & j, const LayerInfoDelta & x) {
+j = json::object();
+j["base"] = x.base;
+j["checksum"] = x.checksum;
+if (x.removed) {
+j["removed"] = x.removed;
+}
+}
+
 inline void from_json(const json & j, LayerInfo& x) {
+x.compression = get_stack_optional<std::string>(j, "compression");
+x.delta = get_stack_optional<LayerInfoDelta>(j, "delta");
 x.info = get_untyped(j, "info");
 x.version = j.at("version").get<std::string>();
 }
 
 inline void to_json(json & j, const LayerInfo & x) {
 j = json::object();
+if (x.compression) {
+j["compression"] = x.compression;
+}
+if (x.delta) {
+j["delta"] = x.delta;
+}
 j["info"] = x.info;
 j["version"] = x.version;
 }
@@ -476,6 +515,67 @@ j = json::object();
 j["id"] = x.id;
 }
 
+inline void from_json(const json & j, PackageManager1PruneResult& x) {
+x.packages = get_stack_optional<std::vector<PackageInfo>>(j, "packages");
+x.reclaimedBytes = get_stack_optional<int64_t>(j, "reclaimedBytes");
+x.code = j.at("code").get<int64_t>();
+x.message = j.at("message").get<std::string>();
+}
+
+inline void to_json(json & j, const PackageManager1PruneResult & x) {
+j = json::object();
+if (x.packages) {
+j["packages"] = x.packages;
+}
+if (x.reclaimedBytes) {
+j["reclaimedBytes"] = x.reclaimedBytes;
+}
+j["code"] = x.code;
+j["message"] = x.message;
+}
+
+inline void from_json(const json & j, PackageManager1VerifyParameters& x) {
+x.repair = get_stack_optional<bool>(j, "repair");
+}
+
+inline void to_json(json & j, const PackageManager1VerifyParameters & x) {
+j = json::object();
+if (x.repair) {
+j["repair"] = x.repair;
+}
+}
+
+inline void from_json(const json & j, PackageManager1VerifyResult& x) {
+x.brokenLayers = get_stack_optional<std::vector<std::string>>(j, "brokenLayers");
+x.corruptedObjects = get_stack_optional<std::vector<std::string>>(j, "corruptedObjects");
+x.layers = get_stack_optional<int64_t>(j, "layers");
+x.objects = get_stack_optional<int64_t>(j, "objects");
+x.repairedLayers = get_stack_optional<std::vector<std::string>>(j, "repairedLayers");
+x.code = j.at("code").get<int64_t>();
+x.message = j.at("message").get<std::string>();
+}
+
+inline void to_json(json & j, const PackageManager1VerifyResult & x) {
+j = json::object();
+if (x.brokenLayers) {
+j["brokenLayers"] = x.brokenLayers;
+}
+if (x.corruptedObjects) {
+j["corruptedObjects"] = x.corruptedObjects;
+}
+if (x.layers) {
+j["layers"] = x.layers;
+}
+if (x.objects) {
+j["objects"] = x.objects;
+}
+if (x.repairedLayers) {
+j["repairedLayers"] = x.repairedLayers;
+}
+j["code"] = x.code;
+j["message"] = x.message;
+}
+
 inline void from_json(const json & j, PackageManager1SearchResult& x) {
 x.packages = get_stack_optional<std::vector<PackageInfo>>(j, "packages");
 x.code = j.at("code").get<int64_t>();
@@ -510,14 +610,42 @@ j["packages"] = x.packages;
 }
 
 inline void from_json(const json & j, RepoConfig& x) {
+x.backgroundBandwidthLimit = get_stack_optional<int64_t>(j, "backgroundBandwidthLimit");
+x.backgroundIOPriority = get_stack_optional<int64_t>(j, "backgroundIOPriority");
+x.backgroundNice = get_stack_optional<int64_t>(j, "backgroundNice");
 x.defaultRepo = j.at("defaultRepo").get<std::string>();
+x.mirrors = get_stack_optional<std::map<std::string, std::vector<std::string>>>(j, "mirrors");
+x.peerInterface = get_stack_optional<std::string>(j, "peerInterface");
+x.peerSharing = get_stack_optional<bool>(j, "peerSharing");
+x.remoteCacheTimeout = get_stack_optional<int64_t>(j, "remoteCacheTimeout");
 x.repos = j.at("repos").get<std::map<std::string, std::string>>();
 x.version = j.at("version").get<int64_t>();
 }
 
 inline void to_json(json & j, const RepoConfig & x) {
 j = json::object();
+if (x.backgroundBandwidthLimit) {
+j["backgroundBandwidthLimit"] = x.backgroundBandwidthLimit;
+}
+if (x.backgroundIOPriority) {
+j["backgroundIOPriority"] = x.backgroundIOPriority;
+}
+if (x.backgroundNice) {
+j["backgroundNice"] = x.backgroundNice;
+}
 j["defaultRepo"] = x.defaultRepo;
+if (x.mirrors) {
+j["mirrors"] = x.mirrors;
+}
+if (x.peerInterface) {
+j["peerInterface"] = x.peerInterface;
+}
+if (x.peerSharing) {
+j["peerSharing"] = x.peerSharing;
+}
+if (x.remoteCacheTimeout) {
+j["remoteCacheTimeout"] = x.remoteCacheTimeout;
+}
 j["repos"] = x.repos;
 j["version"] = x.version;
 }
@@ -539,9 +667,12 @@ x.packageManager1InstallResult = get_stack_optional<PackageManager1ResultWithTas
 x.packageManager1ModifyRepoParameters = get_stack_optional<PackageManager1ModifyRepoParameters>(j, "PackageManager1ModifyRepoParameters");
 x.packageManager1ModifyRepoResult = get_stack_optional<CommonResult>(j, "PackageManager1ModifyRepoResult");
 x.packageManager1Package = get_stack_optional<PackageManager1Package>(j, "PackageManager1Package");
+x.packageManager1PruneResult = get_stack_optional<PackageManager1PruneResult>(j, "PackageManager1PruneResult");
 x.packageManager1SearchParameters = get_stack_optional<PackageManager1SearchParameters>(j, "PackageManager1SearchParameters");
 x.packageManager1SearchResult = get_stack_optional<PackageManager1SearchResult>(j, "PackageManager1SearchResult");
 x.packageManager1UninstallParameters = get_stack_optional<PackageManager1UninstallParameters>(j, "PackageManager1UninstallParameters");
+x.packageManager1VerifyParameters = get_stack_optional<PackageManager1VerifyParameters>(j, "PackageManager1VerifyParameters");
+x.packageManager1VerifyResult = get_stack_optional<PackageManager1VerifyResult>(j, "PackageManager1VerifyResult");
 x.packageManager1UninstallResult = get_stack_optional<CommonResult>(j, "PackageManager1UninstallResult");
 x.packageManager1UpdateParameters = get_stack_optional<PackageManager1UpdateParameters>(j, "PackageManager1UpdateParameters");
 x.packageManager1UpdateResult = get_stack_optional<PackageManager1ResultWithTaskID>(j, "PackageManager1UpdateResult");
@@ -598,6 +729,9 @@ j["PackageManager1ModifyRepoResult"] = x.packageManager1ModifyRepoResult;
 if (x.packageManager1Package) {
 j["PackageManager1Package"] = x.packageManager1Package;
 }
+if (x.packageManager1PruneResult) {
+j["PackageManager1PruneResult"] = x.packageManager1PruneResult;
+}
 if (x.packageManager1SearchParameters) {
 j["PackageManager1SearchParameters"] = x.packageManager1SearchParameters;
 }
@@ -607,6 +741,12 @@ j["PackageManager1SearchResult"] = x.packageManager1SearchResult;
 if (x.packageManager1UninstallParameters) {
 j["PackageManager1UninstallParameters"] = x.packageManager1UninstallParameters;
 }
+if (x.packageManager1VerifyParameters) {
+j["PackageManager1VerifyParameters"] = x.packageManager1VerifyParameters;
+}
+if (x.packageManager1VerifyResult) {
+j["PackageManager1VerifyResult"] = x.packageManager1VerifyResult;
+}
 if (x.packageManager1UninstallResult) {
 j["PackageManager1UninstallResult"] = x.packageManager1UninstallResult;
 }
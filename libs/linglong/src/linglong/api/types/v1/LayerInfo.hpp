@@ -17,6 +17,8 @@
 #include <nlohmann/json.hpp>
 #include "linglong/api/types/v1/helper.hpp"
 
+#include "linglong/api/types/v1/LayerInfoDelta.hpp"
+
 namespace linglong {
 namespace api {
 namespace types {
@@ -31,6 +33,12 @@ using nlohmann::json;
 * Meta infomation on the head of layer file.
 */
 struct LayerInfo {
+std::optional<std::string> compression;
+/**
+* present if the layer only contains the files changed since another version of the
+* package, it is installed on top of that version
+*/
+std::optional<LayerInfoDelta> delta;
 nlohmann::json info;
 std::string version;
 };
@@ -0,0 +1,55 @@
+// This file is generated by tools/codegen.sh
+// DO NOT EDIT IT.
+
+// clang-format off
+
+//  To parse this JSON data, first install
+//
+//      json.hpp  https://github.com/nlohmann/json
+//
+//  Then include this file, and then do
+//
+//     LayerInfoDelta.hpp data = nlohmann::json::parse(jsonString);
+
+#pragma once
+
+#include <optional>
+#include <nlohmann/json.hpp>
+#include "linglong/api/types/v1/helper.hpp"
+
+namespace linglong {
+namespace api {
+namespace types {
+namespace v1 {
+/**
+* present if the layer only contains the files changed since another version of the
+* package, it is installed on top of that version
+*/
+
+using nlohmann::json;
+
+/**
+* present if the layer only contains the files changed since another version of the
+* package, it is installed on top of that version
+*/
+struct LayerInfoDelta {
+/**
+* reference of the version the delta is based on
+*/
+std::string base;
+/**
+* content checksum of the ostree commit of the base layer, which does not depend on when
+* and where the layer is committed
+*/
+std::string checksum;
+/**
+* paths removed from the base layer, relative to the layer directory
+*/
+std::optional<std::vector<std::string>> removed;
+};
+}
+}
+}
+}
+
+// clang-format on
@@ -31,9 +31,12 @@
 #include "linglong/api/types/v1/PackageManager1ResultWithTaskID.hpp"
 #include "linglong/api/types/v1/PackageManager1ModifyRepoParameters.hpp"
 #include "linglong/api/types/v1/PackageManager1Package.hpp"
+#include "linglong/api/types/v1/PackageManager1PruneResult.hpp"
 #include "linglong/api/types/v1/PackageManager1SearchParameters.hpp"
 #include "linglong/api/types/v1/PackageManager1SearchResult.hpp"
 #include "linglong/api/types/v1/PackageManager1UninstallParameters.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyParameters.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyResult.hpp"
 #include "linglong/api/types/v1/PackageManager1UpdateParameters.hpp"
 #include "linglong/api/types/v1/RepoConfig.hpp"
 
@@ -69,9 +72,12 @@ std::optional<PackageManager1ResultWithTaskID> packageManager1InstallResult;
 std::optional<PackageManager1ModifyRepoParameters> packageManager1ModifyRepoParameters;
 std::optional<CommonResult> packageManager1ModifyRepoResult;
 std::optional<PackageManager1Package> packageManager1Package;
+std::optional<PackageManager1PruneResult> packageManager1PruneResult;
 std::optional<PackageManager1SearchParameters> packageManager1SearchParameters;
 std::optional<PackageManager1SearchResult> packageManager1SearchResult;
 std::optional<PackageManager1UninstallParameters> packageManager1UninstallParameters;
+std::optional<PackageManager1VerifyParameters> packageManager1VerifyParameters;
+std::optional<PackageManager1VerifyResult> packageManager1VerifyResult;
 std::optional<CommonResult> packageManager1UninstallResult;
 std::optional<PackageManager1UpdateParameters> packageManager1UpdateParameters;
 std::optional<PackageManager1ResultWithTaskID> packageManager1UpdateResult;
@@ -0,0 +1,37 @@
+// This file is generated by tools/codegen.sh
+// DO NOT EDIT IT.
+
+// clang-format off
+
+//  To parse this JSON data, first install
+//
+//      json.hpp  https://github.com/nlohmann/json
+//
+//  Then include this file, and then do
+//
+//     PackageManager1VerifyParameters.hpp data = nlohmann::json::parse(jsonString);
+
+#pragma once
+
+#include <optional>
+#include <nlohmann/json.hpp>
+#include "linglong/api/types/v1/helper.hpp"
+
+namespace linglong {
+namespace api {
+namespace types {
+namespace v1 {
+using nlohmann::json;
+
+struct PackageManager1VerifyParameters {
+/**
+* repair the broken layers found by package manager verify
+*/
+std::optional<bool> repair;
+};
+}
+}
+}
+}
+
+// clang-format on
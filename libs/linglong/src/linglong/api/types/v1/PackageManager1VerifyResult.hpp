@@ -0,0 +1,62 @@
+// This file is generated by tools/codegen.sh
+// DO NOT EDIT IT.
+
+// clang-format off
+
+//  To parse this JSON data, first install
+//
+//      json.hpp  https://github.com/nlohmann/json
+//
+//  Then include this file, and then do
+//
+//     PackageManager1VerifyResult.hpp data = nlohmann::json::parse(jsonString);
+
+#pragma once
+
+#include <optional>
+#include <nlohmann/json.hpp>
+#include "linglong/api/types/v1/helper.hpp"
+
+namespace linglong {
+namespace api {
+namespace types {
+namespace v1 {
+using nlohmann::json;
+
+struct PackageManager1VerifyResult {
+/**
+* layers with missing or modified files
+*/
+std::optional<std::vector<std::string>> brokenLayers;
+/**
+* ostree objects whose content does not match their checksum
+*/
+std::optional<std::vector<std::string>> corruptedObjects;
+/**
+* number of layers verified
+*/
+std::optional<int64_t> layers;
+/**
+* number of ostree objects verified
+*/
+std::optional<int64_t> objects;
+/**
+* broken layers repaired by package manager verify
+*/
+std::optional<std::vector<std::string>> repairedLayers;
+/**
+* We do not use DBus error. We return an error code instead. Non-zero code indicated errors
+* occurs and message should be displayed to user.
+*/
+int64_t code;
+/**
+* Human readable result message.
+*/
+std::string message;
+};
+}
+}
+}
+}
+
+// clang-format on
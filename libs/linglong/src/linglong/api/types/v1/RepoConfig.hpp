@@ -31,7 +31,14 @@ using nlohmann::json;
 * Configuration file for local linglong repository.
 */
 struct RepoConfig {
+std::optional<int64_t> backgroundBandwidthLimit;
+std::optional<int64_t> backgroundIOPriority;
+std::optional<int64_t> backgroundNice;
 std::string defaultRepo;
+std::optional<std::map<std::string, std::vector<std::string>>> mirrors;
+std::optional<std::string> peerInterface;
+std::optional<bool> peerSharing;
+std::optional<int64_t> remoteCacheTimeout;
 std::map<std::string, std::string> repos;
 int64_t version;
 };
@@ -17,6 +17,7 @@
 #include "linglong/utils/command/ocppi-helper.h"
 #include "linglong/utils/error/error.h"
 #include "linglong/utils/global/initialize.h"
+#include "linglong/utils/serialize/json.h"
 #include "linglong/utils/xdg/desktop_entry.h"
 #include "nlohmann/json.hpp"
 #include "ocppi/cli/CLI.hpp"
@@ -721,11 +722,23 @@ utils::error::Result<void> Builder::build(const QStringList &args) noexcept
         return LINGLONG_ERR(result);
     }
 
+    // NOTE: Release the layers replaced above.
+    result = this->repo.emptyTrash();
+    if (!result) {
+        qWarning() << result.error();
+    }
+    auto pruned = this->repo.prune();
+    if (!pruned) {
+        qWarning() << pruned.error();
+    }
+
     printMessage("Successfully build " + this->project.package.id);
     return LINGLONG_OK;
 }
 
-utils::error::Result<void> Builder::exportLayer(const QString &destination)
+utils::error::Result<void> Builder::exportLayer(const QString &destination,
+                                                const QString &compression,
+                                                const QString &deltaFrom)
 {
     LINGLONG_TRACE("export layer file");
 
@@ -745,34 +758,80 @@ utils::error::Result<void> Builder::exportLayer(const QString &destination)
     if (!runtimeLayerDir) {
         return LINGLONG_ERR(runtimeLayerDir);
     }
-    const auto runtimeLayerPath = QString("%1/%2_%3_%4_%5.layer")
-                                    .arg(destDir.absolutePath(),
-                                         ref->id,
-                                         ref->version.toString(),
-                                         ref->arch.toString(),
-                                         "runtime");
 
     auto developLayerDir = this->repo.getLayerDir(*ref, true);
-    const auto develLayerPath = QString("%1/%2_%3_%4_%5.layer")
-                                  .arg(destDir.absolutePath(),
-                                       ref->id,
-                                       ref->version.toString(),
-                                       ref->arch.toString(),
-                                       "develop");
     if (!developLayerDir) {
         return LINGLONG_ERR(developLayerDir);
     }
 
+    std::optional<package::Reference> baseRef;
+    if (!deltaFrom.isEmpty()) {
+        auto base = this->deltaBase(deltaFrom, *ref);
+        if (!base) {
+            return LINGLONG_ERR(base);
+        }
+        baseRef = *base;
+    }
+
     package::LayerPackager pkger;
 
-    auto runtimeLayer = pkger.pack(*runtimeLayerDir, runtimeLayerPath);
-    if (!runtimeLayer) {
-        return LINGLONG_ERR(runtimeLayer);
+    auto pack = [&](const package::LayerDir &layerDir,
+                    const QString &module) -> utils::error::Result<void> {
+        LINGLONG_TRACE("export " + module + " layer");
+
+        const auto develop = module == "develop";
+        const auto layerPath = QString("%1/%2_%3_%4_%5")
+                                 .arg(destDir.absolutePath(),
+                                      ref->id,
+                                      ref->version.toString(),
+                                      ref->arch.toString(),
+                                      module);
+
+        // NOTE: A layer file as the base only has one module, the other
+        // module is exported in full.
+        std::optional<package::LayerDir> baseLayerDir;
+        if (baseRef) {
+            auto dir = this->repo.getLayerDir(*baseRef, develop);
+            if (dir) {
+                baseLayerDir = *dir;
+            } else {
+                qWarning() << "export full" << module << "layer:" << dir.error().message();
+            }
+        }
+
+        if (!baseLayerDir) {
+            auto layer = pkger.pack(layerDir, layerPath + ".layer", compression);
+            if (!layer) {
+                return LINGLONG_ERR(layer);
+            }
+            return LINGLONG_OK;
+        }
+
+        auto checksum = this->repo.getLayerChecksum(*baseRef, develop);
+        if (!checksum) {
+            return LINGLONG_ERR(checksum);
+        }
+
+        auto layer = pkger.packDelta(*baseLayerDir,
+                                     *checksum,
+                                     layerDir,
+                                     QString("%1_delta_%2.layer")
+                                       .arg(layerPath, baseRef->version.toString()),
+                                     compression);
+        if (!layer) {
+            return LINGLONG_ERR(layer);
+        }
+        return LINGLONG_OK;
+    };
+
+    auto result = pack(*runtimeLayerDir, "runtime");
+    if (!result) {
+        return LINGLONG_ERR(result);
     }
 
-    auto develLayer = pkger.pack(*developLayerDir, develLayerPath);
-    if (!develLayer) {
-        return LINGLONG_ERR(develLayer);
+    result = pack(*developLayerDir, "develop");
+    if (!result) {
+        return LINGLONG_ERR(result);
     }
 
     return LINGLONG_OK;
@@ -810,7 +869,8 @@ utils::error::Result<void> Builder::extractLayer(const QString &layerPath,
 
 linglong::utils::error::Result<void> Builder::push(bool pushWithDevel,
                                                    const QString &repoName,
-                                                   const QString &repoUrl)
+                                                   const QString &repoUrl,
+                                                   bool pushObjects)
 {
     LINGLONG_TRACE("push reference to remote repository");
 
@@ -839,15 +899,17 @@ linglong::utils::error::Result<void> Builder::push(bool pushWithDevel,
         return LINGLONG_ERR(result);
     }
 
+    repo::pushOption opts{ .objects = pushObjects };
+
     if (pushWithDevel) {
-        result = repo.push(*ref, true);
+        result = repo.push(*ref, true, opts);
 
         if (!result) {
             return LINGLONG_ERR(result);
         }
     }
 
-    result = repo.push(*ref);
+    result = repo.push(*ref, false, opts);
     if (!result) {
         return LINGLONG_ERR(result);
     }
@@ -864,6 +926,11 @@ utils::error::Result<void> Builder::importLayer(const QString &path)
         return LINGLONG_ERR(layerFile);
     }
 
+    auto layerInfo = (*layerFile)->metaInfo();
+    if (!layerInfo) {
+        return LINGLONG_ERR(layerInfo);
+    }
+
     package::LayerPackager pkg;
 
     auto layerDir = pkg.unpack(*(*layerFile));
@@ -871,7 +938,7 @@ utils::error::Result<void> Builder::importLayer(const QString &path)
         return LINGLONG_ERR(layerDir);
     }
 
-    auto result = this->repo.importLayerDir(*layerDir);
+    auto result = this->repo.importLayerDir(*layerDir, layerInfo->delta);
     if (!result) {
         return LINGLONG_ERR(result);
     }
@@ -879,6 +946,73 @@ utils::error::Result<void> Builder::importLayer(const QString &path)
     return LINGLONG_OK;
 }
 
+utils::error::Result<package::Reference> Builder::deltaBase(const QString &deltaFrom,
+                                                            const package::Reference &ref)
+{
+    LINGLONG_TRACE("get base of delta from " + deltaFrom);
+
+    std::optional<package::Reference> baseRef;
+    if (deltaFrom.endsWith(".layer") && QFileInfo::exists(deltaFrom)) {
+        auto layerFile = package::LayerFile::New(deltaFrom);
+        if (!layerFile) {
+            return LINGLONG_ERR(layerFile);
+        }
+
+        auto layerInfo = (*layerFile)->metaInfo();
+        if (!layerInfo) {
+            return LINGLONG_ERR(layerInfo);
+        }
+
+        if (layerInfo->delta) {
+            return LINGLONG_ERR(deltaFrom + " is a delta layer");
+        }
+
+        auto info = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(layerInfo->info);
+        if (!info) {
+            return LINGLONG_ERR(info);
+        }
+
+        auto layerRef = package::Reference::fromPackageInfo(*info);
+        if (!layerRef) {
+            return LINGLONG_ERR(layerRef);
+        }
+        baseRef = *layerRef;
+
+        // NOTE: The delta is computed against the files in the repository,
+        // which are those of the layer file unless the same version has been
+        // built again. Installing the delta checks the files anyway.
+        if (!this->repo.getLayerDir(*baseRef, info->packageInfoModule == "develop")) {
+            auto result = this->importLayer(deltaFrom);
+            if (!result) {
+                return LINGLONG_ERR(result);
+            }
+        }
+    } else {
+        auto fuzzyRef = package::FuzzyReference::parse(deltaFrom);
+        if (!fuzzyRef) {
+            return LINGLONG_ERR(fuzzyRef);
+        }
+
+        auto localRef =
+          this->repo.clearReference(*fuzzyRef,
+                                    { .forceRemote = false, .fallbackToRemote = false });
+        if (!localRef) {
+            return LINGLONG_ERR(localRef);
+        }
+        baseRef = *localRef;
+    }
+
+    if (baseRef->id != ref.id || baseRef->arch != ref.arch) {
+        return LINGLONG_ERR(baseRef->toString() + " is not another version of " + ref.toString());
+    }
+
+    if (baseRef->version == ref.version) {
+        return LINGLONG_ERR(baseRef->toString() + " is the version to export");
+    }
+
+    return *baseRef;
+}
+
 utils::error::Result<void> Builder::run(const QStringList &args)
 {
     LINGLONG_TRACE("run application");
@@ -898,10 +1032,76 @@ utils::error::Result<void> Builder::run(const QStringList &args)
         return LINGLONG_ERR(info);
     }
 
+    // NOTE: The project is run as linglong.yaml describes it now, which may
+    // have changed since the layer was built.
+    info->base = this->project.base;
+    info->runtime = this->project.runtime;
+    info->kind = this->project.package.kind;
+    info->command = this->project.command;
+
+    auto result = this->runLayer(*curRef, *curDir, *info, args);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> Builder::runLayerFile(const QString &path, const QStringList &args)
+{
+    LINGLONG_TRACE("run " + path);
+
+    auto layerFile = package::LayerFile::New(path);
+    if (!layerFile) {
+        return LINGLONG_ERR(layerFile);
+    }
+
+    auto layerInfo = (*layerFile)->metaInfo();
+    if (!layerInfo) {
+        return LINGLONG_ERR(layerInfo);
+    }
+
+    if (layerInfo->delta) {
+        return LINGLONG_ERR(path + " is a delta layer, import it on top of "
+                            + QString::fromStdString(layerInfo->delta->base));
+    }
+
+    auto info = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(layerInfo->info);
+    if (!info) {
+        return LINGLONG_ERR(info);
+    }
+
+    auto ref = package::Reference::fromPackageInfo(*info);
+    if (!ref) {
+        return LINGLONG_ERR(ref);
+    }
+
+    // NOTE: The layer is mounted until pkg is destroyed.
+    package::LayerPackager pkg;
+    auto layerDir = pkg.unpack(*(*layerFile));
+    if (!layerDir) {
+        return LINGLONG_ERR(layerDir);
+    }
+
+    auto result = this->runLayer(*ref, *layerDir, *info, args);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> Builder::runLayer(const package::Reference &curRef,
+                                             const package::LayerDir &curDir,
+                                             const api::types::v1::PackageInfo &info,
+                                             const QStringList &args)
+{
+    LINGLONG_TRACE("run " + curRef.toString());
+
     auto options = runtime::ContainerOptions{
-        .appID = curRef->id,
+        .appID = curRef.id,
         .containerID =
-          (curRef->toString() + "-" + QUuid::createUuid().toString()).toUtf8().toBase64(),
+          (curRef.toString() + "-" + QUuid::createUuid().toString()).toUtf8().toBase64(),
         .runtimeDir = {},
         .baseDir = {},
         .appDir = {},
@@ -909,7 +1109,7 @@ utils::error::Result<void> Builder::run(const QStringList &args)
         .mounts = {},
     };
 
-    auto baseRef = pullDependency(QString::fromStdString(this->project.base),
+    auto baseRef = pullDependency(QString::fromStdString(info.base),
                                   this->repo,
                                   false,
                                   cfg.skipPullDepend.has_value() && *cfg.skipPullDepend);
@@ -922,8 +1122,8 @@ utils::error::Result<void> Builder::run(const QStringList &args)
     }
     options.baseDir = QDir(baseDir->absolutePath());
 
-    if (this->project.runtime) {
-        auto ref = pullDependency(QString::fromStdString(*this->project.runtime),
+    if (info.runtime) {
+        auto ref = pullDependency(QString::fromStdString(*info.runtime),
                                   this->repo,
                                   false,
                                   cfg.skipPullDepend.has_value() && *cfg.skipPullDepend);
@@ -937,16 +1137,16 @@ utils::error::Result<void> Builder::run(const QStringList &args)
         options.runtimeDir = QDir(dir->absolutePath());
     }
 
-    if (this->project.package.kind == "runtime") {
-        options.runtimeDir = QDir(curDir->absolutePath());
+    if (info.kind == "runtime") {
+        options.runtimeDir = QDir(curDir.absolutePath());
     }
 
-    if (this->project.package.kind == "base") {
-        options.baseDir = QDir(curDir->absolutePath());
+    if (info.kind == "base") {
+        options.baseDir = QDir(curDir.absolutePath());
     }
 
-    if (this->project.package.kind == "app") {
-        options.appDir = QDir(curDir->absolutePath());
+    if (info.kind == "app") {
+        options.appDir = QDir(curDir.absolutePath());
     }
 
     std::vector<ocppi::runtime::config::types::Mount> applicationMounts{};
@@ -970,8 +1170,8 @@ utils::error::Result<void> Builder::run(const QStringList &args)
           });
       };
 
-    if (info->permissions) {
-        auto &perm = info->permissions;
+    if (info.permissions) {
+        const auto &perm = info.permissions;
         if (perm->binds) {
             const auto &binds = perm->binds;
             std::for_each(binds->cbegin(), binds->cend(), bindMount);
@@ -980,7 +1180,7 @@ utils::error::Result<void> Builder::run(const QStringList &args)
         if (perm->innerBinds) {
             const auto &innerBinds = perm->innerBinds;
             const auto &hostSourceDir =
-              std::filesystem::path{ curDir->absolutePath().toStdString() };
+              std::filesystem::path{ curDir.absolutePath().toStdString() };
             std::for_each(innerBinds->cbegin(), innerBinds->cend(), bindInnerMount);
         }
     }
@@ -1000,7 +1200,7 @@ utils::error::Result<void> Builder::run(const QStringList &args)
             p.args->push_back(arg.toStdString());
         }
     } else {
-        p.args = this->project.command;
+        p.args = info.command;
         if (!p.args) {
             p.args = std::vector<std::string>{ "bash" };
         }
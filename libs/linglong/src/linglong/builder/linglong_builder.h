@@ -9,6 +9,7 @@
 
 #include "linglong/api/types/v1/BuilderConfig.hpp"
 #include "linglong/api/types/v1/BuilderProject.hpp"
+#include "linglong/package/layer_packager.h"
 #include "linglong/repo/ostree_repo.h"
 #include "linglong/runtime/container_builder.h"
 #include "linglong/utils/error/error.h"
@@ -31,13 +32,20 @@ public:
     auto build(const QStringList &args = { "/project/linglong/entry.sh" }) noexcept
       -> utils::error::Result<void>;
 
-    auto exportLayer(const QString &destination) -> utils::error::Result<void>;
+    // compression is one of package::compressionProfiles. If deltaFrom, a
+    // layer file or a reference of another version, is given, the layers only
+    // contain the files changed since that version.
+    auto exportLayer(const QString &destination,
+                     const QString &compression = package::defaultCompressionProfile,
+                     const QString &deltaFrom = "") -> utils::error::Result<void>;
 
     auto extractLayer(const QString &layerPath, const QString &destination)
       -> utils::error::Result<void>;
 
-    auto push(bool pushWithDevel = true, const QString &repoUrl = "", const QString &repoName = "")
-      -> utils::error::Result<void>;
+    auto push(bool pushWithDevel = true,
+              const QString &repoUrl = "",
+              const QString &repoName = "",
+              bool pushObjects = false) -> utils::error::Result<void>;
 
     auto import() -> utils::error::Result<void>;
 
@@ -45,11 +53,25 @@ public:
 
     auto run(const QStringList &args = { QString("bash") }) -> utils::error::Result<void>;
 
+    // Run the layer file without importing it, its base and runtime are
+    // resolved as run() does.
+    auto runLayerFile(const QString &path, const QStringList &args = {})
+      -> utils::error::Result<void>;
+
     auto appimageConvert(const QStringList &templateArgs) -> utils::error::Result<void>;
 
 private:
     auto splitDevelop(QDir developOutput, QDir runtimeOutput, QString prefix)
       -> utils::error::Result<void>;
+    // Returns the reference of the version deltaFrom refers to, a layer file
+    // of it is imported into the repository.
+    auto deltaBase(const QString &deltaFrom, const package::Reference &ref)
+      -> utils::error::Result<package::Reference>;
+    // Run the layer in curDir with the base, runtime, kind and command of info.
+    auto runLayer(const package::Reference &curRef,
+                  const package::LayerDir &curDir,
+                  const api::types::v1::PackageInfo &info,
+                  const QStringList &args) -> utils::error::Result<void>;
 
     repo::OSTreeRepo &repo;
     QDir workingDir;
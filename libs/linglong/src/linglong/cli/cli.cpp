@@ -10,6 +10,7 @@
 #include "linglong/api/types/v1/PackageManager1Package.hpp"
 #include "linglong/api/types/v1/PackageManager1ResultWithTaskID.hpp"
 #include "linglong/package/layer_file.h"
+#include "linglong/package/layer_packager.h"
 #include "linglong/runtime/container_builder.h"
 #include "linglong/utils/command/env.h"
 #include "linglong/utils/configure.h"
@@ -42,16 +43,19 @@ Usage:
     ll-cli [--json] kill PAGODA
     ll-cli [--json] [--no-dbus] install TIER
     ll-cli [--json] uninstall TIER [--all] [--prune]
-    ll-cli [--json] upgrade TIER
+    ll-cli [--json] upgrade (--all | TIER)
     ll-cli [--json] search [--type=TYPE] [--dev] TEXT
     ll-cli [--json] [--no-dbus] list [--type=TYPE]
     ll-cli [--json] repo modify [--name=REPO] URL
     ll-cli [--json] repo show
     ll-cli [--json] info TIER
     ll-cli [--json] content APP
+    ll-cli [--json] prune
+    ll-cli [--json] verify
+    ll-cli [--json] repair
 
 Arguments:
-    APP     Specify the application.
+    APP     Specify the application, or the path of a layer file to run without installing it.
     PAGODA  Specify the pagodas (container).
     TIER    Specify the tier (container layer).
     URL     Specify the new repo URL.
@@ -70,6 +74,7 @@ Options:
     --type=TYPE               Filter result with tiers type. One of "runtime", "app" or "all". [default: app]
     --state=STATE             Filter result with the tiers install state. Should be "local" or "remote". [default: local]
     --prune                   Remove application data if the tier is an application and all version of that application has been removed.
+    --all                     With upgrade, upgrade all installed applications together.
     --dev                     include develop tiers in result.
 
 Subcommands:
@@ -86,6 +91,9 @@ Subcommands:
     repo       Display or modify information of the repository currently using.
     info       Display the information of layer
     content    Display the exported files of application
+    prune      Remove the runtimes and bases not used by any application.
+    verify     Check the integrity of the repository and the installed tiers.
+    repair     Check the integrity and repair the broken tiers.
 )";
 
 void Cli::processDownloadStatus(const QString &recTaskID,
@@ -123,6 +131,15 @@ void Cli::processDownloadStatus(const QString &recTaskID,
     }
 }
 
+void Cli::processTaskResult(const QString &recTaskID, const QVariantMap &result)
+{
+    if (recTaskID != this->taskID) {
+        return;
+    }
+
+    this->taskResult = result;
+}
+
 Cli::Cli(Printer &printer,
          ocppi::cli::CLI &ociCLI,
          runtime::ContainerBuilder &containerBuilder,
@@ -145,26 +162,45 @@ int Cli::run(std::map<std::string, docopt::value> &args)
     const auto userInputAPP = QString::fromStdString(args["APP"].asString());
     Q_ASSERT(!userInputAPP.isEmpty());
 
-    auto fuzzyRef = package::FuzzyReference::parse(userInputAPP);
-    if (!fuzzyRef) {
-        this->printer.printErr(fuzzyRef.error());
-        return -1;
-    }
+    // NOTE: A layer file is mounted and run without installing it, it is
+    // unmounted by layerPackager after the application exits.
+    std::unique_ptr<package::LayerPackager> layerPackager;
+    std::optional<package::Reference> ref;
+    std::optional<package::LayerDir> layerDir;
+
+    const QFileInfo layerFileInfo(userInputAPP);
+    if (layerFileInfo.isFile() && layerFileInfo.suffix() == "layer") {
+        auto layerRef = this->mountLayerFile(layerFileInfo.absoluteFilePath(), layerPackager);
+        if (!layerRef) {
+            this->printer.printErr(layerRef.error());
+            return -1;
+        }
+        ref = layerRef->first;
+        layerDir = layerRef->second;
+    } else {
+        auto fuzzyRef = package::FuzzyReference::parse(userInputAPP);
+        if (!fuzzyRef) {
+            this->printer.printErr(fuzzyRef.error());
+            return -1;
+        }
 
-    auto ref = this->repository.clearReference(*fuzzyRef,
-                                               {
-                                                 .forceRemote = false,
-                                                 .fallbackToRemote = false,
-                                               });
-    if (!ref) {
-        this->printer.printErr(ref.error());
-        return -1;
-    }
+        auto localRef = this->repository.clearReference(*fuzzyRef,
+                                                        {
+                                                          .forceRemote = false,
+                                                          .fallbackToRemote = false,
+                                                        });
+        if (!localRef) {
+            this->printer.printErr(localRef.error());
+            return -1;
+        }
 
-    auto layerDir = this->repository.getLayerDir(*ref, false);
-    if (!layerDir) {
-        this->printer.printErr(layerDir.error());
-        return -1;
+        auto localLayerDir = this->repository.getLayerDir(*localRef, false);
+        if (!localLayerDir) {
+            this->printer.printErr(localLayerDir.error());
+            return -1;
+        }
+        ref = *localRef;
+        layerDir = *localLayerDir;
     }
 
     auto info = layerDir->info();
@@ -318,6 +354,49 @@ int Cli::run(std::map<std::string, docopt::value> &args)
     return 0;
 }
 
+utils::error::Result<std::pair<package::Reference, package::LayerDir>>
+Cli::mountLayerFile(const QString &path, std::unique_ptr<package::LayerPackager> &layerPackager)
+{
+    LINGLONG_TRACE("mount " + path);
+
+    auto layerFile = package::LayerFile::New(path);
+    if (!layerFile) {
+        return LINGLONG_ERR(layerFile);
+    }
+
+    auto layerInfo = (*layerFile)->metaInfo();
+    if (!layerInfo) {
+        return LINGLONG_ERR(layerInfo);
+    }
+
+    if (layerInfo->delta) {
+        return LINGLONG_ERR(path + " is a delta layer, install it on top of "
+                            + QString::fromStdString(layerInfo->delta->base));
+    }
+
+    auto info = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(layerInfo->info);
+    if (!info) {
+        return LINGLONG_ERR(info);
+    }
+
+    if (info->kind != "app") {
+        return LINGLONG_ERR(QString::fromStdString(info->appid) + " is not an application");
+    }
+
+    auto ref = package::Reference::fromPackageInfo(*info);
+    if (!ref) {
+        return LINGLONG_ERR(ref);
+    }
+
+    layerPackager = std::make_unique<package::LayerPackager>();
+    auto layerDir = layerPackager->unpack(**layerFile);
+    if (!layerDir) {
+        return LINGLONG_ERR(layerDir);
+    }
+
+    return std::make_pair(*ref, *layerDir);
+}
+
 int Cli::exec(std::map<std::string, docopt::value> &args)
 {
     LINGLONG_TRACE("ll-cli exec");
@@ -553,21 +632,25 @@ int Cli::upgrade(std::map<std::string, docopt::value> &args)
 {
     LINGLONG_TRACE("command upgrade");
 
-    auto tier = args["TIER"].asString();
-
-    auto fuzzyRef = package::FuzzyReference::parse(QString::fromStdString(tier));
-    if (!fuzzyRef) {
-        this->printer.printErr(fuzzyRef.error());
-        return -1;
-    }
+    const auto upgradeAll = args["--all"].isBool() && args["--all"].asBool();
 
     api::types::v1::PackageManager1InstallParameters params;
-    params.package.id = fuzzyRef->id.toStdString();
-    if (fuzzyRef->channel) {
-        params.package.channel = fuzzyRef->channel->toStdString();
-    }
-    if (fuzzyRef->version) {
-        params.package.version = fuzzyRef->version->toString().toStdString();
+    if (!upgradeAll) {
+        auto tier = args["TIER"].asString();
+
+        auto fuzzyRef = package::FuzzyReference::parse(QString::fromStdString(tier));
+        if (!fuzzyRef) {
+            this->printer.printErr(fuzzyRef.error());
+            return -1;
+        }
+
+        params.package.id = fuzzyRef->id.toStdString();
+        if (fuzzyRef->channel) {
+            params.package.channel = fuzzyRef->channel->toStdString();
+        }
+        if (fuzzyRef->version) {
+            params.package.version = fuzzyRef->version->toString().toStdString();
+        }
     }
 
     auto conn = this->pkgMan.connection();
@@ -583,7 +666,8 @@ int Cli::upgrade(std::map<std::string, docopt::value> &args)
         return -1;
     }
 
-    auto reply = this->pkgMan.Update(utils::serialize::toQVariantMap(params)).value();
+    auto reply = upgradeAll ? this->pkgMan.UpgradeAll().value()
+                            : this->pkgMan.Update(utils::serialize::toQVariantMap(params)).value();
     auto result =
       utils::serialize::fromQVariantMap<api::types::v1::PackageManager1ResultWithTaskID>(reply);
     if (!result) {
@@ -597,6 +681,12 @@ int Cli::upgrade(std::map<std::string, docopt::value> &args)
         return -1;
     }
 
+    // NOTE: No task is started if all applications are up to date.
+    if (!result->taskID) {
+        this->printer.printReply({ .code = result->code, .message = result->message });
+        return 0;
+    }
+
     this->taskID = QString::fromStdString(*result->taskID);
     this->taskDone = false;
     QEventLoop loop;
@@ -746,6 +836,130 @@ int Cli::uninstall(std::map<std::string, docopt::value> &args)
     return 0;
 }
 
+int Cli::prune(std::map<std::string, docopt::value> & /*args*/)
+{
+    LINGLONG_TRACE("command prune");
+
+    auto taskResult = this->waitTaskResult("PruneFinished", [this]() {
+        return this->pkgMan.Prune();
+    });
+    if (!taskResult) {
+        this->printer.printErr(taskResult.error());
+        return -1;
+    }
+    auto result =
+      utils::serialize::fromQVariantMap<api::types::v1::PackageManager1PruneResult>(*taskResult);
+    if (!result) {
+        this->printer.printErr(result.error());
+        return -1;
+    }
+    if (result->code != 0) {
+        this->printer.printErr(
+          LINGLONG_ERRV(QString::fromStdString(result->message), result->code));
+        return -1;
+    }
+
+    this->printer.printPruneResult(*result);
+    return 0;
+}
+
+utils::error::Result<QVariantMap>
+Cli::waitTaskResult(const QString &signal,
+                    const std::function<QDBusPendingReply<QVariantMap>()> &start)
+{
+    LINGLONG_TRACE("wait for " + signal);
+
+    // NOTE: Connect before the task starts, the result may be sent right
+    // after the reply.
+    auto conn = this->pkgMan.connection();
+    auto con = conn.connect(this->pkgMan.service(),
+                            this->pkgMan.path(),
+                            this->pkgMan.interface(),
+                            signal,
+                            this,
+                            SLOT(processTaskResult(const QString &, const QVariantMap &)));
+    if (!con) {
+        return LINGLONG_ERR("Failed to connect signal: " + signal);
+    }
+
+    this->taskResult.clear();
+    auto reply = start();
+    reply.waitForFinished();
+    if (!reply.isValid()) {
+        return LINGLONG_ERR(reply.error().message(), reply.error().type());
+    }
+    auto task = utils::serialize::fromQVariantMap<api::types::v1::PackageManager1ResultWithTaskID>(
+      reply.value());
+    if (!task) {
+        return LINGLONG_ERR(task);
+    }
+    if (task->code != 0 || !task->taskID) {
+        return LINGLONG_ERR(QString::fromStdString(task->message), task->code);
+    }
+
+    // NOTE: Tasks like checking every object of a large repository take a
+    // while, the result is sent once the package manager finishes.
+    this->taskID = QString::fromStdString(*task->taskID);
+    QEventLoop loop;
+    std::function<void()> resultChecker = std::function{ [&loop, &resultChecker, this]() -> void {
+        if (!this->taskResult.isEmpty()) {
+            loop.exit(0);
+        }
+        QMetaObject::invokeMethod(&loop, resultChecker, Qt::QueuedConnection);
+    } };
+
+    QMetaObject::invokeMethod(&loop, resultChecker, Qt::QueuedConnection);
+    loop.exec();
+
+    return this->taskResult;
+}
+
+int Cli::verify(std::map<std::string, docopt::value> & /*args*/)
+{
+    return this->verifyRepository(false);
+}
+
+int Cli::repair(std::map<std::string, docopt::value> & /*args*/)
+{
+    return this->verifyRepository(true);
+}
+
+int Cli::verifyRepository(bool repair)
+{
+    LINGLONG_TRACE(repair ? "command repair" : "command verify");
+
+    auto params = api::types::v1::PackageManager1VerifyParameters{ .repair = repair };
+    auto taskResult = this->waitTaskResult("VerifyFinished", [this, &params]() {
+        return this->pkgMan.Verify(utils::serialize::toQVariantMap(params));
+    });
+    if (!taskResult) {
+        this->printer.printErr(taskResult.error());
+        return -1;
+    }
+
+    auto result =
+      utils::serialize::fromQVariantMap<api::types::v1::PackageManager1VerifyResult>(*taskResult);
+    if (!result) {
+        this->printer.printErr(result.error());
+        return -1;
+    }
+    if (result->code != 0) {
+        this->printer.printErr(
+          LINGLONG_ERRV(QString::fromStdString(result->message), result->code));
+        return -1;
+    }
+
+    this->printer.printVerifyResult(*result);
+
+    const auto empty = std::vector<std::string>{};
+    const auto broken = result->brokenLayers.value_or(empty).size();
+    if (!repair) {
+        return broken == 0 && result->corruptedObjects.value_or(empty).empty() ? 0 : -1;
+    }
+
+    return broken == result->repairedLayers.value_or(empty).size() ? 0 : -1;
+}
+
 int Cli::list(std::map<std::string, docopt::value> &args)
 {
     QString type;
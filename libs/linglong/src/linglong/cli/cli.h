@@ -9,6 +9,7 @@
 
 #include "linglong/api/dbus/v1/package_manager.h"
 #include "linglong/cli/printer.h"
+#include "linglong/package/layer_packager.h"
 #include "linglong/package_manager/package_manager.h"
 #include "linglong/runtime/container_builder.h"
 #include "linglong/utils/error/error.h"
@@ -25,6 +26,8 @@
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <utility>
 
 namespace linglong::cli {
 
@@ -55,10 +58,20 @@ private:
     QString taskID;
     bool taskDone{ true };
     service::InstallTask::Status lastStatus;
+    QVariantMap taskResult;
     void filePathMapping(std::map<std::string, docopt::value> &args,
                          const std::vector<std::string> &command,
                          std::vector<std::string> &execArgs) const noexcept;
     void filterPackageInfosFromType(std::vector<api::types::v1::PackageInfo> &list, const QString &type);
+    int verifyRepository(bool repair);
+    // Start a task of the package manager which sends its result by signal,
+    // and wait for the result.
+    utils::error::Result<QVariantMap>
+    waitTaskResult(const QString &signal,
+                   const std::function<QDBusPendingReply<QVariantMap>()> &start);
+    // Mount the application in the layer file by a new layerPackager.
+    utils::error::Result<std::pair<package::Reference, package::LayerDir>>
+    mountLayerFile(const QString &path, std::unique_ptr<package::LayerPackager> &layerPackager);
 
 public:
     int run(std::map<std::string, docopt::value> &args);
@@ -74,6 +87,9 @@ public:
     int repo(std::map<std::string, docopt::value> &args);
     int info(std::map<std::string, docopt::value> &args);
     int content(std::map<std::string, docopt::value> &args);
+    int prune(std::map<std::string, docopt::value> &args);
+    int verify(std::map<std::string, docopt::value> &args);
+    int repair(std::map<std::string, docopt::value> &args);
 
     void cancelCurrentTask();
 
@@ -82,6 +98,7 @@ private Q_SLOTS:
                                const QString &percentage,
                                const QString &message,
                                int status);
+    void processTaskResult(const QString &recTaskID, const QVariantMap &result);
 };
 
 } // namespace linglong::cli
@@ -62,6 +62,16 @@ void JSONPrinter::printContent(const QStringList &filePaths)
     std::cout << QString::fromUtf8(QJsonDocument(obj).toJson()).toStdString() << std::endl;
 }
 
+void JSONPrinter::printPruneResult(const api::types::v1::PackageManager1PruneResult &result)
+{
+    std::cout << nlohmann::json(result).dump() << std::endl;
+}
+
+void JSONPrinter::printVerifyResult(const api::types::v1::PackageManager1VerifyResult &result)
+{
+    std::cout << nlohmann::json(result).dump() << std::endl;
+}
+
 void JSONPrinter::printTaskStatus(const QString &percentage, const QString &message, int status)
 {
     QJsonArray jsonArray;
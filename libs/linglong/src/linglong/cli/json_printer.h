@@ -23,6 +23,8 @@ public:
     void printLayerInfo(const api::types::v1::LayerInfo &) override;
     void printTaskStatus(const QString &percentage, const QString &message, int status) override;
     void printContent(const QStringList &desktopPaths) override;
+    void printPruneResult(const api::types::v1::PackageManager1PruneResult &) override;
+    void printVerifyResult(const api::types::v1::PackageManager1VerifyResult &) override;
 };
 
 } // namespace linglong::cli
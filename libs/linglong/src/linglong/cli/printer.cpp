@@ -76,6 +76,37 @@ void Printer::printContent(const QStringList &filePaths)
     }
 }
 
+void Printer::printPruneResult(const api::types::v1::PackageManager1PruneResult &result)
+{
+    const auto &packages = result.packages.value_or(std::vector<api::types::v1::PackageInfo>{});
+    if (!packages.empty()) {
+        this->printPackages(packages);
+    }
+
+    std::cout << packages.size() << " tiers removed, " << result.reclaimedBytes.value_or(0)
+              << " bytes reclaimed." << std::endl;
+}
+
+void Printer::printVerifyResult(const api::types::v1::PackageManager1VerifyResult &result)
+{
+    const auto empty = std::vector<std::string>{};
+    for (const auto &object : result.corruptedObjects.value_or(empty)) {
+        std::cout << "corrupted object: " << object << std::endl;
+    }
+    for (const auto &layer : result.brokenLayers.value_or(empty)) {
+        std::cout << "broken tier: " << layer << std::endl;
+    }
+    for (const auto &layer : result.repairedLayers.value_or(empty)) {
+        std::cout << "repaired tier: " << layer << std::endl;
+    }
+
+    std::cout << result.objects.value_or(0) << " objects and " << result.layers.value_or(0)
+              << " tiers verified, " << result.corruptedObjects.value_or(empty).size()
+              << " objects corrupted, " << result.brokenLayers.value_or(empty).size()
+              << " tiers broken, " << result.repairedLayers.value_or(empty).size()
+              << " tiers repaired." << std::endl;
+}
+
 void Printer::printTaskStatus(const QString &percentage, const QString &message, int /*status*/)
 {
     std::cout << "\r\33[K"
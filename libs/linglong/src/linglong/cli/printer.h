@@ -13,6 +13,8 @@
 #include "linglong/api/types/v1/PackageInfo.hpp"
 #include "linglong/api/types/v1/PackageManager1GetRepoInfoResultRepoInfo.hpp"
 #include "linglong/api/types/v1/PackageManager1Package.hpp"
+#include "linglong/api/types/v1/PackageManager1PruneResult.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyResult.hpp"
 #include "linglong/api/types/v1/RepoConfig.hpp"
 #include "linglong/utils/error/error.h"
 
@@ -43,6 +45,8 @@ public:
     virtual void printLayerInfo(const api::types::v1::LayerInfo &);
     virtual void printTaskStatus(const QString &percentage, const QString &message, int status);
     virtual void printContent(const QStringList &filePaths);
+    virtual void printPruneResult(const api::types::v1::PackageManager1PruneResult &);
+    virtual void printVerifyResult(const api::types::v1::PackageManager1VerifyResult &);
 
 private:
     void printPackageInfo(const api::types::v1::PackageInfo &);
@@ -10,6 +10,7 @@
 #include "linglong/utils/error/error.h"
 #include "nlohmann/json.hpp"
 
+#include <QHash>
 #include <QString>
 
 namespace linglong::package {
@@ -34,6 +35,11 @@ public:
 
     bool operator!=(const Architecture &that) const noexcept { return this->v != that.v; }
 
+    friend uint qHash(const Architecture &arch, uint seed = 0) noexcept
+    {
+        return ::qHash(static_cast<quint32>(arch.v), seed);
+    }
+
     static utils::error::Result<Architecture> parse(const QString &raw) noexcept;
 
 private:
@@ -0,0 +1,655 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/package/erofs_reader.h"
+
+#include <lz4.h>
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+namespace linglong::package {
+
+namespace {
+
+// The on-disk format, see include/erofs_fs.h of erofs-utils.
+
+constexpr quint64 superblockOffset = 1024;
+constexpr quint64 superblockSize = 128;
+constexpr quint32 superblockMagic = 0xE0F5E1E2;
+
+constexpr quint32 featureZeroPadding = 0x1;
+constexpr quint32 featureBigPcluster = 0x2;
+constexpr quint32 featureXattrPrefixes = 0x40;
+constexpr quint32 supportedFeatures =
+  featureZeroPadding | featureBigPcluster | featureXattrPrefixes;
+
+constexpr quint64 inodeSlotSize = 32;
+constexpr quint64 compactInodeSize = 32;
+constexpr quint64 extendedInodeSize = 64;
+
+constexpr quint8 layoutFlatPlain = 0;
+constexpr quint8 layoutCompressedFull = 1;
+constexpr quint8 layoutFlatInline = 2;
+constexpr quint8 layoutCompressedCompact = 3;
+
+constexpr quint64 mapHeaderSize = 8;
+constexpr quint64 fullIndexSize = 8;
+constexpr quint16 adviseCompacted2B = 0x1;
+constexpr quint16 adviseBigPcluster1 = 0x2;
+constexpr quint16 adviseBigPcluster2 = 0x4;
+constexpr quint16 adviseInlinePcluster = 0x8;
+constexpr quint16 adviseInterlacedPcluster = 0x10;
+constexpr quint16 adviseFragmentPcluster = 0x20;
+constexpr quint8 clusterbitsFragmentInode = 0x80;
+
+constexpr quint8 lclusterPlain = 0;
+constexpr quint8 lclusterHead1 = 1;
+constexpr quint8 lclusterNonHead = 2;
+constexpr quint32 lclusterD0CompressedBlocks = 1U << 11;
+
+constexpr quint8 algorithmLZ4 = 0;
+
+constexpr quint64 direntSize = 12;
+
+struct Lcluster
+{
+    quint8 type = lclusterPlain;
+    quint32 clusterofs = 0;
+    quint32 pblk = 0;
+    // Blocks of the big pcluster of the previous head lcluster, 0 if unknown.
+    quint32 compressedBlocks = 0;
+};
+
+quint16 le16(const uchar *p) noexcept
+{
+    return qFromLittleEndian<quint16>(p);
+}
+
+quint32 le32(const uchar *p) noexcept
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+quint64 le64(const uchar *p) noexcept
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+} // namespace
+
+struct ErofsReader::Extent
+{
+    quint64 start = 0;
+    quint64 length = 0;
+    quint32 pblk = 0;
+    quint32 blocks = 1;
+    bool plain = false;
+    bool interlaced = false;
+    quint8 algorithm = algorithmLZ4;
+};
+
+ErofsReader::ErofsReader(const QString &path, qint64 offset)
+    : file(path)
+{
+    if (!this->file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error(this->file.errorString().toStdString());
+    }
+
+    if (offset < 0 || offset >= this->file.size()) {
+        throw std::runtime_error("no EROFS image in the file");
+    }
+
+    this->size = this->file.size() - offset;
+    this->data = this->file.map(offset, static_cast<qint64>(this->size));
+    if (this->data == nullptr) {
+        throw std::runtime_error(this->file.errorString().toStdString());
+    }
+}
+
+ErofsReader::~ErofsReader()
+{
+    if (this->data != nullptr) {
+        this->file.unmap(this->data);
+    }
+}
+
+utils::error::Result<QSharedPointer<ErofsReader>> ErofsReader::New(const QString &path,
+                                                                   qint64 offset) noexcept
+{
+    LINGLONG_TRACE(QString("open EROFS image in %1").arg(path));
+
+    QSharedPointer<ErofsReader> reader;
+    try {
+        reader.reset(new ErofsReader(path, offset));
+    } catch (const std::exception &e) {
+        return LINGLONG_ERR(e);
+    }
+
+    const auto *sb = reader->at(superblockOffset, superblockSize);
+    if (sb == nullptr || le32(sb) != superblockMagic) {
+        return LINGLONG_ERR("invalid EROFS superblock");
+    }
+
+    reader->blkszbits = sb[12];
+    reader->rootNid = le16(sb + 14);
+    reader->metaBlkaddr = le32(sb + 40);
+    reader->featureIncompat = le32(sb + 80);
+    const auto dirblkbits = sb[90];
+
+    if (reader->blkszbits < 9 || reader->blkszbits > 16 || dirblkbits != 0) {
+        return LINGLONG_ERR(QString("unsupported block size %1").arg(1U << reader->blkszbits),
+                            ENOTSUP);
+    }
+
+    const auto unsupported = reader->featureIncompat & ~supportedFeatures;
+    if (unsupported != 0) {
+        return LINGLONG_ERR(QString("unsupported features 0x%1").arg(unsupported, 0, 16),
+                            ENOTSUP);
+    }
+
+    return reader;
+}
+
+const uchar *ErofsReader::at(quint64 offset, quint64 length) const noexcept
+{
+    if (offset > this->size || length > this->size - offset) {
+        return nullptr;
+    }
+
+    return this->data + offset;
+}
+
+utils::error::Result<ErofsReader::Inode> ErofsReader::root() const noexcept
+{
+    return this->inode(this->rootNid);
+}
+
+utils::error::Result<ErofsReader::Inode> ErofsReader::inode(quint64 nid) const noexcept
+{
+    LINGLONG_TRACE(QString("read inode %1").arg(nid));
+
+    const auto offset = (quint64(this->metaBlkaddr) << this->blkszbits) + nid * inodeSlotSize;
+    const auto *raw = this->at(offset, compactInodeSize);
+    if (raw == nullptr) {
+        return LINGLONG_ERR("inode out of the image");
+    }
+
+    const auto format = le16(raw);
+    const auto extended = (format & 0x1) != 0;
+    if (extended && this->at(offset, extendedInodeSize) == nullptr) {
+        return LINGLONG_ERR("inode out of the image");
+    }
+
+    Inode inode;
+    inode.nid = nid;
+    inode.layout = (format >> 1) & 0x7;
+    inode.mode = le16(raw + 4);
+    inode.size = extended ? le64(raw + 8) : le32(raw + 8);
+    inode.blkaddr = le32(raw + 16);
+
+    const auto xattrCount = le16(raw + 2);
+    const quint64 xattrSize = xattrCount == 0 ? 0 : 12 + (xattrCount - 1) * 4;
+    inode.tailOffset = offset + (extended ? extendedInodeSize : compactInodeSize) + xattrSize;
+
+    return inode;
+}
+
+utils::error::Result<std::vector<ErofsReader::DirEntry>>
+ErofsReader::readDir(const Inode &dir) const noexcept
+{
+    LINGLONG_TRACE(QString("read directory %1").arg(dir.nid));
+
+    if (!S_ISDIR(dir.mode)) {
+        return LINGLONG_ERR("not a directory");
+    }
+    // NOTE: mkfs.erofs never compresses directories, a directory larger than
+    // the image is corrupted.
+    if (dir.size > this->size) {
+        return LINGLONG_ERR("corrupted directory");
+    }
+
+    auto content = this->read(dir);
+    if (!content) {
+        return LINGLONG_ERR(content);
+    }
+
+    // Every block starts with the dirents, followed by the names they point
+    // to. Names are not terminated, except the last one of a block is padded
+    // with zeros.
+    const auto *raw = reinterpret_cast<const uchar *>(content->constData());
+    const quint64 contentSize = content->size();
+    const quint64 blockSize = 1ULL << this->blkszbits;
+    std::vector<DirEntry> entries;
+    for (quint64 offset = 0; offset < contentSize; offset += blockSize) {
+        const auto *block = raw + offset;
+        const auto size = std::min(blockSize, contentSize - offset);
+        if (size < direntSize) {
+            return LINGLONG_ERR("corrupted directory");
+        }
+
+        const quint64 namesOffset = le16(block + 8);
+        if (namesOffset < direntSize || namesOffset % direntSize != 0 || namesOffset > size) {
+            return LINGLONG_ERR("corrupted directory");
+        }
+
+        const auto count = namesOffset / direntSize;
+        for (quint64 i = 0; i < count; ++i) {
+            const auto *dirent = block + i * direntSize;
+            const quint64 nameOffset = le16(dirent + 8);
+            const quint64 nameEnd = i + 1 < count ? le16(dirent + direntSize + 8) : size;
+            if (nameOffset > nameEnd || nameEnd > size) {
+                return LINGLONG_ERR("corrupted directory");
+            }
+
+            const auto *name = reinterpret_cast<const char *>(block + nameOffset);
+            auto length = nameEnd - nameOffset;
+            if (i + 1 == count) {
+                length = ::strnlen(name, length);
+            }
+            if (length == 0) {
+                return LINGLONG_ERR("corrupted directory");
+            }
+
+            QByteArray entryName(name, static_cast<int>(length));
+            if (entryName == "." || entryName == "..") {
+                continue;
+            }
+            if (entryName.contains('/')) {
+                return LINGLONG_ERR("corrupted directory");
+            }
+            entries.push_back({ std::move(entryName), le64(dirent) });
+        }
+    }
+
+    return entries;
+}
+
+utils::error::Result<QByteArray> ErofsReader::read(const Inode &inode) const noexcept
+{
+    LINGLONG_TRACE(QString("read data of inode %1").arg(inode.nid));
+
+    if (inode.size > quint64(std::numeric_limits<int>::max())) {
+        return LINGLONG_ERR(QString("file of %1 bytes is too large").arg(inode.size), ENOTSUP);
+    }
+
+    QByteArray content;
+    auto result =
+      this->read(inode, [&content](const char *data, quint64 size) -> utils::error::Result<void> {
+          content.append(data, static_cast<int>(size));
+          return LINGLONG_OK;
+      });
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return content;
+}
+
+utils::error::Result<void> ErofsReader::read(const Inode &inode, const Sink &sink) const noexcept
+{
+    LINGLONG_TRACE(QString("read data of inode %1").arg(inode.nid));
+
+    if (inode.size == 0) {
+        return LINGLONG_OK;
+    }
+
+    switch (inode.layout) {
+    case layoutFlatPlain:
+    case layoutFlatInline: {
+        // NOTE: The last block of an inline file is stored after the inode.
+        const quint64 blockSize = 1ULL << this->blkszbits;
+        auto blocksSize = inode.size;
+        if (inode.layout == layoutFlatInline) {
+            blocksSize = (inode.size - 1) / blockSize * blockSize;
+        }
+
+        const auto tailSize = inode.size - blocksSize;
+        const auto *blocks = this->at(quint64(inode.blkaddr) << this->blkszbits, blocksSize);
+        const auto *tail = this->at(inode.tailOffset, tailSize);
+        if ((blocksSize > 0 && blocks == nullptr) || (tailSize > 0 && tail == nullptr)) {
+            return LINGLONG_ERR("data out of the image");
+        }
+
+        // NOTE: The image is mapped, the data is passed without copying.
+        if (blocksSize > 0) {
+            auto result = sink(reinterpret_cast<const char *>(blocks), blocksSize);
+            if (!result) {
+                return LINGLONG_ERR(result);
+            }
+        }
+        if (tailSize > 0) {
+            auto result = sink(reinterpret_cast<const char *>(tail), tailSize);
+            if (!result) {
+                return LINGLONG_ERR(result);
+            }
+        }
+
+        return LINGLONG_OK;
+    }
+    case layoutCompressedFull:
+    case layoutCompressedCompact: {
+        auto extents = this->extents(inode);
+        if (!extents) {
+            return LINGLONG_ERR(extents);
+        }
+
+        QByteArray buffer;
+        for (const auto &extent : *extents) {
+            // NOTE: LZ4 expands data by 255 times at most, larger extents are
+            // corrupted, the buffer is not allocated for them.
+            const quint64 inputSize = quint64(extent.blocks) << this->blkszbits;
+            if (extent.length > inputSize * 255
+                || extent.length > quint64(std::numeric_limits<int>::max())) {
+                return LINGLONG_ERR(QString("corrupted extent at %1").arg(extent.start));
+            }
+            if (extent.length == 0) {
+                continue;
+            }
+
+            buffer.resize(static_cast<int>(extent.length));
+            auto result = this->decompress(extent, buffer.data());
+            if (!result) {
+                return LINGLONG_ERR(result);
+            }
+            result = sink(buffer.constData(), extent.length);
+            if (!result) {
+                return LINGLONG_ERR(result);
+            }
+        }
+
+        return LINGLONG_OK;
+    }
+    default:
+        return LINGLONG_ERR(QString("unsupported data layout %1").arg(inode.layout), ENOTSUP);
+    }
+}
+
+// Logical clusters of a compressed file are described by indexes after the
+// inode. Every head lcluster starts an extent, which is compressed into the
+// physical cluster at pblk. The indexes are either all 8 bytes, or packed as
+// in z_erofs_load_compact_lcluster() of the kernel.
+utils::error::Result<std::vector<ErofsReader::Extent>>
+ErofsReader::extents(const Inode &inode) const noexcept
+{
+    LINGLONG_TRACE("read compression indexes");
+
+    const auto headerOffset = (inode.tailOffset + 7) & ~quint64(7);
+    const auto *header = this->at(headerOffset, mapHeaderSize);
+    if (header == nullptr) {
+        return LINGLONG_ERR("compression indexes out of the image");
+    }
+
+    const auto advise = le16(header + 4);
+    const auto algorithms = header[6];
+    const auto clusterbits = header[7];
+    if ((advise & (adviseInlinePcluster | adviseFragmentPcluster)) != 0
+        || (clusterbits & clusterbitsFragmentInode) != 0) {
+        return LINGLONG_ERR("tail packing and fragments are not supported", ENOTSUP);
+    }
+
+    const unsigned lclusterbits = this->blkszbits + (clusterbits & 0x7);
+    const auto indexes = (inode.size + (1ULL << lclusterbits) - 1) >> lclusterbits;
+    const auto base = headerOffset + mapHeaderSize;
+    const auto compact = inode.layout == layoutCompressedCompact;
+
+    // The compact indexes start with 4 bytes ones until 32 bytes aligned,
+    // 2 bytes ones follow in packs of 16, and 4 bytes ones for the rest.
+    quint64 initial4B = 0;
+    quint64 count2B = 0;
+    if (compact) {
+        initial4B = (32 - base % 32) / 4 % 8;
+        if ((advise & adviseCompacted2B) != 0 && initial4B < indexes) {
+            count2B = (indexes - initial4B) / 16 * 16;
+        }
+        if (lclusterbits > 14 || (count2B > 0 && lclusterbits > 12)) {
+            return LINGLONG_ERR(QString("unsupported lcluster size %1").arg(1U << lclusterbits),
+                                ENOTSUP);
+        }
+    }
+
+    const auto loadFull = [&](quint64 lcn) -> std::optional<Lcluster> {
+        const auto *index = this->at(base + lcn * fullIndexSize, fullIndexSize);
+        if (index == nullptr) {
+            return std::nullopt;
+        }
+
+        Lcluster lcluster;
+        lcluster.type = le16(index) & 0x3;
+        if (lcluster.type == lclusterNonHead) {
+            const auto delta0 = le16(index + 4);
+            if ((delta0 & lclusterD0CompressedBlocks) != 0) {
+                if ((advise & (adviseBigPcluster1 | adviseBigPcluster2)) == 0) {
+                    return std::nullopt;
+                }
+                lcluster.compressedBlocks = delta0 & ~lclusterD0CompressedBlocks;
+            }
+            return lcluster;
+        }
+
+        lcluster.clusterofs = le16(index + 2);
+        lcluster.pblk = le32(index + 4);
+        if (lcluster.clusterofs >= 1U << lclusterbits) {
+            return std::nullopt;
+        }
+        return lcluster;
+    };
+
+    const auto loadCompact = [&](quint64 lcn) -> std::optional<Lcluster> {
+        auto pos = base;
+        unsigned shift = 2;
+        if (lcn >= initial4B) {
+            pos += initial4B * 4;
+            lcn -= initial4B;
+            if (lcn < count2B) {
+                shift = 1;
+            } else {
+                pos += count2B * 2;
+                lcn -= count2B;
+            }
+        }
+        pos += lcn << shift;
+
+        // A pack is the encoded indexes followed by the pblk of its first
+        // head lcluster.
+        const quint64 vcnt = shift == 2 ? 2 : 16;
+        const auto packSize = vcnt << shift;
+        const unsigned lobits = std::max(lclusterbits, 12U);
+        const auto encodebits = (packSize - 4) * 8 / vcnt;
+        const auto *pack = this->at(pos & ~(packSize - 1), packSize);
+        if (pack == nullptr) {
+            return std::nullopt;
+        }
+
+        const auto decode = [&](int i, quint8 &type) -> quint32 {
+            const auto bit = encodebits * i;
+            const auto v = le32(pack + bit / 8) >> (bit & 7);
+            type = (v >> lobits) & 0x3;
+            return v & ((1U << lobits) - 1);
+        };
+
+        auto i = static_cast<int>((pos & (packSize - 1)) >> shift);
+        Lcluster lcluster;
+        auto lo = decode(i, lcluster.type);
+        if (lcluster.type == lclusterNonHead) {
+            if ((lo & lclusterD0CompressedBlocks) != 0) {
+                if ((advise & adviseBigPcluster1) == 0) {
+                    return std::nullopt;
+                }
+                lcluster.compressedBlocks = lo & ~lclusterD0CompressedBlocks;
+            }
+            return lcluster;
+        }
+
+        lcluster.clusterofs = lo;
+        quint32 blocks = 0;
+        quint8 type = 0;
+        if ((advise & adviseBigPcluster1) == 0) {
+            blocks = 1;
+            while (i > 0) {
+                --i;
+                lo = decode(i, type);
+                if (type == lclusterNonHead) {
+                    i -= static_cast<int>(lo);
+                }
+                if (i >= 0) {
+                    ++blocks;
+                }
+            }
+        } else {
+            while (i > 0) {
+                --i;
+                lo = decode(i, type);
+                if (type != lclusterNonHead) {
+                    ++blocks;
+                    continue;
+                }
+                if ((lo & lclusterD0CompressedBlocks) != 0) {
+                    --i;
+                    blocks += lo & ~lclusterD0CompressedBlocks;
+                    continue;
+                }
+                if (lo <= 1) {
+                    return std::nullopt;
+                }
+                i -= static_cast<int>(lo) - 2;
+            }
+        }
+        lcluster.pblk = le32(pack + packSize - 4) + blocks;
+        return lcluster;
+    };
+
+    const auto load = [&](quint64 lcn) {
+        return compact ? loadCompact(lcn) : loadFull(lcn);
+    };
+
+    std::vector<Extent> extents;
+    for (quint64 lcn = 0; lcn < indexes; ++lcn) {
+        const auto lcluster = load(lcn);
+        if (!lcluster) {
+            return LINGLONG_ERR(QString("corrupted index of lcluster %1").arg(lcn));
+        }
+        if (lcluster->type == lclusterNonHead) {
+            continue;
+        }
+
+        Extent extent;
+        extent.start = (lcn << lclusterbits) + lcluster->clusterofs;
+        extent.pblk = lcluster->pblk;
+        extent.plain = lcluster->type == lclusterPlain;
+        extent.interlaced = (advise & adviseInterlacedPcluster) != 0;
+        extent.algorithm = lcluster->type == lclusterHead1 ? algorithms & 0xf : algorithms >> 4;
+        if (extent.start > inode.size
+            || (!extents.empty() && extent.start < extents.back().start)) {
+            return LINGLONG_ERR(QString("corrupted index of lcluster %1").arg(lcn));
+        }
+
+        // NOTE: The size of a big pcluster is saved in the next lcluster.
+        const auto bigPcluster = (advise
+                                  & (lcluster->type == lclusterHead1 ? adviseBigPcluster1
+                                                                      : adviseBigPcluster2))
+          != 0;
+        if (bigPcluster && ((lcn + 1) << lclusterbits) < inode.size) {
+            const auto next = load(lcn + 1);
+            if (!next) {
+                return LINGLONG_ERR(QString("corrupted index of lcluster %1").arg(lcn + 1));
+            }
+            if (next->type == lclusterNonHead) {
+                if (next->compressedBlocks == 0) {
+                    return LINGLONG_ERR(QString("no pcluster size of lcluster %1").arg(lcn));
+                }
+                extent.blocks = next->compressedBlocks;
+            }
+        }
+
+        if (!extents.empty()) {
+            extents.back().length = extent.start - extents.back().start;
+        }
+        extents.push_back(extent);
+    }
+
+    if (extents.empty() || extents.front().start != 0) {
+        return LINGLONG_ERR("corrupted compression indexes");
+    }
+    extents.back().length = inode.size - extents.back().start;
+
+    return extents;
+}
+
+utils::error::Result<void> ErofsReader::decompress(const Extent &extent, char *out) const noexcept
+{
+    LINGLONG_TRACE(QString("decompress extent at %1").arg(extent.start));
+
+    const quint64 blockSize = 1ULL << this->blkszbits;
+    const quint64 inputSize = quint64(extent.blocks) << this->blkszbits;
+    const auto *in = this->at(quint64(extent.pblk) << this->blkszbits, inputSize);
+    if (in == nullptr) {
+        return LINGLONG_ERR("pcluster out of the image");
+    }
+
+    if (extent.plain) {
+        if (extent.length > inputSize) {
+            return LINGLONG_ERR("corrupted uncompressed pcluster");
+        }
+        if (!extent.interlaced) {
+            std::memcpy(out, in, extent.length);
+            return LINGLONG_OK;
+        }
+
+        // An interlaced pcluster is rotated by the offset of the extent in
+        // its block, so the data stays at the same offset as in the file.
+        if (inputSize > blockSize) {
+            return LINGLONG_ERR("corrupted uncompressed pcluster");
+        }
+        const auto skip = extent.start & (blockSize - 1);
+        const auto right = std::min(blockSize - skip, extent.length);
+        std::memcpy(out, in + skip, right);
+        std::memcpy(out + right, in, extent.length - right);
+        return LINGLONG_OK;
+    }
+
+    if (extent.algorithm != algorithmLZ4) {
+        return LINGLONG_ERR(QString("unsupported compression algorithm %1").arg(extent.algorithm),
+                            ENOTSUP);
+    }
+
+    // NOTE: Compressed data ends at the end of the pcluster, it is padded
+    // with zeros in the front.
+    quint64 margin = 0;
+    if ((this->featureIncompat & featureZeroPadding) != 0) {
+        while (margin < blockSize && in[margin] == 0) {
+            ++margin;
+        }
+        if (margin >= inputSize) {
+            return LINGLONG_ERR("corrupted compressed pcluster");
+        }
+    }
+
+    const auto length = static_cast<int>(extent.length);
+    const auto decompressed = LZ4_decompress_safe_partial(reinterpret_cast<const char *>(in)
+                                                            + margin,
+                                                          out,
+                                                          static_cast<int>(inputSize - margin),
+                                                          length,
+                                                          length);
+    if (decompressed != length) {
+        return LINGLONG_ERR(QString("LZ4 decompressed %1 of %2 bytes")
+                              .arg(decompressed)
+                              .arg(extent.length));
+    }
+
+    return LINGLONG_OK;
+}
+
+} // namespace linglong::package
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_PACKAGE_EROFS_READER_H_
+#define LINGLONG_PACKAGE_EROFS_READER_H_
+
+#include "linglong/utils/error/error.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QSharedPointer>
+
+#include <functional>
+#include <vector>
+
+namespace linglong::package {
+
+// ErofsReader reads the EROFS image at the end of a layer file in user space,
+// so that a layer can be imported without mounting it by erofsfuse.
+//
+// It supports the images written by LayerPackager::pack(): uncompressed and
+// inline data, LZ4 compressed files with full or compact indexes and big
+// pclusters. Other features are reported with the error code ENOTSUP, mount
+// such images instead. Extended attributes are ignored.
+//
+// The image is mapped into memory, all methods can be called from any thread.
+class ErofsReader
+{
+public:
+    struct Inode
+    {
+        quint64 nid = 0;
+        quint32 mode = 0;
+        quint64 size = 0;
+
+    private:
+        friend class ErofsReader;
+        quint8 layout = 0;
+        quint32 blkaddr = 0;
+        // offset of the inline data or the compression indexes in the image
+        quint64 tailOffset = 0;
+    };
+
+    struct DirEntry
+    {
+        QByteArray name;
+        quint64 nid = 0;
+    };
+
+    ErofsReader(const ErofsReader &) = delete;
+    ErofsReader(ErofsReader &&) = delete;
+    ErofsReader &operator=(const ErofsReader &) = delete;
+    ErofsReader &operator=(ErofsReader &&) = delete;
+    ~ErofsReader();
+
+    utils::error::Result<Inode> root() const noexcept;
+    utils::error::Result<Inode> inode(quint64 nid) const noexcept;
+    utils::error::Result<std::vector<DirEntry>> readDir(const Inode &dir) const noexcept;
+    // Content of a regular file, or the target of a symbolic link.
+    utils::error::Result<QByteArray> read(const Inode &inode) const noexcept;
+    // Pass the content to sink in order, one extent at a time, so that large
+    // files are never held in memory at once.
+    using Sink = std::function<utils::error::Result<void>(const char *data, quint64 size)>;
+    utils::error::Result<void> read(const Inode &inode, const Sink &sink) const noexcept;
+
+    static utils::error::Result<QSharedPointer<ErofsReader>> New(const QString &path,
+                                                                 qint64 offset) noexcept;
+
+private:
+    ErofsReader(const QString &path, qint64 offset);
+
+    struct Extent;
+    utils::error::Result<std::vector<Extent>> extents(const Inode &inode) const noexcept;
+    utils::error::Result<void> decompress(const Extent &extent, char *out) const noexcept;
+    const uchar *at(quint64 offset, quint64 length) const noexcept;
+
+    QFile file;
+    uchar *data = nullptr;
+    quint64 size = 0;
+
+    quint8 blkszbits = 0;
+    quint64 rootNid = 0;
+    quint32 metaBlkaddr = 0;
+    quint32 featureIncompat = 0;
+};
+
+} // namespace linglong::package
+
+#endif /* LINGLONG_PACKAGE_EROFS_READER_H_ */
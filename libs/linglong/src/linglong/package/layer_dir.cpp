@@ -23,4 +23,21 @@ utils::error::Result<api::types::v1::PackageInfo> LayerDir::info() const
     return info;
 }
 
+utils::error::Result<QByteArray> LayerDir::rawInfo() const
+{
+    LINGLONG_TRACE("get raw layer info from " + this->absolutePath());
+
+    QFile file = this->filePath("info.json");
+    if (!file.open(QFile::ReadOnly)) {
+        return LINGLONG_ERR("open", file);
+    }
+
+    auto content = file.readAll();
+    if (file.error() != QFile::NoError) {
+        return LINGLONG_ERR("read all", file);
+    }
+
+    return content;
+}
+
 } // namespace linglong::package
@@ -59,6 +59,10 @@ utils::error::Result<api::types::v1::LayerInfo> LayerFile::metaInfo() noexcept
         return LINGLONG_ERR(ret);
     }
 
+    if (!this->seek(magicNumber.size() + sizeof(quint32))) {
+        return LINGLONG_ERR(*this);
+    }
+
     auto rawData = this->read(qint64(*ret));
 
     auto layerInfo = utils::serialize::LoadJSON<api::types::v1::LayerInfo>(rawData);
@@ -77,6 +81,10 @@ utils::error::Result<quint32> LayerFile::metaInfoLength()
         return metaInfoLengthValue;
     }
 
+    if (!this->seek(magicNumber.size())) {
+        return LINGLONG_ERR(*this);
+    }
+
     QDataStream layerDataStream(this);
 
     layerDataStream.startTransaction();
@@ -24,6 +24,9 @@ const QByteArray magicNumber =
 // meta info length  4                 40
 // meta info         meta info length  44
 // binary data                         44 + meta info length
+//
+// Meta info is JSON, it may be padded with spaces so that binary data starts
+// at a multiple of 4096 bytes.
 class LayerFile : public QFile
 {
 public:
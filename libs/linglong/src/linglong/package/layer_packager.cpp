@@ -8,13 +8,321 @@
 
 #include "linglong/api/types/v1/Generators.hpp"
 #include "linglong/api/types/v1/LayerInfo.hpp"
+#include "linglong/package/reference.h"
 #include "linglong/utils/command/env.h"
+#include "linglong/utils/finally/finally.h"
+#include "linglong/utils/transaction.h"
 
 #include <QDataStream>
+#include <QDirIterator>
+#include <QFileInfo>
 #include <QSysInfo>
+#include <QThread>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace linglong::package {
 
+namespace {
+
+// The binary data starts at a multiple of the block size of common file
+// systems, so that appending it can share the extents of the image.
+constexpr qint64 binaryDataAlignment = 4096;
+
+// Append the file at path to out in the kernel. copy_file_range shares the
+// extents instead of copying them on file systems supporting reflinks, or
+// copies them without a round trip through user space.
+utils::error::Result<void> appendFile(QFile &out, const QString &path) noexcept
+{
+    LINGLONG_TRACE(QString("append %1 to %2").arg(path, out.fileName()));
+
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return LINGLONG_ERR(in);
+    }
+
+    if (!out.flush()) {
+        return LINGLONG_ERR(out);
+    }
+
+    auto remaining = in.size();
+    bool copyFileRange = true;
+    while (remaining > 0) {
+        ssize_t copied = -1;
+        if (copyFileRange) {
+            copied = ::copy_file_range(in.handle(), nullptr, out.handle(), nullptr, remaining, 0);
+            // NOTE: Fall back to sendfile if the file systems can not copy between them.
+            if (copied < 0
+                && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+                copyFileRange = false;
+                continue;
+            }
+        } else {
+            copied = ::sendfile(out.handle(), in.handle(), nullptr, remaining);
+        }
+
+        if (copied < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            const auto *call = copyFileRange ? "copy_file_range" : "sendfile";
+            return LINGLONG_ERR(QString("%1: %2").arg(call, ::strerror(errno)), errno);
+        }
+        if (copied == 0) {
+            return LINGLONG_ERR(QString("%1 is truncated").arg(path));
+        }
+
+        remaining -= copied;
+    }
+
+    return LINGLONG_OK;
+}
+
+// Options of mkfs.erofs for the compression profile.
+utils::error::Result<QStringList> compressionOptions(const QString &profile) noexcept
+{
+    LINGLONG_TRACE("compression profile " + profile);
+
+    if (profile == "fast") {
+        return QStringList{ "-zlz4" };
+    }
+    if (profile == "balanced") {
+        return QStringList{ "-zlz4hc,9" };
+    }
+    if (profile == "small") {
+        return QStringList{ "-zlzma,9", "-C1048576", "-Eztailpacking" };
+    }
+
+    return LINGLONG_ERR("unknown profile, it should be one of "
+                        + compressionProfiles.join(", "));
+}
+
+// mkfs.erofs compresses with multiple threads since erofs-utils 1.8, if it
+// is built with multi-threading support.
+QStringList workerOptions() noexcept
+{
+    static const auto supported = []() {
+        auto help = utils::command::Exec("mkfs.erofs", { "--help" });
+        return help && help->contains("--workers");
+    }();
+
+    if (!supported) {
+        return {};
+    }
+    return { QString("--workers=%1").arg(QThread::idealThreadCount()) };
+}
+
+// Type of the file at path without following symbolic links, 0 if it does not exist.
+mode_t fileType(const QString &path) noexcept
+{
+    struct stat st = {};
+    if (::lstat(QFile::encodeName(path).constData(), &st) != 0) {
+        return 0;
+    }
+    return st.st_mode & S_IFMT;
+}
+
+QByteArray readLink(const QString &path) noexcept
+{
+    QByteArray target(PATH_MAX, Qt::Uninitialized);
+    const auto length =
+      ::readlink(QFile::encodeName(path).constData(), target.data(), target.size());
+    if (length < 0) {
+        return {};
+    }
+    target.truncate(int(length));
+    return target;
+}
+
+// Whether the files at the paths have the same type, permissions and content.
+// Unchanged files of layers checked out from one repository are usually
+// hardlinks of the same object, which are not read.
+bool sameFile(const QString &a, const QString &b) noexcept
+{
+    struct stat stA = {};
+    struct stat stB = {};
+    if (::lstat(QFile::encodeName(a).constData(), &stA) != 0
+        || ::lstat(QFile::encodeName(b).constData(), &stB) != 0) {
+        return false;
+    }
+
+    if (stA.st_dev == stB.st_dev && stA.st_ino == stB.st_ino) {
+        return true;
+    }
+
+    if (stA.st_mode != stB.st_mode || stA.st_size != stB.st_size) {
+        return false;
+    }
+
+    if (S_ISLNK(stA.st_mode)) {
+        return readLink(a) == readLink(b);
+    }
+
+    QFile fileA(a);
+    QFile fileB(b);
+    if (!fileA.open(QIODevice::ReadOnly) || !fileB.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    constexpr qint64 chunkSize = 64 * 1024;
+    while (!fileA.atEnd()) {
+        if (fileA.read(chunkSize) != fileB.read(chunkSize)) {
+            return false;
+        }
+    }
+    return fileB.atEnd();
+}
+
+// Copy the file, or the symbolic link, at source to destination, by a
+// hardlink if possible.
+utils::error::Result<void> stageFile(const QString &source, const QString &destination) noexcept
+{
+    LINGLONG_TRACE(QString("stage %1").arg(source));
+
+    if (!QDir().mkpath(QFileInfo(destination).path())) {
+        return LINGLONG_ERR("mkpath " + QFileInfo(destination).path() + ": failed");
+    }
+
+    if (fileType(source) == S_IFLNK) {
+        if (::symlink(readLink(source).constData(), QFile::encodeName(destination).constData())
+            != 0) {
+            return LINGLONG_ERR(QString("symlink: %1").arg(::strerror(errno)), errno);
+        }
+        return LINGLONG_OK;
+    }
+
+    if (::link(QFile::encodeName(source).constData(), QFile::encodeName(destination).constData())
+        == 0) {
+        return LINGLONG_OK;
+    }
+
+    QFile file(source);
+    if (!file.copy(destination)) {
+        return LINGLONG_ERR(file);
+    }
+
+    return LINGLONG_OK;
+}
+
+// Give the directory at destination the mode and the owner of the one at
+// source, mkpath creates directories with the default ones.
+utils::error::Result<void> copyDirAttributes(const QString &source,
+                                             const QString &destination) noexcept
+{
+    LINGLONG_TRACE(QString("copy attributes of %1").arg(source));
+
+    struct stat st = {};
+    if (::stat(QFile::encodeName(source).constData(), &st) != 0) {
+        return LINGLONG_ERR(QString("stat: %1").arg(::strerror(errno)), errno);
+    }
+
+    const auto path = QFile::encodeName(destination);
+    // NOTE: Only root can give files away, other users pack their own files.
+    if (::chown(path.constData(), st.st_uid, st.st_gid) != 0 && errno != EPERM) {
+        return LINGLONG_ERR(QString("chown: %1").arg(::strerror(errno)), errno);
+    }
+    if (::chmod(path.constData(), st.st_mode & 07777) != 0) {
+        return LINGLONG_ERR(QString("chmod: %1").arg(::strerror(errno)), errno);
+    }
+
+    return LINGLONG_OK;
+}
+
+// Remove the staging directory of diffLayerDir(), whose directories may have
+// lost the write permission of the owner.
+void removeStagingDir(const QDir &dir) noexcept
+{
+    ::chmod(QFile::encodeName(dir.absolutePath()).constData(), 0700);
+    QDirIterator it(dir.absolutePath(),
+                    QDir::Dirs | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot
+                      | QDir::NoSymLinks,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        ::chmod(QFile::encodeName(it.next()).constData(), 0700);
+    }
+
+    QDir(dir).removeRecursively();
+}
+
+// Write the files of dir added or changed since base into delta, and returns
+// the paths removed since base. A path whose type changes between a directory
+// and a file is both removed and added.
+utils::error::Result<std::vector<std::string>>
+diffLayerDir(const QDir &base, const QDir &dir, const QDir &delta) noexcept
+{
+    LINGLONG_TRACE(QString("diff %1 with %2").arg(dir.absolutePath(), base.absolutePath()));
+
+    const auto filters = QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot;
+
+    std::vector<std::string> removed;
+    QDirIterator it(dir.absolutePath(), filters, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const auto path = dir.relativeFilePath(it.next());
+        const auto type = fileType(it.filePath());
+        const auto baseType = fileType(base.filePath(path));
+        if (baseType != 0 && (type == S_IFDIR) != (baseType == S_IFDIR)) {
+            removed.push_back(path.toStdString());
+        }
+
+        if (type == S_IFDIR) {
+            if (baseType != S_IFDIR && !delta.mkpath(path)) {
+                return LINGLONG_ERR("mkpath " + delta.filePath(path) + ": failed");
+            }
+            continue;
+        }
+
+        // NOTE: info.json is always packed, LayerDir::info() reads it.
+        if (path != "info.json" && baseType == type
+            && sameFile(it.filePath(), base.filePath(path))) {
+            continue;
+        }
+
+        auto result = stageFile(it.filePath(), delta.filePath(path));
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
+
+    QDirIterator baseIt(base.absolutePath(), filters, QDirIterator::Subdirectories);
+    while (baseIt.hasNext()) {
+        const auto path = base.relativeFilePath(baseIt.next());
+        // NOTE: Only the topmost one of the removed paths is recorded.
+        if (fileType(dir.filePath(path)) == 0
+            && fileType(dir.filePath(QFileInfo(path).path())) == S_IFDIR) {
+            removed.push_back(path.toStdString());
+        }
+    }
+
+    // NOTE: The directories are only given their attributes once all files
+    // are staged, a read-only directory can not be written into.
+    QStringList dirs{ "." };
+    QDirIterator deltaIt(delta.absolutePath(),
+                         QDir::Dirs | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot
+                           | QDir::NoSymLinks,
+                         QDirIterator::Subdirectories);
+    while (deltaIt.hasNext()) {
+        dirs.append(delta.relativeFilePath(deltaIt.next()));
+    }
+    for (const auto &path : dirs) {
+        auto result = copyDirAttributes(dir.filePath(path), delta.filePath(path));
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
+
+    std::sort(removed.begin(), removed.end());
+    return removed;
+}
+
+} // namespace
+
 LayerPackager::LayerPackager(const QDir &workDir)
     : workDir(workDir)
 {
@@ -34,6 +342,15 @@ LayerPackager::~LayerPackager()
         }
 
         auto ret = utils::command::Exec("umount", { info.absoluteFilePath() });
+        if (ret) {
+            continue;
+        }
+
+        // NOTE: Only root can umount, erofsfuse mounts of other users are
+        // removed by fusermount.
+        if (::geteuid() != 0) {
+            ret = utils::command::Exec("fusermount", { "-u", info.absoluteFilePath() });
+        }
         if (!ret) {
             qCritical() << ret.error();
         }
@@ -48,15 +365,117 @@ LayerPackager::~LayerPackager()
 }
 
 utils::error::Result<QSharedPointer<LayerFile>>
-LayerPackager::pack(const LayerDir &dir, const QString &layerFilePath) const
+LayerPackager::pack(const LayerDir &dir,
+                    const QString &layerFilePath,
+                    const QString &compression) const
+{
+    return this->pack(dir, layerFilePath, compression, std::nullopt);
+}
+
+utils::error::Result<QSharedPointer<LayerFile>>
+LayerPackager::packDelta(const LayerDir &base,
+                         const QString &baseChecksum,
+                         const LayerDir &dir,
+                         const QString &layerFilePath,
+                         const QString &compression) const
+{
+    LINGLONG_TRACE(QString("pack delta layer from %1").arg(base.absolutePath()));
+
+    auto baseInfo = base.info();
+    if (!baseInfo) {
+        return LINGLONG_ERR(baseInfo);
+    }
+
+    auto info = dir.info();
+    if (!info) {
+        return LINGLONG_ERR(info);
+    }
+
+    if (baseInfo->appid != info->appid
+        || baseInfo->packageInfoModule != info->packageInfoModule) {
+        return LINGLONG_ERR(QString("%1 is not another version of the %2 module of %3")
+                              .arg(base.absolutePath(),
+                                   QString::fromStdString(info->packageInfoModule),
+                                   QString::fromStdString(info->appid)));
+    }
+
+    auto baseRef = Reference::fromPackageInfo(*baseInfo);
+    if (!baseRef) {
+        return LINGLONG_ERR(baseRef);
+    }
+
+    // NOTE: The changed files are staged beside the layer file, like the image.
+    const QFileInfo layerFileInfo(layerFilePath);
+    LayerDir deltaDir(
+      layerFileInfo.absoluteDir().absoluteFilePath("." + layerFileInfo.fileName() + ".delta"));
+    removeStagingDir(deltaDir);
+    auto removeDeltaDir = utils::finally::finally([&deltaDir]() {
+        removeStagingDir(deltaDir);
+    });
+    if (!deltaDir.mkpath(".")) {
+        return LINGLONG_ERR("mkpath " + deltaDir.absolutePath() + ": failed");
+    }
+
+    auto removed = diffLayerDir(base, dir, deltaDir);
+    if (!removed) {
+        return LINGLONG_ERR(removed);
+    }
+
+    api::types::v1::LayerInfoDelta delta;
+    delta.base = baseRef->toString().toStdString();
+    delta.checksum = baseChecksum.toStdString();
+    if (!removed->empty()) {
+        delta.removed = std::move(*removed);
+    }
+
+    auto layerFile = this->pack(deltaDir, layerFilePath, compression, delta);
+    if (!layerFile) {
+        return LINGLONG_ERR(layerFile);
+    }
+
+    return layerFile;
+}
+
+utils::error::Result<QSharedPointer<LayerFile>>
+LayerPackager::pack(const LayerDir &dir,
+                    const QString &layerFilePath,
+                    const QString &compression,
+                    const std::optional<api::types::v1::LayerInfoDelta> &delta) const
 {
     LINGLONG_TRACE("pack layer");
 
+    auto options = compressionOptions(compression);
+    if (!options) {
+        return LINGLONG_ERR(options);
+    }
+
+    // compress data with erofs
+    // NOTE: The image is created beside the layer file, on the same file system.
+    const QFileInfo layerFileInfo(layerFilePath);
+    const auto compressedFilePath =
+      layerFileInfo.absoluteDir().absoluteFilePath("." + layerFileInfo.fileName() + ".erofs");
+    auto removeCompressedFile = utils::finally::finally([&compressedFilePath]() {
+        QFile::remove(compressedFilePath);
+    });
+
+    auto ret = utils::command::Exec("mkfs.erofs",
+                                    *options + workerOptions()
+                                      + QStringList{ compressedFilePath, dir.absolutePath() });
+    if (!ret) {
+        return LINGLONG_ERR(ret);
+    }
+
     QFile layer(layerFilePath);
-    if (!layer.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    if (!layer.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
         return LINGLONG_ERR(layer);
     }
 
+    // NOTE: A partially written layer file is removed on any error.
+    utils::Transaction transaction;
+    transaction.addRollBack([&layer]() noexcept {
+        layer.remove();
+    });
+
     if (layer.write(magicNumber) < 0) {
         return LINGLONG_ERR(layer);
     }
@@ -66,6 +485,8 @@ LayerPackager::pack(const LayerDir &dir, const QString &layerFilePath) const
     // layer info version not used yet, so give fixed value
     // keep it for later function expansion
     layerInfo.version = "1";
+    layerInfo.compression = compression.toStdString();
+    layerInfo.delta = delta;
 
     auto info = dir.info();
     if (!info) {
@@ -75,6 +496,12 @@ LayerPackager::pack(const LayerDir &dir, const QString &layerFilePath) const
     layerInfo.info = nlohmann::json(*info);
     auto data = QByteArray::fromStdString(nlohmann::json(layerInfo).dump());
 
+    // NOTE: Pad the meta info with spaces, which are ignored by JSON parsers.
+    const auto headerSize = magicNumber.size() + qint64(sizeof(quint32)) + data.size();
+    const auto padding = (binaryDataAlignment - headerSize % binaryDataAlignment)
+      % binaryDataAlignment;
+    data.append(QByteArray(int(padding), ' '));
+
     QByteArray dataSizeBytes;
 
     QDataStream dataSizeStream(&dataSizeBytes, QIODevice::WriteOnly);
@@ -92,28 +519,20 @@ LayerPackager::pack(const LayerDir &dir, const QString &layerFilePath) const
         return LINGLONG_ERR(layer);
     }
 
-    layer.close();
-
-    // compress data with erofs
-    const auto compressedFilePath = this->workDir.absoluteFilePath("tmp.erofs");
-
-    auto ret =
-      utils::command::Exec("mkfs.erofs", { "-zlz4hc,9", compressedFilePath, dir.absolutePath() });
-    if (!ret) {
-        return LINGLONG_ERR(ret);
+    auto result = appendFile(layer, compressedFilePath);
+    if (!result) {
+        return LINGLONG_ERR(result);
     }
 
-    ret = utils::command::Exec(
-      "sh",
-      { "-c", QString("cat %1 >> %2").arg(compressedFilePath, layerFilePath) });
-    if (!ret) {
-        LINGLONG_ERR(ret);
-    }
+    layer.close();
 
-    auto result = LayerFile::New(layerFilePath);
-    Q_ASSERT(result.has_value());
+    auto layerFile = LayerFile::New(layerFilePath);
+    if (!layerFile) {
+        return LINGLONG_ERR(layerFile);
+    }
 
-    return result;
+    transaction.commit();
+    return layerFile;
 }
 
 utils::error::Result<LayerDir> LayerPackager::unpack(LayerFile &file)
@@ -130,6 +549,23 @@ utils::error::Result<LayerDir> LayerPackager::unpack(LayerFile &file)
         return LINGLONG_ERR(offset);
     }
 
+    // NOTE: The kernel mounts the image faster than erofsfuse, but it is only
+    // permitted to root. The loop device is released by umount in the
+    // destructor.
+    if (::geteuid() == 0) {
+        auto ret = utils::command::Exec("mount",
+                                        { "-t",
+                                          "erofs",
+                                          "-o",
+                                          QString("ro,loop,offset=%1").arg(*offset),
+                                          fileInfo.absoluteFilePath(),
+                                          unpackDir.absolutePath() });
+        if (ret) {
+            return unpackDir.absolutePath();
+        }
+        qInfo() << "mount layer file by erofsfuse:" << ret.error().message();
+    }
+
     auto ret = utils::command::Exec("erofsfuse",
                                     { QString("--offset=%1").arg(*offset),
                                       fileInfo.absoluteFilePath(),
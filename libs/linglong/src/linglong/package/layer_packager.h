@@ -7,15 +7,27 @@
 #ifndef LINGLONG_PACKAGE_LAYER_PACKAGER_H_
 #define LINGLONG_PACKAGE_LAYER_PACKAGER_H_
 
+#include "linglong/api/types/v1/LayerInfoDelta.hpp"
 #include "linglong/package/layer_dir.h"
 #include "linglong/package/layer_file.h"
 #include "linglong/utils/error/error.h"
 
 #include <QString>
+#include <QStringList>
 #include <QUuid>
 
+#include <optional>
+
 namespace linglong::package {
 
+// Compression profiles of the EROFS image in a layer file:
+//   fast      LZ4, the fastest to pack, e.g. for CI artifacts.
+//   balanced  LZ4HC, the default, fast to read.
+//   small     LZMA with 1 MiB pclusters, the smallest for archives. Reading
+//             it needs erofsfuse or a kernel with LZMA support.
+const QStringList compressionProfiles = { "fast", "balanced", "small" };
+const QString defaultCompressionProfile = "balanced";
+
 class LayerPackager : public QObject
 {
 public:
@@ -26,12 +38,29 @@ public:
     LayerPackager &operator=(const LayerPackager &) = delete;
     LayerPackager &operator=(LayerPackager &&) = delete;
     ~LayerPackager() override;
-    utils::error::Result<QSharedPointer<LayerFile>> pack(const LayerDir &dir,
-                                                         const QString &layerFilePath) const;
+    utils::error::Result<QSharedPointer<LayerFile>>
+    pack(const LayerDir &dir,
+         const QString &layerFilePath,
+         const QString &compression = defaultCompressionProfile) const;
+    // Pack the files of dir added or changed since base as a delta layer,
+    // which is installed on top of base. baseChecksum is the checksum of the
+    // base layer, see repo::OSTreeRepo::getLayerChecksum().
+    utils::error::Result<QSharedPointer<LayerFile>>
+    packDelta(const LayerDir &base,
+              const QString &baseChecksum,
+              const LayerDir &dir,
+              const QString &layerFilePath,
+              const QString &compression = defaultCompressionProfile) const;
     utils::error::Result<LayerDir> unpack(LayerFile &file);
 
 private:
     QDir workDir;
+
+    utils::error::Result<QSharedPointer<LayerFile>>
+    pack(const LayerDir &dir,
+         const QString &layerFilePath,
+         const QString &compression,
+         const std::optional<api::types::v1::LayerInfoDelta> &delta) const;
 };
 
 } // namespace linglong::package
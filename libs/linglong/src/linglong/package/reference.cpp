@@ -8,6 +8,7 @@
 
 #include <qregularexpression.h>
 
+#include <QStringBuilder>
 #include <QStringList>
 
 namespace linglong::package {
@@ -106,7 +107,7 @@ Reference::Reference(const QString &channel,
 
 QString Reference::toString() const noexcept
 {
-    return QString("%1:%2/%3/%4").arg(channel, id, version.toString(), arch.toString());
+    return channel % ':' % id % '/' % version.toString() % '/' % arch.toString();
 }
 
 } // namespace linglong::package
@@ -11,8 +11,11 @@
 #include "linglong/package/architecture.h"
 #include "linglong/package/version.h"
 
+#include <QHash>
 #include <QString>
 
+#include <functional>
+
 namespace linglong::package {
 
 // This class is a reference to a tier, use as a tier ID.
@@ -34,6 +37,15 @@ public:
 
     QString toString() const noexcept;
 
+    // Compare and hash the fields instead of the strings from toString().
+    bool operator==(const Reference &that) const noexcept
+    {
+        return this->version == that.version && this->arch == that.arch && this->id == that.id
+          && this->channel == that.channel;
+    }
+
+    bool operator!=(const Reference &that) const noexcept { return !(*this == that); }
+
 private:
     Reference(const QString &channel,
               const QString &id,
@@ -41,6 +53,26 @@ private:
               const Architecture &architecture);
 };
 
+inline uint qHash(const Reference &ref, uint seed = 0) noexcept
+{
+    seed ^= ::qHash(ref.channel) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= ::qHash(ref.id) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= qHash(ref.version) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= qHash(ref.arch) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+}
+
 } // namespace linglong::package
 
+namespace std {
+template<>
+struct hash<linglong::package::Reference>
+{
+    std::size_t operator()(const linglong::package::Reference &ref) const noexcept
+    {
+        return qHash(ref);
+    }
+};
+} // namespace std
+
 #endif
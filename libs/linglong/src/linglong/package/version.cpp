@@ -5,198 +5,106 @@
  */
 #include "linglong/package/version.h"
 
-#include <QRegularExpression>
 #include <QString>
 #include <QStringBuilder>
+#include <QStringView>
 
-#if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
-namespace Qt {
-static auto SkipEmptyParts = QString::SkipEmptyParts;
-} // namespace Qt
-#endif
+#include <limits>
 
 namespace linglong::package {
 namespace {
 
-struct PreRelease
+// Parse a component of a version, which is 0 or a decimal number without
+// leading zeros. Returns nullptr on success, otherwise the reason.
+const char *parseComponent(QStringView raw, qlonglong &value) noexcept
 {
-    explicit PreRelease(const QString &raw)
-        : list(raw.split('.', Qt::SkipEmptyParts))
-    {
+    if (raw.isEmpty() || (raw.size() > 1 && raw.front() == u'0')) {
+        return "version component mismatched";
     }
 
-    bool operator==(const PreRelease &that) const { return this->list == that.list; };
-
-    bool operator<(const PreRelease &that) const
-    {
-        auto limit = std::min(this->list.size(), that.list.size());
-        for (decltype(limit) i = 0; i < limit; i++) {
-            bool ok = false;
-            auto thisAsNumber = this->list[i].toInt(&ok);
-            if (!ok) {
-                thisAsNumber = std::numeric_limits<decltype(thisAsNumber)>::max();
-            }
-            auto thatAsNumber = that.list[i].toInt(&ok);
-            if (!ok) {
-                thatAsNumber = std::numeric_limits<decltype(thatAsNumber)>::max();
-            }
-
-            if (thisAsNumber != thatAsNumber) {
-                return thisAsNumber < thatAsNumber;
-            }
-
-            if (this->list[i] != that.list[i]) {
-                return this->list[i] < that.list[i];
-            }
+    value = 0;
+    for (const auto c : raw) {
+        if (c < u'0' || c > u'9') {
+            return "version component mismatched";
         }
-
-        if (this->list.isEmpty()) {
-            return false;
-        }
-
-        if (that.list.isEmpty()) {
-            return !this->list.isEmpty();
-        }
-
-        return this->list.size() < that.list.size();
-    }
-
-    bool operator>(const PreRelease &that) const
-    {
-        auto limit = std::min(this->list.size(), that.list.size());
-        for (decltype(limit) i = 0; i < limit; i++) {
-            bool ok = false;
-            auto thisAsNumber = this->list[i].toInt(&ok);
-            if (!ok) {
-                thisAsNumber = std::numeric_limits<decltype(thisAsNumber)>::max();
-            }
-            auto thatAsNumber = that.list[i].toInt(&ok);
-            if (!ok) {
-                thatAsNumber = std::numeric_limits<decltype(thatAsNumber)>::max();
-            }
-
-            if (thisAsNumber != thatAsNumber) {
-                return thisAsNumber > thatAsNumber;
-            }
-
-            if (this->list[i] != that.list[i]) {
-                return this->list[i] > that.list[i];
-            }
-        }
-
-        if (this->list.isEmpty()) {
-            return !that.list.isEmpty();
+        const auto digit = c.unicode() - u'0';
+        if (value > (std::numeric_limits<qlonglong>::max() - digit) / 10) {
+            return "version component too large";
         }
-
-        if (that.list.isEmpty()) {
-            return false;
-        }
-
-        return this->list.size() > that.list.size();
+        value = value * 10 + digit;
     }
 
-    QStringList list;
-};
-
-} // namespace
-
-utils::error::Result<Version> Version::parse(const QString &raw) noexcept
-try {
-    return Version(raw);
-} catch (const std::exception &e) {
-    LINGLONG_TRACE("parse version " + raw);
-    return LINGLONG_ERR(e);
+    return nullptr;
 }
 
-Version::Version(const QString &raw)
+// Same as matching ^(0|[1-9]\d*)\.(0|[1-9]\d*)\.(0|[1-9]\d*)(?:\.(0|[1-9]\d*))?$
+// but without a regular expression, as versions are parsed for every record
+// when resolving references.
+const char *parseVersion(QStringView raw, Version &version) noexcept
 {
-    // modified from https://regex101.com/r/vkijKf/1/
-    static QRegularExpression regexExp(
-      R"(^(0|[1-9]\d*)\.(0|[1-9]\d*)\.(0|[1-9]\d*)(?:\.(0|[1-9]\d*))?$)");
-
-    QRegularExpressionMatch matched = regexExp.match(raw);
-
-    if (!matched.hasMatch()) {
-        throw std::runtime_error("version regex mismatched");
-    }
-
-    bool ok = false;
-    this->major = matched.captured(1).toLongLong(&ok);
-    if (!ok) {
-        throw std::runtime_error("major too large");
-    }
-    this->minor = matched.captured(2).toLongLong(&ok);
-    if (!ok) {
-        throw std::runtime_error("minor too large");
-    }
-    this->patch = matched.captured(3).toLongLong(&ok);
-    if (!ok) {
-        throw std::runtime_error("patch too large");
-    }
-    if (!matched.captured(4).isNull()) {
-        this->tweak = matched.captured(4).toLongLong(&ok);
-        if (!ok) {
-            throw std::runtime_error("tweak too large");
+    qlonglong components[4] = {};
+    int count = 0;
+    int begin = 0;
+    for (int i = 0; i <= raw.size(); ++i) {
+        if (i < raw.size() && raw[i] != u'.') {
+            continue;
         }
+        if (count == 4) {
+            return "too many version components";
+        }
+        const auto *err = parseComponent(raw.mid(begin, i - begin), components[count]);
+        if (err != nullptr) {
+            return err;
+        }
+        ++count;
+        begin = i + 1;
     }
-}
 
-bool Version::operator==(const Version &that) const noexcept
-{
-    if (this->tweak.has_value() != that.tweak.has_value()) {
-        return false;
+    if (count < 3) {
+        return "too few version components";
     }
 
-    auto thistweak = this->tweak.value_or(0);
-    auto thattweak = that.tweak.value_or(0);
-
-    return std::tie(this->major, this->minor, this->patch, thistweak)
-      == std::tie(that.major, that.minor, that.patch, thattweak);
-}
+    version.major = components[0];
+    version.minor = components[1];
+    version.patch = components[2];
+    version.tweak = std::nullopt;
+    if (count == 4) {
+        version.tweak = components[3];
+    }
 
-bool Version::operator!=(const Version &that) const noexcept
-{
-    return !(*this == that);
+    return nullptr;
 }
 
-bool Version::operator<(const Version &that) const noexcept
-{
-    auto thistweak = this->tweak.value_or(0);
-    auto thattweak = that.tweak.value_or(0);
-
-    auto thisAsNumber = std::tie(this->major, this->minor, this->patch, thistweak);
-    auto thatAsNumber = std::tie(that.major, that.minor, that.patch, thattweak);
-
-    return thisAsNumber < thatAsNumber;
-}
+} // namespace
 
-bool Version::operator>(const Version &that) const noexcept
+utils::error::Result<Version> Version::parse(const QString &raw) noexcept
 {
-    auto thistweak = this->tweak.value_or(0);
-    auto thattweak = that.tweak.value_or(0);
-
-    auto thisAsNumber = std::tie(this->major, this->minor, this->patch, thistweak);
-    auto thatAsNumber = std::tie(that.major, that.minor, that.patch, thattweak);
+    Version version(0, 0, 0);
+    const auto *err = parseVersion(raw, version);
+    if (err != nullptr) {
+        LINGLONG_TRACE("parse version " + raw);
+        return LINGLONG_ERR(err);
+    }
 
-    return thisAsNumber > thatAsNumber;
+    return version;
 }
 
-bool Version::operator<=(const Version &that) const noexcept
-{
-    return (*this == that) || (*this < that);
-}
-
-bool Version::operator>=(const Version &that) const noexcept
+Version::Version(const QString &raw)
 {
-    return (*this == that) || (*this > that);
+    const auto *err = parseVersion(raw, *this);
+    if (err != nullptr) {
+        throw std::runtime_error(err);
+    }
 }
 
 QString Version::toString() const noexcept
 {
-    return QString("%1.%2.%3%4")
-      .arg(this->major)
-      .arg(this->minor)
-      .arg(this->patch)
-      .arg(this->tweak ? "." + QString::number(*this->tweak) : "");
+    if (!this->tweak) {
+        return QString::number(this->major) % '.' % QString::number(this->minor) % '.'
+          % QString::number(this->patch);
+    }
+
+    return QString::number(this->major) % '.' % QString::number(this->minor) % '.'
+      % QString::number(this->patch) % '.' % QString::number(*this->tweak);
 }
 } // namespace linglong::package
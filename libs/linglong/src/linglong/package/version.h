@@ -11,7 +11,11 @@
 
 #include <QString>
 
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
 #include <optional>
+#include <tuple>
 
 namespace linglong::package {
 
@@ -22,20 +26,84 @@ public:
     static utils::error::Result<Version> parse(const QString &raw) noexcept;
     explicit Version(const QString &raw);
 
+    constexpr Version(qlonglong major,
+                      qlonglong minor,
+                      qlonglong patch,
+                      std::optional<qlonglong> tweak = std::nullopt) noexcept
+        : major(major)
+        , minor(minor)
+        , patch(patch)
+        , tweak(tweak)
+    {
+    }
+
     qlonglong major = 0;
     qlonglong minor = 0;
     qlonglong patch = 0;
     std::optional<qlonglong> tweak = {};
 
-    bool operator==(const Version &that) const noexcept;
-    bool operator!=(const Version &that) const noexcept;
-    bool operator<(const Version &that) const noexcept;
-    bool operator>(const Version &that) const noexcept;
-    bool operator<=(const Version &that) const noexcept;
-    bool operator>=(const Version &that) const noexcept;
+    // NOTE: A missing tweak is ordered as 0, but 1.0.0 and 1.0.0.0 are not equal.
+    constexpr bool operator==(const Version &that) const noexcept
+    {
+        return this->tweak.has_value() == that.tweak.has_value()
+          && this->tuple() == that.tuple();
+    }
+
+    constexpr bool operator!=(const Version &that) const noexcept { return !(*this == that); }
+
+    constexpr bool operator<(const Version &that) const noexcept
+    {
+        return this->tuple() < that.tuple();
+    }
+
+    constexpr bool operator>(const Version &that) const noexcept
+    {
+        return this->tuple() > that.tuple();
+    }
+
+    constexpr bool operator<=(const Version &that) const noexcept
+    {
+        return (*this == that) || (*this < that);
+    }
+
+    constexpr bool operator>=(const Version &that) const noexcept
+    {
+        return (*this == that) || (*this > that);
+    }
+
+    constexpr std::size_t hash() const noexcept
+    {
+        std::size_t seed = this->tweak ? 1 : 0;
+        for (auto value : { this->major, this->minor, this->patch, this->tweak.value_or(0) }) {
+            seed ^= static_cast<std::size_t>(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
 
     QString toString() const noexcept;
+
+private:
+    constexpr std::tuple<qlonglong, qlonglong, qlonglong, qlonglong> tuple() const noexcept
+    {
+        return { this->major, this->minor, this->patch, this->tweak.value_or(0) };
+    }
 };
+
+inline uint qHash(const Version &version, uint seed = 0) noexcept
+{
+    return static_cast<uint>(version.hash()) ^ seed;
+}
 } // namespace linglong::package
 
+namespace std {
+template<>
+struct hash<linglong::package::Version>
+{
+    constexpr std::size_t operator()(const linglong::package::Version &version) const noexcept
+    {
+        return version.hash();
+    }
+};
+} // namespace std
+
 #endif
@@ -8,6 +8,9 @@
 
 #include "linglong/api/types/v1/Generators.hpp"
 #include "linglong/api/types/v1/PackageManager1ModifyRepoParameters.hpp"
+#include "linglong/api/types/v1/PackageManager1PruneResult.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyParameters.hpp"
+#include "linglong/api/types/v1/PackageManager1VerifyResult.hpp"
 #include "linglong/package/layer_file.h"
 #include "linglong/package/layer_packager.h"
 #include "linglong/utils/finally/finally.h"
@@ -22,10 +25,19 @@
 #include <QJsonArray>
 #include <QMetaObject>
 #include <QSettings>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cerrno>
+#include <set>
+#include <utility>
+
+#include <unistd.h>
 
 namespace linglong::service {
 
 namespace {
+
 template<typename T>
 QVariantMap toDBusReply(const utils::error::Result<T> &x) noexcept
 {
@@ -45,6 +57,31 @@ QVariantMap toDBusReply(int code, const QString &message) noexcept
     });
 }
 
+QVariantMap verifyReply(const repo::verifyResult &result) noexcept
+{
+    auto toStrings = [](const QStringList &list) {
+        std::vector<std::string> ret;
+        ret.reserve(list.size());
+        for (const auto &item : list) {
+            ret.push_back(item.toStdString());
+        }
+        return ret;
+    };
+
+    return utils::serialize::toQVariantMap(api::types::v1::PackageManager1VerifyResult{
+      .brokenLayers = toStrings(result.brokenLayers),
+      .corruptedObjects = toStrings(result.corruptedObjects),
+      .layers = result.layers,
+      .objects = result.objects,
+      .repairedLayers = toStrings(result.repairedLayers),
+      .code = 0,
+      .message = QString("%1 objects and %2 layers verified")
+                   .arg(result.objects)
+                   .arg(result.layers)
+                   .toStdString(),
+    });
+}
+
 utils::error::Result<package::FuzzyReference>
 fuzzyReferenceFromPackage(const api::types::v1::PackageManager1Package &pkg) noexcept
 {
@@ -75,6 +112,417 @@ PackageManager::PackageManager(linglong::repo::OSTreeRepo &repo, QObject *parent
     : QObject(parent)
     , repo(repo)
 {
+    this->pruneTimer.setSingleShot(true);
+    this->pruneTimer.setInterval(std::chrono::seconds(10));
+    connect(&this->pruneTimer, &QTimer::timeout, this, &PackageManager::pruneRepository);
+    this->sharedInfoTimer.setSingleShot(true);
+    this->sharedInfoTimer.setInterval(std::chrono::seconds(1));
+    connect(&this->sharedInfoTimer, &QTimer::timeout, this, &PackageManager::updateSharedInfo);
+    this->resumeUpgradeAllTimer.setSingleShot(true);
+    this->resumeUpgradeAllTimer.setInterval(std::chrono::seconds(10));
+    connect(&this->resumeUpgradeAllTimer,
+            &QTimer::timeout,
+            this,
+            &PackageManager::resumeUpgradeAll);
+    connect(&this->repo,
+            &linglong::repo::OSTreeRepo::sharedInfoChanged,
+            this,
+            &PackageManager::scheduleSharedInfoUpdate);
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]() {
+        this->pruneFuture.waitForFinished();
+        this->emptyTrashFuture.waitForFinished();
+        this->sharedInfoFuture.waitForFinished();
+        this->verifyFuture.waitForFinished();
+        if (!this->changedSharedInfo.isEmpty()) {
+            this->sharedInfoTimer.stop();
+            const QStringList dirs(this->changedSharedInfo.begin(),
+                                   this->changedSharedInfo.end());
+            this->changedSharedInfo.clear();
+            this->repo.updateSharedInfo(dirs);
+        }
+    });
+
+    // NOTE: Clean up layers left in the trash by a previous run.
+    this->schedulePrune();
+}
+
+void PackageManager::schedulePrune() noexcept
+{
+    // NOTE: Restarting the timer coalesces removals in a row into one prune.
+    this->pruneTimer.start();
+}
+
+void PackageManager::pruneRepository() noexcept
+{
+    // NOTE: Objects of an ongoing pull are not referenced yet, pruning now
+    // would remove them.
+    if (!this->taskMap.empty() || this->pruning || this->emptyTrashFuture.isRunning()
+        || this->verifyFuture.isRunning()) {
+        this->schedulePrune();
+        return;
+    }
+
+    this->pruneInWorker([](utils::error::Result<quint64> &result) {
+        if (!result) {
+            qWarning() << result.error();
+        }
+    });
+}
+
+void PackageManager::pruneInWorker(
+  std::function<void(utils::error::Result<quint64> &)> finished) noexcept
+{
+    // NOTE:
+    // Traversing all commits of a large repository takes a while, so objects
+    // are pruned in a worker instead of blocking other clients. The future
+    // may not be finished yet when the result arrives, so pruning is tracked
+    // by a flag in this thread.
+    this->pruning = true;
+    this->pruneFuture = QtConcurrent::run([this, finished = std::move(finished)]() {
+        auto result = std::make_shared<utils::error::Result<quint64>>(this->repo.prune());
+        QMetaObject::invokeMethod(
+          this,
+          [this, finished, result]() {
+              this->pruning = false;
+              finished(*result);
+              this->emptyTrash();
+              this->startQueuedTasks();
+          },
+          Qt::QueuedConnection);
+    });
+}
+
+void PackageManager::emptyTrash() noexcept
+{
+    if (this->emptyTrashFuture.isRunning()) {
+        return;
+    }
+
+    this->emptyTrashFuture = QtConcurrent::run([&repo = this->repo]() {
+        auto result = repo.emptyTrash();
+        if (!result) {
+            qWarning() << result.error();
+        }
+    });
+}
+
+void PackageManager::preemptBackgroundTasks() noexcept
+{
+    for (const auto &[_, task] : this->taskMap) {
+        if (task->priority() != InstallTask::Background) {
+            continue;
+        }
+
+        // NOTE:
+        // Objects fetched so far are kept, see OSTreeRepo::pull, so the task
+        // resumes where it stopped once it is started again.
+        qInfo() << "preempt background task" << task->taskID();
+        task->cancelTask();
+        task->updateStatus(InstallTask::Canceled,
+                           "preempted by an interactive task, it will be resumed later");
+        this->resumeUpgradeAllTimer.start();
+    }
+}
+
+void PackageManager::resumeUpgradeAll() noexcept
+{
+    if (!this->taskMap.empty() || this->pruning || this->verifyFuture.isRunning()) {
+        this->resumeUpgradeAllTimer.start();
+        return;
+    }
+
+    auto result = this->UpgradeAll();
+    qInfo() << "resume upgrading all applications:" << result.value("message").toString();
+}
+
+void PackageManager::queueTask(std::function<void()> task) noexcept
+{
+    this->queuedTasks.push_back(std::move(task));
+    this->startQueuedTasks();
+}
+
+void PackageManager::startQueuedTasks() noexcept
+{
+    if (this->taskRunning || this->pruning || this->queuedTasks.empty()) {
+        return;
+    }
+
+    // NOTE: Set before the task starts, so that tasks queued meanwhile wait for it.
+    this->taskRunning = true;
+    auto task = std::move(this->queuedTasks.front());
+    this->queuedTasks.pop_front();
+    QMetaObject::invokeMethod(
+      this,
+      [this, task = std::move(task)]() {
+          task();
+          this->taskRunning = false;
+          this->startQueuedTasks();
+      },
+      Qt::QueuedConnection);
+}
+
+void PackageManager::scheduleSharedInfoUpdate(const QStringList &dirs) noexcept
+{
+    this->changedSharedInfo.unite(QSet<QString>(dirs.begin(), dirs.end()));
+    // NOTE: Restarting the timer coalesces a batch of installs and upgrades
+    // into one run of each tool.
+    this->sharedInfoTimer.start();
+}
+
+void PackageManager::updateSharedInfo() noexcept
+{
+    if (this->sharedInfoFuture.isRunning()) {
+        this->sharedInfoTimer.start();
+        return;
+    }
+
+    const QStringList dirs(this->changedSharedInfo.begin(), this->changedSharedInfo.end());
+    this->changedSharedInfo.clear();
+    this->sharedInfoFuture = QtConcurrent::run([&repo = this->repo, dirs]() {
+        repo.updateSharedInfo(dirs);
+    });
+}
+
+utils::error::Result<std::vector<api::types::v1::PackageInfo>>
+PackageManager::removeUnusedLayers() noexcept
+{
+    LINGLONG_TRACE("remove unused layers");
+
+    // NOTE:
+    // The dependency graph is derived from info.json of installed layers,
+    // which the local index of the repository keeps up to date on every
+    // install and removal. Applications are the roots, a base or runtime is
+    // used if an application or a used runtime depends on it.
+    auto pkgInfos = this->repo.listLocal();
+    if (!pkgInfos) {
+        return LINGLONG_ERR(pkgInfos);
+    }
+
+    std::map<QString, const api::types::v1::PackageInfo *> runtimeLayers;
+    std::vector<const api::types::v1::PackageInfo *> pending;
+    for (const auto &info : *pkgInfos) {
+        if (info.kind == "app") {
+            pending.push_back(&info);
+            continue;
+        }
+
+        if (info.packageInfoModule != "runtime") {
+            continue;
+        }
+
+        auto ref = package::Reference::fromPackageInfo(info);
+        if (!ref) {
+            qWarning() << "Ignore invalid layer" << ref.error();
+            continue;
+        }
+
+        runtimeLayers.emplace(ref->toString(), &info);
+    }
+
+    std::set<QString> used;
+    auto markUsed = [this, &used, &runtimeLayers, &pending](const std::string &dependency) {
+        auto fuzzyRef = package::FuzzyReference::parse(QString::fromStdString(dependency));
+        if (!fuzzyRef) {
+            qWarning() << "Ignore invalid dependency" << fuzzyRef.error();
+            return;
+        }
+
+        // NOTE: The same version is chosen when the application runs.
+        auto ref = this->repo.clearReference(*fuzzyRef,
+                                             {
+                                               .fallbackToRemote = false // NOLINT
+                                             });
+        if (!ref) {
+            qWarning() << "Dependency" << fuzzyRef->toString() << "not installed";
+            return;
+        }
+
+        if (!used.insert(ref->toString()).second) {
+            return;
+        }
+
+        auto layer = runtimeLayers.find(ref->toString());
+        if (layer != runtimeLayers.end()) {
+            pending.push_back(layer->second);
+        }
+    };
+
+    while (!pending.empty()) {
+        const auto *info = pending.back();
+        pending.pop_back();
+
+        if (info->runtime) {
+            markUsed(*info->runtime);
+        }
+        if (!info->base.empty()) {
+            markUsed(info->base);
+        }
+    }
+
+    // NOTE: The unused layers are removed together, or none of them.
+    std::vector<api::types::v1::PackageInfo> removed;
+    std::vector<std::pair<package::Reference, bool>> layers;
+    for (const auto &info : *pkgInfos) {
+        if (info.kind == "app") {
+            continue;
+        }
+
+        auto ref = package::Reference::fromPackageInfo(info);
+        if (!ref) {
+            continue;
+        }
+
+        if (used.find(ref->toString()) != used.end()) {
+            continue;
+        }
+
+        layers.emplace_back(*ref, info.packageInfoModule == "develop");
+        removed.push_back(info);
+    }
+
+    if (layers.empty()) {
+        return removed;
+    }
+
+    auto result = this->repo.remove(layers);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return removed;
+}
+
+auto PackageManager::Prune() noexcept -> QVariantMap
+{
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
+    if (this->pruning) {
+        return toDBusReply(-1, "The repository is being pruned, please try again later.");
+    }
+
+    // NOTE: A running task may be installing the runtime or base it needs.
+    if (!this->taskMap.empty()) {
+        return toDBusReply(-1, "Some tasks are running, please try again later.");
+    }
+
+    this->pruneTimer.stop();
+
+    auto removed = this->removeUnusedLayers();
+    if (!removed) {
+        return toDBusReply(removed);
+    }
+
+    auto taskID = QUuid::createUuid();
+    auto taskPtr = std::make_shared<InstallTask>(taskID);
+    connect(taskPtr.get(), &InstallTask::TaskChanged, this, &PackageManager::TaskChanged);
+
+    // NOTE: The result is reported by PruneFinished and the status of the
+    // task once the worker finishes.
+    this->pruneInWorker(
+      [this, taskPtr, packages = std::move(*removed)](utils::error::Result<quint64> &reclaimed) {
+          QVariantMap reply;
+          if (reclaimed) {
+              reply = utils::serialize::toQVariantMap(api::types::v1::PackageManager1PruneResult{
+                .packages = packages,
+                .reclaimedBytes = static_cast<int64_t>(*reclaimed),
+                .code = 0,
+                .message = QString("%1 bytes reclaimed").arg(*reclaimed).toStdString(),
+              });
+          } else {
+              reply = toDBusReply(reclaimed);
+          }
+
+          Q_EMIT this->PruneFinished(taskPtr->taskID(), reply);
+          const auto message = reply.value("message").toString();
+          if (reply.value("code").toInt() != 0) {
+              taskPtr->updateStatus(InstallTask::Failed, message);
+              return;
+          }
+          taskPtr->updateStatus(InstallTask::Success, message);
+      });
+
+    return utils::serialize::toQVariantMap(api::types::v1::PackageManager1ResultWithTaskID{
+      .taskID = taskID.toString(QUuid::WithoutBraces).toStdString(),
+      .code = 0,
+      .message = "Pruning the repository",
+    });
+}
+
+auto PackageManager::Verify(const QVariantMap &parameters) noexcept -> QVariantMap
+{
+    auto paras = utils::serialize::fromQVariantMap<api::types::v1::PackageManager1VerifyParameters>(
+      parameters);
+    if (!paras) {
+        return toDBusReply(paras);
+    }
+
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
+    // NOTE: Objects being pruned would be reported as corrupted.
+    if (this->pruning) {
+        return toDBusReply(-1, "The repository is being pruned, please try again later.");
+    }
+
+    const auto repair = paras->repair.value_or(false);
+    // NOTE: Repairing replaces layers and objects a running task may be using.
+    if (repair && !this->taskMap.empty()) {
+        return toDBusReply(-1, "Some tasks are running, please try again later.");
+    }
+
+    auto taskID = QUuid::createUuid();
+    auto taskPtr = std::make_shared<InstallTask>(taskID);
+    connect(taskPtr.get(), &InstallTask::TaskChanged, this, &PackageManager::TaskChanged);
+
+    // NOTE:
+    // Checking every object of a large repository takes minutes, so it runs
+    // in a worker instead of blocking other clients. The result is reported
+    // by VerifyFinished and the status of the task once it finishes.
+    // The worker must not use the local index, which tasks update meanwhile,
+    // so it is given the layers and the repaired ones are reindexed here.
+    this->verifyFuture =
+      QtConcurrent::run([this, repair, taskPtr, layers = this->repo.listLayers()]() {
+          auto result = this->repo.verify({ .repair = repair, .layers = layers });
+          QVariantMap reply;
+          QStringList repaired;
+          if (result) {
+              reply = verifyReply(*result);
+              repaired = result->repairedLayers;
+          } else {
+              reply = toDBusReply(result);
+          }
+
+          QMetaObject::invokeMethod(
+            this,
+            [this, taskPtr, reply, repaired]() mutable {
+                if (!repaired.isEmpty()) {
+                    auto ret = this->repo.reindexLayers(repaired);
+                    if (!ret) {
+                        reply = toDBusReply(ret);
+                    }
+                    // NOTE: Broken checkouts were moved into the trash.
+                    this->schedulePrune();
+                }
+
+                Q_EMIT this->VerifyFinished(taskPtr->taskID(), reply);
+                const auto message = reply.value("message").toString();
+                if (reply.value("code").toInt() != 0) {
+                    taskPtr->updateStatus(InstallTask::Failed, message);
+                    return;
+                }
+                taskPtr->updateStatus(InstallTask::Success, message);
+            },
+            Qt::QueuedConnection);
+      });
+
+    return utils::serialize::toQVariantMap(api::types::v1::PackageManager1ResultWithTaskID{
+      .taskID = taskID.toString(QUuid::WithoutBraces).toStdString(),
+      .code = 0,
+      .message = repair ? "Repairing the repository" : "Verifying the repository",
+    });
 }
 
 auto PackageManager::getConfiguration() const noexcept -> QVariantMap
@@ -89,6 +537,11 @@ auto PackageManager::setConfiguration(const QVariantMap &parameters) noexcept ->
         return toDBusReply(cfg);
     }
 
+    // NOTE: A running task pulls from the remote the configuration points to.
+    if (this->taskRunning) {
+        return toDBusReply(-1, "Some tasks are running, please try again later.");
+    }
+
     auto result = this->repo.setConfig(*cfg);
     if (!result) {
         return toDBusReply(result);
@@ -99,6 +552,20 @@ auto PackageManager::setConfiguration(const QVariantMap &parameters) noexcept ->
 
 auto PackageManager::InstallLayer(const QDBusUnixFileDescriptor &fd) noexcept -> QVariantMap
 {
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
+    // NOTE: Objects imported meanwhile would be pruned, as nothing refers to them yet.
+    if (this->pruning) {
+        return toDBusReply(-1, "The repository is being pruned, please try again later.");
+    }
+
+    // NOTE: A running task holds a transaction of the repository open while pulling.
+    if (this->taskRunning) {
+        return toDBusReply(-1, "Some tasks are running, please try again later.");
+    }
+
     const auto layerFile =
       package::LayerFile::New(QString("/proc/%1/fd/%2").arg(getpid()).arg(fd.fileDescriptor()));
     if (!layerFile) {
@@ -106,32 +573,51 @@ auto PackageManager::InstallLayer(const QDBusUnixFileDescriptor &fd) noexcept ->
     }
     Q_ASSERT(*layerFile != nullptr);
 
-    package::LayerPackager layerPackager;
-    auto layerDir = layerPackager.unpack(**layerFile);
-    if (!layerDir) {
-        return toDBusReply(layerDir);
+    auto layerInfo = (*layerFile)->metaInfo();
+    if (!layerInfo) {
+        return toDBusReply(layerInfo);
     }
 
-    auto result = this->repo.importLayerDir(*layerDir);
-    if (!result) {
-        return toDBusReply(result);
-    }
-
-    auto info = (*layerDir).info();
+    auto info = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(layerInfo->info);
     if (!info) {
         return toDBusReply(info);
     }
 
+    // NOTE: Mount the layer file by erofsfuse only if its image is not
+    // supported by package::ErofsReader.
+    auto result = this->repo.importLayerFile(**layerFile);
+    if (!result && result.error().code() == ENOTSUP) {
+        qInfo() << "unpack layer file:" << result.error().message();
+
+        package::LayerPackager layerPackager;
+        auto layerDir = layerPackager.unpack(**layerFile);
+        if (!layerDir) {
+            return toDBusReply(layerDir);
+        }
+
+        result = this->repo.importLayerDir(*layerDir, layerInfo->delta);
+    }
+    if (!result) {
+        return toDBusReply(result);
+    }
+
     auto ref = package::Reference::fromPackageInfo(*info);
     if (!ref) {
         return toDBusReply(ref);
     }
-    this->repo.exportReference(*ref);
+    result = this->repo.exportReference(*ref);
+    if (!result) {
+        return toDBusReply(result);
+    }
     return toDBusReply(0, "Install layer file success.");
 }
 
 auto PackageManager::Install(const QVariantMap &parameters) noexcept -> QVariantMap
 {
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
     auto paras =
       utils::serialize::fromQVariantMap<api::types::v1::PackageManager1InstallParameters>(
         parameters);
@@ -169,22 +655,21 @@ auto PackageManager::Install(const QVariantMap &parameters) noexcept -> QVariant
         return toDBusReply(-1, ref->toString() + " is installing");
     }
 
+    this->preemptBackgroundTasks();
+
     auto taskID = QUuid::createUuid();
     auto taskPtr = std::make_shared<InstallTask>(taskID);
     connect(taskPtr.get(), &InstallTask::TaskChanged, this, &PackageManager::TaskChanged);
 
     auto reference = *ref;
 
-    QMetaObject::invokeMethod(
-      QCoreApplication::instance(),
-      [this, reference, taskPtr, develop] {
-          auto _ = utils::finally::finally([this, reference]() {
-              this->taskMap.erase(reference.toString());
-          });
+    this->queueTask([this, reference, taskPtr, develop] {
+        auto _ = utils::finally::finally([this, reference]() {
+            this->taskMap.erase(reference.toString());
+        });
 
-          this->Install(taskPtr, reference, develop);
-      },
-      Qt::QueuedConnection);
+        this->Install(taskPtr, reference, develop);
+    });
 
     // FIXME: Install task contains module, we should not just use ref as key.
     taskMap.emplace(ref->toString(), std::move(taskPtr));
@@ -214,101 +699,113 @@ void PackageManager::Install(const std::shared_ptr<InstallTask> &taskContext,
         return;
     }
 
-    utils::Transaction t;
-
-    this->repo.pull(taskContext, ref, develop);
-    if (taskContext->currentStatus() == InstallTask::Failed
-        || taskContext->currentStatus() == InstallTask::Canceled) {
+    // NOTE:
+    // Resolve the whole dependency set before downloading anything, so that
+    // the application and its missing runtime and base can be fetched in one
+    // pull. Only info.json of the application is fetched here.
+    auto info = this->repo.getRemoteInfo(ref, develop, taskContext->cancellable());
+    if (!info) {
+        taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(info).message());
         return;
     }
-    t.addRollBack([this, &ref, develop]() noexcept {
-        auto result = this->repo.remove(ref, develop);
-        if (!result) {
-            qCritical() << result.error();
-            Q_ASSERT(false);
-        }
-    });
 
-    auto layerDir = this->repo.getLayerDir(ref);
-    if (!layerDir) {
-        taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(layerDir).message());
+    std::vector<package::Reference> refs{ ref };
+
+    auto result = this->addDependencies(*info, develop, refs);
+    if (!result) {
+        taskContext->updateStatus(InstallTask::Failed, result.error().message());
         return;
     }
 
-    auto info = layerDir->info();
-    if (!info) {
-        taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(info).message());
+    QStringList refNames;
+    for (const auto &item : refs) {
+        refNames.append(item.toString());
+    }
+    taskContext->updateStatus(InstallTask::installApplication,
+                              "Installing " + refNames.join(", "));
+
+    this->repo.pull(taskContext, refs, develop);
+    if (taskContext->currentStatus() == InstallTask::Failed
+        || taskContext->currentStatus() == InstallTask::Canceled) {
         return;
     }
-    // for 'kind: app', check runtime and foundation
-    if (info->kind == "app") {
-        if (info->runtime) {
-            auto fuzzyRuntime =
-              package::FuzzyReference::parse(QString::fromStdString(*info->runtime));
-            if (!fuzzyRuntime) {
-                taskContext->updateStatus(InstallTask::Failed,
-                                          LINGLONG_ERRV(fuzzyRuntime).message());
-                return;
-            }
 
-            auto runtime = this->repo.clearReference(*fuzzyRuntime,
-                                                     {
-                                                       .forceRemote = true // NOLINT
-                                                     });
-            if (!runtime) {
-                taskContext->updateStatus(InstallTask::Failed, runtime.error().message());
-                return;
-            }
+    taskContext->updateStatus(InstallTask::postInstall, "Exporting " + ref.toString());
+    result = this->repo.exportReference(ref);
+    if (!result) {
+        qCritical() << result.error();
+    }
 
-            taskContext->updateStatus(InstallTask::installRuntime,
-                                      "Installing runtime " + runtime->toString());
-            this->repo.pull(taskContext, *runtime, develop);
-            if (taskContext->currentStatus() == InstallTask::Failed
-                || taskContext->currentStatus() == InstallTask::Canceled) {
-                return;
-            }
+    taskContext->updateStatus(InstallTask::Success, "Install " + ref.toString() + " success");
+}
 
-            auto runtimeRef = *runtime;
-            t.addRollBack([this, runtimeRef, develop]() noexcept {
-                auto result = this->repo.remove(runtimeRef, develop);
-                if (!result) {
-                    qCritical() << result.error();
-                    Q_ASSERT(false);
-                }
-            });
+utils::error::Result<void>
+PackageManager::addDependencies(const api::types::v1::PackageInfo &info,
+                                bool develop,
+                                std::vector<package::Reference> &refs) noexcept
+{
+    LINGLONG_TRACE("resolve dependencies of " + QString::fromStdString(info.appid));
+
+    auto addDependency = [this, &refs, develop](const std::string &dependency) noexcept
+      -> utils::error::Result<void> {
+        LINGLONG_TRACE("resolve dependency " + QString::fromStdString(dependency));
+
+        auto fuzzyRef = package::FuzzyReference::parse(QString::fromStdString(dependency));
+        if (!fuzzyRef) {
+            return LINGLONG_ERR(fuzzyRef);
         }
 
-        auto fuzzyBase = package::FuzzyReference::parse(QString::fromStdString(info->base));
-        if (!fuzzyBase) {
-            taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(info).message());
-            return;
+        auto dependencyRef = this->repo.clearReference(*fuzzyRef,
+                                                       {
+                                                         .forceRemote = true // NOLINT
+                                                       });
+        if (!dependencyRef) {
+            return LINGLONG_ERR(dependencyRef);
         }
 
-        auto base = this->repo.clearReference(*fuzzyBase,
-                                              {
-                                                .forceRemote = true // NOLINT
-                                              });
-        if (!base) {
-            taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(base).message());
-            return;
+        if (this->repo.getLayerDir(*dependencyRef, develop)) {
+            qInfo() << dependencyRef->toString() << "is already installed";
+            return LINGLONG_OK;
         }
 
-        taskContext->updateStatus(InstallTask::installBase, "Installing base " + base->toString());
-        this->repo.pull(taskContext, *base, develop);
-        if (taskContext->currentStatus() == InstallTask::Failed
-            || taskContext->currentStatus() == InstallTask::Canceled) {
-            return;
+        // NOTE: Applications upgraded together often share the runtime and base.
+        auto listed = std::find_if(refs.cbegin(), refs.cend(), [&dependencyRef](const auto &ref) {
+            return ref == *dependencyRef;
+        });
+        if (listed != refs.cend()) {
+            return LINGLONG_OK;
         }
+
+        refs.push_back(*dependencyRef);
+        return LINGLONG_OK;
+    };
+
+    // for 'kind: app', check runtime and foundation
+    if (info.kind != "app") {
+        return LINGLONG_OK;
     }
 
-    this->repo.exportReference(ref);
+    if (info.runtime) {
+        auto result = addDependency(*info.runtime);
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
 
-    taskContext->updateStatus(InstallTask::Success, "Install " + ref.toString() + " success");
-    t.commit();
+    auto result = addDependency(info.base);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
 }
 
 auto PackageManager::Uninstall(const QVariantMap &parameters) noexcept -> QVariantMap
 {
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
     auto paras =
       utils::serialize::fromQVariantMap<api::types::v1::PackageManager1UninstallParameters>(
         parameters);
@@ -321,6 +818,11 @@ auto PackageManager::Uninstall(const QVariantMap &parameters) noexcept -> QVaria
         return toDBusReply(fuzzyRef);
     }
 
+    // NOTE: A running task may be pulling or exporting the layer.
+    if (this->taskRunning) {
+        return toDBusReply(-1, "Some tasks are running, please try again later.");
+    }
+
     auto ref = this->repo.clearReference(*fuzzyRef,
                                          {
                                            .fallbackToRemote = false // NOLINT
@@ -335,6 +837,7 @@ auto PackageManager::Uninstall(const QVariantMap &parameters) noexcept -> QVaria
     if (!result) {
         return toDBusReply(result);
     }
+    this->schedulePrune();
 
     this->repo.unexportReference(*ref);
 
@@ -343,6 +846,10 @@ auto PackageManager::Uninstall(const QVariantMap &parameters) noexcept -> QVaria
 
 auto PackageManager::Update(const QVariantMap &parameters) noexcept -> QVariantMap
 {
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
     auto paras =
       utils::serialize::fromQVariantMap<api::types::v1::PackageManager1UninstallParameters>(
         parameters);
@@ -382,6 +889,8 @@ auto PackageManager::Update(const QVariantMap &parameters) noexcept -> QVariantM
             .arg(ref->version.toString()));
     }
 
+    this->preemptBackgroundTasks();
+
     auto taskID = QUuid::createUuid();
     auto taskPtr = std::make_shared<InstallTask>(taskID);
     connect(taskPtr.get(), &InstallTask::TaskChanged, this, &PackageManager::TaskChanged);
@@ -391,15 +900,12 @@ auto PackageManager::Update(const QVariantMap &parameters) noexcept -> QVariantM
 
     auto develop = paras->package.packageManager1PackageModule.value_or("runtime") == "develop";
 
-    QMetaObject::invokeMethod(
-      QCoreApplication::instance(),
-      [this, reference, newReference, taskPtr, develop] {
-          auto _ = utils::finally::finally([this, reference]() {
-              this->taskMap.erase(reference.toString());
-          });
-          this->Update(taskPtr, reference, newReference, develop);
-      },
-      Qt::QueuedConnection);
+    this->queueTask([this, reference, newReference, taskPtr, develop] {
+        auto _ = utils::finally::finally([this, reference]() {
+            this->taskMap.erase(reference.toString());
+        });
+        this->Update(taskPtr, reference, newReference, develop);
+    });
 
     // FIXME(black_desk):
     // taskPtr is updating ref to newRef, but we just using ref as key. Does it really make sense?
@@ -432,6 +938,7 @@ void PackageManager::Update(const std::shared_ptr<InstallTask> &taskContext,
             qCritical() << result.error();
         }
         this->repo.unexportReference(newRef);
+        this->schedulePrune();
     });
 
     auto result = this->repo.remove(ref, develop);
@@ -439,14 +946,205 @@ void PackageManager::Update(const std::shared_ptr<InstallTask> &taskContext,
         taskContext->updateStatus(InstallTask::Failed, result.error().message());
         return;
     }
+    this->schedulePrune();
 
     this->repo.unexportReference(ref);
-    this->repo.exportReference(newRef);
+    result = this->repo.exportReference(newRef);
+    if (!result) {
+        qCritical() << result.error();
+    }
 
     taskContext->updateStatus(InstallTask::Success, "Upgrade " + ref.toString() + " success");
     t.commit();
 }
 
+auto PackageManager::UpgradeAll() noexcept -> QVariantMap
+{
+    if (this->verifyFuture.isRunning()) {
+        return toDBusReply(-1, "The repository is being verified, please try again later.");
+    }
+
+    if (this->pruning) {
+        return toDBusReply(-1, "The repository is being pruned, please try again later.");
+    }
+
+    // NOTE: Upgrading removes the old versions a running task may depend on.
+    if (!this->taskMap.empty()) {
+        return toDBusReply(-1, "Some tasks are running, please try again later.");
+    }
+
+    auto localInfos = this->repo.listLocal();
+    if (!localInfos) {
+        return toDBusReply(localInfos);
+    }
+
+    // NOTE: Only the latest installed version of every application is upgraded.
+    std::map<QString, package::Reference> installed;
+    for (const auto &info : *localInfos) {
+        if (info.kind != "app" || info.packageInfoModule == "develop") {
+            continue;
+        }
+
+        auto ref = package::Reference::fromPackageInfo(info);
+        if (!ref) {
+            qWarning() << ref.error();
+            continue;
+        }
+
+        const auto key = QString("%1/%2/%3").arg(ref->channel, ref->id, ref->arch.toString());
+        auto it = installed.find(key);
+        if (it == installed.end()) {
+            installed.emplace(key, *ref);
+        } else if (it->second.version < ref->version) {
+            it->second = *ref;
+        }
+    }
+
+    std::vector<package::Reference> refs;
+    std::vector<package::FuzzyReference> fuzzyRefs;
+    for (const auto &[_, ref] : installed) {
+        auto fuzzyRef =
+          package::FuzzyReference::create(ref.channel, ref.id, std::nullopt, ref.arch);
+        if (!fuzzyRef) {
+            qWarning() << fuzzyRef.error();
+            continue;
+        }
+
+        refs.push_back(ref);
+        fuzzyRefs.push_back(*fuzzyRef);
+    }
+
+    // NOTE:
+    // The new versions of all applications are resolved from one listing of
+    // the remote, instead of searching the remote for every application.
+    auto newRefs = this->repo.clearReferences(fuzzyRefs);
+    std::vector<std::pair<package::Reference, package::Reference>> upgrades;
+    for (std::size_t i = 0; i < refs.size(); ++i) {
+        if (!newRefs[i]) {
+            qWarning() << newRefs[i].error();
+            continue;
+        }
+
+        if (refs[i].version < newRefs[i]->version) {
+            upgrades.emplace_back(refs[i], *newRefs[i]);
+        }
+    }
+
+    if (upgrades.empty()) {
+        return toDBusReply(0, "All applications are up to date.");
+    }
+
+    // NOTE: Upgrading all applications is mostly started by the timer, it
+    // yields to interactive tasks, see preemptBackgroundTasks().
+    auto taskID = QUuid::createUuid();
+    auto taskPtr = std::make_shared<InstallTask>(taskID, InstallTask::Background);
+    connect(taskPtr.get(), &InstallTask::TaskChanged, this, &PackageManager::TaskChanged);
+
+    this->queueTask([this, upgrades, taskPtr] {
+        auto _ = utils::finally::finally([this]() {
+            this->taskMap.erase(upgradeAllTaskKey);
+        });
+        this->UpgradeAll(taskPtr, upgrades);
+    });
+
+    taskMap.emplace(upgradeAllTaskKey, std::move(taskPtr));
+
+    return utils::serialize::toQVariantMap(api::types::v1::PackageManager1ResultWithTaskID{
+      .taskID = taskID.toString(QUuid::WithoutBraces).toStdString(),
+      .code = 0,
+      .message = QString("%1 applications are upgrading").arg(upgrades.size()).toStdString(),
+    });
+}
+
+void PackageManager::UpgradeAll(
+  const std::shared_ptr<InstallTask> &taskContext,
+  const std::vector<std::pair<package::Reference, package::Reference>> &upgrades) noexcept
+{
+    LINGLONG_TRACE("upgrade all applications");
+
+    taskContext->updateStatus(InstallTask::preInstall, "prepare upgrading applications");
+
+    std::vector<package::Reference> refs;
+    for (const auto &upgrade : upgrades) {
+        refs.push_back(upgrade.second);
+    }
+
+    auto infos = this->repo.getRemoteInfo(refs, false, taskContext->cancellable());
+    if (!infos) {
+        taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(infos).message());
+        return;
+    }
+
+    for (const auto &info : *infos) {
+        auto result = this->addDependencies(info, false, refs);
+        if (!result) {
+            taskContext->updateStatus(InstallTask::Failed, result.error().message());
+            return;
+        }
+    }
+
+    QStringList refNames;
+    for (const auto &item : refs) {
+        refNames.append(item.toString());
+    }
+    taskContext->updateStatus(InstallTask::installApplication,
+                              "Installing " + refNames.join(", "));
+
+    // NOTE:
+    // All new versions and their dependencies are fetched in one pull, which
+    // installs either all or none of them.
+    this->repo.pull(taskContext, refs, false);
+    if (taskContext->currentStatus() == InstallTask::Failed
+        || taskContext->currentStatus() == InstallTask::Canceled) {
+        return;
+    }
+
+    taskContext->updateStatus(InstallTask::postInstall, "Exporting applications");
+
+    // NOTE:
+    // All new versions are exported before any old version is touched. If one
+    // of them fails, the new versions are removed again and the old ones are
+    // exported as they were.
+    auto _ = utils::finally::finally([this]() {
+        this->schedulePrune();
+    });
+    utils::Transaction transaction;
+    for (const auto &[ref, newRef] : upgrades) {
+        transaction.addRollBack([this, ref = ref, newRef = newRef]() noexcept {
+            this->repo.unexportReference(newRef);
+            auto result = this->repo.remove(newRef);
+            if (!result) {
+                qCritical() << result.error();
+            }
+
+            result = this->repo.exportReference(ref);
+            if (!result) {
+                qCritical() << result.error();
+            }
+        });
+
+        auto result = this->repo.exportReference(newRef);
+        if (!result) {
+            taskContext->updateStatus(InstallTask::Failed, LINGLONG_ERRV(result).message());
+            return;
+        }
+    }
+    transaction.commit();
+
+    for (const auto &[ref, newRef] : upgrades) {
+        this->repo.unexportReference(ref);
+
+        // NOTE: The new version is usable already, keep the old one if it can not be removed.
+        auto result = this->repo.remove(ref);
+        if (!result) {
+            qWarning() << result.error();
+        }
+    }
+
+    taskContext->updateStatus(InstallTask::Success,
+                              QString("Upgrade %1 applications success").arg(upgrades.size()));
+}
+
 auto PackageManager::Search(const QVariantMap &parameters) noexcept -> QVariantMap
 {
     auto paras = utils::serialize::fromQVariantMap<api::types::v1::PackageManager1SearchParameters>(
@@ -12,8 +12,15 @@
 
 #include <QDBusArgument>
 #include <QDBusContext>
+#include <QFuture>
 #include <QList>
 #include <QObject>
+#include <QSet>
+#include <QTimer>
+
+#include <deque>
+#include <functional>
+#include <vector>
 
 namespace linglong::service {
 
@@ -38,6 +45,11 @@ public:
                         const package::Reference &ref,
                         const package::Reference &newRef,
                         bool develop) noexcept;
+    // Pull the new versions of all applications together, the pairs are
+    // (installed reference, new reference).
+    void UpgradeAll(
+      const std::shared_ptr<InstallTask> &taskContext,
+      const std::vector<std::pair<package::Reference, package::Reference>> &upgrades) noexcept;
 
 public Q_SLOT:
     auto getConfiguration() const noexcept -> QVariantMap;
@@ -46,15 +58,67 @@ public Q_SLOT:
     auto InstallLayer(const QDBusUnixFileDescriptor &fd) noexcept -> QVariantMap;
     auto Uninstall(const QVariantMap &parameters) noexcept -> QVariantMap;
     auto Update(const QVariantMap &parameters) noexcept -> QVariantMap;
+    auto UpgradeAll() noexcept -> QVariantMap;
     auto Search(const QVariantMap &parameters) noexcept -> QVariantMap;
+    auto Prune() noexcept -> QVariantMap;
+    auto Verify(const QVariantMap &parameters) noexcept -> QVariantMap;
     void CancelTask(const QString &taskID) noexcept;
 
 Q_SIGNALS:
     void TaskChanged(QString taskID, QString percentage, QString message, int status);
+    // Emitted with a PackageManager1VerifyResult before the task of Verify
+    // finishes.
+    void VerifyFinished(QString taskID, QVariantMap result);
+    // Emitted with a PackageManager1PruneResult before the task of Prune
+    // finishes.
+    void PruneFinished(QString taskID, QVariantMap result);
 
 private:
+    // Removed layers are cleaned up in batch once no removal happened for a
+    // while, see pruneRepository().
+    void schedulePrune() noexcept;
+    void pruneRepository() noexcept;
+    // finished is called in this thread once the worker pruned the repository.
+    void pruneInWorker(std::function<void(utils::error::Result<quint64> &)> finished) noexcept;
+    void emptyTrash() noexcept;
+    utils::error::Result<std::vector<api::types::v1::PackageInfo>> removeUnusedLayers() noexcept;
+    // Append the runtime and base of an application to refs, unless they are
+    // installed or listed already.
+    utils::error::Result<void> addDependencies(const api::types::v1::PackageInfo &info,
+                                               bool develop,
+                                               std::vector<package::Reference> &refs) noexcept;
+    // Caches in entries/share are regenerated in background once exports
+    // settle down, see updateSharedInfo().
+    void scheduleSharedInfoUpdate(const QStringList &dirs) noexcept;
+    void updateSharedInfo() noexcept;
+    // Background tasks are cancelled when an interactive task starts, and
+    // started again once no task is running.
+    void preemptBackgroundTasks() noexcept;
+    void resumeUpgradeAll() noexcept;
+    // Tasks run one after another, and not while the repository is being
+    // pruned, which would remove the objects they pull. A running task
+    // serves D-Bus from nested event loops, calls served there only queue
+    // their tasks, or are refused if they modify the repository.
+    void queueTask(std::function<void()> task) noexcept;
+    void startQueuedTasks() noexcept;
+
+    static constexpr auto upgradeAllTaskKey = "UpgradeAll";
+
     linglong::repo::OSTreeRepo &repo; // NOLINT
     std::map<QString, std::shared_ptr<InstallTask>> taskMap;
+    QTimer pruneTimer;
+    bool pruning = false;
+    QFuture<void> pruneFuture;
+    QFuture<void> emptyTrashFuture;
+    QTimer sharedInfoTimer;
+    QSet<QString> changedSharedInfo;
+    QFuture<void> sharedInfoFuture;
+    QTimer resumeUpgradeAllTimer;
+    bool taskRunning = false;
+    std::deque<std::function<void()>> queuedTasks;
+    // NOTE: Other tasks are refused while the repository is being verified,
+    // which may modify it from a worker thread.
+    QFuture<void> verifyFuture;
 };
 
 } // namespace linglong::service
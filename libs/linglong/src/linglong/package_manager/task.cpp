@@ -9,10 +9,13 @@
 #include <QDebug>
 #include <QUuid>
 
+#include <algorithm>
+
 namespace linglong::service {
 
-InstallTask::InstallTask(const QUuid &taskID, QObject *parent)
+InstallTask::InstallTask(const QUuid &taskID, Priority priority, QObject *parent)
     : QObject(parent)
+    , m_priority(priority)
     , m_taskID(taskID)
     , m_cancelFlag(g_cancellable_new())
 {
@@ -23,20 +26,20 @@ InstallTask::~InstallTask()
     g_object_unref(m_cancelFlag);
 }
 
-void InstallTask::updateTask(double currentPercentage,
-                             double totalPercentage,
-                             const QString &message) noexcept
+void InstallTask::updateTask(double current, double total, const QString &message) noexcept
 {
-    if (totalPercentage == 0) {
+    if (total == 0) {
         return;
     }
-    auto increase = (currentPercentage / totalPercentage) * partsMap[Success];
+
+    auto progress = std::min(current / total, 1.0);
     auto partPercentage = QString("%1/%2(%3%)")
-                            .arg(currentPercentage)
-                            .arg(totalPercentage)
-                            .arg(formatPercentage(currentPercentage / totalPercentage * 100));
+                            .arg(current)
+                            .arg(total)
+                            .arg(QString::number(progress * 100, 'g', 4));
+    m_statePercentage = std::max(m_statePercentage, progress * downloadPercentage);
     Q_EMIT PartChanged(taskID(), partPercentage, message, m_status, {});
-    Q_EMIT TaskChanged(taskID(), formatPercentage(increase), message, m_status, {});
+    Q_EMIT TaskChanged(taskID(), formatPercentage(), message, m_status, {});
 }
 
 void InstallTask::updateStatus(Status newStatus, const QString &message) noexcept
@@ -45,8 +48,8 @@ void InstallTask::updateStatus(Status newStatus, const QString &message) noexcep
 
     if (newStatus == Success || newStatus == Failed || newStatus == Canceled) {
         m_statePercentage = 100;
-    } else {
-        m_statePercentage += partsMap[m_status];
+    } else if (newStatus == postInstall) {
+        m_statePercentage = downloadPercentage;
     }
 
     m_status = newStatus;
@@ -59,8 +62,8 @@ void InstallTask::updateStatus(Status newStatus, linglong::utils::error::Error e
 
     if (newStatus == Success || newStatus == Failed || newStatus == Canceled) {
         m_statePercentage = 100;
-    } else {
-        m_statePercentage += partsMap[m_status];
+    } else if (newStatus == postInstall) {
+        m_statePercentage = downloadPercentage;
     }
 
     Q_EMIT TaskChanged(taskID(), formatPercentage(), err.message(), newStatus, {});
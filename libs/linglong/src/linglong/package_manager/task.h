@@ -8,7 +8,6 @@
 
 #include <gio/gio.h>
 
-#include <QMap>
 #include <QObject>
 #include <QString>
 #include <QUuid>
@@ -19,7 +18,14 @@ class InstallTask : public QObject
 {
     Q_OBJECT
 public:
-    explicit InstallTask(const QUuid &taskID, QObject *parent = nullptr);
+    // Background tasks yield the disk, the CPU and the network to interactive
+    // tasks and running applications, see PackageManager.
+    enum Priority { Interactive, Background };
+    Q_ENUM(Priority)
+
+    explicit InstallTask(const QUuid &taskID,
+                         Priority priority = Interactive,
+                         QObject *parent = nullptr);
     ~InstallTask() override;
 
     enum Status {
@@ -35,14 +41,16 @@ public:
     };
     Q_ENUM(Status)
 
-    void updateTask(double currentPercentage,
-                    double totalPercentage,
-                    const QString &message = "") noexcept;
+    // Report the progress of downloading all parts of the task, current and
+    // total should be in bytes if known, otherwise in objects.
+    void updateTask(double current, double total, const QString &message = "") noexcept;
     void updateStatus(Status newStatus, const QString &message = "") noexcept;
     void updateStatus(Status newStatus, linglong::utils::error::Error) noexcept;
 
     [[nodiscard]] Status currentStatus() const noexcept { return m_status; }
 
+    [[nodiscard]] Priority priority() const noexcept { return m_priority; }
+
     [[nodiscard]] utils::error::Error &&currentError() noexcept { return std::move(m_err); }
 
     [[nodiscard]] QString taskID() const noexcept
@@ -63,16 +71,15 @@ Q_SIGNALS:
 private:
     QString formatPercentage(double increase = 0) const noexcept;
     Status m_status{ Queued };
+    Priority m_priority{ Interactive };
     utils::error::Error m_err;
     double m_statePercentage{ 0 };
     QUuid m_taskID;
     GCancellable *m_cancelFlag{ nullptr };
 
-    inline static QMap<Status, double> partsMap{ { Queued, 0 },       { Canceled, 0 },
-                                                 { preInstall, 10 },  { installRuntime, 20 },
-                                                 { installBase, 20 }, { installApplication, 20 },
-                                                 { postInstall, 20 }, { Success, 10 },
-                                                 { Failed, 10 } };
+    // Percentage of the whole task taken by downloading, the rest is taken by
+    // checking out and exporting after all parts downloaded.
+    inline static constexpr double downloadPercentage{ 90 };
 };
 
 } // namespace linglong::service
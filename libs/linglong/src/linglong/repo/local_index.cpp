@@ -0,0 +1,344 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/repo/local_index.h"
+
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace linglong::repo {
+
+namespace {
+
+constexpr char indexMagic[8] = "LLINDEX";
+constexpr quint32 indexVersion = 1;
+constexpr quint64 headerSize = 16;
+constexpr quint64 entrySize = 16;
+
+quint32 readUInt32(const char *data, quint64 offset) noexcept
+{
+    return qFromLittleEndian<quint32>(data + offset);
+}
+
+utils::error::Result<quint32> validate(const char *data, quint64 size) noexcept
+{
+    LINGLONG_TRACE("validate local index");
+
+    if (size < headerSize) {
+        return LINGLONG_ERR("file too small");
+    }
+
+    if (std::memcmp(data, indexMagic, sizeof(indexMagic)) != 0) {
+        return LINGLONG_ERR("magic number mismatch");
+    }
+
+    auto version = readUInt32(data, 8);
+    if (version != indexVersion) {
+        return LINGLONG_ERR(QString("unsupported version %1").arg(version));
+    }
+
+    auto count = readUInt32(data, 12);
+    if (headerSize + entrySize * count > size) {
+        return LINGLONG_ERR("entry table out of range");
+    }
+
+    QByteArray lastKey;
+    for (quint32 i = 0; i < count; ++i) {
+        const auto entry = headerSize + entrySize * i;
+        const quint64 keyOffset = readUInt32(data, entry);
+        const quint64 keyLength = readUInt32(data, entry + 4);
+        const quint64 valueOffset = readUInt32(data, entry + 8);
+        const quint64 valueLength = readUInt32(data, entry + 12);
+        if (keyOffset + keyLength > size || valueOffset + valueLength > size) {
+            return LINGLONG_ERR(QString("entry %1 out of range").arg(i));
+        }
+
+        auto key = QByteArray::fromRawData(data + keyOffset, static_cast<int>(keyLength));
+        if (i != 0 && !(lastKey < key)) {
+            return LINGLONG_ERR(QString("entry %1 is not sorted").arg(i));
+        }
+        lastKey = key;
+    }
+
+    return count;
+}
+
+QByteArray serialize(const LocalIndex::Entries &entries) noexcept
+{
+    const auto tableSize = headerSize + entrySize * entries.size();
+
+    QByteArray content(static_cast<int>(tableSize), 0);
+    std::memcpy(content.data(), indexMagic, sizeof(indexMagic));
+    qToLittleEndian<quint32>(indexVersion, content.data() + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(entries.size()), content.data() + 12);
+
+    quint64 entry = headerSize;
+    for (const auto &[key, value] : entries) {
+        auto *table = content.data() + entry;
+        qToLittleEndian<quint32>(static_cast<quint32>(content.size()), table);
+        qToLittleEndian<quint32>(static_cast<quint32>(key.size()), table + 4);
+        content.append(key);
+
+        table = content.data() + entry;
+        qToLittleEndian<quint32>(static_cast<quint32>(content.size()), table + 8);
+        qToLittleEndian<quint32>(static_cast<quint32>(value.size()), table + 12);
+        content.append(value);
+
+        entry += entrySize;
+    }
+
+    return content;
+}
+
+} // namespace
+
+LocalIndex::LocalIndex(const QString &path) noexcept
+    : file(path)
+{
+}
+
+LocalIndex::~LocalIndex()
+{
+    this->unmap();
+}
+
+void LocalIndex::unmap() noexcept
+{
+    if (this->mapped != nullptr) {
+        this->file.unmap(this->mapped);
+        this->mapped = nullptr;
+    }
+
+    if (this->file.isOpen()) {
+        this->file.close();
+    }
+}
+
+utils::error::Result<void> LocalIndex::open() noexcept
+{
+    LINGLONG_TRACE("open local index " + this->file.fileName());
+
+    this->unmap();
+
+    if (!this->file.open(QFile::ReadOnly)) {
+        return LINGLONG_ERR("open", this->file);
+    }
+
+    const auto size = this->file.size();
+    if (size < static_cast<qint64>(headerSize)) {
+        this->file.close();
+        return LINGLONG_ERR("file too small");
+    }
+
+    auto *mapped = this->file.map(0, size);
+    if (mapped == nullptr) {
+        this->file.close();
+        return LINGLONG_ERR("map", this->file);
+    }
+    this->mapped = mapped;
+
+    auto count = validate(reinterpret_cast<const char *>(mapped), size);
+    if (!count) {
+        this->unmap();
+        return LINGLONG_ERR(count);
+    }
+
+    this->count = *count;
+    this->buffer.clear();
+
+    return LINGLONG_OK;
+}
+
+const char *LocalIndex::data() const noexcept
+{
+    if (this->mapped != nullptr) {
+        return reinterpret_cast<const char *>(this->mapped);
+    }
+
+    return this->buffer.constData();
+}
+
+quint32 LocalIndex::size() const noexcept
+{
+    return this->count;
+}
+
+QByteArray LocalIndex::keyAt(quint32 pos) const noexcept
+{
+    Q_ASSERT(pos < this->count);
+    const auto entry = headerSize + entrySize * pos;
+    return QByteArray::fromRawData(this->data() + readUInt32(this->data(), entry),
+                                   static_cast<int>(readUInt32(this->data(), entry + 4)));
+}
+
+QByteArray LocalIndex::valueAt(quint32 pos) const noexcept
+{
+    Q_ASSERT(pos < this->count);
+    const auto entry = headerSize + entrySize * pos;
+    return QByteArray::fromRawData(this->data() + readUInt32(this->data(), entry + 8),
+                                   static_cast<int>(readUInt32(this->data(), entry + 12)));
+}
+
+quint32 LocalIndex::lowerBound(const QByteArray &key) const noexcept
+{
+    quint32 first = 0;
+    quint32 len = this->count;
+    while (len > 0) {
+        const auto half = len / 2;
+        if (this->keyAt(first + half) < key) {
+            first += half + 1;
+            len -= half + 1;
+            continue;
+        }
+        len = half;
+    }
+
+    return first;
+}
+
+std::optional<QByteArray> LocalIndex::find(const QByteArray &key) const noexcept
+{
+    const auto pos = this->lowerBound(key);
+    if (pos == this->count || this->keyAt(pos) != key) {
+        return std::nullopt;
+    }
+
+    return this->valueAt(pos);
+}
+
+std::vector<std::pair<QByteArray, QByteArray>>
+LocalIndex::findByPrefix(const QByteArray &prefix) const noexcept
+{
+    std::vector<std::pair<QByteArray, QByteArray>> result;
+
+    for (auto pos = this->lowerBound(prefix); pos < this->count; ++pos) {
+        auto key = this->keyAt(pos);
+        if (!key.startsWith(prefix)) {
+            break;
+        }
+        result.emplace_back(key, this->valueAt(pos));
+    }
+
+    return result;
+}
+
+LocalIndex::Entries LocalIndex::entries() const noexcept
+{
+    Entries entries;
+
+    for (quint32 pos = 0; pos < this->count; ++pos) {
+        const auto key = this->keyAt(pos);
+        const auto value = this->valueAt(pos);
+        // NOTE: Make deep copies, the mapped memory is released on modification.
+        entries.emplace(QByteArray(key.constData(), key.size()),
+                        QByteArray(value.constData(), value.size()));
+    }
+
+    return entries;
+}
+
+utils::error::Result<void> LocalIndex::insert(const QByteArray &key,
+                                              const QByteArray &value) noexcept
+{
+    LINGLONG_TRACE("insert " + key + " to local index");
+
+    auto entries = this->entries();
+    entries[QByteArray(key.constData(), key.size())] = QByteArray(value.constData(), value.size());
+
+    auto result = this->replace(entries);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> LocalIndex::remove(const QByteArray &key) noexcept
+{
+    LINGLONG_TRACE("remove " + key + " from local index");
+
+    if (!this->find(key)) {
+        return LINGLONG_OK;
+    }
+
+    auto entries = this->entries();
+    entries.erase(key);
+
+    auto result = this->replace(entries);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+QByteArray LocalIndex::content() const noexcept
+{
+    return serialize(this->entries());
+}
+
+utils::error::Result<void> LocalIndex::load(const QByteArray &content) noexcept
+{
+    LINGLONG_TRACE("load local index " + this->file.fileName());
+
+    auto count = validate(content.constData(), content.size());
+    if (!count) {
+        return LINGLONG_ERR(count);
+    }
+
+    auto result = this->write(content, *count);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> LocalIndex::replace(const Entries &entries) noexcept
+{
+    LINGLONG_TRACE("replace local index " + this->file.fileName());
+
+    auto result = this->write(serialize(entries), static_cast<quint32>(entries.size()));
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> LocalIndex::write(const QByteArray &content, quint32 count) noexcept
+{
+    LINGLONG_TRACE("write local index " + this->file.fileName());
+
+    this->unmap();
+    this->buffer = content;
+    this->count = count;
+
+    QSaveFile saveFile(this->file.fileName());
+    if (!saveFile.open(QIODevice::WriteOnly)) {
+        return LINGLONG_ERR("open: " + saveFile.errorString());
+    }
+
+    if (saveFile.write(content) != content.size()) {
+        return LINGLONG_ERR("write: " + saveFile.errorString());
+    }
+
+    if (!saveFile.commit()) {
+        return LINGLONG_ERR("commit: " + saveFile.errorString());
+    }
+
+    auto result = this->open();
+    if (!result) {
+        // NOTE: The in memory copy is still valid, keep using it.
+        qWarning() << result.error();
+    }
+
+    return LINGLONG_OK;
+}
+
+} // namespace linglong::repo
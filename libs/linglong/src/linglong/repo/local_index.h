@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_REPO_LOCAL_INDEX_H_
+#define LINGLONG_REPO_LOCAL_INDEX_H_
+
+#include "linglong/utils/error/error.h"
+
+#include <QByteArray>
+#include <QFile>
+
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace linglong::repo {
+
+// LocalIndex is a sorted key-value table persisted in a single file, which is
+// mapped into memory so that lookups never touch the layers directory tree.
+// Keys are ostree refspecs of installed layers, values are the raw content of
+// their info.json.
+//
+// LocalIndex file format (all integers are little endian):
+//
+// Name              Length (bytes)    Starts at (bytes)
+// magic number      8                 0
+// format version    4                 8
+// entry count       4                 12
+// entry table       16 * entry count  16
+// data                                16 + 16 * entry count
+//
+// Every entry in the entry table is four quint32: key offset, key length,
+// value offset and value length. Offsets are counted from the start of the
+// file. Entries are sorted by key in byte order.
+class LocalIndex
+{
+public:
+    using Entries = std::map<QByteArray, QByteArray>;
+
+    explicit LocalIndex(const QString &path) noexcept;
+    LocalIndex(const LocalIndex &) = delete;
+    LocalIndex(LocalIndex &&) = delete;
+    LocalIndex &operator=(const LocalIndex &) = delete;
+    LocalIndex &operator=(LocalIndex &&) = delete;
+    ~LocalIndex();
+
+    // Map the index file into memory. Fails if the file is missing or broken,
+    // in which case the caller is expected to rebuild it with replace().
+    utils::error::Result<void> open() noexcept;
+
+    [[nodiscard]] quint32 size() const noexcept;
+
+    // NOTE: Returned values reference the mapped memory without copying, they
+    // are invalidated by the next modification of the index.
+    [[nodiscard]] std::optional<QByteArray> find(const QByteArray &key) const noexcept;
+    [[nodiscard]] std::vector<std::pair<QByteArray, QByteArray>>
+    findByPrefix(const QByteArray &prefix) const noexcept;
+
+    utils::error::Result<void> insert(const QByteArray &key, const QByteArray &value) noexcept;
+    utils::error::Result<void> remove(const QByteArray &key) noexcept;
+
+    // Replace the whole index. If the index file cannot be written, for
+    // example because the repository is opened by an unprivileged user, the
+    // new content is still used in memory and an error is returned.
+    utils::error::Result<void> replace(const Entries &entries) noexcept;
+
+    // Serialized index in the file format described above, which can be
+    // shipped to other machines and installed there with load().
+    [[nodiscard]] QByteArray content() const noexcept;
+    utils::error::Result<void> load(const QByteArray &content) noexcept;
+
+private:
+    [[nodiscard]] const char *data() const noexcept;
+    [[nodiscard]] QByteArray keyAt(quint32 pos) const noexcept;
+    [[nodiscard]] QByteArray valueAt(quint32 pos) const noexcept;
+    [[nodiscard]] quint32 lowerBound(const QByteArray &key) const noexcept;
+    [[nodiscard]] Entries entries() const noexcept;
+    utils::error::Result<void> write(const QByteArray &content, quint32 count) noexcept;
+    void unmap() noexcept;
+
+    QFile file;
+    uchar *mapped = nullptr;
+    QByteArray buffer;
+    quint32 count = 0;
+};
+
+} // namespace linglong::repo
+
+#endif /* LINGLONG_REPO_LOCAL_INDEX_H_ */
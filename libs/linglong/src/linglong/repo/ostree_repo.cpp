@@ -8,11 +8,13 @@
 
 #include "linglong/api/types/helper.h"
 #include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/erofs_reader.h"
 #include "linglong/package/fuzzy_reference.h"
 #include "linglong/package/layer_dir.h"
 #include "linglong/package/reference.h"
 #include "linglong/package_manager/task.h"
 #include "linglong/repo/config.h"
+#include "linglong/repo/local_index.h"
 #include "linglong/utils/command/env.h"
 #include "linglong/utils/error/error.h"
 #include "linglong/utils/finally/finally.h"
@@ -23,15 +25,47 @@
 #include <glib.h>
 #include <ostree-repo.h>
 
+#include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QHttpMultiPart>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
 #include <QProcess>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <QUuid>
+#include <QtConcurrent>
 #include <QtWebSockets/QWebSocket>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
 #include <complex>
 #include <cstddef>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <tuple>
 #include <utility>
 
+#include <dlfcn.h>
 #include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace linglong::repo {
 
@@ -41,8 +75,79 @@ struct ostreeUserData
 {
     OSTreeRepo *repo{ nullptr };
     service::InstallTask *taskContext{ nullptr };
+    // Bytes per second, 0 means no limit.
+    quint64 bandwidthLimit{ 0 };
 };
 
+// See ioprio_set(2), glibc provides no wrapper.
+constexpr int ioprioWhoProcess = 1;
+constexpr int ioprioClassShift = 13;
+constexpr int ioprioClassBestEffort = 2;
+
+// Set the I/O priority and the nice value of the calling thread, and restore
+// them on destruction.
+class ThreadPriorityGuard
+{
+public:
+    ThreadPriorityGuard(int ioprio, int nice) noexcept
+        : tid(static_cast<pid_t>(syscall(SYS_gettid)))
+    {
+        errno = 0;
+        this->oldNice = getpriority(PRIO_PROCESS, this->tid);
+        if (errno != 0) {
+            qWarning() << "failed to get nice value of thread" << this->tid << ::strerror(errno);
+            return;
+        }
+        this->oldIOPrio = static_cast<int>(syscall(SYS_ioprio_get, ioprioWhoProcess, this->tid));
+        if (this->oldIOPrio < 0) {
+            qWarning() << "failed to get I/O priority of thread" << this->tid << ::strerror(errno);
+            return;
+        }
+
+        this->set(ioprio, nice);
+        this->changed = true;
+    }
+
+    ~ThreadPriorityGuard()
+    {
+        if (this->changed) {
+            this->set(this->oldIOPrio, this->oldNice);
+        }
+    }
+
+    ThreadPriorityGuard(const ThreadPriorityGuard &) = delete;
+    ThreadPriorityGuard(ThreadPriorityGuard &&) = delete;
+    ThreadPriorityGuard &operator=(const ThreadPriorityGuard &) = delete;
+    ThreadPriorityGuard &operator=(ThreadPriorityGuard &&) = delete;
+
+private:
+    void set(int ioprio, int nice) const noexcept
+    {
+        if (syscall(SYS_ioprio_set, ioprioWhoProcess, this->tid, ioprio) != 0) {
+            qWarning() << "failed to set I/O priority of thread" << this->tid << ::strerror(errno);
+        }
+        if (setpriority(PRIO_PROCESS, this->tid, nice) != 0) {
+            qWarning() << "failed to set nice value of thread" << this->tid << ::strerror(errno);
+        }
+    }
+
+    pid_t tid;
+    int oldIOPrio = 0;
+    int oldNice = 0;
+    bool changed = false;
+};
+
+// Update the task in the thread it belongs to, the pull runs in a worker.
+void reportProgress(service::InstallTask *taskContext, double current, double total) noexcept
+{
+    QMetaObject::invokeMethod(
+      taskContext,
+      [taskContext, current, total]() {
+          taskContext->updateTask(current, total, "pulling.");
+      },
+      Qt::QueuedConnection);
+}
+
 char *formatted_time_remaining_from_seconds(guint64 seconds_remaining)
 {
     guint64 minutes_remaining = seconds_remaining / 60;
@@ -131,9 +236,8 @@ void progress_changed(OstreeAsyncProgress *progress, gpointer user_data)
         new_progress = 100;
         g_string_append(buf, status);
     } else if (caught_error) {
-        auto msg = "Caught error, waiting for outstanding tasks";
-        g_string_append_printf(buf, "%s", msg);
-        Q_EMIT data->taskContext->updateStatus(service::InstallTask::Failed, msg);
+        // NOTE: The error is reported by the caller of ostree_repo_pull, which may retry.
+        g_string_append_printf(buf, "%s", "Caught error, waiting for outstanding tasks");
     } else if (outstanding_fetches) {
         guint64 bytes_transferred, start_time, total_delta_part_size;
         guint fetched, metadata_fetched, requested;
@@ -214,6 +318,11 @@ void progress_changed(OstreeAsyncProgress *progress, gpointer user_data)
                                        formatted_fetched,
                                        formatted_total);
             }
+
+            // NOTE: Deltas of all requested refs are known before fetching, report in bytes.
+            reportProgress(data->taskContext,
+                           static_cast<double>(fetched_delta_part_size),
+                           static_cast<double>(total_delta_part_size));
         } else if ((scanning != 0) || (outstanding_metadata_fetches != 0U)) {
             new_progress += 5;
             g_object_set_data(G_OBJECT(progress), "last-was-metadata", GUINT_TO_POINTER(TRUE));
@@ -231,14 +340,36 @@ void progress_changed(OstreeAsyncProgress *progress, gpointer user_data)
                                    formatted_bytes_sec,
                                    formatted_bytes_transferred);
             new_progress = fetched * 97 / requested;
+            reportProgress(data->taskContext, fetched, requested);
         }
-
-        Q_EMIT data->taskContext->updateTask(fetched, requested, "pulling.");
     } else if (outstanding_writes) {
         g_string_append_printf(buf, "Writing objects: %u", outstanding_writes);
     } else {
         g_string_append_printf(buf, "Scanning metadata: %u", n_scanned_metadata);
     }
+
+    // NOTE:
+    // ostree has no option to limit the bandwidth. This callback is dispatched
+    // by the main context of the worker thread the pull runs in, so sleeping
+    // here stops reading from the connections until the average rate drops
+    // under the limit, without blocking the thread serving D-Bus.
+    if (data->bandwidthLimit > 0 && outstanding_fetches != 0U
+        && g_cancellable_is_cancelled(data->taskContext->cancellable()) == FALSE) {
+        const auto bytes = ostree_async_progress_get_uint64(progress, "bytes-transferred");
+        const auto startTime = ostree_async_progress_get_uint64(progress, "start-time");
+        const auto elapsed = static_cast<guint64>(g_get_monotonic_time()) - startTime;
+        const auto expected = bytes * G_USEC_PER_SEC / data->bandwidthLimit;
+        if (expected > elapsed) {
+            g_usleep(std::min<guint64>(expected - elapsed, G_USEC_PER_SEC));
+        }
+    }
+}
+
+// The configuration of the repository is saved in its root directory, see
+// OSTreeRepo::setConfig().
+QString configPath(const QDir &root) noexcept
+{
+    return root.absoluteFilePath("config.yaml");
 }
 
 QString ostreeSpecFromReference(const package::Reference &ref, bool develop = false) noexcept
@@ -260,57 +391,249 @@ utils::error::Result<void> removeOstreeRef(OstreeRepo *repo, const char *ref) no
 
     LINGLONG_TRACE("remove ostree refspec from repository");
 
+    // NOTE: Objects are left in the repository, see OSTreeRepo::prune.
     g_autoptr(GError) gErr = nullptr;
     if (ostree_repo_set_ref_immediate(repo, nullptr, ref, nullptr, nullptr, &gErr) == FALSE) {
         return LINGLONG_ERR("ostree_repo_set_ref_immediate", gErr);
     }
 
-    [[maybe_unused]] gint out_objects_total = 0;
-    [[maybe_unused]] gint out_objects_pruned = 0;
-    [[maybe_unused]] guint64 out_pruned_object_size_total = 0;
+    return LINGLONG_OK;
+}
+
+// NOTE:
+// The generated ClientApi reads the whole file into memory before uploading,
+// which is not acceptable for layers of several gigabytes. The file is
+// streamed from disk here instead.
+utils::error::Result<void>
+uploadFile(const QUrl &url, const QString &token, const QString &filePath) noexcept
+{
+    LINGLONG_TRACE(QString("upload %1 to %2").arg(filePath, url.toString()));
 
-    if (ostree_repo_prune(repo,
-                          OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY,
-                          0,
-                          &out_objects_total,
-                          &out_objects_pruned,
-                          &out_pruned_object_size_total,
-                          nullptr,
-                          &gErr)
-        == FALSE) {
-        return LINGLONG_ERR("ostree_repo_prune", gErr);
+    auto *file = new QFile(filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        auto err = LINGLONG_ERR("open", *file);
+        delete file;
+        return err;
+    }
+
+    auto *multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+    file->setParent(multiPart);
+
+    QHttpPart filePart;
+    filePart.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    filePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                       QString(R"(form-data; name="file"; filename="%1")")
+                         .arg(QFileInfo(filePath).fileName()));
+    filePart.setBodyDevice(file);
+    multiPart->append(filePart);
+
+    QNetworkRequest request(url);
+    request.setRawHeader("X-Token", token.toUtf8());
+
+    QNetworkAccessManager manager;
+    QEventLoop loop;
+    auto *reply = manager.put(request, multiPart);
+    multiPart->setParent(reply);
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    auto _ = utils::finally::finally([reply]() {
+        reply->deleteLater();
+    });
+
+    const auto content = reply->readAll();
+    if (reply->error() != QNetworkReply::NoError) {
+        return LINGLONG_ERR(QString("%1, %2").arg(reply->errorString(), QString(content)),
+                            reply->error());
+    }
+
+    const qint32 HTTP_OK = 200;
+    api::client::Api_UploadTaskFileResp resp(QString::fromUtf8(content));
+    if (resp.getCode() != HTTP_OK) {
+        return LINGLONG_ERR(resp.getMsg(), resp.getCode());
     }
 
     return LINGLONG_OK;
 }
 
-utils::error::Result<void> commitDirToRepo(GFile *dir,
-                                           OstreeRepo *repo,
-                                           const char *refspec) noexcept
+// Write the content stream of the object into a temporary file, which is
+// uploaded from there, so that large files never sit in memory.
+utils::error::Result<std::unique_ptr<QTemporaryFile>> spoolObject(OstreeRepo *repo,
+                                                                  const QString &object) noexcept
 {
-    Q_ASSERT(dir != nullptr);
-    Q_ASSERT(repo != nullptr);
+    LINGLONG_TRACE("spool " + object);
 
-    LINGLONG_TRACE("commit to ostree linglong repo");
+    g_autofree char *checksum = nullptr;
+    OstreeObjectType objectType{};
+    ostree_object_from_string(object.toUtf8(), &checksum, &objectType);
 
+    // NOTE: File objects are loaded as content streams, which the server
+    // can write into a repository of any mode.
     g_autoptr(GError) gErr = nullptr;
-    if (ostree_repo_prepare_transaction(repo, NULL, NULL, &gErr) == FALSE) {
-        return LINGLONG_ERR("ostree_repo_prepare_transaction", gErr);
+    g_autoptr(GInputStream) input = nullptr;
+    guint64 size = 0;
+    if (ostree_repo_load_object_stream(repo, objectType, checksum, &input, &size, nullptr, &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_load_object_stream", gErr);
     }
 
-    g_autoptr(OstreeMutableTree) mtree = ostree_mutable_tree_new();
-    g_autoptr(OstreeRepoCommitModifier) modifier = nullptr;
-    modifier =
-      ostree_repo_commit_modifier_new(OSTREE_REPO_COMMIT_MODIFIER_FLAGS_CANONICAL_PERMISSIONS,
-                                      nullptr,
-                                      nullptr,
-                                      nullptr);
-    Q_ASSERT(modifier != nullptr);
+    auto file = std::make_unique<QTemporaryFile>();
+    if (!file->open()) {
+        return LINGLONG_ERR("open", *file);
+    }
 
-    if (ostree_repo_write_directory_to_mtree(repo, dir, mtree, modifier, nullptr, &gErr) == FALSE) {
-        return LINGLONG_ERR("ostree_repo_write_directory_to_mtree", gErr);
+    constexpr gsize chunkSize = 64 * 1024;
+    QByteArray chunk(chunkSize, Qt::Uninitialized);
+    guint64 written = 0;
+    while (true) {
+        const auto bytesRead = g_input_stream_read(input, chunk.data(), chunkSize, nullptr, &gErr);
+        if (bytesRead < 0) {
+            return LINGLONG_ERR("g_input_stream_read", gErr);
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        if (file->write(chunk.constData(), bytesRead) != bytesRead) {
+            return LINGLONG_ERR("write", *file);
+        }
+        written += static_cast<guint64>(bytesRead);
+    }
+
+    if (written != size) {
+        return LINGLONG_ERR(QString("%1 of %2 bytes read").arg(written).arg(size));
+    }
+
+    if (!file->flush() || !file->seek(0)) {
+        return LINGLONG_ERR("seek", *file);
+    }
+
+    return file;
+}
+
+// Data of a reply like {"code": 200, "msg": "", "data": {}} from the
+// repository server.
+utils::error::Result<QJsonObject> replyData(QNetworkReply &reply) noexcept
+{
+    LINGLONG_TRACE("read reply of " + reply.url().toString());
+
+    const auto content = reply.readAll();
+    if (reply.error() != QNetworkReply::NoError) {
+        return LINGLONG_ERR(QString("%1, %2").arg(reply.errorString(), QString(content)),
+                            reply.error());
+    }
+
+    QJsonParseError parseError{};
+    auto doc = QJsonDocument::fromJson(content, &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        return LINGLONG_ERR(parseError.errorString());
+    }
+
+    const qint32 HTTP_OK = 200;
+    auto resp = doc.object();
+    if (resp.value("code").toInt() != HTTP_OK) {
+        return LINGLONG_ERR(resp.value("msg").toString(), resp.value("code").toInt());
+    }
+
+    return resp.value("data").toObject();
+}
+
+// Send a request to the repository server, which replies with a JSON object
+// like {"code": 200, "msg": "", "data": {}}. Returns the data on success.
+utils::error::Result<QJsonObject>
+sendRequest(QNetworkAccessManager &manager,
+            const QByteArray &verb,
+            const QUrl &url,
+            const QString &token,
+            const QByteArray &body,
+            const QByteArray &contentType = "application/json") noexcept
+{
+    LINGLONG_TRACE(QString("%1 %2").arg(QString::fromUtf8(verb), url.toString()));
+
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    request.setRawHeader("X-Token", token.toUtf8());
+
+    QEventLoop loop;
+    auto *reply = manager.sendCustomRequest(request, verb, body);
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    auto _ = utils::finally::finally([reply]() {
+        reply->deleteLater();
+    });
+
+    auto data = replyData(*reply);
+    if (!data) {
+        return LINGLONG_ERR(data);
+    }
+
+    return data;
+}
+
+utils::error::Result<void> pullFromRemote(OstreeRepo *repo,
+                                          const char *remote,
+                                          const QByteArrayList &refspecs,
+                                          bool disableStaticDeltas,
+                                          OstreeAsyncProgress *progress,
+                                          GCancellable *cancellable,
+                                          const char *subdir = nullptr,
+                                          bool inheritTransaction = false,
+                                          const char *overrideURL = nullptr) noexcept
+{
+    LINGLONG_TRACE(QString("pull %1 from %2").arg(refspecs.join(' '), remote));
+
+    std::vector<const char *> refs;
+    for (const auto &refspec : refspecs) {
+        refs.push_back(refspec.constData());
+    }
+    refs.push_back(nullptr);
+
+    GVariantBuilder builder{};
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder,
+                          "{s@v}",
+                          "refs",
+                          g_variant_new_variant(g_variant_new_strv(refs.data(), -1)));
+    if (subdir != nullptr) {
+        const char *subdirs[] = { subdir, nullptr };
+        g_variant_builder_add(&builder,
+                              "{s@v}",
+                              "subdirs",
+                              g_variant_new_variant(g_variant_new_strv(subdirs, -1)));
+    }
+    g_variant_builder_add(&builder,
+                          "{s@v}",
+                          "disable-static-deltas",
+                          g_variant_new_variant(g_variant_new_boolean(disableStaticDeltas)));
+    g_variant_builder_add(&builder,
+                          "{s@v}",
+                          "inherit-transaction",
+                          g_variant_new_variant(g_variant_new_boolean(inheritTransaction)));
+    if (overrideURL != nullptr) {
+        g_variant_builder_add(&builder,
+                              "{s@v}",
+                              "override-url",
+                              g_variant_new_variant(g_variant_new_string(overrideURL)));
+    }
+    g_autoptr(GVariant) options = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+    g_autoptr(GError) gErr = nullptr;
+    if (ostree_repo_pull_with_options(repo, remote, options, progress, cancellable, &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_pull_with_options", gErr);
     }
 
+    return LINGLONG_OK;
+}
+
+// Write the tree as the commit of refspec, and commit the prepared transaction.
+utils::error::Result<void> commitMtreeToRepo(OstreeMutableTree *mtree,
+                                             OstreeRepo *repo,
+                                             const char *refspec) noexcept
+{
+    LINGLONG_TRACE("commit tree to ostree linglong repo");
+
+    g_autoptr(GError) gErr = nullptr;
     g_autoptr(GFile) file = nullptr;
     if (ostree_repo_write_mtree(repo, mtree, &file, nullptr, &gErr) == FALSE) {
         return LINGLONG_ERR("ostree_repo_write_mtree", gErr);
@@ -339,137 +662,618 @@ utils::error::Result<void> commitDirToRepo(GFile *dir,
     return LINGLONG_OK;
 }
 
-utils::error::Result<void> handleRepositoryUpdate(OstreeRepo *repo,
-                                                  QDir layerDir,
-                                                  const char *refspec) noexcept
+// Write the files of dir into mtree, which may hold the files of the base
+// layer of a delta, and commit it.
+utils::error::Result<void> commitDirToRepo(GFile *dir,
+                                           OstreeRepo *repo,
+                                           OstreeMutableTree *mtree,
+                                           const char *refspec) noexcept
 {
-    LINGLONG_TRACE(QString("checkout %1 from ostree repository to layers dir").arg(refspec));
-
-    int root = open("/", O_DIRECTORY);
-    auto _ = utils::finally::finally([root]() {
-        close(root);
-    });
-
-    auto path = layerDir.absolutePath();
-    path = path.right(path.length() - 1);
+    Q_ASSERT(dir != nullptr);
+    Q_ASSERT(repo != nullptr);
+    Q_ASSERT(mtree != nullptr);
 
-    Q_ASSERT(layerDir.exists() == false);
-    if (!layerDir.mkpath(".")) {
-        Q_ASSERT(false);
-    }
-    if (!layerDir.removeRecursively()) {
-        Q_ASSERT(false);
-    }
+    LINGLONG_TRACE("commit to ostree linglong repo");
 
     g_autoptr(GError) gErr = nullptr;
+    if (ostree_repo_prepare_transaction(repo, NULL, NULL, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_prepare_transaction", gErr);
+    }
 
-    g_autofree char *commit;
+    g_autoptr(OstreeRepoCommitModifier) modifier = nullptr;
+    modifier =
+      ostree_repo_commit_modifier_new(OSTREE_REPO_COMMIT_MODIFIER_FLAGS_CANONICAL_PERMISSIONS,
+                                      nullptr,
+                                      nullptr,
+                                      nullptr);
+    Q_ASSERT(modifier != nullptr);
 
-    if (ostree_repo_resolve_rev(repo, refspec, FALSE, &commit, &gErr) == FALSE) {
-        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    if (ostree_repo_write_directory_to_mtree(repo, dir, mtree, modifier, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_write_directory_to_mtree", gErr);
     }
 
-    if (ostree_repo_checkout_at(repo, nullptr, root, path.toUtf8().constData(), commit, NULL, &gErr)
-        == FALSE) {
-        return LINGLONG_ERR(QString("ostree_repo_checkout_at %1").arg(path), gErr);
+    auto result = commitMtreeToRepo(mtree, repo, refspec);
+    if (!result) {
+        return LINGLONG_ERR(result);
     }
 
     return LINGLONG_OK;
 }
 
-utils::error::Result<void> updateOstreeRepoConfig(OstreeRepo *repo,
-                                                  const QString &remoteName,
-                                                  const QString &url,
-                                                  QString parent = "") noexcept
+utils::error::Result<QByteArray> writeDirMeta(OstreeRepo *repo, quint32 mode) noexcept
 {
-    LINGLONG_TRACE("update configuration");
+    LINGLONG_TRACE("write dirmeta");
 
-    g_autoptr(GVariant) options = NULL;
-    GVariantBuilder builder;
-    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-    g_variant_builder_add(&builder, "{sv}", "gpg-verify", g_variant_new_boolean(FALSE));
-    // NOTE:
-    // libcurl 8.2.1 has a http2 bug https://github.com/curl/curl/issues/11859
-    // We disable http2 for now.
-    g_variant_builder_add(&builder, "{sv}", "http2", g_variant_new_boolean(FALSE));
-    options = g_variant_ref_sink(g_variant_builder_end(&builder));
+    g_autoptr(GFileInfo) info = g_file_info_new();
+    g_file_info_set_file_type(info, G_FILE_TYPE_DIRECTORY);
+    g_file_info_set_attribute_uint32(info, "unix::uid", 0);
+    g_file_info_set_attribute_uint32(info, "unix::gid", 0);
+    g_file_info_set_attribute_uint32(info, "unix::mode", mode & (S_IFDIR | 0755));
 
     g_autoptr(GError) gErr = nullptr;
-    if (ostree_repo_remote_change(repo,
-                                  nullptr,
-                                  OSTREE_REPO_REMOTE_CHANGE_DELETE_IF_EXISTS,
-                                  remoteName.toUtf8(),
-                                  nullptr,
-                                  nullptr,
-                                  nullptr,
-                                  &gErr)
+    g_autoptr(GVariant) dirMeta = ostree_create_directory_metadata(info, nullptr);
+    g_autofree guchar *csum = nullptr;
+    if (ostree_repo_write_metadata(repo,
+                                   OSTREE_OBJECT_TYPE_DIR_META,
+                                   nullptr,
+                                   dirMeta,
+                                   &csum,
+                                   nullptr,
+                                   &gErr)
         == FALSE) {
-        return LINGLONG_ERR("ostree_repo_remote_change", gErr);
+        return LINGLONG_ERR("ostree_repo_write_metadata", gErr);
     }
 
-    if (ostree_repo_remote_change(repo,
-                                  nullptr,
-                                  OSTREE_REPO_REMOTE_CHANGE_ADD,
-                                  remoteName.toUtf8(),
-                                  (url + "/repos/" + remoteName).toUtf8(),
-                                  options,
-                                  nullptr,
-                                  &gErr)
-        == FALSE) {
-        return LINGLONG_ERR("ostree_repo_remote_change", gErr);
+    g_autofree char *checksum = ostree_checksum_from_bytes(csum);
+    return QByteArray(checksum);
+}
+
+// Write a regular file or a symbolic link in the EROFS image as a content
+// object, with the canonical permissions as commitDirToRepo. Regular files
+// are streamed into the repository one extent at a time.
+utils::error::Result<QByteArray> writeContent(const package::ErofsReader &reader,
+                                              OstreeRepo *repo,
+                                              const package::ErofsReader::Inode &inode) noexcept
+{
+    LINGLONG_TRACE(QString("write content of inode %1").arg(inode.nid));
+
+    g_autoptr(GError) gErr = nullptr;
+    if (S_ISREG(inode.mode)) {
+        g_autoptr(OstreeContentWriter) writer =
+          ostree_repo_write_regfile(repo,
+                                    nullptr,
+                                    0,
+                                    0,
+                                    inode.mode & (S_IFREG | 0755),
+                                    inode.size,
+                                    nullptr,
+                                    &gErr);
+        if (writer == nullptr) {
+            return LINGLONG_ERR("ostree_repo_write_regfile", gErr);
+        }
+
+        auto result = reader.read(
+          inode,
+          [&writer](const char *data, quint64 size) -> utils::error::Result<void> {
+              LINGLONG_TRACE("write data");
+
+              g_autoptr(GError) gErr = nullptr;
+              if (g_output_stream_write_all(G_OUTPUT_STREAM(writer),
+                                            data,
+                                            size,
+                                            nullptr,
+                                            nullptr,
+                                            &gErr)
+                  == FALSE) {
+                  return LINGLONG_ERR("g_output_stream_write_all", gErr);
+              }
+              return LINGLONG_OK;
+          });
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+
+        g_autofree char *checksum = ostree_content_writer_finish(writer, nullptr, &gErr);
+        if (checksum == nullptr) {
+            return LINGLONG_ERR("ostree_content_writer_finish", gErr);
+        }
+        return QByteArray(checksum);
     }
 
-    GKeyFile *configKeyFile = ostree_repo_get_config(repo);
-    Q_ASSERT(configKeyFile != nullptr);
-    QDir a;
+    auto target = reader.read(inode);
+    if (!target) {
+        return LINGLONG_ERR(target);
+    }
 
-    g_key_file_set_string(configKeyFile, "core", "min-free-space-size", "600MB");
-    if (!parent.isEmpty()) {
-        QDir parentDir = parent;
-        Q_ASSERT(parentDir.exists());
-        g_key_file_set_string(configKeyFile, "core", "parent", parentDir.absolutePath().toUtf8());
+    g_autoptr(GFileInfo) info = g_file_info_new();
+    g_file_info_set_attribute_uint32(info, "unix::uid", 0);
+    g_file_info_set_attribute_uint32(info, "unix::gid", 0);
+    g_file_info_set_file_type(info, G_FILE_TYPE_SYMBOLIC_LINK);
+    g_file_info_set_is_symlink(info, TRUE);
+    g_file_info_set_symlink_target(info, target->constData());
+    g_file_info_set_attribute_uint32(info, "unix::mode", inode.mode);
+    g_file_info_set_size(info, 0);
+
+    g_autoptr(GInputStream) object = nullptr;
+    guint64 length = 0;
+    if (ostree_raw_file_to_content_stream(nullptr, info, nullptr, &object, &length, nullptr, &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_raw_file_to_content_stream", gErr);
     }
 
-    if (ostree_repo_write_config(repo, configKeyFile, &gErr) == FALSE) {
-        return LINGLONG_ERR("ostree_repo_write_config", gErr);
+    g_autofree guchar *csum = nullptr;
+    if (ostree_repo_write_content(repo, nullptr, object, length, &csum, nullptr, &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_write_content", gErr);
     }
 
-    return LINGLONG_OK;
+    g_autofree char *checksum = ostree_checksum_from_bytes(csum);
+    return QByteArray(checksum);
 }
 
-utils::error::Result<OstreeRepo *> createOstreeRepo(const QDir &location,
-                                                    const QString &remoteName,
-                                                    const QString &url,
-                                                    const QString &parent = "") noexcept
+// Same as commitDirToRepo, but reads the files from the EROFS image. The
+// directories are walked first, then the files are decompressed and written
+// in parallel.
+utils::error::Result<void> commitErofsToRepo(const package::ErofsReader &reader,
+                                             OstreeRepo *repo,
+                                             OstreeMutableTree *mtree,
+                                             const char *refspec) noexcept
 {
-    LINGLONG_TRACE("create linglong repository at " + location.absolutePath());
+    Q_ASSERT(repo != nullptr);
+    Q_ASSERT(mtree != nullptr);
 
-    if (!QFileInfo(location.absolutePath()).isWritable()) {
-        return LINGLONG_ERR("permission denied");
+    LINGLONG_TRACE("commit EROFS image to ostree linglong repo");
+
+    auto root = reader.root();
+    if (!root) {
+        return LINGLONG_ERR(root);
     }
 
     g_autoptr(GError) gErr = nullptr;
-    g_autoptr(GFile) repoPath = nullptr;
-    g_autoptr(OstreeRepo) ostreeRepo = nullptr;
-
-    repoPath = g_file_new_for_path(location.absolutePath().toUtf8());
-    ostreeRepo = ostree_repo_new(repoPath);
-    Q_ASSERT(ostreeRepo != nullptr);
-    if (ostree_repo_create(ostreeRepo, OSTREE_REPO_MODE_BARE_USER_ONLY, nullptr, &gErr) == FALSE) {
-        return LINGLONG_ERR("ostree_repo_create", gErr);
+    if (ostree_repo_prepare_transaction(repo, NULL, NULL, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_prepare_transaction", gErr);
     }
 
-    auto result = updateOstreeRepoConfig(ostreeRepo, remoteName, url, parent);
+    bool committed = false;
+    auto abort = utils::finally::finally([repo, &committed]() {
+        if (!committed) {
+            ostree_repo_abort_transaction(repo, nullptr, nullptr);
+        }
+    });
 
-    if (!result) {
+    struct File
+    {
+        OstreeMutableTree *parent = nullptr;
+        QByteArray name;
+        package::ErofsReader::Inode inode;
+        utils::error::Result<QByteArray> checksum;
+    };
+
+    // NOTE:
+    // Subtrees are owned by their parents. The image may be crafted, a
+    // directory reached twice is a loop, and a path of more than
+    // PATH_MAX / 2 directories could not be checked out anyway.
+    constexpr int maxDepth = PATH_MAX / 2;
+    std::vector<std::tuple<package::ErofsReader::Inode, OstreeMutableTree *, int>> dirs{
+        { *root, mtree, 0 }
+    };
+    QSet<quint64> visited{ root->nid };
+    QHash<quint32, QByteArray> dirMetas;
+    std::vector<File> files;
+    while (!dirs.empty()) {
+        const auto [dir, tree, depth] = dirs.back();
+        dirs.pop_back();
+
+        auto dirMeta = dirMetas.find(dir.mode);
+        if (dirMeta == dirMetas.end()) {
+            auto checksum = writeDirMeta(repo, dir.mode);
+            if (!checksum) {
+                return LINGLONG_ERR(checksum);
+            }
+            dirMeta = dirMetas.insert(dir.mode, *checksum);
+        }
+        ostree_mutable_tree_set_metadata_checksum(tree, dirMeta->constData());
+
+        auto entries = reader.readDir(dir);
+        if (!entries) {
+            return LINGLONG_ERR(entries);
+        }
+
+        for (auto &entry : *entries) {
+            auto inode = reader.inode(entry.nid);
+            if (!inode) {
+                return LINGLONG_ERR(inode);
+            }
+
+            if (S_ISDIR(inode->mode)) {
+                if (visited.contains(inode->nid)) {
+                    return LINGLONG_ERR(QString("directory %1 is linked more than once")
+                                          .arg(QString::fromUtf8(entry.name)));
+                }
+                if (depth + 1 > maxDepth) {
+                    return LINGLONG_ERR(QString("directory %1 is nested too deeply")
+                                          .arg(QString::fromUtf8(entry.name)));
+                }
+                visited.insert(inode->nid);
+
+                g_autoptr(OstreeMutableTree) subtree = nullptr;
+                if (ostree_mutable_tree_ensure_dir(tree, entry.name.constData(), &subtree, &gErr)
+                    == FALSE) {
+                    return LINGLONG_ERR("ostree_mutable_tree_ensure_dir", gErr);
+                }
+                dirs.emplace_back(*inode, subtree, depth + 1);
+                continue;
+            }
+
+            if (!S_ISREG(inode->mode) && !S_ISLNK(inode->mode)) {
+                return LINGLONG_ERR(QString("%1 is not a regular file, directory or symbolic link")
+                                      .arg(QString::fromUtf8(entry.name)));
+            }
+            files.push_back({ tree, std::move(entry.name), *inode, QByteArray() });
+        }
+    }
+
+    QtConcurrent::blockingMap(files, [&reader, repo](File &file) {
+        file.checksum = writeContent(reader, repo, file.inode);
+    });
+
+    for (auto &file : files) {
+        if (!file.checksum) {
+            return LINGLONG_ERR(QString::fromUtf8(file.name), std::move(file.checksum));
+        }
+        if (ostree_mutable_tree_replace_file(file.parent,
+                                             file.name.constData(),
+                                             file.checksum->constData(),
+                                             &gErr)
+            == FALSE) {
+            return LINGLONG_ERR("ostree_mutable_tree_replace_file", gErr);
+        }
+    }
+
+    auto result = commitMtreeToRepo(mtree, repo, refspec);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    committed = true;
+    return LINGLONG_OK;
+}
+
+// Checksum of the root directory of the commit refspec points to, see
+// ostree_commit_get_content_checksum. Unlike the checksum of the commit, it
+// only depends on the files.
+utils::error::Result<QString> contentChecksum(OstreeRepo *repo, const char *refspec) noexcept
+{
+    LINGLONG_TRACE(QString("get content checksum of %1").arg(refspec));
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autofree char *commit = nullptr;
+    if (ostree_repo_resolve_rev(repo, refspec, FALSE, &commit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+
+    g_autoptr(GVariant) commitVariant = nullptr;
+    if (ostree_repo_load_variant(repo, OSTREE_OBJECT_TYPE_COMMIT, commit, &commitVariant, &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_load_variant", gErr);
+    }
+
+    g_autofree char *checksum = ostree_commit_get_content_checksum(commitVariant);
+    if (checksum == nullptr) {
+        return LINGLONG_ERR(QString("commit %1 is invalid").arg(commit));
+    }
+
+    return QString(checksum);
+}
+
+// Remove the paths, which are relative to the root of mtree.
+utils::error::Result<void> removeFromMtree(OstreeMutableTree *mtree,
+                                           const std::vector<std::string> &paths) noexcept
+{
+    LINGLONG_TRACE("remove files from tree");
+
+    for (const auto &path : paths) {
+        const auto components = QString::fromStdString(path).split('/', Qt::SkipEmptyParts);
+        if (components.isEmpty() || components.contains("..") || components.contains(".")) {
+            return LINGLONG_ERR(QString("invalid path %1").arg(path.c_str()));
+        }
+
+        g_autoptr(GPtrArray) split = g_ptr_array_new_with_free_func(g_free);
+        for (const auto &component : components) {
+            g_ptr_array_add(split, g_strdup(component.toUtf8().constData()));
+        }
+
+        // NOTE: ostree_mutable_tree_walk stops at the parent of the last component.
+        g_autoptr(GError) gErr = nullptr;
+        g_autoptr(OstreeMutableTree) parent = nullptr;
+        if (ostree_mutable_tree_walk(mtree, split, 0, &parent, &gErr) == FALSE) {
+            return LINGLONG_ERR(QString("ostree_mutable_tree_walk %1").arg(path.c_str()), gErr);
+        }
+        if (ostree_mutable_tree_remove(parent, components.last().toUtf8().constData(), FALSE, &gErr)
+            == FALSE) {
+            return LINGLONG_ERR(QString("ostree_mutable_tree_remove %1").arg(path.c_str()), gErr);
+        }
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> handleRepositoryUpdate(OstreeRepo *repo,
+                                                  QDir layerDir,
+                                                  const char *refspec) noexcept
+{
+    LINGLONG_TRACE(QString("checkout %1 from ostree repository to layers dir").arg(refspec));
+
+    int root = open("/", O_DIRECTORY);
+    auto _ = utils::finally::finally([root]() {
+        close(root);
+    });
+
+    auto path = layerDir.absolutePath();
+    path = path.right(path.length() - 1);
+
+    Q_ASSERT(layerDir.exists() == false);
+    if (!layerDir.mkpath(".")) {
+        Q_ASSERT(false);
+    }
+    if (!layerDir.removeRecursively()) {
+        Q_ASSERT(false);
+    }
+
+    g_autoptr(GError) gErr = nullptr;
+
+    g_autofree char *commit;
+
+    if (ostree_repo_resolve_rev(repo, refspec, FALSE, &commit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+
+    // NOTE:
+    // Objects in a bare-user-only repository can be hardlinked into the
+    // checkout in user mode, so installed layers share file content with the
+    // object store instead of being full copies. ostree falls back to copying
+    // when a hardlink is impossible, e.g. layers dir on another filesystem.
+    OstreeRepoCheckoutAtOptions options = {};
+    options.mode = OSTREE_REPO_CHECKOUT_MODE_USER;
+    options.overwrite_mode = OSTREE_REPO_CHECKOUT_OVERWRITE_NONE;
+    options.no_copy_fallback = FALSE;
+    // Empty files all share one object, hardlinking them may hit the link limit.
+    options.force_copy_zerosized = TRUE;
+
+    if (ostree_repo_checkout_at(repo,
+                                &options,
+                                root,
+                                path.toUtf8().constData(),
+                                commit,
+                                NULL,
+                                &gErr)
+        == FALSE) {
+        return LINGLONG_ERR(QString("ostree_repo_checkout_at %1").arg(path), gErr);
+    }
+
+    return LINGLONG_OK;
+}
+
+// The leading fields of curl_version_info_data, see curl_version_info(3). The
+// layout is stable since libcurl 7.10, so libcurl is not needed to build.
+struct CurlVersionInfo
+{
+    int age;
+    const char *version;
+    unsigned int versionNum;
+    const char *host;
+    int features;
+};
+
+constexpr int curlVersionFirst = 0;
+constexpr int curlVersionHttp2 = 1 << 16;
+
+// Whether ostree may use http2. libcurl 8.2.1 has a http2 bug
+// https://github.com/curl/curl/issues/11859, which is fixed in 8.3.0.
+// ostree fetches by the libcurl loaded into the process, if it is built with
+// libsoup instead the option is ignored.
+bool curlSupportsHttp2() noexcept
+{
+    static const bool supported = [] {
+        void *handle = ::dlopen("libcurl.so.4", RTLD_LAZY | RTLD_NOLOAD);
+        if (handle == nullptr) {
+            return false;
+        }
+        auto closeHandle = utils::finally::finally([handle] {
+            ::dlclose(handle);
+        });
+
+        using VersionInfo = const CurlVersionInfo *(*)(int);
+        auto versionInfo = reinterpret_cast<VersionInfo>(::dlsym(handle, "curl_version_info"));
+        if (versionInfo == nullptr) {
+            return false;
+        }
+
+        const auto *info = versionInfo(curlVersionFirst);
+        if (info == nullptr) {
+            return false;
+        }
+        qDebug() << "libcurl" << info->version << "http2"
+                 << ((info->features & curlVersionHttp2) != 0);
+        return info->versionNum >= 0x080300 && (info->features & curlVersionHttp2) != 0;
+    }();
+    return supported;
+}
+
+utils::error::Result<void> updateOstreeRepoConfig(OstreeRepo *repo,
+                                                  const QString &remoteName,
+                                                  const QString &url,
+                                                  QString parent = "") noexcept
+{
+    LINGLONG_TRACE("update configuration");
+
+    g_autoptr(GVariant) options = NULL;
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", "gpg-verify", g_variant_new_boolean(FALSE));
+    g_variant_builder_add(&builder,
+                          "{sv}",
+                          "http2",
+                          g_variant_new_boolean(curlSupportsHttp2() ? TRUE : FALSE));
+    options = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+    g_autoptr(GError) gErr = nullptr;
+    if (ostree_repo_remote_change(repo,
+                                  nullptr,
+                                  OSTREE_REPO_REMOTE_CHANGE_DELETE_IF_EXISTS,
+                                  remoteName.toUtf8(),
+                                  nullptr,
+                                  nullptr,
+                                  nullptr,
+                                  &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_remote_change", gErr);
+    }
+
+    if (ostree_repo_remote_change(repo,
+                                  nullptr,
+                                  OSTREE_REPO_REMOTE_CHANGE_ADD,
+                                  remoteName.toUtf8(),
+                                  (url + "/repos/" + remoteName).toUtf8(),
+                                  options,
+                                  nullptr,
+                                  &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_remote_change", gErr);
+    }
+
+    GKeyFile *configKeyFile = ostree_repo_get_config(repo);
+    Q_ASSERT(configKeyFile != nullptr);
+    QDir a;
+
+    g_key_file_set_string(configKeyFile, "core", "min-free-space-size", "600MB");
+    if (!parent.isEmpty()) {
+        QDir parentDir = parent;
+        Q_ASSERT(parentDir.exists());
+        g_key_file_set_string(configKeyFile, "core", "parent", parentDir.absolutePath().toUtf8());
+    }
+
+    if (ostree_repo_write_config(repo, configKeyFile, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_write_config", gErr);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<OstreeRepo *> createOstreeRepo(const QDir &location,
+                                                    const QString &remoteName,
+                                                    const QString &url,
+                                                    const QString &parent = "") noexcept
+{
+    LINGLONG_TRACE("create linglong repository at " + location.absolutePath());
+
+    if (!QFileInfo(location.absolutePath()).isWritable()) {
+        return LINGLONG_ERR("permission denied");
+    }
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) repoPath = nullptr;
+    g_autoptr(OstreeRepo) ostreeRepo = nullptr;
+
+    repoPath = g_file_new_for_path(location.absolutePath().toUtf8());
+    ostreeRepo = ostree_repo_new(repoPath);
+    Q_ASSERT(ostreeRepo != nullptr);
+    if (ostree_repo_create(ostreeRepo, OSTREE_REPO_MODE_BARE_USER_ONLY, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_create", gErr);
+    }
+
+    auto result = updateOstreeRepoConfig(ostreeRepo, remoteName, url, parent);
+
+    if (!result) {
         return LINGLONG_ERR(result);
     }
 
     return static_cast<OstreeRepo *>(g_steal_pointer(&ostreeRepo));
 }
 
+// The URL of the default repository, followed by its mirrors.
+QStringList mirrorsOf(const api::types::v1::RepoConfig &cfg) noexcept
+{
+    QStringList mirrors{ QString::fromStdString(cfg.repos.at(cfg.defaultRepo)) };
+    if (!cfg.mirrors) {
+        return mirrors;
+    }
+
+    auto it = cfg.mirrors->find(cfg.defaultRepo);
+    if (it == cfg.mirrors->end()) {
+        return mirrors;
+    }
+
+    for (const auto &mirror : it->second) {
+        const auto url = QString::fromStdString(mirror);
+        if (!mirrors.contains(url)) {
+            mirrors.append(url);
+        }
+    }
+
+    return mirrors;
+}
+
+// Measure how long every mirror takes to serve the config file of the
+// repository, and return the mirrors ordered by it. Unreachable mirrors are
+// kept at the end in the configured order, they are still tried on failover.
+QStringList sortMirrorsByLatency(const QStringList &mirrors, const QString &remoteName) noexcept
+{
+    std::vector<qint64> latencies(mirrors.size(), -1);
+    auto pending = mirrors.size();
+    QElapsedTimer timer;
+
+    // NOTE: The loop is destroyed first, which disconnects the replies.
+    QNetworkAccessManager manager;
+    QEventLoop loop;
+    QTimer::singleShot(std::chrono::seconds(5), &loop, &QEventLoop::quit);
+
+    timer.start();
+    for (int i = 0; i < mirrors.size(); ++i) {
+        const QUrl url(mirrors[i] + "/repos/" + remoteName + "/config");
+        auto *reply = manager.get(QNetworkRequest(url));
+        QObject::connect(reply, &QNetworkReply::finished, &loop, [&, i, reply]() {
+            if (reply->error() == QNetworkReply::NoError) {
+                latencies[i] = timer.elapsed();
+            }
+            if (--pending == 0) {
+                loop.quit();
+            }
+        });
+    }
+    loop.exec();
+
+    std::vector<int> order(mirrors.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&latencies](int lhs, int rhs) {
+        if (latencies[lhs] < 0 || latencies[rhs] < 0) {
+            return latencies[rhs] < 0 && latencies[lhs] >= 0;
+        }
+        return latencies[lhs] < latencies[rhs];
+    });
+
+    QStringList sorted;
+    for (const auto i : order) {
+        qDebug() << "mirror" << mirrors[i] << "latency" << latencies[i] << "ms";
+        sorted.append(mirrors[i]);
+    }
+
+    return sorted;
+}
+
+bool versionMatches(const package::Version &version, const package::Version &wanted) noexcept
+{
+    if (wanted.tweak) {
+        return version == wanted;
+    }
+
+    auto versionWithoutTweak = version;
+    versionWithoutTweak.tweak = std::nullopt;
+    return versionWithoutTweak == wanted;
+}
+
 utils::error::Result<package::Reference> clearReferenceLocal(const package::FuzzyReference &fuzzy,
-                                                             QDir layersDir) noexcept
+                                                             const LocalIndex &index) noexcept
 {
     LINGLONG_TRACE("clear fuzzy reference locally");
 
@@ -484,60 +1288,55 @@ utils::error::Result<package::Reference> clearReferenceLocal(const package::Fuzz
         channel = *fuzzy.channel;
     }
 
-    QDir versionDir = layersDir.absoluteFilePath(channel + "/" + fuzzy.id);
-    if (!versionDir.exists() && channel == "main") {
+    auto records = index.findByPrefix(QString("%1/%2/").arg(channel, fuzzy.id).toUtf8());
+    if (records.empty() && channel == "main") {
         // NOTE: fallback from main to linglong
         channel = "linglong";
-        versionDir.setPath(layersDir.absoluteFilePath(channel + "/" + fuzzy.id));
+        records = index.findByPrefix(QString("%1/%2/").arg(channel, fuzzy.id).toUtf8());
     }
-    if (!versionDir.exists()) {
+    if (records.empty()) {
         return LINGLONG_ERR("channel not found");
     }
 
     utils::error::Result<package::Version> foundVersion =
       LINGLONG_ERR("compatible version not found");
 
-    auto list = versionDir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const auto &record : records) {
+        // NOTE: refspec is channel/id/version/arch/module
+        const auto parts = QString::fromUtf8(record.first).split('/');
+        if (parts.size() != 5) {
+            qCritical() << "broken local index detected" << record.first;
+            Q_ASSERT(false);
+            continue;
+        }
 
-    for (const auto &info : list) {
-        if (!info.isDir()) {
+        if (parts[3] != arch->toString()) {
             continue;
         }
 
-        auto availableVersion = package::Version::parse(info.fileName());
+        auto availableVersion = package::Version::parse(parts[2]);
         if (!availableVersion) {
-            qCritical() << "broken ostree based linglong repository detected"
-                        << info.absoluteFilePath() << availableVersion.error();
+            qCritical() << "broken ostree based linglong repository detected" << record.first
+                        << availableVersion.error();
             Q_ASSERT(false);
             continue;
         }
 
         if (!availableVersion->tweak) {
-            qCritical() << "broken ostree based linglong repository detected"
-                        << info.absoluteFilePath() << "tweak missing.";
+            qCritical() << "broken ostree based linglong repository detected" << record.first
+                        << "tweak missing.";
             Q_ASSERT(false);
             continue;
         }
 
         qDebug() << "available version found:" << availableVersion->toString();
 
-        if (!fuzzy.version) {
-            foundVersion = *availableVersion;
-            continue;
-        }
-
-        if (fuzzy.version->tweak) {
-            if (*availableVersion != fuzzy.version) {
-                continue;
-            }
-
-            foundVersion = *availableVersion;
+        if (fuzzy.version && !versionMatches(*availableVersion, *fuzzy.version)) {
             continue;
         }
 
-        auto versionWithoutTweak = *availableVersion;
-        versionWithoutTweak.tweak = std::nullopt;
-        if (versionWithoutTweak != *fuzzy.version) {
+        // NOTE: records are sorted by bytes, not by version.
+        if (foundVersion && *foundVersion >= *availableVersion) {
             continue;
         }
 
@@ -554,111 +1353,578 @@ utils::error::Result<package::Reference> clearReferenceLocal(const package::Fuzz
         return LINGLONG_ERR(ref);
     }
 
-    QDir layer = versionDir.absoluteFilePath(foundVersion->toString() + "/" + arch->toString());
-    if (!layer.exists()) {
-        return LINGLONG_ERR("cannot found layer " + ref->toString());
-    }
-
     return ref;
 }
 
-utils::error::Result<package::Reference> clearReferenceRemote(const package::FuzzyReference &fuzzy,
-                                                              api::client::ClientApi &api,
-                                                              const QString &repoName) noexcept
+utils::error::Result<package::Reference>
+clearReferenceRemote(const package::FuzzyReference &fuzzy,
+                     const std::vector<api::types::v1::PackageInfo> &records) noexcept
 {
     LINGLONG_TRACE("clear reference remotely");
 
-    api::client::Request_FuzzySearchReq req;
-    if (fuzzy.channel) {
-        req.setChannel(*fuzzy.channel);
-    }
+    utils::error::Result<package::Reference> ref = LINGLONG_ERR("not found");
 
-    req.setAppId(fuzzy.id);
-    if (fuzzy.version) {
-        req.setVersion(fuzzy.version->toString());
-    }
+    for (const auto &record : records) {
+        // NOTE: Search results are fuzzy, only take the exact application.
+        if (QString::fromStdString(record.appid) != fuzzy.id) {
+            continue;
+        }
 
-    if (fuzzy.arch) {
-        req.setArch(fuzzy.arch->toString());
-    } else {
-        // NOTE: Server requires that arch is set, but why?
-        req.setArch(QSysInfo::currentCpuArchitecture());
-    }
+        const auto recordJSON = QString::fromStdString(nlohmann::json(record).dump());
 
-    req.setRepoName(repoName);
+        auto version = package::Version::parse(QString::fromStdString(record.version));
+        if (!version) {
+            qWarning() << "Ignore invalid package record" << recordJSON << version.error();
+            continue;
+        }
 
-    utils::error::Result<package::Reference> ref = LINGLONG_ERR("unknown error");
+        if (record.arch.empty()) {
+            qWarning() << "Ignore invalid package record" << recordJSON << "arch missing.";
+            continue;
+        }
 
-    QEventLoop loop;
-    const qint32 HTTP_OK = 200;
-    QEventLoop::connect(
-      &api,
-      &api::client::ClientApi::fuzzySearchAppSignal,
-      &loop,
-      [&](api::client::FuzzySearchApp_200_response resp) {
-          LINGLONG_TRACE("fuzzySearchAppSignal");
+        auto arch = package::Architecture::parse(QString::fromStdString(record.arch.front()));
+        if (!arch) {
+            qWarning() << "Ignore invalid package record" << recordJSON << arch.error();
+            continue;
+        }
 
-          loop.exit();
-          if (resp.getCode() != HTTP_OK) {
-              ref = LINGLONG_ERR(resp.getMsg(), resp.getCode());
-              return;
-          }
+        auto currentRef = package::Reference::create(QString::fromStdString(record.channel),
+                                                     QString::fromStdString(record.appid),
+                                                     *version,
+                                                     *arch);
+        if (!currentRef) {
+            qWarning() << "Ignore invalid package record" << recordJSON << currentRef.error();
+            continue;
+        }
+        if (!ref) {
+            ref = *currentRef;
+            continue;
+        }
 
-          for (const auto &record : resp.getData()) {
-              auto version = package::Version::parse(record.getVersion());
-              if (!version) {
-                  qWarning() << "Ignore invalid package record" << record.asJson()
-                             << version.error();
-                  continue;
-              }
+        if (ref->version >= currentRef->version) {
+            continue;
+        }
 
-              auto arch = package::Architecture::parse(record.getArch());
-              if (!arch) {
-                  qWarning() << "Ignore invalid package record" << record.asJson() << arch.error();
-                  continue;
-              }
+        ref = *currentRef;
+    }
 
-              auto currentRef =
-                package::Reference::create(record.getChannel(), record.getAppId(), *version, *arch);
-              if (!currentRef) {
-                  qWarning() << "Ignore invalid package record" << record.asJson()
-                             << currentRef.error();
-                  continue;
-              }
-              if (!ref) {
-                  ref = *currentRef;
-                  continue;
-              }
+    if (!ref) {
+        return LINGLONG_ERR(ref);
+    }
 
-              if (ref->version >= currentRef->version) {
-                  continue;
-              }
+    return *ref;
+}
 
-              ref = *currentRef;
-          }
-          return;
-      },
-      loop.thread() == api.thread() ? Qt::AutoConnection : Qt::BlockingQueuedConnection);
+// NOTE: The remote index is shipped as additional metadata of the ostree
+// summary file, which is fetched with conditional requests by ostree itself.
+constexpr auto remoteIndexKey = "linglong.index";
+constexpr auto remoteIndexVersionKey = "linglong.index.version";
+constexpr guint32 remoteIndexVersion = 1;
 
-    QEventLoop::connect(
-      &api,
-      &api::client::ClientApi::fuzzySearchAppSignalEFull,
-      &loop,
-      [&](auto, auto error_type, const QString &error_str) {
-          LINGLONG_TRACE("fuzzySearchAppSignalEFull");
-          loop.exit();
-          ref = LINGLONG_ERR(error_str, error_type);
-      },
-      loop.thread() == api.thread() ? Qt::AutoConnection : Qt::BlockingQueuedConnection);
+utils::error::Result<void> regenerateSummary(OstreeRepo *repo, const LocalIndex &index) noexcept
+{
+    LINGLONG_TRACE("regenerate summary");
 
-    api.fuzzySearchApp(req);
-    loop.exec();
+    const auto compressed = qCompress(index.content());
 
-    if (!ref) {
-        return LINGLONG_ERR("not found", ref);
+    GVariantBuilder builder{};
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder,
+                          "{sv}",
+                          remoteIndexVersionKey,
+                          g_variant_new_uint32(remoteIndexVersion));
+    g_variant_builder_add(&builder,
+                          "{sv}",
+                          remoteIndexKey,
+                          g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                    compressed.constData(),
+                                                    compressed.size(),
+                                                    sizeof(char)));
+    g_autoptr(GVariant) metadata = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+    g_autoptr(GError) gErr = nullptr;
+    if (ostree_repo_regenerate_summary(repo, metadata, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_regenerate_summary", gErr);
     }
 
-    return *ref;
+    return LINGLONG_OK;
+}
+
+// Generate a static delta between the commits of the refspecs, so that
+// clients which have the first one only download the delta.
+utils::error::Result<void> generateStaticDelta(OstreeRepo *repo,
+                                               const QByteArray &from,
+                                               const QByteArray &to) noexcept
+{
+    LINGLONG_TRACE(QString("generate static delta from %1 to %2")
+                     .arg(QString::fromUtf8(from), QString::fromUtf8(to)));
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autofree char *fromCommit = nullptr;
+    if (ostree_repo_resolve_rev(repo, from.constData(), FALSE, &fromCommit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+
+    g_autofree char *toCommit = nullptr;
+    if (ostree_repo_resolve_rev(repo, to.constData(), FALSE, &toCommit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+
+    GVariantBuilder builder{};
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_autoptr(GVariant) params = g_variant_ref_sink(g_variant_builder_end(&builder));
+
+    if (ostree_repo_static_delta_generate(repo,
+                                          OSTREE_STATIC_DELTA_GENERATE_OPT_MAJOR,
+                                          fromCommit,
+                                          toCommit,
+                                          nullptr,
+                                          params,
+                                          nullptr,
+                                          &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_static_delta_generate", gErr);
+    }
+
+    return LINGLONG_OK;
+}
+
+// The summary of a remote repository. index is std::nullopt if the remote
+// repository does not provide one, commits are the refspecs it points to.
+struct RemoteSummary
+{
+    std::optional<QByteArray> index;
+    QHash<QByteArray, QByteArray> commits;
+};
+
+utils::error::Result<RemoteSummary> fetchRemoteSummary(OstreeRepo *repo,
+                                                       const QString &remote) noexcept
+{
+    LINGLONG_TRACE("fetch remote summary of " + remote);
+
+    g_autoptr(GBytes) summary = nullptr;
+    g_autoptr(GError) gErr = nullptr;
+    if (ostree_repo_remote_fetch_summary_with_options(repo,
+                                                      remote.toUtf8(),
+                                                      nullptr,
+                                                      &summary,
+                                                      nullptr,
+                                                      nullptr,
+                                                      &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_remote_fetch_summary_with_options", gErr);
+    }
+
+    RemoteSummary result;
+    if (summary == nullptr) {
+        return result;
+    }
+
+    g_autoptr(GVariant) summaryVariant =
+      g_variant_ref_sink(g_variant_new_from_bytes(OSTREE_SUMMARY_GVARIANT_FORMAT, summary, FALSE));
+
+    // NOTE: refs are a(s(taya{sv})), the name and the size, checksum and
+    // metadata of its commit.
+    g_autoptr(GVariant) refs = g_variant_get_child_value(summaryVariant, 0);
+    const auto refsCount = g_variant_n_children(refs);
+    for (gsize i = 0; i < refsCount; ++i) {
+        g_autoptr(GVariant) ref = g_variant_get_child_value(refs, i);
+        g_autoptr(GVariant) name = g_variant_get_child_value(ref, 0);
+        g_autoptr(GVariant) commit = g_variant_get_child_value(ref, 1);
+        g_autoptr(GVariant) checksum = g_variant_get_child_value(commit, 1);
+        if (ostree_validate_structureof_csum_v(checksum, nullptr) == FALSE) {
+            continue;
+        }
+
+        g_autofree char *checksumString = ostree_checksum_from_bytes_v(checksum);
+        result.commits.insert(g_variant_get_string(name, nullptr), checksumString);
+    }
+
+    g_autoptr(GVariant) metadata = g_variant_get_child_value(summaryVariant, 1);
+
+    guint32 version = 0;
+    if (g_variant_lookup(metadata, remoteIndexVersionKey, "u", &version) == FALSE) {
+        return result;
+    }
+
+    if (version != remoteIndexVersion) {
+        qWarning() << "Ignore remote index with unsupported version" << version;
+        return result;
+    }
+
+    g_autoptr(GVariant) index =
+      g_variant_lookup_value(metadata, remoteIndexKey, G_VARIANT_TYPE_BYTESTRING);
+    if (index == nullptr) {
+        return LINGLONG_ERR("remote index missing");
+    }
+
+    gsize size = 0;
+    const auto *data = g_variant_get_fixed_array(index, &size, sizeof(char));
+    auto content = qUncompress(static_cast<const uchar *>(data), static_cast<int>(size));
+    if (content.isEmpty()) {
+        return LINGLONG_ERR("broken remote index");
+    }
+
+    result.index = std::move(content);
+    return result;
+}
+
+// An empty id matches all applications, which FuzzyReference does not allow.
+utils::error::Result<std::vector<api::types::v1::PackageInfo>>
+searchRemoteIndex(const LocalIndex &index,
+                  const std::optional<QString> &channel,
+                  const QString &id,
+                  const std::optional<package::Version> &wantedVersion,
+                  const std::optional<package::Architecture> &wantedArch) noexcept
+{
+    LINGLONG_TRACE("search remote index for " + (id.isEmpty() ? QString("all") : id));
+
+    auto arch = package::Architecture::parse(QSysInfo::currentCpuArchitecture());
+    if (wantedArch) {
+        arch = *wantedArch;
+    }
+    if (!arch) {
+        return LINGLONG_ERR(arch);
+    }
+
+    QByteArray prefix;
+    if (channel) {
+        prefix = (*channel + "/").toUtf8();
+    }
+
+    std::vector<api::types::v1::PackageInfo> pkgInfos;
+
+    for (const auto &[refspec, rawInfo] : index.findByPrefix(prefix)) {
+        // NOTE: refspec is channel/id/version/arch/module
+        const auto parts = QString::fromUtf8(refspec).split('/');
+        if (parts.size() != 5) {
+            qWarning() << "Ignore invalid remote index record" << refspec;
+            continue;
+        }
+
+        // NOTE: Develop modules are installed along with their runtime module,
+        // as the search API does, only the latter is listed.
+        if (parts[4] == "develop") {
+            continue;
+        }
+
+        if (!parts[1].contains(id, Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        if (parts[3] != arch->toString()) {
+            continue;
+        }
+
+        if (wantedVersion) {
+            auto version = package::Version::parse(parts[2]);
+            if (!version) {
+                qWarning() << "Ignore invalid remote index record" << refspec << version.error();
+                continue;
+            }
+
+            if (!versionMatches(*version, *wantedVersion)) {
+                continue;
+            }
+        }
+
+        auto pkgInfo = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(rawInfo);
+        if (!pkgInfo) {
+            qWarning() << "Ignore invalid remote index record" << refspec << pkgInfo.error();
+            continue;
+        }
+
+        pkgInfos.emplace_back(std::move(*pkgInfo));
+    }
+
+    return pkgInfos;
+}
+
+// Directories under entries/share with a cache, and the tool regenerating it.
+const std::vector<std::pair<QString, QString>> sharedInfoTools = {
+    { "applications", "update-desktop-database" },
+    { "mime", "update-mime-database" },
+    { "glib-2.0/schemas", "glib-compile-schemas" },
+};
+
+// The link manifest lists the links an exported reference created, one path
+// relative to entries/share per line.
+utils::error::Result<QStringList> readLinkManifest(const QString &path) noexcept
+{
+    LINGLONG_TRACE("read link manifest " + path);
+
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        return LINGLONG_ERR("open", file);
+    }
+
+    QStringList links;
+    while (!file.atEnd()) {
+        const auto line = QString::fromUtf8(file.readLine()).trimmed();
+        if (!line.isEmpty()) {
+            links.append(line);
+        }
+    }
+    if (file.error() != QFile::NoError) {
+        return LINGLONG_ERR("read", file);
+    }
+
+    return links;
+}
+
+utils::error::Result<void> writeLinkManifest(const QString &path, const QStringList &links) noexcept
+{
+    LINGLONG_TRACE("write link manifest " + path);
+
+    QSaveFile saveFile(path);
+    if (!saveFile.open(QIODevice::WriteOnly)) {
+        return LINGLONG_ERR("open: " + saveFile.errorString());
+    }
+
+    const auto content = links.join('\n').toUtf8() + '\n';
+    if (saveFile.write(content) != content.size()) {
+        return LINGLONG_ERR("write: " + saveFile.errorString());
+    }
+
+    if (!saveFile.commit()) {
+        return LINGLONG_ERR("commit: " + saveFile.errorString());
+    }
+
+    return LINGLONG_OK;
+}
+
+// The returned repository is owned by the caller.
+utils::error::Result<OstreeRepo *> openOstreeRepo(const QString &path) noexcept
+{
+    LINGLONG_TRACE("open ostree repo " + path);
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) repoPath = g_file_new_for_path(path.toUtf8());
+    g_autoptr(OstreeRepo) repo = ostree_repo_new(repoPath);
+    if (ostree_repo_open(repo, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_open", gErr);
+    }
+
+    return static_cast<OstreeRepo *>(g_steal_pointer(&repo));
+}
+
+// Check the objects against their checksums, returns the corrupted ones.
+// Every worker opens the repository on its own.
+utils::error::Result<QStringList> fsckObjects(const QString &repoPath,
+                                              const QStringList &objects) noexcept
+{
+    LINGLONG_TRACE("fsck objects");
+
+    auto result = openOstreeRepo(repoPath);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+    g_autoptr(OstreeRepo) repo = *result;
+
+    QStringList corrupted;
+    for (const auto &object : objects) {
+        g_autofree char *checksum = nullptr;
+        OstreeObjectType objectType{};
+        ostree_object_from_string(object.toUtf8(), &checksum, &objectType);
+
+        g_autoptr(GError) gErr = nullptr;
+        if (ostree_repo_fsck_object(repo, objectType, checksum, nullptr, &gErr) == FALSE) {
+            qWarning() << "corrupted object" << object << gErr->message;
+            corrupted.append(object);
+        }
+    }
+
+    return corrupted;
+}
+
+// Compare a checkout with the tree it was checked out from, returns the paths
+// of files missing or modified in the checkout. Files hardlinked to their
+// object are covered by fsckObjects, the others are checksummed again.
+utils::error::Result<QStringList>
+verifyCheckout(OstreeRepo *repo, GFile *tree, const QDir &checkout) noexcept
+{
+    LINGLONG_TRACE("verify checkout " + checkout.absolutePath());
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFileEnumerator) enumerator =
+      g_file_enumerate_children(tree,
+                                "standard::name,standard::type,standard::size,"
+                                "standard::symlink-target",
+                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                nullptr,
+                                &gErr);
+    if (enumerator == nullptr) {
+        return LINGLONG_ERR("g_file_enumerate_children", gErr);
+    }
+
+    QStringList broken;
+    while (true) {
+        GFileInfo *info = nullptr;
+        GFile *child = nullptr;
+        if (g_file_enumerator_iterate(enumerator, &info, &child, nullptr, &gErr) == FALSE) {
+            return LINGLONG_ERR("g_file_enumerator_iterate", gErr);
+        }
+        if (info == nullptr) {
+            break;
+        }
+
+        const auto path = checkout.absoluteFilePath(QString::fromUtf8(g_file_info_get_name(info)));
+        const QFileInfo local(path);
+
+        switch (g_file_info_get_file_type(info)) {
+        case G_FILE_TYPE_DIRECTORY: {
+            if (local.isSymLink() || !local.isDir()) {
+                broken.append(path);
+                break;
+            }
+
+            auto result = verifyCheckout(repo, child, QDir(path));
+            if (!result) {
+                return LINGLONG_ERR(result);
+            }
+            broken.append(*result);
+        } break;
+        case G_FILE_TYPE_SYMBOLIC_LINK: {
+            g_autofree char *target = g_file_read_link(path.toUtf8(), nullptr);
+            if (g_strcmp0(target, g_file_info_get_symlink_target(info)) != 0) {
+                broken.append(path);
+            }
+        } break;
+        case G_FILE_TYPE_REGULAR: {
+            if (local.isSymLink() || !local.isFile()
+                || local.size() != g_file_info_get_size(info)) {
+                broken.append(path);
+                break;
+            }
+
+            if (local.size() == 0) {
+                break;
+            }
+
+            const auto *checksum = ostree_repo_file_get_checksum(OSTREE_REPO_FILE(child));
+            g_autofree char *objectPath =
+              ostree_get_relative_object_path(checksum, OSTREE_OBJECT_TYPE_FILE, FALSE);
+            struct stat objectStat = {};
+            struct stat localStat = {};
+            if (fstatat(ostree_repo_get_dfd(repo), objectPath, &objectStat, AT_SYMLINK_NOFOLLOW)
+                  == 0
+                && lstat(path.toUtf8(), &localStat) == 0 && objectStat.st_dev == localStat.st_dev
+                && objectStat.st_ino == localStat.st_ino) {
+                break;
+            }
+
+            // NOTE: The mode and owner of the object are used, only the
+            // content of the checkout is compared.
+            g_autoptr(GFileInfo) objectInfo = g_file_query_info(child,
+                                                                "standard::*,unix::*",
+                                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                                nullptr,
+                                                                &gErr);
+            if (objectInfo == nullptr) {
+                return LINGLONG_ERR("g_file_query_info", gErr);
+            }
+
+            g_autoptr(GFile) localFile = g_file_new_for_path(path.toUtf8());
+            g_autoptr(GFileInputStream) input = g_file_read(localFile, nullptr, &gErr);
+            if (input == nullptr) {
+                qWarning() << "failed to read" << path << gErr->message;
+                g_clear_error(&gErr);
+                broken.append(path);
+                break;
+            }
+
+            g_autofree guchar *csum = nullptr;
+            if (ostree_checksum_file_from_input(objectInfo,
+                                                nullptr,
+                                                G_INPUT_STREAM(input),
+                                                OSTREE_OBJECT_TYPE_FILE,
+                                                &csum,
+                                                nullptr,
+                                                &gErr)
+                == FALSE) {
+                return LINGLONG_ERR("ostree_checksum_file_from_input", gErr);
+            }
+
+            g_autofree char *actual = ostree_checksum_from_bytes(csum);
+            if (g_strcmp0(actual, checksum) != 0) {
+                broken.append(path);
+            }
+        } break;
+        default:
+            break;
+        }
+    }
+
+    return broken;
+}
+
+struct layerState
+{
+    // The commit of the layer misses objects or has corrupted ones.
+    bool needsPull = false;
+    // Files missing or modified in the checkout.
+    QStringList brokenFiles;
+};
+
+utils::error::Result<layerState> verifyLayer(const QString &repoPath,
+                                             const QString &refspec,
+                                             const QDir &layerDir,
+                                             const QSet<QString> &corrupted) noexcept
+{
+    LINGLONG_TRACE("verify layer " + refspec);
+
+    auto result = openOstreeRepo(repoPath);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+    g_autoptr(OstreeRepo) repo = *result;
+
+    g_autoptr(GError) gErr = nullptr;
+    layerState state;
+
+    g_autofree char *commit = nullptr;
+    if (ostree_repo_resolve_rev(repo, refspec.toUtf8(), TRUE, &commit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+    if (commit == nullptr) {
+        state.needsPull = true;
+        return state;
+    }
+
+    g_autoptr(GHashTable) reachable = nullptr;
+    if (ostree_repo_traverse_commit(repo, commit, 0, &reachable, nullptr, &gErr) == FALSE) {
+        qWarning() << "failed to traverse" << refspec << gErr->message;
+        state.needsPull = true;
+        return state;
+    }
+
+    GHashTableIter iter;
+    gpointer key = nullptr;
+    g_hash_table_iter_init(&iter, reachable);
+    while (g_hash_table_iter_next(&iter, &key, nullptr) == TRUE) {
+        const char *checksum = nullptr;
+        OstreeObjectType objectType{};
+        ostree_object_name_deserialize(static_cast<GVariant *>(key), &checksum, &objectType);
+        g_autofree char *object = ostree_object_to_string(checksum, objectType);
+        if (corrupted.contains(object)) {
+            state.needsPull = true;
+            return state;
+        }
+    }
+
+    g_autoptr(GFile) root = nullptr;
+    if (ostree_repo_read_commit(repo, commit, &root, nullptr, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_read_commit", gErr);
+    }
+
+    auto files = verifyCheckout(repo, root, layerDir);
+    if (!files) {
+        return LINGLONG_ERR(files);
+    }
+    state.brokenFiles = *files;
+
+    return state;
 }
 
 } // namespace
@@ -668,6 +1934,13 @@ QDir OSTreeRepo::getLayerQDir(const package::Reference &ref, bool develop) const
     return this->repoDir.absoluteFilePath("layers/" + ostreeSpecFromReference(ref, develop));
 }
 
+QString OSTreeRepo::linkManifestPath(const package::Reference &ref) const noexcept
+{
+    // NOTE: The manifest is kept next to the layer directory instead of in
+    // it, the layer is gone by the time its reference is unexported.
+    return this->getLayerQDir(ref).absolutePath() + ".links";
+}
+
 QDir OSTreeRepo::ostreeRepoDir() const noexcept
 {
     Q_ASSERT(!this->repoDir.path().isEmpty());
@@ -682,6 +1955,10 @@ OSTreeRepo::OSTreeRepo(const QDir &path,
                        const api::types::v1::RepoConfig &cfg,
                        api::client::ClientApi &client) noexcept
     : cfg(cfg)
+    , localIndex(path.absoluteFilePath("layers.idx"))
+    , remoteIndex(QFileInfo(configPath(path)).absoluteDir().absoluteFilePath("remote.idx"))
+    , stagingIndex(path.absoluteFilePath("staging.idx"))
+    , sharedIndex(path.absoluteFilePath("shared.idx"))
     , apiClient(client)
 {
     if (!path.exists()) {
@@ -700,6 +1977,35 @@ OSTreeRepo::OSTreeRepo(const QDir &path,
 
     this->repoDir = path;
 
+    {
+        auto result = this->localIndex.open();
+        if (!result) {
+            qDebug() << result.error();
+            result = this->rebuildLocalIndex();
+            if (!result) {
+                qWarning() << result.error();
+            }
+        }
+
+        // NOTE: A missing remote index is fetched on the first remote query.
+        result = this->remoteIndex.open();
+        if (!result) {
+            qDebug() << result.error();
+        }
+
+        // NOTE: A missing staging index means there is no unfinished pull.
+        result = this->stagingIndex.open();
+        if (!result) {
+            qDebug() << result.error();
+        }
+
+        // NOTE: A missing shared index means no layer is shared with the peers.
+        result = this->sharedIndex.open();
+        if (!result) {
+            qDebug() << result.error();
+        }
+    }
+
     {
         LINGLONG_TRACE("use linglong repo at " + path.absolutePath());
 
@@ -708,6 +2014,18 @@ OSTreeRepo::OSTreeRepo(const QDir &path,
         Q_ASSERT(ostreeRepo != nullptr);
         if (ostree_repo_open(ostreeRepo, nullptr, &gErr) == TRUE) {
             this->ostreeRepo.reset(static_cast<OstreeRepo *>(g_steal_pointer(&ostreeRepo)));
+
+            // NOTE: The remote may point to a mirror chosen by a previous run.
+            g_autofree char *url = nullptr;
+            if (ostree_repo_remote_get_url(this->ostreeRepo.get(),
+                                           this->cfg.defaultRepo.c_str(),
+                                           &url,
+                                           &gErr)
+                == TRUE) {
+                this->currentMirror = QString::fromUtf8(url).section("/repos/", 0, 0);
+            } else {
+                qDebug() << LINGLONG_ERRV("ostree_repo_remote_get_url", gErr);
+            }
             return;
         }
 
@@ -728,6 +2046,7 @@ OSTreeRepo::OSTreeRepo(const QDir &path,
     }
 
     this->ostreeRepo.reset(*result);
+    this->currentMirror = QString::fromStdString(this->cfg.repos[this->cfg.defaultRepo]);
 }
 
 api::types::v1::RepoConfig OSTreeRepo::getConfig() const noexcept
@@ -745,12 +2064,12 @@ utils::error::Result<void> OSTreeRepo::setConfig(const api::types::v1::RepoConfi
 
     utils::Transaction transaction;
 
-    auto result = saveConfig(cfg, this->repoDir.absoluteFilePath("config.yaml"));
+    auto result = saveConfig(cfg, configPath(this->repoDir));
     if (!result) {
         return LINGLONG_ERR(result);
     }
     transaction.addRollBack([this]() noexcept {
-        auto result = saveConfig(this->cfg, this->repoDir.absoluteFilePath("config.yaml"));
+        auto result = saveConfig(this->cfg, configPath(this->repoDir));
         if (!result) {
             qCritical() << result.error();
             Q_ASSERT(false);
@@ -778,21 +2097,52 @@ utils::error::Result<void> OSTreeRepo::setConfig(const api::types::v1::RepoConfi
       QString::fromStdString(cfg.repos.at(cfg.defaultRepo)));
 
     this->cfg = cfg;
+    this->remoteSearchCache.clear();
+    {
+        QMutexLocker locker(&this->mirrorsLock);
+        this->currentMirror = QString::fromStdString(cfg.repos.at(cfg.defaultRepo));
+        this->mirrors.clear();
+        this->mirrorsDeadline = QDeadlineTimer(std::chrono::seconds(0));
+    }
+
+    // NOTE: The remote index belongs to the previous default repository.
+    this->remoteIndexDeadline = QDeadlineTimer(std::chrono::seconds(0));
+    this->remoteCommits.clear();
+    result = this->remoteIndex.replace({});
+    if (!result) {
+        qWarning() << result.error();
+    }
 
     transaction.commit();
 
     return LINGLONG_OK;
 }
 
-utils::error::Result<void> OSTreeRepo::importLayerDir(const package::LayerDir &dir) noexcept
+void OSTreeRepo::setPeers(std::function<QList<QUrl>()> peers) noexcept
 {
-    LINGLONG_TRACE("import layer dir");
+    this->peers = std::move(peers);
+}
 
-    if (!dir.exists()) {
-        return LINGLONG_ERR(QString("layer directory %1 not exists").arg(dir.absolutePath()));
+QByteArrayList OSTreeRepo::sharedCommits() const noexcept
+{
+    QMutexLocker locker(&this->sharedIndexLock);
+
+    QByteArrayList commits;
+    for (const auto &[refspec, commit] : this->sharedIndex.findByPrefix({})) {
+        commits.append(QByteArray(commit.constData(), commit.size()));
     }
+    return commits;
+}
 
-    utils::Transaction transaction;
+utils::error::Result<void>
+OSTreeRepo::importLayerDir(const package::LayerDir &dir,
+                           const std::optional<api::types::v1::LayerInfoDelta> &delta) noexcept
+{
+    LINGLONG_TRACE("import layer dir");
+
+    if (!dir.exists()) {
+        return LINGLONG_ERR(QString("layer directory %1 not exists").arg(dir.absolutePath()));
+    }
 
     g_autoptr(GFile) gFile = g_file_new_for_path(dir.absolutePath().toUtf8());
     if (gFile == nullptr) {
@@ -804,12 +2154,72 @@ utils::error::Result<void> OSTreeRepo::importLayerDir(const package::LayerDir &d
         return LINGLONG_ERR(info);
     }
 
-    auto reference = package::Reference::fromPackageInfo(*info);
+    auto result = this->importLayer(
+      *info,
+      delta,
+      [this, &gFile](OstreeMutableTree *mtree, const char *refspec) {
+          return commitDirToRepo(gFile, this->ostreeRepo.get(), mtree, refspec);
+      });
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::importLayerFile(package::LayerFile &file) noexcept
+{
+    LINGLONG_TRACE("import layer file");
+
+    auto layerInfo = file.metaInfo();
+    if (!layerInfo) {
+        return LINGLONG_ERR(layerInfo);
+    }
+
+    auto info = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(layerInfo->info);
+    if (!info) {
+        return LINGLONG_ERR(info);
+    }
+
+    auto offset = file.binaryDataOffset();
+    if (!offset) {
+        return LINGLONG_ERR(offset);
+    }
+
+    auto reader = package::ErofsReader::New(file.fileName(), *offset);
+    if (!reader) {
+        return LINGLONG_ERR(reader);
+    }
+
+    auto result = this->importLayer(
+      *info,
+      layerInfo->delta,
+      [this, &reader](OstreeMutableTree *mtree, const char *refspec) {
+          return commitErofsToRepo(**reader, this->ostreeRepo.get(), mtree, refspec);
+      });
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::importLayer(
+  const api::types::v1::PackageInfo &info,
+  const std::optional<api::types::v1::LayerInfoDelta> &delta,
+  const std::function<utils::error::Result<void>(OstreeMutableTree *, const char *)>
+    &commit) noexcept
+{
+    LINGLONG_TRACE("import layer");
+
+    utils::Transaction transaction;
+
+    auto reference = package::Reference::fromPackageInfo(info);
     if (!reference) {
         return LINGLONG_ERR(reference);
     }
 
-    const auto isDevel = info->packageInfoModule == "develop";
+    const auto isDevel = info.packageInfoModule == "develop";
 
     if (this->getLayerDir(*reference, isDevel)) {
         return LINGLONG_ERR(reference->toString() + " exists.");
@@ -817,11 +2227,22 @@ utils::error::Result<void> OSTreeRepo::importLayerDir(const package::LayerDir &d
 
     const auto refspec = ostreeSpecFromReference(*reference, isDevel).toUtf8();
 
-    auto result = commitDirToRepo(gFile, this->ostreeRepo.get(), refspec);
+    g_autoptr(OstreeMutableTree) mtree = nullptr;
+    if (delta) {
+        auto baseTree = this->deltaBaseTree(*reference, isDevel, *delta);
+        if (!baseTree) {
+            return LINGLONG_ERR(baseTree);
+        }
+        mtree = *baseTree;
+    } else {
+        mtree = ostree_mutable_tree_new();
+    }
+
+    auto result = commit(mtree, refspec);
     if (!result) {
         return LINGLONG_ERR(result);
     }
-    transaction.addRollBack([this, &refspec]() noexcept {
+    transaction.addRollBack([this, refspec]() noexcept {
         auto result = removeOstreeRef(this->ostreeRepo.get(), refspec);
         if (!result) {
             qCritical() << result.error();
@@ -829,9 +2250,26 @@ utils::error::Result<void> OSTreeRepo::importLayerDir(const package::LayerDir &d
         }
     });
 
-    result = handleRepositoryUpdate(this->ostreeRepo.get(),
-                                    this->getLayerQDir(*reference, isDevel),
-                                    refspec);
+    const auto layerDir = this->getLayerQDir(*reference, isDevel);
+    transaction.addRollBack([layerDir]() noexcept {
+        auto dir = layerDir;
+        if (!dir.removeRecursively()) {
+            qCritical() << "Failed to remove layer directory" << layerDir.absolutePath();
+            Q_ASSERT(false);
+        }
+    });
+
+    result = handleRepositoryUpdate(this->ostreeRepo.get(), layerDir, refspec);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    auto rawInfo = package::LayerDir(layerDir.absolutePath()).rawInfo();
+    if (!rawInfo) {
+        return LINGLONG_ERR(rawInfo);
+    }
+
+    result = this->localIndex.insert(refspec, *rawInfo);
     if (!result) {
         return LINGLONG_ERR(result);
     }
@@ -840,13 +2278,96 @@ utils::error::Result<void> OSTreeRepo::importLayerDir(const package::LayerDir &d
     return LINGLONG_OK;
 }
 
+auto OSTreeRepo::deltaBaseTree(const package::Reference &ref,
+                               bool develop,
+                               const api::types::v1::LayerInfoDelta &delta) noexcept
+  -> utils::error::Result<OstreeMutableTree *>
+{
+    LINGLONG_TRACE("prepare base of delta " + ref.toString());
+
+    auto base = package::Reference::parse(QString::fromStdString(delta.base));
+    if (!base) {
+        return LINGLONG_ERR(base);
+    }
+
+    if (base->id != ref.id || base->arch != ref.arch) {
+        return LINGLONG_ERR(QString("the delta is based on %1, not another version of %2")
+                              .arg(base->toString(), ref.id));
+    }
+
+    if (!this->getLayerDir(*base, develop)) {
+        return LINGLONG_ERR(QString("%1 is not installed, install it before the delta")
+                              .arg(base->toString()));
+    }
+
+    const auto baseRefspec = ostreeSpecFromReference(*base, develop).toUtf8();
+    auto checksum = contentChecksum(this->ostreeRepo.get(), baseRefspec);
+    if (!checksum) {
+        return LINGLONG_ERR(checksum);
+    }
+
+    if (*checksum != QString::fromStdString(delta.checksum)) {
+        return LINGLONG_ERR(QString("the files of the installed %1 differ from those the delta "
+                                    "is based on, install the full layer instead")
+                              .arg(base->toString()));
+    }
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(OstreeMutableTree) mtree =
+      ostree_mutable_tree_new_from_commit(this->ostreeRepo.get(), baseRefspec, &gErr);
+    if (mtree == nullptr) {
+        return LINGLONG_ERR("ostree_mutable_tree_new_from_commit", gErr);
+    }
+
+    auto result = removeFromMtree(mtree, delta.removed.value_or(std::vector<std::string>{}));
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return static_cast<OstreeMutableTree *>(g_steal_pointer(&mtree));
+}
+
+auto OSTreeRepo::getLayerChecksum(const package::Reference &ref, bool develop) const noexcept
+  -> utils::error::Result<QString>
+{
+    LINGLONG_TRACE("get checksum of " + ref.toString());
+
+    if (!this->getLayerDir(ref, develop)) {
+        return LINGLONG_ERR(ref.toString() + " not exist.");
+    }
+
+    auto checksum =
+      contentChecksum(this->ostreeRepo.get(), ostreeSpecFromReference(ref, develop).toUtf8());
+    if (!checksum) {
+        return LINGLONG_ERR(checksum);
+    }
+
+    return checksum;
+}
+
 utils::error::Result<void> OSTreeRepo::push(const package::Reference &ref,
-                                            bool develop) const noexcept
+                                            bool develop,
+                                            const pushOption &opts) const noexcept
 {
     const qint32 HTTP_OK = 200;
 
     LINGLONG_TRACE("push " + ref.toString());
 
+    // NOTE: Repositories in the local file system are written directly, and
+    // can be served by any static HTTP server afterwards.
+    const QUrl url(QString::fromStdString(this->cfg.repos.at(this->cfg.defaultRepo)));
+    if (url.isLocalFile()) {
+        auto result = this->publish(
+          ref,
+          develop,
+          url.toLocalFile() + "/repos/" + QString::fromStdString(this->cfg.defaultRepo));
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+
+        return LINGLONG_OK;
+    }
+
     auto token = [this]() -> utils::error::Result<QString> {
         LINGLONG_TRACE("sign in");
 
@@ -939,59 +2460,9 @@ utils::error::Result<void> OSTreeRepo::push(const package::Reference &ref,
         return LINGLONG_ERR(taskID);
     }
 
-    const QTemporaryDir tmpDir;
-    if (!tmpDir.isValid()) {
-        return LINGLONG_ERR(tmpDir.errorString());
-    }
-
-    const QString tarFileName = QString("%1.tgz").arg(ref.id);
-    const QString tarFilePath = QDir::cleanPath(tmpDir.filePath(tarFileName));
-    QStringList args = { "-zcf",
-                         tarFilePath,
-                         "-C",
-                         this->getLayerQDir(ref, develop).absolutePath(),
-                         "." };
-    auto tarStdout = utils::command::Exec("tar", args);
-    if (!tarStdout) {
-        return LINGLONG_ERR(tarStdout);
-    }
-
-    auto uploadTaskResult = [this, &tarFilePath, &token, &taskID]() -> utils::error::Result<void> {
-        LINGLONG_TRACE("do upload task");
-
-        utils::error::Result<void> result;
-
-        QEventLoop loop;
-        QEventLoop::connect(
-          &this->apiClient,
-          &api::client::ClientApi::uploadTaskFileSignal,
-          &loop,
-          [&](const api::client::Api_UploadTaskFileResp &resp) {
-              loop.exit();
-              if (resp.getCode() != HTTP_OK) {
-                  result = LINGLONG_ERR(resp.getMsg(), resp.getCode());
-                  return;
-              }
-          },
-          loop.thread() == apiClient.thread() ? Qt::AutoConnection : Qt::BlockingQueuedConnection);
-        QEventLoop::connect(
-          &this->apiClient,
-          &api::client::ClientApi::uploadTaskFileSignalEFull,
-          &loop,
-          [&](auto, auto error_type, const QString &error_str) {
-              loop.exit();
-              result = LINGLONG_ERR(error_str, error_type);
-          },
-          loop.thread() == apiClient.thread() ? Qt::AutoConnection : Qt::BlockingQueuedConnection);
-
-        api::client::HttpFileElement file;
-        file.setFileName(tarFilePath);
-        file.setRequestFileName(tarFilePath);
-        apiClient.uploadTaskFile(*token, *taskID, file);
-
-        loop.exec();
-        return result;
-    }();
+    auto uploadTaskResult = opts.objects
+      ? this->uploadObjects(ostreeSpecFromReference(ref, develop), *token, *taskID)
+      : this->uploadTarball(ref, develop, *token, *taskID);
     if (!uploadTaskResult) {
         return LINGLONG_ERR(uploadTaskResult);
     }
@@ -1001,6 +2472,11 @@ utils::error::Result<void> OSTreeRepo::push(const package::Reference &ref,
 
         utils::error::Result<bool> isFinished;
 
+        // NOTE: The server takes a while to unpack and commit a large layer,
+        // poll less frequently as time goes on.
+        constexpr std::chrono::milliseconds maxInterval{ std::chrono::seconds(10) };
+        std::chrono::milliseconds interval{ 500 };
+
         while (true) {
             QEventLoop loop;
             QEventLoop::connect(
@@ -1050,7 +2526,8 @@ utils::error::Result<void> OSTreeRepo::push(const package::Reference &ref,
                 return LINGLONG_OK;
             }
 
-            QThread::sleep(1);
+            QThread::msleep(interval.count());
+            interval = std::min(interval * 2, maxInterval);
         }
 
         return LINGLONG_OK;
@@ -1062,141 +2539,1488 @@ utils::error::Result<void> OSTreeRepo::push(const package::Reference &ref,
     return LINGLONG_OK;
 }
 
-utils::error::Result<void> OSTreeRepo::remove(const package::Reference &ref, bool develop) noexcept
+utils::error::Result<void> OSTreeRepo::publish(const package::Reference &ref,
+                                               bool develop,
+                                               const QString &path) const noexcept
 {
-    LINGLONG_TRACE("remove " + ref.toString());
+    LINGLONG_TRACE("publish " + ref.toString() + " to " + path);
 
-    if (!this->getLayerQDir(ref, develop).removeRecursively()) {
-        qCritical() << "Failed to remove layer directory of" << ref.toString()
-                    << "develop:" << develop;
-        Q_ASSERT(false);
+    const auto refspec = ostreeSpecFromReference(ref, develop).toUtf8();
+    auto rawInfo = this->localIndex.find(refspec);
+    if (!rawInfo) {
+        return LINGLONG_ERR(QString::fromUtf8(refspec) + " not found");
     }
+    // NOTE: rawInfo references the mapped index, which may change meanwhile.
+    const QByteArray info(rawInfo->constData(), rawInfo->size());
 
-    auto refspec = ostreeSpecFromReference(ref, develop).toUtf8();
-    const auto *data = refspec.constData();
+    if (!QDir().mkpath(path)) {
+        return LINGLONG_ERR("mkpath " + path);
+    }
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) repoPath = g_file_new_for_path(path.toUtf8());
+    g_autoptr(OstreeRepo) repo = ostree_repo_new(repoPath);
+    // NOTE: Creating an existing repository only opens it.
+    if (ostree_repo_create(repo, OSTREE_REPO_MODE_ARCHIVE, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_create", gErr);
+    }
+
+    const auto source = QUrl::fromLocalFile(this->ostreeRepoDir().absolutePath()).toEncoded();
+    const char *refs[] = { refspec.constData(), nullptr };
+    GVariantBuilder builder{};
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder,
+                          "{s@v}",
+                          "refs",
+                          g_variant_new_variant(g_variant_new_strv(refs, -1)));
+    g_autoptr(GVariant) options = g_variant_ref_sink(g_variant_builder_end(&builder));
+    if (ostree_repo_pull_with_options(repo, source, options, nullptr, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_pull_with_options", gErr);
+    }
+
+    // NOTE:
+    // The index of the published layers is kept in the published repository,
+    // and shipped to clients in its summary, see fetchRemoteSummary().
+    LocalIndex index(QDir(path).absoluteFilePath("layers.idx"));
+    auto result = index.open();
+    if (!result) {
+        qDebug() << result.error();
+        result = index.replace({});
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
+
+    // NOTE:
+    // Clients which installed the previous version of the layer pull a static
+    // delta from it instead of the objects, see deltaSourceOf().
+    std::optional<std::pair<package::Version, QByteArray>> previous;
+    const auto prefix = QString("%1/%2/").arg(ref.channel, ref.id).toUtf8();
+    for (const auto &record : index.findByPrefix(prefix)) {
+        // NOTE: refspec is channel/id/version/arch/module
+        const auto parts = QString::fromUtf8(record.first).split('/');
+        if (parts.size() != 5 || parts[3] != ref.arch.toString()
+            || parts[4] != (develop ? "develop" : "runtime")) {
+            continue;
+        }
+
+        auto version = package::Version::parse(parts[2]);
+        if (!version || *version >= ref.version || (previous && previous->first >= *version)) {
+            continue;
+        }
+
+        previous = std::make_pair(*version, record.first);
+    }
+
+    if (previous) {
+        result = generateStaticDelta(repo, previous->second, refspec);
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
+
+    result = index.insert(refspec, info);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    result = regenerateSummary(repo, index);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+QUrl OSTreeRepo::uploadTaskUrl(const QString &taskID, const QString &path) const noexcept
+{
+    QUrl url(QString::fromStdString(this->cfg.repos.at(this->cfg.defaultRepo)));
+    url.setPath(url.path() + QString("/api/v1/upload-tasks/%1/%2").arg(taskID, path));
+    return url;
+}
+
+utils::error::Result<void> OSTreeRepo::uploadTarball(const package::Reference &ref,
+                                                     bool develop,
+                                                     const QString &token,
+                                                     const QString &taskID) const noexcept
+{
+    LINGLONG_TRACE("upload tarball of " + ref.toString());
+
+    const QTemporaryDir tmpDir;
+    if (!tmpDir.isValid()) {
+        return LINGLONG_ERR(tmpDir.errorString());
+    }
+
+    const QString tarFileName = QString("%1.tgz").arg(ref.id);
+    const QString tarFilePath = QDir::cleanPath(tmpDir.filePath(tarFileName));
+    QStringList args = { "-cf",
+                         tarFilePath,
+                         "-C",
+                         this->getLayerQDir(ref, develop).absolutePath(),
+                         "." };
+    // NOTE: pigz compresses on all cores and produces the same gzip stream
+    // the server expects, fallback to gzip if it is not installed.
+    if (!QStandardPaths::findExecutable("pigz").isEmpty()) {
+        args.prepend("--use-compress-program=pigz");
+    } else {
+        args.prepend("-z");
+    }
+    auto tarStdout = utils::command::Exec("tar", args);
+    if (!tarStdout) {
+        return LINGLONG_ERR(tarStdout);
+    }
+
+    // NOTE: The server cannot resume a partial upload, retry the whole
+    // file on network errors.
+    constexpr auto maxAttempts = 3;
+    utils::error::Result<void> result;
+    for (auto attempt = 1; attempt <= maxAttempts; ++attempt) {
+        result = uploadFile(this->uploadTaskUrl(taskID, "tar"), token, tarFilePath);
+        if (result) {
+            break;
+        }
+
+        // NOTE: Only connection level errors, such as timeouts and resets,
+        // are worth a retry.
+        const auto code = result.error().code();
+        if (code <= QNetworkReply::NoError || code > QNetworkReply::UnknownNetworkError) {
+            break;
+        }
+
+        qWarning() << "upload failed, attempt" << attempt << "of" << maxAttempts << result.error();
+        QThread::sleep(1U << attempt);
+    }
+
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::uploadObjects(const QString &refspec,
+                                                     const QString &token,
+                                                     const QString &taskID) const noexcept
+{
+    LINGLONG_TRACE("upload objects of " + refspec);
+
+    auto *repo = this->ostreeRepo.get();
+    g_autoptr(GError) gErr = nullptr;
+
+    g_autofree char *commit = nullptr;
+    if (ostree_repo_resolve_rev(repo, refspec.toUtf8(), FALSE, &commit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+
+    g_autoptr(GHashTable) reachable = nullptr;
+    if (ostree_repo_traverse_commit(repo, commit, 0, &reachable, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_traverse_commit", gErr);
+    }
+
+    // NOTE: The commit object is uploaded last, so that the server never
+    // holds a commit which references missing objects.
+    g_autofree char *commitObject = ostree_object_to_string(commit, OSTREE_OBJECT_TYPE_COMMIT);
+    QStringList objects;
+    GHashTableIter iter;
+    gpointer key = nullptr;
+    g_hash_table_iter_init(&iter, reachable);
+    while (g_hash_table_iter_next(&iter, &key, nullptr) == TRUE) {
+        const char *checksum = nullptr;
+        OstreeObjectType objectType{};
+        ostree_object_name_deserialize(static_cast<GVariant *>(key), &checksum, &objectType);
+        g_autofree char *object = ostree_object_to_string(checksum, objectType);
+        if (g_strcmp0(object, commitObject) == 0) {
+            continue;
+        }
+        objects.append(object);
+    }
+    objects.append(commitObject);
+
+    QNetworkAccessManager manager;
+
+    QStringList missing;
+    constexpr auto batchSize = 1000;
+    for (auto i = 0; i < objects.size(); i += batchSize) {
+        QJsonObject req{ { "objects", QJsonArray::fromStringList(objects.mid(i, batchSize)) } };
+        auto resp = sendRequest(manager,
+                                "POST",
+                                this->uploadTaskUrl(taskID, "objects/missing"),
+                                token,
+                                QJsonDocument(req).toJson(QJsonDocument::Compact));
+        if (!resp) {
+            return LINGLONG_ERR(resp);
+        }
+
+        for (const auto &object : resp->value("missing").toArray()) {
+            missing.append(object.toString());
+        }
+    }
+
+    qInfo() << "uploading" << missing.size() << "of" << objects.size() << "objects";
+
+    // NOTE: Up to maxUploads objects are streamed from their spooled files at
+    // the same time, which hides the latency of the many small objects.
+    constexpr auto maxUploads = 4;
+    auto upload = [&](const QStringList &objects) -> utils::error::Result<void> {
+        utils::error::Result<void> uploaded = LINGLONG_OK;
+        auto next = 0;
+        auto running = 0;
+        QEventLoop loop;
+        std::function<void()> startUploads = [&]() {
+            while (uploaded && running < maxUploads && next < objects.size()) {
+                const auto &object = objects.at(next++);
+                auto file = spoolObject(repo, object);
+                if (!file) {
+                    uploaded = LINGLONG_ERR(file);
+                    break;
+                }
+
+                QNetworkRequest request(this->uploadTaskUrl(taskID, "objects/" + object));
+                request.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+                request.setRawHeader("X-Token", token.toUtf8());
+                auto *reply = manager.put(request, file->get());
+                file->release()->setParent(reply);
+                ++running;
+
+                QObject::connect(reply, &QNetworkReply::finished, &loop, [&, reply]() {
+                    --running;
+                    reply->deleteLater();
+                    auto resp = replyData(*reply);
+                    if (!resp && uploaded) {
+                        uploaded = LINGLONG_ERR(resp);
+                    }
+
+                    startUploads();
+                    if (running == 0) {
+                        loop.quit();
+                    }
+                });
+            }
+        };
+
+        startUploads();
+        if (running > 0) {
+            loop.exec();
+        }
+        return uploaded;
+    };
+
+    const QString commitName = QString::fromUtf8(commitObject);
+    const bool commitMissing = missing.removeAll(commitName) > 0;
+    auto result = upload(missing);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    if (commitMissing) {
+        result = upload({ commitName });
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
+
+    QJsonObject req{ { "commit", QString::fromUtf8(commit) } };
+    auto resp = sendRequest(manager,
+                            "POST",
+                            this->uploadTaskUrl(taskID, "commit"),
+                            token,
+                            QJsonDocument(req).toJson(QJsonDocument::Compact));
+    if (!resp) {
+        return LINGLONG_ERR(resp);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::remove(const package::Reference &ref, bool develop) noexcept
+{
+    return this->remove(std::vector<std::pair<package::Reference, bool>>{ { ref, develop } });
+}
+
+utils::error::Result<void>
+OSTreeRepo::remove(const std::vector<std::pair<package::Reference, bool>> &layers) noexcept
+{
+    LINGLONG_TRACE(QString("remove %1 layers").arg(layers.size()));
+
+    utils::Transaction transaction;
+    QByteArrayList refspecs;
+    for (const auto &[ref, develop] : layers) {
+        auto result = this->removeLayer(ref, develop, transaction);
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+        refspecs.push_back(ostreeSpecFromReference(ref, develop).toUtf8());
+    }
+
+    transaction.commit();
+
+    QMutexLocker locker(&this->sharedIndexLock);
+    for (const auto &refspec : refspecs) {
+        auto result = this->sharedIndex.remove(refspec);
+        if (!result) {
+            qWarning() << result.error();
+        }
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::removeLayer(const package::Reference &ref,
+                                                   bool develop,
+                                                   utils::Transaction &transaction) noexcept
+{
+    LINGLONG_TRACE("remove " + ref.toString());
+
+    auto refspec = ostreeSpecFromReference(ref, develop).toUtf8();
+    const auto *data = refspec.constData();
+
+    auto rawInfo = this->localIndex.find(refspec);
+    if (rawInfo) {
+        // NOTE: The value references the mapped index, copy it before modification.
+        transaction.addRollBack(
+          [this, refspec, info = QByteArray(rawInfo->constData(), rawInfo->size())]() noexcept {
+              auto result = this->localIndex.insert(refspec, info);
+              if (!result) {
+                  qCritical() << result.error();
+                  Q_ASSERT(false);
+              }
+          });
+    }
+
+    auto result = this->localIndex.remove(refspec);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    // NOTE:
+    // Removing a layer directory recursively takes a while, move it into the
+    // trash directory instead, which is emptied later by emptyTrash().
+    const auto layerDir = this->getLayerQDir(ref, develop);
+    if (layerDir.exists()) {
+        auto trashDir = this->trashDir();
+        const auto trashPath = trashDir.absoluteFilePath(
+          QString("%1-%2").arg(QString::fromUtf8(refspec).replace('/', '_'),
+                               QUuid::createUuid().toString(QUuid::WithoutBraces)));
+        if (!trashDir.rename(layerDir.absolutePath(), trashPath)) {
+            return LINGLONG_ERR(QString("move %1 to %2").arg(layerDir.absolutePath(), trashPath));
+        }
+        transaction.addRollBack([trashDir, trashPath, layerDir]() noexcept {
+            auto dir = trashDir;
+            if (!dir.rename(trashPath, layerDir.absolutePath())) {
+                qCritical() << "Failed to restore layer directory" << layerDir.absolutePath();
+                Q_ASSERT(false);
+            }
+        });
+    }
+
+    // NOTE: The objects are kept until prune(), so the ref can point to its commit again.
+    g_autoptr(GError) gErr = nullptr;
+    g_autofree char *commit = nullptr;
+    if (ostree_repo_resolve_rev(this->ostreeRepo.get(), data, TRUE, &commit, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+    }
+
+    result = removeOstreeRef(this->ostreeRepo.get(), data);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    if (commit != nullptr) {
+        transaction.addRollBack([this, refspec, commit = QByteArray(commit)]() noexcept {
+            g_autoptr(GError) gErr = nullptr;
+            if (ostree_repo_set_ref_immediate(this->ostreeRepo.get(),
+                                              nullptr,
+                                              refspec.constData(),
+                                              commit.constData(),
+                                              nullptr,
+                                              &gErr)
+                == FALSE) {
+                qCritical() << "Failed to restore ref" << refspec << gErr->message;
+                Q_ASSERT(false);
+            }
+        });
+    }
+
+    return LINGLONG_OK;
+}
+
+QDir OSTreeRepo::trashDir() const noexcept
+{
+    Q_ASSERT(!this->repoDir.path().isEmpty());
+    auto trashDir = QDir(this->repoDir.absoluteFilePath("trash"));
+    if (!trashDir.mkpath(".")) {
+        Q_ASSERT(false);
+    }
+    return trashDir;
+}
+
+utils::error::Result<void> OSTreeRepo::emptyTrash() const noexcept
+{
+    LINGLONG_TRACE("empty trash");
+
+    auto trashDir = this->trashDir();
+    for (const auto &info :
+         trashDir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System)) {
+        if (!QDir(info.absoluteFilePath()).removeRecursively()) {
+            return LINGLONG_ERR("remove " + info.absoluteFilePath());
+        }
+    }
+
+    return LINGLONG_OK;
+}
+
+QByteArrayList OSTreeRepo::recordStaging(const QByteArrayList &refspecs) noexcept
+{
+    LINGLONG_TRACE("record staging commits of " + refspecs.join(' '));
+
+    // NOTE:
+    // The commits come from the summary the references were resolved from,
+    // see updateRemoteIndex(), which is fetched again only once it expired.
+    auto result = this->updateRemoteIndex();
+    if (!result) {
+        // NOTE: The pull still works, but it can not be resumed after a prune.
+        qWarning() << result.error();
+    }
+
+    QByteArrayList commits;
+
+    const auto now = QDateTime::currentSecsSinceEpoch();
+    for (const auto &refspec : refspecs) {
+        const auto commit = this->remoteCommits.value(refspec);
+        if (commit.isEmpty()) {
+            continue;
+        }
+        commits.push_back(commit);
+
+        // NOTE: The time of the last attempt, an abandoned pull expires after stagingMaxAge.
+        QJsonObject record{ { "commit", QString::fromUtf8(commit) }, { "time", now } };
+        result = this->stagingIndex.insert(refspec,
+                                           QJsonDocument(record).toJson(QJsonDocument::Compact));
+        if (!result) {
+            qWarning() << result.error();
+        }
+    }
+
+    return commits;
+}
+
+bool OSTreeRepo::pullFromPeers(const QList<QUrl> &peers,
+                               const QByteArrayList &commits,
+                               OstreeAsyncProgress *progress,
+                               GCancellable *cancellable) noexcept
+{
+    const auto *remote = "linglong-peer";
+    auto *repo = this->ostreeRepo.get();
+
+    // NOTE:
+    // Peers serve objects without any references, so commits are pulled by
+    // their checksums. ostree verifies the checksum of every object. The
+    // remote only exists while pulling, every peer is passed by override-url.
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GVariant) options = g_variant_ref_sink(
+      g_variant_new_parsed("{'gpg-verify': <false>, 'gpg-verify-summary': <false>}"));
+    if (ostree_repo_remote_change(repo,
+                                  nullptr,
+                                  OSTREE_REPO_REMOTE_CHANGE_DELETE_IF_EXISTS,
+                                  remote,
+                                  nullptr,
+                                  nullptr,
+                                  cancellable,
+                                  &gErr)
+          == FALSE
+        || ostree_repo_remote_change(repo,
+                                     nullptr,
+                                     OSTREE_REPO_REMOTE_CHANGE_ADD,
+                                     remote,
+                                     peers.first().toString().toUtf8(),
+                                     options,
+                                     cancellable,
+                                     &gErr)
+          == FALSE) {
+        qWarning() << "add peer remote:" << gErr->message;
+        return false;
+    }
+    auto removeRemote = utils::finally::finally([repo, remote]() {
+        g_autoptr(GError) gErr = nullptr;
+        if (ostree_repo_remote_change(repo,
+                                      nullptr,
+                                      OSTREE_REPO_REMOTE_CHANGE_DELETE_IF_EXISTS,
+                                      remote,
+                                      nullptr,
+                                      nullptr,
+                                      nullptr,
+                                      &gErr)
+            == FALSE) {
+            qWarning() << "remove peer remote:" << gErr->message;
+        }
+    });
+
+    bool pulled = false;
+    for (const auto &peer : peers) {
+        LINGLONG_TRACE("pull from peer " + peer.toString());
+        const auto url = peer.toString().toUtf8();
+
+        // NOTE:
+        // A peer may vanish from the LAN at any time. The pull from it is
+        // cancelled once nothing has been transferred for peerStallTimeout
+        // seconds, the pull as a whole is cancelled with cancellable.
+        g_autoptr(GCancellable) peerCancellable = g_cancellable_new();
+        const auto handler = cancellable == nullptr
+          ? 0
+          : g_cancellable_connect(cancellable,
+                                  G_CALLBACK(+[](GCancellable *, gpointer data) {
+                                      g_cancellable_cancel(static_cast<GCancellable *>(data));
+                                  }),
+                                  peerCancellable,
+                                  nullptr);
+        auto disconnect = utils::finally::finally([cancellable, handler]() {
+            if (handler != 0) {
+                g_cancellable_disconnect(cancellable, handler);
+            }
+        });
+
+        struct watchdog
+        {
+            GCancellable *cancellable;
+            OstreeAsyncProgress *progress;
+            guint64 transferred;
+        } peerWatchdog{ peerCancellable,
+                        progress,
+                        ostree_async_progress_get_uint64(progress, "bytes-transferred") };
+        g_autoptr(GSource) timer = g_timeout_source_new_seconds(peerStallTimeout);
+        g_source_set_callback(
+          timer,
+          +[](gpointer data) -> gboolean {
+              auto *watchdog = static_cast<struct watchdog *>(data);
+              const auto transferred =
+                ostree_async_progress_get_uint64(watchdog->progress, "bytes-transferred");
+              if (transferred == watchdog->transferred) {
+                  g_cancellable_cancel(watchdog->cancellable);
+                  return G_SOURCE_REMOVE;
+              }
+              watchdog->transferred = transferred;
+              return G_SOURCE_CONTINUE;
+          },
+          &peerWatchdog,
+          nullptr);
+        // NOTE: ostree iterates the thread default main context while pulling.
+        g_source_attach(timer, g_main_context_get_thread_default());
+        auto destroyTimer = utils::finally::finally([&timer]() {
+            g_source_destroy(timer);
+        });
+
+        auto result = pullFromRemote(repo,
+                                     remote,
+                                     commits,
+                                     true,
+                                     progress,
+                                     peerCancellable,
+                                     nullptr,
+                                     true,
+                                     url.constData());
+        if (result) {
+            return true;
+        }
+        if (g_cancellable_is_cancelled(cancellable) == TRUE) {
+            return pulled;
+        }
+        qDebug() << result.error();
+
+        // NOTE: The peer may have only some of the objects, which are kept.
+        for (const auto &checksum : commits) {
+            gboolean exists = FALSE;
+            if (ostree_repo_has_object(repo,
+                                       OSTREE_OBJECT_TYPE_COMMIT,
+                                       checksum,
+                                       &exists,
+                                       nullptr,
+                                       nullptr)
+                  == TRUE
+                && exists == TRUE) {
+                pulled = true;
+            }
+        }
+    }
+
+    return pulled;
+}
+
+void OSTreeRepo::keepStaging(GHashTable *reachable) noexcept
+{
+    auto *repo = this->ostreeRepo.get();
+    const auto now = QDateTime::currentSecsSinceEpoch();
+
+    struct stagingEntry
+    {
+        qint64 time;
+        QByteArray refspec;
+        QByteArray commit;
+    };
+
+    std::vector<stagingEntry> entries;
+    QByteArrayList expired;
+    for (const auto &[key, value] : this->stagingIndex.findByPrefix({})) {
+        // NOTE: Make a deep copy, the mapped memory is released on removal.
+        const auto refspec = QByteArray(key.constData(), key.size());
+        const auto record = QJsonDocument::fromJson(value).object();
+        const auto time = record.value("time").toVariant().toLongLong();
+        const auto commit = record.value("commit").toString().toUtf8();
+        if (commit.isEmpty() || now - time > stagingMaxAge) {
+            expired.push_back(refspec);
+            continue;
+        }
+        entries.push_back({ time, refspec, commit });
+    }
+
+    // NOTE: Newer pulls are more likely to be retried, they are kept first.
+    std::sort(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.time > rhs.time;
+    });
+
+    quint64 total = 0;
+    for (const auto &entry : entries) {
+        // NOTE:
+        // The commit is partial, ostree traverses only the objects already
+        // fetched. A missing commit object means nothing is left to keep.
+        g_autoptr(GError) gErr = nullptr;
+        g_autoptr(GHashTable) objects = ostree_repo_traverse_new_reachable();
+        if (ostree_repo_traverse_commit_union(repo, entry.commit, 0, objects, nullptr, &gErr)
+            == FALSE) {
+            qDebug() << "drop staging commit of" << entry.refspec << gErr->message;
+            expired.push_back(entry.refspec);
+            continue;
+        }
+
+        quint64 size = 0;
+        GHashTableIter iter;
+        gpointer key = nullptr;
+        g_hash_table_iter_init(&iter, objects);
+        while (g_hash_table_iter_next(&iter, &key, nullptr) == TRUE) {
+            if (g_hash_table_contains(reachable, key) == TRUE) {
+                continue;
+            }
+
+            const char *checksum = nullptr;
+            OstreeObjectType objectType{};
+            ostree_object_name_deserialize(static_cast<GVariant *>(key), &checksum, &objectType);
+            guint64 objectSize = 0;
+            if (ostree_repo_query_object_storage_size(repo,
+                                                      objectType,
+                                                      checksum,
+                                                      &objectSize,
+                                                      nullptr,
+                                                      nullptr)
+                == TRUE) {
+                size += objectSize;
+            }
+        }
+
+        if (total + size > stagingMaxSize) {
+            qDebug() << "drop staging commit of" << entry.refspec << size << "bytes";
+            expired.push_back(entry.refspec);
+            continue;
+        }
+        total += size;
+
+        g_hash_table_iter_init(&iter, objects);
+        while (g_hash_table_iter_next(&iter, &key, nullptr) == TRUE) {
+            g_hash_table_add(reachable, g_variant_ref(static_cast<GVariant *>(key)));
+        }
+    }
+
+    for (const auto &refspec : expired) {
+        auto result = this->stagingIndex.remove(refspec);
+        if (!result) {
+            qWarning() << result.error();
+        }
+    }
+}
+
+utils::error::Result<quint64> OSTreeRepo::prune() noexcept
+{
+    LINGLONG_TRACE("prune repository");
+
+    gint out_objects_total = 0;
+    gint out_objects_pruned = 0;
+    guint64 out_pruned_object_size_total = 0;
+
+    auto *repo = this->ostreeRepo.get();
+    g_autoptr(GError) gErr = nullptr;
+
+    // NOTE:
+    // This is what ostree_repo_prune does with OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY,
+    // plus the objects of the unfinished pulls, see keepStaging().
+    g_autoptr(GHashTable) refs = nullptr;
+    if (ostree_repo_list_refs_ext(repo,
+                                  nullptr,
+                                  &refs,
+                                  OSTREE_REPO_LIST_REFS_EXT_NONE,
+                                  nullptr,
+                                  &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_list_refs_ext", gErr);
+    }
+
+    g_autoptr(GHashTable) reachable = ostree_repo_traverse_new_reachable();
+    GHashTableIter iter;
+    gpointer value = nullptr;
+    g_hash_table_iter_init(&iter, refs);
+    while (g_hash_table_iter_next(&iter, nullptr, &value) == TRUE) {
+        const auto *commit = static_cast<const char *>(value);
+        if (ostree_repo_traverse_commit_union(repo, commit, 0, reachable, nullptr, &gErr)
+            == FALSE) {
+            return LINGLONG_ERR("ostree_repo_traverse_commit_union", gErr);
+        }
+    }
+
+    this->keepStaging(reachable);
+
+    OstreeRepoPruneOptions options{};
+    options.flags = OSTREE_REPO_PRUNE_FLAGS_NONE;
+    options.reachable = reachable;
+    if (ostree_repo_prune_from_reachable(repo,
+                                         &options,
+                                         &out_objects_total,
+                                         &out_objects_pruned,
+                                         &out_pruned_object_size_total,
+                                         nullptr,
+                                         &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_prune_from_reachable", gErr);
+    }
+
+    qDebug() << "pruned" << out_objects_pruned << "of" << out_objects_total << "objects,"
+             << out_pruned_object_size_total << "bytes freed";
+
+    return out_pruned_object_size_total;
+}
+
+utils::error::Result<verifyResult> OSTreeRepo::verify(const verifyOption &opts) noexcept
+{
+    LINGLONG_TRACE("verify repository");
+
+    auto *repo = this->ostreeRepo.get();
+    g_autoptr(GError) gErr = nullptr;
+
+    g_autoptr(GHashTable) objects = nullptr;
+    if (ostree_repo_list_objects(repo, OSTREE_REPO_LIST_OBJECTS_ALL, &objects, nullptr, &gErr)
+        == FALSE) {
+        return LINGLONG_ERR("ostree_repo_list_objects", gErr);
+    }
+
+    // NOTE: Objects are spread over all cores, checking them is bound by
+    // hashing on an SSD.
+    const auto workers = std::max(QThread::idealThreadCount(), 1);
+    std::vector<QStringList> chunks(workers);
+    verifyResult result;
+
+    GHashTableIter iter;
+    gpointer key = nullptr;
+    g_hash_table_iter_init(&iter, objects);
+    while (g_hash_table_iter_next(&iter, &key, nullptr) == TRUE) {
+        const char *checksum = nullptr;
+        OstreeObjectType objectType{};
+        ostree_object_name_deserialize(static_cast<GVariant *>(key), &checksum, &objectType);
+        g_autofree char *object = ostree_object_to_string(checksum, objectType);
+        chunks[result.objects++ % workers].append(object);
+    }
+
+    const auto repoPath = this->ostreeRepoDir().absolutePath();
+    {
+        std::vector<utils::error::Result<QStringList>> corrupted(chunks.size());
+        QList<QFuture<void>> futures;
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            futures.append(QtConcurrent::run([&repoPath, &chunks, &corrupted, i]() {
+                corrupted[i] = fsckObjects(repoPath, chunks[i]);
+            }));
+        }
+        for (auto &future : futures) {
+            future.waitForFinished();
+        }
+
+        for (auto &ret : corrupted) {
+            if (!ret) {
+                return LINGLONG_ERR(ret);
+            }
+            result.corruptedObjects.append(*ret);
+        }
+    }
+
+    const QSet<QString> corruptedSet(result.corruptedObjects.begin(),
+                                     result.corruptedObjects.end());
+    const QDir layersDir = this->repoDir.absoluteFilePath("layers");
+
+    const auto refspecs = opts.layers ? *opts.layers : this->listLayers();
+    result.layers = refspecs.size();
+
+    std::vector<utils::error::Result<layerState>> states(refspecs.size());
+    {
+        QList<QFuture<void>> futures;
+        for (int i = 0; i < refspecs.size(); ++i) {
+            futures.append(
+              QtConcurrent::run([&repoPath, &refspecs, &layersDir, &corruptedSet, &states, i]() {
+                  states[i] = verifyLayer(repoPath,
+                                          refspecs[i],
+                                          layersDir.absoluteFilePath(refspecs[i]),
+                                          corruptedSet);
+              }));
+        }
+        for (auto &future : futures) {
+            future.waitForFinished();
+        }
+    }
+
+    std::vector<std::pair<QString, bool>> brokenLayers;
+    for (int i = 0; i < refspecs.size(); ++i) {
+        auto &state = states[i];
+        if (!state) {
+            return LINGLONG_ERR(state);
+        }
+
+        if (!state->needsPull && state->brokenFiles.isEmpty()) {
+            continue;
+        }
+
+        qWarning() << "broken layer" << refspecs[i] << state->brokenFiles;
+        result.brokenLayers.append(refspecs[i]);
+        brokenLayers.emplace_back(refspecs[i], state->needsPull);
+    }
+
+    if (!opts.repair) {
+        return result;
+    }
+
+    for (const auto &object : result.corruptedObjects) {
+        g_autofree char *checksum = nullptr;
+        OstreeObjectType objectType{};
+        ostree_object_from_string(object.toUtf8(), &checksum, &objectType);
+        if (ostree_repo_delete_object(repo, objectType, checksum, nullptr, &gErr) == FALSE) {
+            qWarning() << "failed to delete corrupted object" << object << gErr->message;
+            g_clear_error(&gErr);
+        }
+    }
+
+    for (const auto &[refspec, needsPull] : brokenLayers) {
+        auto ret = this->repairLayer(refspec, needsPull);
+        if (!ret) {
+            qWarning() << ret.error();
+            continue;
+        }
+        result.repairedLayers.append(refspec);
+    }
+
+    if (!opts.layers) {
+        auto ret = this->reindexLayers(result.repairedLayers);
+        if (!ret) {
+            return LINGLONG_ERR(ret);
+        }
+    }
+
+    return result;
+}
+
+QStringList OSTreeRepo::listLayers() const noexcept
+{
+    QStringList refspecs;
+    for (const auto &[refspec, _] : this->localIndex.findByPrefix(QByteArray())) {
+        refspecs.append(QString::fromUtf8(refspec));
+    }
+    return refspecs;
+}
+
+utils::error::Result<void> OSTreeRepo::reindexLayers(const QStringList &refspecs) noexcept
+{
+    LINGLONG_TRACE("reindex layers");
+
+    for (const auto &refspec : refspecs) {
+        const auto layerDir = this->repoDir.absoluteFilePath("layers/" + refspec);
+        auto rawInfo = package::LayerDir(layerDir).rawInfo();
+        if (!rawInfo) {
+            return LINGLONG_ERR(rawInfo);
+        }
+
+        auto result = this->localIndex.insert(refspec.toUtf8(), *rawInfo);
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::repairLayer(const QString &refspec, bool pull) noexcept
+{
+    LINGLONG_TRACE("repair layer " + refspec);
+
+    auto *repo = this->ostreeRepo.get();
+    const auto *remote = this->cfg.defaultRepo.c_str();
+    const auto refString = refspec.toUtf8();
+    g_autoptr(GError) gErr = nullptr;
+
+    if (pull) {
+        // NOTE: ostree skips commits it has completely, mark the commit
+        // partial so that the missing objects are fetched again.
+        g_autofree char *commit = nullptr;
+        if (ostree_repo_resolve_rev(repo, refString, TRUE, &commit, &gErr) == FALSE) {
+            return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+        }
+        if (commit != nullptr
+            && ostree_repo_mark_commit_partial(repo, commit, TRUE, &gErr) == FALSE) {
+            return LINGLONG_ERR("ostree_repo_mark_commit_partial", gErr);
+        }
+
+        auto removeStagingRef = utils::finally::finally([repo, remote, &refString]() {
+            g_autoptr(GError) gErr = nullptr;
+            if (ostree_repo_set_ref_immediate(repo, remote, refString, nullptr, nullptr, &gErr)
+                == FALSE) {
+                qWarning() << "failed to remove staging ref" << refString << gErr->message;
+            }
+        });
+
+        auto result = pullFromRemote(repo, remote, { refString }, false, nullptr, nullptr);
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+
+        g_autofree char *pulled = nullptr;
+        g_autofree char *stagingRef = g_strconcat(remote, ":", refString.constData(), NULL);
+        if (ostree_repo_resolve_rev(repo, stagingRef, FALSE, &pulled, &gErr) == FALSE) {
+            return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+        }
+
+        if (ostree_repo_set_ref_immediate(repo, nullptr, refString, pulled, nullptr, &gErr)
+            == FALSE) {
+            return LINGLONG_ERR("ostree_repo_set_ref_immediate", gErr);
+        }
+    }
+
+    // NOTE: The broken checkout is moved into the trash like a removed layer,
+    // and checked out again.
+    const QDir layerDir = this->repoDir.absoluteFilePath("layers/" + refspec);
+    if (layerDir.exists()) {
+        auto trashDir = this->trashDir();
+        const auto trashPath = trashDir.absoluteFilePath(
+          QString("%1-%2").arg(QString(refspec).replace('/', '_'),
+                               QUuid::createUuid().toString(QUuid::WithoutBraces)));
+        if (!trashDir.rename(layerDir.absolutePath(), trashPath)) {
+            return LINGLONG_ERR(QString("move %1 to %2").arg(layerDir.absolutePath(), trashPath));
+        }
+    }
+
+    auto result = handleRepositoryUpdate(repo, layerDir, refString);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+void OSTreeRepo::pull(std::shared_ptr<service::InstallTask> taskContext,
+                      const package::Reference &reference,
+                      bool develop) noexcept
+{
+    this->pull(std::move(taskContext), std::vector<package::Reference>{ reference }, develop);
+}
+
+void OSTreeRepo::pull(std::shared_ptr<service::InstallTask> taskContext,
+                      const std::vector<package::Reference> &references,
+                      bool develop) noexcept
+{
+    QByteArrayList refStrings;
+    for (const auto &reference : references) {
+        refStrings.push_back(ostreeSpecFromReference(reference, develop).toUtf8());
+    }
+
+    LINGLONG_TRACE("pull " + refStrings.join(' '));
+
+    utils::Transaction transaction;
+
+    const auto *remote = this->cfg.defaultRepo.c_str();
+    auto *repo = this->ostreeRepo.get();
+    auto *cancellable = taskContext->cancellable();
+
+    // NOTE:
+    // Objects are fetched into the system repository directly. ostree records
+    // the pulled commit as the remote tracking ref "remote:refspec", which
+    // is used as a staging ref here. It is promoted to the real refspec only
+    // after all commits have been fetched, and always dropped on exit.
+    auto removeStagingRefs = utils::finally::finally([repo, remote, &refStrings]() {
+        for (const auto &refString : refStrings) {
+            g_autoptr(GError) gErr = nullptr;
+            if (ostree_repo_set_ref_immediate(repo, remote, refString, nullptr, nullptr, &gErr)
+                == FALSE) {
+                qWarning() << "failed to remove staging ref" << refString << gErr->message;
+            }
+        }
+    });
+
+    g_autoptr(GError) gErr = nullptr;
+
+    // NOTE:
+    // ostree looks up static deltas from the commit the staging ref points to.
+    // Seed it with the commit of an older installed version of this layer, so
+    // that upgrading fetches a delta from the installed commit if the remote
+    // provides one, instead of individual objects.
+    bool seeded = false;
+    for (std::size_t i = 0; i < references.size(); ++i) {
+        auto from = this->deltaSourceOf(references[i], develop);
+        if (!from) {
+            continue;
+        }
+
+        const auto fromRefString = ostreeSpecFromReference(*from, develop).toUtf8();
+        g_autofree char *fromCommit = nullptr;
+        if (ostree_repo_resolve_rev(repo, fromRefString, FALSE, &fromCommit, &gErr) == TRUE
+            && ostree_repo_set_ref_immediate(repo,
+                                             remote,
+                                             refStrings[i],
+                                             fromCommit,
+                                             cancellable,
+                                             &gErr)
+              == TRUE) {
+            qDebug() << "try static delta from" << fromRefString << fromCommit;
+            seeded = true;
+        } else {
+            qWarning() << "failed to seed staging ref of" << refStrings[i] << gErr->message;
+            g_clear_error(&gErr);
+        }
+    }
+
+    // NOTE:
+    // A cancelled or failed pull leaves its commits partial. Record them, so
+    // that prune() keeps the objects fetched so far and a retry only fetches
+    // the rest, see keepStaging().
+    const auto commits = this->recordStaging(refStrings);
+
+    // NOTE: All refs are fetched in one pull, so ostree downloads their objects concurrently.
+    ostreeUserData data{ .repo = this, .taskContext = taskContext.get() };
+    std::optional<std::pair<int, int>> priority;
+    if (taskContext->priority() == service::InstallTask::Background) {
+        data.bandwidthLimit =
+          std::max<int64_t>(this->cfg.backgroundBandwidthLimit.value_or(0), 0);
+        const auto level = std::clamp<int64_t>(this->cfg.backgroundIOPriority.value_or(7), 0, 7);
+        const auto nice = std::clamp<int64_t>(this->cfg.backgroundNice.value_or(10), 0, 19);
+        priority.emplace(static_cast<int>((ioprioClassBestEffort << ioprioClassShift) | level),
+                         static_cast<int>(nice));
+    }
+    const auto peerURLs = this->cfg.peerSharing.value_or(false) && this->peers && !commits.isEmpty()
+      ? this->peers()
+      : QList<QUrl>{};
+
+    // NOTE:
+    // Throttling and lowering the priority of a background pull only affect
+    // the worker thread, and the daemon keeps serving D-Bus meanwhile, so
+    // that an interactive task can cancel it, see PackageManager.
+    utils::error::Result<void> result = this->pullInWorker(
+      [&]() {
+          std::optional<ThreadPriorityGuard> priorityGuard;
+          if (priority) {
+              priorityGuard.emplace(priority->first, priority->second);
+          }
+
+          g_autoptr(OstreeAsyncProgress) progress =
+            ostree_async_progress_new_and_connect(progress_changed, (void *)&data);
+          Q_ASSERT(progress != nullptr);
+          auto finishProgress = utils::finally::finally([&progress]() {
+              ostree_async_progress_finish(progress);
+          });
+
+          // NOTE:
+          // Objects the peers on the LAN have are fetched from them first, the
+          // remote only provides the rest. A static delta would fetch them again.
+          const bool fromPeers =
+            !peerURLs.isEmpty() && this->pullFromPeers(peerURLs, commits, progress, cancellable);
+
+          return this->pullWithFailover(
+            [&]() {
+                auto pulled = pullFromRemote(repo,
+                                             remote,
+                                             refStrings,
+                                             fromPeers,
+                                             progress,
+                                             cancellable,
+                                             nullptr,
+                                             true);
+                if (!pulled && seeded && !fromPeers
+                    && g_cancellable_is_cancelled(cancellable) == FALSE) {
+                    qWarning() << "failed to pull with static delta, fallback to objects:"
+                               << pulled.error();
+                    pulled = pullFromRemote(repo,
+                                            remote,
+                                            refStrings,
+                                            true,
+                                            progress,
+                                            cancellable,
+                                            nullptr,
+                                            true);
+                }
+                return pulled;
+            },
+            cancellable);
+      },
+      cancellable);
+
+    if (!result) {
+        taskContext->updateStatus(service::InstallTask::Failed, LINGLONG_ERRV(result));
+        return;
+    }
+
+    for (std::size_t i = 0; i < references.size(); ++i) {
+        const auto &reference = references[i];
+        const auto &refString = refStrings[i];
+
+        g_autofree char *commit = nullptr;
+        g_autofree char *stagingRef = g_strconcat(remote, ":", refString.constData(), NULL);
+        if (ostree_repo_resolve_rev(repo, stagingRef, FALSE, &commit, &gErr) == FALSE) {
+            taskContext->updateStatus(service::InstallTask::Failed,
+                                      LINGLONG_ERRV("ostree_repo_resolve_rev", gErr));
+            return;
+        }
+
+        if (ostree_repo_set_ref_immediate(repo, nullptr, refString, commit, cancellable, &gErr)
+            == FALSE) {
+            taskContext->updateStatus(service::InstallTask::Failed,
+                                      LINGLONG_ERRV("ostree_repo_set_ref_immediate", gErr));
+            return;
+        }
+
+        transaction.addRollBack([this, reference, develop]() noexcept {
+            auto result = this->remove(reference, develop);
+            if (!result) {
+                qCritical() << result.error();
+                Q_ASSERT(false);
+            }
+        });
+
+        result = handleRepositoryUpdate(this->ostreeRepo.get(),
+                                        this->getLayerQDir(reference, develop),
+                                        refString);
+        if (!result) {
+            taskContext->updateStatus(service::InstallTask::Failed, LINGLONG_ERRV(result));
+            return;
+        }
+
+        auto rawInfo =
+          package::LayerDir(this->getLayerQDir(reference, develop).absolutePath()).rawInfo();
+        if (!rawInfo) {
+            taskContext->updateStatus(service::InstallTask::Failed, LINGLONG_ERRV(rawInfo));
+            return;
+        }
+
+        result = this->localIndex.insert(refString, *rawInfo);
+        if (!result) {
+            taskContext->updateStatus(service::InstallTask::Failed, LINGLONG_ERRV(result));
+            return;
+        }
+
+        result = this->stagingIndex.remove(refString);
+        if (!result) {
+            qWarning() << result.error();
+        }
+
+        // NOTE: Only layers pulled from the remote are shared with the peers,
+        // imported layers may be private.
+        QMutexLocker locker(&this->sharedIndexLock);
+        result = this->sharedIndex.insert(refString, commit);
+        if (!result) {
+            qWarning() << result.error();
+        }
+    }
+
+    transaction.commit();
+}
+
+utils::error::Result<void>
+OSTreeRepo::pullInWorker(const std::function<utils::error::Result<void>()> &pull,
+                         GCancellable *cancellable) noexcept
+{
+    LINGLONG_TRACE("pull in worker");
+
+    auto *repo = this->ostreeRepo.get();
+
+    // NOTE:
+    // The objects are fetched in a worker thread, which runs the main context
+    // of the pull, while the calling thread keeps processing its events.
+    utils::error::Result<void> result = LINGLONG_OK;
+    auto future = QtConcurrent::run([&]() {
+        g_autoptr(GMainContext) context = g_main_context_new();
+        g_main_context_push_thread_default(context);
+        auto popContext = utils::finally::finally([&context]() {
+            g_main_context_pop_thread_default(context);
+        });
+
+        this->selectMirror();
+
+        // NOTE:
+        // The transaction is committed even if the pull fails. Otherwise ostree
+        // drops the objects fetched so far with the staging directory of the
+        // transaction. Every object is verified when it is written, so only
+        // complete objects are committed.
+        g_autoptr(GError) gErr = nullptr;
+        if (ostree_repo_prepare_transaction(repo, nullptr, cancellable, &gErr) == FALSE) {
+            result = LINGLONG_ERR("ostree_repo_prepare_transaction", gErr);
+            return;
+        }
+
+        result = pull();
+
+        if (ostree_repo_commit_transaction(repo, nullptr, nullptr, &gErr) == FALSE) {
+            result = LINGLONG_ERR("ostree_repo_commit_transaction", gErr);
+        }
+    });
+
+    QEventLoop loop;
+    QFutureWatcher<void> watcher;
+    QObject::connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+    watcher.setFuture(future);
+    if (!future.isFinished()) {
+        loop.exec();
+    }
+
+    return result;
+}
+
+void OSTreeRepo::selectMirror() noexcept
+{
+    const auto configured = mirrorsOf(this->cfg);
+    {
+        QMutexLocker locker(&this->mirrorsLock);
+        if (configured.size() < 2 || !this->mirrorsDeadline.hasExpired()) {
+            return;
+        }
+        this->mirrorsDeadline.setRemainingTime(std::chrono::seconds(mirrorProbeInterval));
+    }
+
+    auto sorted = sortMirrorsByLatency(configured, QString::fromStdString(this->cfg.defaultRepo));
+    auto result = this->useMirror(sorted.front());
+    if (!result) {
+        qWarning() << result.error();
+    }
+
+    QMutexLocker locker(&this->mirrorsLock);
+    this->mirrors = std::move(sorted);
+}
+
+utils::error::Result<void> OSTreeRepo::useMirror(const QString &url) noexcept
+{
+    LINGLONG_TRACE("use mirror " + url);
+
+    QMutexLocker locker(&this->mirrorsLock);
+    if (url == this->currentMirror) {
+        return LINGLONG_OK;
+    }
+
+    auto result = updateOstreeRepoConfig(this->ostreeRepo.get(),
+                                         QString::fromStdString(this->cfg.defaultRepo),
+                                         url);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    this->currentMirror = url;
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void>
+OSTreeRepo::pullWithFailover(const std::function<utils::error::Result<void>()> &pull,
+                             GCancellable *cancellable) noexcept
+{
+    LINGLONG_TRACE("pull with failover");
+
+    auto result = pull();
+    if (result || g_cancellable_is_cancelled(cancellable) == TRUE) {
+        return result;
+    }
+
+    QString failed;
+    QStringList mirrors;
+    {
+        QMutexLocker locker(&this->mirrorsLock);
+        failed = this->currentMirror;
+        mirrors = this->mirrors.isEmpty() ? mirrorsOf(this->cfg) : this->mirrors;
+    }
+
+    for (const auto &mirror : qAsConst(mirrors)) {
+        if (result || g_cancellable_is_cancelled(cancellable) == TRUE) {
+            break;
+        }
+        if (mirror == failed) {
+            continue;
+        }
+
+        qWarning() << "failed to pull from" << failed << result.error();
+        auto used = this->useMirror(mirror);
+        if (!used) {
+            qWarning() << used.error();
+            continue;
+        }
+
+        failed = mirror;
+        result = pull();
+    }
+
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    // NOTE: Later pulls try the mirror that worked first, until the mirrors
+    // are probed again.
+    QMutexLocker locker(&this->mirrorsLock);
+    if (!this->mirrors.isEmpty() && this->mirrors.front() != this->currentMirror) {
+        this->mirrors.removeAll(this->currentMirror);
+        this->mirrors.prepend(this->currentMirror);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<api::types::v1::PackageInfo>
+OSTreeRepo::getRemoteInfo(const package::Reference &reference,
+                          bool develop,
+                          GCancellable *cancellable) noexcept
+{
+    LINGLONG_TRACE("get remote info of " + reference.toString());
+
+    auto infos = this->getRemoteInfo(std::vector<package::Reference>{ reference },
+                                     develop,
+                                     cancellable);
+    if (!infos) {
+        return LINGLONG_ERR(infos);
+    }
+
+    return std::move(infos->front());
+}
+
+utils::error::Result<std::vector<api::types::v1::PackageInfo>>
+OSTreeRepo::getRemoteInfo(const std::vector<package::Reference> &references,
+                          bool develop,
+                          GCancellable *cancellable) noexcept
+{
+    QByteArrayList refStrings;
+    for (const auto &reference : references) {
+        refStrings.push_back(ostreeSpecFromReference(reference, develop).toUtf8());
+    }
+
+    LINGLONG_TRACE("get remote info of " + refStrings.join(' '));
+
+    const auto *remote = this->cfg.defaultRepo.c_str();
+    auto *repo = this->ostreeRepo.get();
+
+    // NOTE:
+    // A pull of the same refspecs may be using their staging refs, see pull().
+    // Only the staging refs created here are removed again.
+    QByteArrayList createdRefs;
+    for (const auto &refString : refStrings) {
+        g_autoptr(GError) gErr = nullptr;
+        g_autofree char *commit = nullptr;
+        g_autofree char *stagingRef = g_strconcat(remote, ":", refString.constData(), NULL);
+        if (ostree_repo_resolve_rev(repo, stagingRef, TRUE, &commit, &gErr) == FALSE) {
+            return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+        }
+        if (commit == nullptr) {
+            createdRefs.push_back(refString);
+        }
+    }
+    auto removeStagingRefs = utils::finally::finally([repo, remote, &createdRefs]() {
+        for (const auto &refString : createdRefs) {
+            g_autoptr(GError) gErr = nullptr;
+            if (ostree_repo_set_ref_immediate(repo, remote, refString, nullptr, nullptr, &gErr)
+                == FALSE) {
+                qWarning() << "failed to remove staging ref" << refString << gErr->message;
+            }
+        }
+    });
 
-    auto result = removeOstreeRef(this->ostreeRepo.get(), data);
+    // NOTE:
+    // Only info.json of the commits is fetched, in one pull. The commits are
+    // left partial and completed by the following pull of the whole layers.
+    auto result = this->pullInWorker(
+      [&]() {
+          return this->pullWithFailover(
+            [&]() {
+                return pullFromRemote(repo,
+                                      remote,
+                                      refStrings,
+                                      true,
+                                      nullptr,
+                                      cancellable,
+                                      "/info.json",
+                                      true);
+            },
+            cancellable);
+      },
+      cancellable);
     if (!result) {
         return LINGLONG_ERR(result);
     }
 
-    return LINGLONG_OK;
-}
-
-void OSTreeRepo::pull(std::shared_ptr<service::InstallTask> taskContext,
-                      const package::Reference &reference,
-                      bool develop) noexcept
-{
-    const auto refString = ostreeSpecFromReference(reference, develop).toUtf8();
-
-    LINGLONG_TRACE("pull " + refString);
+    std::vector<api::types::v1::PackageInfo> infos;
+    infos.reserve(refStrings.size());
+    for (const auto &refString : refStrings) {
+        g_autoptr(GError) gErr = nullptr;
+        g_autofree char *commit = nullptr;
+        g_autofree char *stagingRef = g_strconcat(remote, ":", refString.constData(), NULL);
+        if (ostree_repo_resolve_rev(repo, stagingRef, FALSE, &commit, &gErr) == FALSE) {
+            return LINGLONG_ERR("ostree_repo_resolve_rev", gErr);
+        }
 
-    utils::Transaction transaction;
-    QTemporaryDir tmpRepoDir;
-    // 初始化临时仓库
-    {
-        if (!tmpRepoDir.isValid()) {
-            taskContext->updateStatus(service::InstallTask::Status::Failed,
-                                      LINGLONG_ERRV("invalid QTemporaryDir"));
-            return;
+        g_autoptr(GFile) root = nullptr;
+        if (ostree_repo_read_commit(repo, commit, &root, nullptr, cancellable, &gErr) == FALSE) {
+            return LINGLONG_ERR("ostree_repo_read_commit", gErr);
         }
 
-        auto repo = createOstreeRepo(tmpRepoDir.path(),
-                                     QString::fromStdString(this->cfg.defaultRepo),
-                                     QString::fromStdString(this->cfg.repos[this->cfg.defaultRepo]),
-                                     this->ostreeRepoDir().absolutePath());
-        if (!repo) {
-            taskContext->updateStatus(service::InstallTask::Status::Failed, LINGLONG_ERRV(repo));
-            return;
+        g_autoptr(GFile) infoFile = g_file_resolve_relative_path(root, "info.json");
+        g_autofree char *content = nullptr;
+        gsize length = 0;
+        if (g_file_load_contents(infoFile, cancellable, &content, &length, nullptr, &gErr)
+            == FALSE) {
+            return LINGLONG_ERR("g_file_load_contents", gErr);
         }
-        g_clear_object(&(*repo));
-    }
-    // 因为更改了仓库配置，所以不使用初始化的值而是重新打开仓库
-    g_autoptr(GError) gErr = nullptr;
-    auto repoPath = g_file_new_for_path(tmpRepoDir.path().toStdString().c_str());
-    auto tmpRepo = ostree_repo_new(repoPath);
-    auto _ = utils::finally::finally([&]() {
-        g_clear_object(&tmpRepo);
-    });
-    Q_ASSERT(tmpRepo != nullptr);
-    if (ostree_repo_open(tmpRepo, nullptr, &gErr) != TRUE) {
-        taskContext->updateStatus(service::InstallTask::Status::Failed,
-                                  LINGLONG_ERRV("ostree_repo_open", gErr));
-        return;
-    }
-    auto *cancellable = taskContext->cancellable();
 
-    char *refs[] = { (char *)refString.data(), nullptr };
+        auto info = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(
+          QByteArray(content, static_cast<int>(length)));
+        if (!info) {
+            return LINGLONG_ERR(info);
+        }
 
-    ostreeUserData data{ .repo = this, .taskContext = taskContext.get() };
-    auto *progress = ostree_async_progress_new_and_connect(progress_changed, (void *)&data);
-    Q_ASSERT(progress != nullptr);
-
-    if (ostree_repo_pull(tmpRepo,
-                         this->cfg.defaultRepo.c_str(),
-                         refs,
-                         OSTREE_REPO_PULL_FLAGS_MIRROR,
-                         progress,
-                         cancellable,
-                         &gErr)
-        == FALSE) {
-        taskContext->updateStatus(service::InstallTask::Failed,
-                                  LINGLONG_ERRV("ostree_repo_pull", gErr));
-        return;
+        infos.push_back(std::move(*info));
     }
 
-    g_autofree auto *fileURLToTmpRepo =
-      g_strconcat("file://", tmpRepoDir.path().toUtf8().constData(), NULL);
-    GVariantBuilder builder{};
-    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
-    g_variant_builder_add(&builder,
-                          "{s@v}",
-                          "refs",
-                          g_variant_new_variant(g_variant_new_strv((const char *const *)refs, -1)));
-    g_variant_builder_add(&builder,
-                          "{s@v}",
-                          "disable-static-deltas",
-                          g_variant_new_variant(g_variant_new_boolean(TRUE)));
-    g_variant_builder_add(&builder,
-                          "{s@v}",
-                          "disable-sign-verify",
-                          g_variant_new_variant(g_variant_new_boolean(TRUE)));
-    g_variant_builder_add(&builder,
-                          "{s@v}",
-                          "disable-sign-verify-summary",
-                          g_variant_new_variant(g_variant_new_boolean(TRUE)));
+    return infos;
+}
 
-    g_autoptr(GVariant) options = g_variant_ref_sink(g_variant_builder_end(&builder));
+std::optional<package::Reference>
+OSTreeRepo::deltaSourceOf(const package::Reference &ref, bool develop) const noexcept
+{
+    std::optional<package::Reference> source;
+
+    const auto module = develop ? "develop" : "runtime";
+    const auto prefix = QString("%1/%2/").arg(ref.channel, ref.id).toUtf8();
+    for (const auto &record : this->localIndex.findByPrefix(prefix)) {
+        // NOTE: refspec is channel/id/version/arch/module
+        const auto parts = QString::fromUtf8(record.first).split('/');
+        if (parts.size() != 5 || parts[3] != ref.arch.toString() || parts[4] != module) {
+            continue;
+        }
 
-    if (ostree_repo_pull_with_options(this->ostreeRepo.get(),
-                                      (char *)fileURLToTmpRepo,
-                                      options,
-                                      NULL,
-                                      cancellable,
-                                      &gErr)
-        == FALSE) {
-        taskContext->updateStatus(service::InstallTask::Failed,
-                                  LINGLONG_ERRV("ostree_repo_pull_with_options", gErr));
-        return;
-    };
+        auto version = package::Version::parse(parts[2]);
+        if (!version) {
+            continue;
+        }
 
-    transaction.addRollBack([this, &reference, &develop]() noexcept {
-        auto result = this->remove(reference, develop);
-        if (!result) {
-            qCritical() << result.error();
-            Q_ASSERT(false);
+        if (*version >= ref.version || (source && source->version >= *version)) {
+            continue;
         }
-    });
 
-    auto result = handleRepositoryUpdate(this->ostreeRepo.get(),
-                                         this->getLayerQDir(reference, develop),
-                                         refString);
-    if (!result) {
-        taskContext->updateStatus(service::InstallTask::Failed, LINGLONG_ERRV(result));
-        return;
+        auto installed = package::Reference::create(ref.channel, ref.id, *version, ref.arch);
+        if (!installed) {
+            continue;
+        }
+
+        source = *installed;
     }
 
-    transaction.commit();
+    return source;
 }
 
 utils::error::Result<package::Reference> OSTreeRepo::clearReference(
@@ -1207,7 +4031,7 @@ utils::error::Result<package::Reference> OSTreeRepo::clearReference(
     utils::error::Result<package::Reference> reference = LINGLONG_ERR("reference not exists");
 
     if (!opts.forceRemote) {
-        reference = clearReferenceLocal(fuzzy, this->repoDir.absoluteFilePath("layers"));
+        reference = clearReferenceLocal(fuzzy, this->localIndex);
         if (reference) {
             return reference;
         }
@@ -1220,8 +4044,12 @@ utils::error::Result<package::Reference> OSTreeRepo::clearReference(
         qInfo() << "fallback to Remote";
     }
 
-    reference =
-      clearReferenceRemote(fuzzy, this->apiClient, QString::fromStdString(this->cfg.defaultRepo));
+    auto records = this->searchRemote(fuzzy);
+    if (!records) {
+        return LINGLONG_ERR(records);
+    }
+
+    reference = clearReferenceRemote(fuzzy, *records);
     if (reference) {
         return reference;
     }
@@ -1229,31 +4057,105 @@ utils::error::Result<package::Reference> OSTreeRepo::clearReference(
     return LINGLONG_ERR(reference);
 }
 
+std::vector<utils::error::Result<package::Reference>>
+OSTreeRepo::clearReferences(const std::vector<package::FuzzyReference> &fuzzies) const noexcept
+{
+    LINGLONG_TRACE("clear fuzzy references remotely");
+
+    auto result = this->updateRemoteIndex();
+    if (!result) {
+        // NOTE: Keep using the outdated index, if any, while offline.
+        qWarning() << result.error();
+    }
+
+    std::vector<utils::error::Result<package::Reference>> references;
+    references.reserve(fuzzies.size());
+
+    // NOTE: Without a remote index, each reference is searched on the server.
+    if (this->remoteIndex.size() == 0) {
+        for (const auto &fuzzy : fuzzies) {
+            auto records = this->searchRemote(fuzzy);
+            if (!records) {
+                references.emplace_back(LINGLONG_ERR(records));
+                continue;
+            }
+
+            references.emplace_back(clearReferenceRemote(fuzzy, *records));
+        }
+
+        return references;
+    }
+
+    std::map<QString, utils::error::Result<std::vector<api::types::v1::PackageInfo>>> listings;
+    for (const auto &fuzzy : fuzzies) {
+        const auto arch = fuzzy.arch ? fuzzy.arch->toString() : QString();
+        auto listing = listings.find(arch);
+        if (listing == listings.end()) {
+            listing = listings
+                        .emplace(arch,
+                                 searchRemoteIndex(this->remoteIndex,
+                                                   std::nullopt,
+                                                   QString(),
+                                                   std::nullopt,
+                                                   fuzzy.arch))
+                        .first;
+        }
+
+        if (!listing->second) {
+            references.emplace_back(LINGLONG_ERR(listing->second.error().message(),
+                                                 listing->second.error().code()));
+            continue;
+        }
+
+        references.emplace_back(clearReferenceRemote(fuzzy, *listing->second));
+    }
+
+    return references;
+}
+
 utils::error::Result<std::vector<api::types::v1::PackageInfo>>
 OSTreeRepo::listLocal() const noexcept
 {
     std::vector<api::types::v1::PackageInfo> pkgInfos;
+    pkgInfos.reserve(this->localIndex.size());
+
+    for (const auto &[refspec, rawInfo] : this->localIndex.findByPrefix("")) {
+        auto pkgInfo = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(rawInfo);
+        if (!pkgInfo) {
+            qCritical() << "broken local index detected" << refspec << pkgInfo.error();
+            Q_ASSERT(false);
+            continue;
+        }
+
+        pkgInfos.emplace_back(std::move(*pkgInfo));
+    }
+
+    return pkgInfos;
+}
+
+utils::error::Result<void> OSTreeRepo::rebuildLocalIndex() noexcept
+{
+    LINGLONG_TRACE("rebuild local index");
+
+    LocalIndex::Entries entries;
 
     QDir layersDir = this->repoDir.absoluteFilePath("layers");
-    Q_ASSERT(layersDir.exists());
-
-    auto pushBackPkgInfos = [&pkgInfos](QDir &dir) noexcept {
-        QFile runtimePkgInfoFile = dir.absoluteFilePath("runtime/info.json");
-        if (runtimePkgInfoFile.exists()) {
-            auto pkgInfo =
-              utils::serialize::LoadJSONFile<api::types::v1::PackageInfo>(runtimePkgInfoFile);
-            if (pkgInfo) {
-                pkgInfos.emplace_back(std::move(*pkgInfo));
+
+    auto insertEntries = [&entries, &layersDir](QDir &dir) noexcept {
+        for (const auto *module : { "runtime", "develop" }) {
+            package::LayerDir layerDir = dir.absoluteFilePath(module);
+            if (!layerDir.exists()) {
+                continue;
             }
-        }
 
-        QFile devPkgInfoFile = dir.absoluteFilePath("develop/info.json");
-        if (devPkgInfoFile.exists()) {
-            auto pkgInfo =
-              utils::serialize::LoadJSONFile<api::types::v1::PackageInfo>(devPkgInfoFile);
-            if (!pkgInfo) {
-                pkgInfos.emplace_back(std::move(*pkgInfo));
+            auto rawInfo = layerDir.rawInfo();
+            if (!rawInfo) {
+                qWarning() << "Ignore invalid layer" << rawInfo.error();
+                continue;
             }
+
+            entries.emplace(layersDir.relativeFilePath(layerDir.absolutePath()).toUtf8(),
+                            *rawInfo);
         }
     };
 
@@ -1266,19 +4168,85 @@ OSTreeRepo::listLocal() const noexcept
                      QDir(versionInfo.absoluteFilePath())
                        .entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
                     QDir architectureDir = architectureInfo.absoluteFilePath();
-                    pushBackPkgInfos(architectureDir);
+                    insertEntries(architectureDir);
                 }
             }
         }
     }
 
-    return pkgInfos;
+    auto result = this->localIndex.replace(entries);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> OSTreeRepo::updateRemoteIndex() const noexcept
+{
+    LINGLONG_TRACE("update remote index");
+
+    if (!this->remoteIndexDeadline.hasExpired()) {
+        return LINGLONG_OK;
+    }
+
+    // NOTE: Set the deadline before fetching, so that an unreachable server is
+    // not queried again for every lookup.
+    const auto timeout = this->cfg.remoteCacheTimeout.value_or(defaultRemoteCacheTimeout);
+    this->remoteIndexDeadline = QDeadlineTimer(std::chrono::seconds(timeout));
+
+    auto summary =
+      fetchRemoteSummary(this->ostreeRepo.get(), QString::fromStdString(this->cfg.defaultRepo));
+    if (!summary) {
+        return LINGLONG_ERR(summary);
+    }
+
+    this->remoteCommits = std::move(summary->commits);
+
+    if (!summary->index) {
+        if (this->remoteIndex.size() == 0) {
+            return LINGLONG_OK;
+        }
+
+        auto result = this->remoteIndex.replace({});
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+
+        return LINGLONG_OK;
+    }
+
+    auto result = this->remoteIndex.load(*summary->index);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
 }
 
 utils::error::Result<std::vector<api::types::v1::PackageInfo>>
-OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
+OSTreeRepo::searchRemote(const package::FuzzyReference &fuzzyRef) const noexcept
 {
-    LINGLONG_TRACE("list remote references");
+    LINGLONG_TRACE("search remote references");
+
+    auto result = this->updateRemoteIndex();
+    if (!result) {
+        // NOTE: Keep using the outdated index, if any, while offline.
+        qWarning() << result.error();
+    }
+
+    if (this->remoteIndex.size() != 0) {
+        auto pkgInfos = searchRemoteIndex(this->remoteIndex,
+                                          fuzzyRef.channel,
+                                          fuzzyRef.id,
+                                          fuzzyRef.version,
+                                          fuzzyRef.arch);
+        if (!pkgInfos) {
+            return LINGLONG_ERR(pkgInfos);
+        }
+
+        return pkgInfos;
+    }
 
     api::client::Request_FuzzySearchReq req;
 
@@ -1287,6 +4255,7 @@ OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
     if (fuzzyRef.arch) {
         req.setArch(fuzzyRef.arch->toString());
     } else {
+        // NOTE: Server requires that arch is set, but why?
         req.setArch(QSysInfo::currentCpuArchitecture());
     }
     if (fuzzyRef.channel) {
@@ -1296,8 +4265,22 @@ OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
         req.setVersion(fuzzyRef.version->toString());
     }
 
-    utils::error::Result<std::vector<api::types::v1::PackageInfo>> pkgInfos =
-      std::vector<api::types::v1::PackageInfo>{};
+    const auto timeout = this->cfg.remoteCacheTimeout.value_or(defaultRemoteCacheTimeout);
+    const RemoteSearchKey key{ req.getRepoName(),
+                               req.getAppId(),
+                               req.getChannel(),
+                               req.getVersion(),
+                               req.getArch() };
+    if (timeout > 0) {
+        auto cached = this->remoteSearchCache.find(key);
+        if (cached != this->remoteSearchCache.end() && !cached->second.deadline.hasExpired()) {
+            qDebug() << "remote search cache hit" << fuzzyRef.toString();
+            return cached->second.records;
+        }
+    }
+
+    utils::error::Result<QList<api::client::Request_RegisterStruct>> records =
+      QList<api::client::Request_RegisterStruct>{};
 
     QEventLoop loop;
     const qint32 HTTP_OK = 200;
@@ -1308,25 +4291,11 @@ OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
       [&](const api::client::FuzzySearchApp_200_response &resp) {
           loop.exit();
           if (resp.getCode() != HTTP_OK) {
-              pkgInfos = LINGLONG_ERR(resp.getMsg(), resp.getCode());
+              records = LINGLONG_ERR(resp.getMsg(), resp.getCode());
               return;
           }
 
-          for (const auto &record : resp.getData()) {
-              auto json = nlohmann::json::parse(QJsonDocument(record.asJsonObject()).toJson());
-              json["appid"] = json["appId"];
-              json.erase("appId");
-              json["base"] = ""; // FIXME: This is werid.
-              json["arch"] = nlohmann::json::array({ json["arch"] });
-              auto pkgInfo = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(json);
-              if (!pkgInfo) {
-                  qCritical() << "Ignored invalid record" << record.asJson() << pkgInfo.error();
-                  continue;
-              }
-
-              pkgInfos->emplace_back(*std::move(pkgInfo));
-          }
-          return;
+          records = resp.getData();
       },
       loop.thread() == this->apiClient.thread() ? Qt::AutoConnection
                                                 : Qt::BlockingQueuedConnection);
@@ -1337,7 +4306,7 @@ OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
       &loop,
       [&](auto, auto error_type, const QString &error_str) {
           loop.exit();
-          pkgInfos = LINGLONG_ERR(error_str, error_type);
+          records = LINGLONG_ERR(error_str, error_type);
       },
       loop.thread() == this->apiClient.thread() ? Qt::AutoConnection
                                                 : Qt::BlockingQueuedConnection);
@@ -1345,6 +4314,50 @@ OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
     this->apiClient.fuzzySearchApp(req);
     loop.exec();
 
+    if (!records) {
+        return LINGLONG_ERR(records);
+    }
+
+    std::vector<api::types::v1::PackageInfo> pkgInfos;
+    for (const auto &record : *records) {
+        auto json = nlohmann::json::parse(QJsonDocument(record.asJsonObject()).toJson());
+        json["appid"] = json["appId"];
+        json.erase("appId");
+        json["base"] = ""; // FIXME: This is werid.
+        json["arch"] = nlohmann::json::array({ json["arch"] });
+        auto pkgInfo = utils::serialize::LoadJSON<api::types::v1::PackageInfo>(json);
+        if (!pkgInfo) {
+            qCritical() << "Ignored invalid record" << record.asJson() << pkgInfo.error();
+            continue;
+        }
+
+        pkgInfos.emplace_back(*std::move(pkgInfo));
+    }
+
+    if (timeout > 0) {
+        for (auto it = this->remoteSearchCache.begin(); it != this->remoteSearchCache.end();) {
+            if (it->second.deadline.hasExpired()) {
+                it = this->remoteSearchCache.erase(it);
+                continue;
+            }
+            ++it;
+        }
+
+        this->remoteSearchCache[key] = RemoteSearchCacheEntry{
+            .deadline = QDeadlineTimer(std::chrono::seconds(timeout)),
+            .records = pkgInfos,
+        };
+    }
+
+    return pkgInfos;
+}
+
+utils::error::Result<std::vector<api::types::v1::PackageInfo>>
+OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
+{
+    LINGLONG_TRACE("list remote references");
+
+    auto pkgInfos = this->searchRemote(fuzzyRef);
     if (!pkgInfos) {
         return LINGLONG_ERR(pkgInfos);
     }
@@ -1353,6 +4366,12 @@ OSTreeRepo::listRemote(const package::FuzzyReference &fuzzyRef) const noexcept
 }
 
 void OSTreeRepo::removeDanglingXDGIntergation() noexcept
+{
+    this->removeDanglingLinks();
+    this->notifySharedInfoChanged();
+}
+
+void OSTreeRepo::removeDanglingLinks() noexcept
 {
     QDir entriesDir = this->repoDir.absoluteFilePath("entries/share");
     QDirIterator it(entriesDir.absolutePath(),
@@ -1382,21 +4401,55 @@ void OSTreeRepo::removeDanglingXDGIntergation() noexcept
             qCritical() << "Failed to remove" << it.filePath();
             Q_ASSERT(false);
         }
+        this->markSharedInfoChanged(entriesDir.relativeFilePath(it.filePath()));
     }
-    this->updateSharedInfo();
 }
 
-void OSTreeRepo::unexportReference(const package::Reference &ref) noexcept
+void OSTreeRepo::removeExportedLinks(const package::Reference &ref,
+                                     const QSet<QString> &keep) noexcept
 {
+    QDir entriesDir = this->repoDir.absoluteFilePath("entries/share");
     auto layerQDir = this->getLayerQDir(ref);
-    // if uninstall package, call removeDanglingXDGIntergation()
+
+    const auto manifestPath = this->linkManifestPath(ref);
+    auto links = readLinkManifest(manifestPath);
+    if (links) {
+        for (const auto &link : *links) {
+            if (keep.contains(link)) {
+                continue;
+            }
+
+            // NOTE: The link may have been taken over by another layer.
+            const QFileInfo info(entriesDir.absoluteFilePath(link));
+            if (!info.isSymLink()
+                || !info.symLinkTarget().startsWith(layerQDir.absolutePath() + "/")) {
+                continue;
+            }
+
+            if (!entriesDir.remove(link)) {
+                qCritical() << "Failed to remove" << info.absoluteFilePath();
+                Q_ASSERT(false);
+            }
+            this->markSharedInfoChanged(link);
+        }
+
+        if (!QFile::remove(manifestPath)) {
+            qWarning() << "Failed to remove" << manifestPath;
+        }
+        return;
+    }
+
+    // NOTE: References exported before link manifests were introduced have
+    // to be found by walking all the links.
+    qDebug() << links.error();
+
+    // if uninstall package, remove all dangling links
     if (!layerQDir.exists()) {
-        removeDanglingXDGIntergation();
+        this->removeDanglingLinks();
         return;
     }
 
     // if upgrade package
-    QDir entriesDir = this->repoDir.absoluteFilePath("entries/share");
     QDirIterator it(entriesDir.absolutePath(),
                     QDir::AllEntries | QDir::NoDot | QDir::NoDotDot | QDir::System,
                     QDirIterator::Subdirectories);
@@ -1424,15 +4477,24 @@ void OSTreeRepo::unexportReference(const package::Reference &ref) noexcept
             qCritical() << "Failed to remove" << it.filePath();
             Q_ASSERT(false);
         }
+        this->markSharedInfoChanged(entriesDir.relativeFilePath(it.filePath()));
     }
-    this->updateSharedInfo();
 }
 
-void OSTreeRepo::exportReference(const package::Reference &ref) noexcept
+void OSTreeRepo::unexportReference(const package::Reference &ref) noexcept
+{
+    this->removeExportedLinks(ref, {});
+    this->notifySharedInfoChanged();
+}
+
+utils::error::Result<void> OSTreeRepo::exportReference(const package::Reference &ref) noexcept
 {
+    LINGLONG_TRACE("export " + ref.toString());
+
     bool shouldExport = true;
+    std::vector<package::Reference> refs;
 
-    [&ref, this, &shouldExport]() {
+    [&ref, this, &shouldExport, &refs]() {
         // Check if we should export the application we just pulled to system.
 
         auto pkgInfos = this->listLocal();
@@ -1442,8 +4504,6 @@ void OSTreeRepo::exportReference(const package::Reference &ref) noexcept
             return;
         }
 
-        std::vector<package::Reference> refs;
-
         for (const auto &localInfo : *pkgInfos) {
             if (QString::fromStdString(localInfo.appid) != ref.id) {
                 continue;
@@ -1464,16 +4524,17 @@ void OSTreeRepo::exportReference(const package::Reference &ref) noexcept
 
             refs.push_back(*localRef);
         }
-
-        for (const auto &ref : refs) {
-            this->unexportReference(ref);
-        }
     }();
 
     if (!shouldExport) {
-        return;
+        return LINGLONG_OK;
     }
 
+    // NOTE: Links changed before a failure need their caches updated too.
+    auto notify = utils::finally::finally([this]() {
+        this->notifySharedInfoChanged();
+    });
+
     auto entriesDir = QDir(this->repoDir.absoluteFilePath("entries/share"));
     if (!entriesDir.exists()) {
         // entries directory should exists.
@@ -1484,75 +4545,112 @@ void OSTreeRepo::exportReference(const package::Reference &ref) noexcept
     auto layerDir = this->getLayerQDir(ref);
     auto layerEntriesDir = QDir(layerDir.absoluteFilePath("entries/share"));
     if (!layerEntriesDir.exists()) {
-        Q_ASSERT(false);
-        qCritical() << QString("Failed to export %1:").arg(ref.toString()) << layerEntriesDir
-                    << "not exists.";
-        return;
+        return LINGLONG_ERR(layerEntriesDir.absolutePath() + " not exists");
     }
 
+    QStringList links;
     QDirIterator it(layerEntriesDir.absolutePath(),
                     QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System,
                     QDirIterator::Subdirectories);
     while (it.hasNext()) {
         it.next();
-        const auto info = it.fileInfo();
-        if (info.isDir()) {
+        if (it.fileInfo().isDir()) {
             continue;
         }
+        links.append(layerEntriesDir.relativeFilePath(it.filePath()));
+    }
+
+    // NOTE: Links shared with the older versions are retargeted below instead
+    // of being removed and created again.
+    const QSet<QString> linkSet(links.begin(), links.end());
+    for (const auto &oldRef : refs) {
+        this->removeExportedLinks(oldRef, linkSet);
+    }
 
-        const auto parentDirForLinkPath =
-          layerEntriesDir.relativeFilePath(it.fileInfo().dir().absolutePath());
+    for (const auto &link : links) {
+        const QFileInfo info(layerEntriesDir.absoluteFilePath(link));
+        const auto parentDirForLinkPath = QFileInfo(link).path();
 
         if (!entriesDir.mkpath(parentDirForLinkPath)) {
-            qCritical() << "Failed to mkpath" << entriesDir.absoluteFilePath(parentDirForLinkPath);
-            Q_ASSERT(false);
+            return LINGLONG_ERR("mkpath " + entriesDir.absoluteFilePath(parentDirForLinkPath));
         }
 
         QDir parentDir(entriesDir.absoluteFilePath(parentDirForLinkPath));
-        const auto from = entriesDir.absoluteFilePath(parentDirForLinkPath) + "/" + it.fileName();
+        const auto from = entriesDir.absoluteFilePath(link);
         const auto to = parentDir.relativeFilePath(info.absoluteFilePath());
 
+        const QFileInfo fromInfo(from);
+        if (fromInfo.isSymLink()) {
+            if (fromInfo.symLinkTarget() == info.absoluteFilePath()) {
+                continue;
+            }
+
+            if (!QFile::remove(from)) {
+                return LINGLONG_ERR("remove " + from);
+            }
+        }
+
         if (!QFile::link(to, from)) {
-            qCritical() << "Failed to create link" << to << "->" << from;
-            Q_ASSERT(false);
+            return LINGLONG_ERR("create link " + to + " -> " + from);
+        }
+        this->markSharedInfoChanged(link);
+    }
+
+    auto result = writeLinkManifest(this->linkManifestPath(ref), links);
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    return LINGLONG_OK;
+}
+
+void OSTreeRepo::markSharedInfoChanged(const QString &link) noexcept
+{
+    for (const auto &[dir, _] : sharedInfoTools) {
+        if (link.startsWith(dir + "/")) {
+            this->changedSharedInfo.insert(dir);
+            return;
         }
     }
-    this->updateSharedInfo();
 }
 
-void OSTreeRepo::updateSharedInfo() noexcept
+void OSTreeRepo::notifySharedInfoChanged() noexcept
+{
+    if (this->changedSharedInfo.isEmpty()) {
+        return;
+    }
+
+    const QStringList dirs(this->changedSharedInfo.begin(), this->changedSharedInfo.end());
+    this->changedSharedInfo.clear();
+    Q_EMIT this->sharedInfoChanged(dirs);
+}
+
+void OSTreeRepo::updateSharedInfo(const QStringList &dirs) const noexcept
 {
     LINGLONG_TRACE("update shared info");
 
-    auto applicationDir = QDir(this->repoDir.absoluteFilePath("entries/share/applications"));
-    auto mimeDataDir = QDir(this->repoDir.absoluteFilePath("entries/share/mime"));
-    auto glibSchemasDir = QDir(this->repoDir.absoluteFilePath("entries/share/glib-2.0/schemas"));
-    // 更新 desktop database
-    if (applicationDir.exists()) {
-        auto ret =
-          utils::command::Exec("update-desktop-database", { applicationDir.absolutePath() });
-        if (!ret) {
-            qWarning() << "warning: failed to update desktop database in "
-                + applicationDir.absolutePath() + ": " + *ret;
+    // NOTE: The tools work on different directories, run them at the same time.
+    QList<QFuture<void>> futures;
+    for (const auto &[dir, tool] : sharedInfoTools) {
+        if (!dirs.contains(dir)) {
+            continue;
         }
-    }
 
-    // 更新 mime type database
-    if (mimeDataDir.exists()) {
-        auto ret = utils::command::Exec("update-mime-database", { mimeDataDir.absolutePath() });
-        if (!ret) {
-            qWarning() << "warning: failed to update mime type database in "
-                + mimeDataDir.absolutePath() + ": " + *ret;
+        const QDir sharedDir = this->repoDir.absoluteFilePath("entries/share/" + dir);
+        if (!sharedDir.exists()) {
+            continue;
         }
+
+        futures.append(QtConcurrent::run([tool = tool, path = sharedDir.absolutePath()]() {
+            auto ret = utils::command::Exec(tool, { path });
+            if (!ret) {
+                qWarning() << "warning: failed to run" << tool << "in" << path << ret.error();
+            }
+        }));
     }
 
-    // 更新 glib-2.0/schemas
-    if (glibSchemasDir.exists()) {
-        auto ret = utils::command::Exec("glib-compile-schemas", { glibSchemasDir.absolutePath() });
-        if (!ret) {
-            qWarning() << "warning: failed to update schemas in " + glibSchemasDir.absolutePath()
-                + ": " + *ret;
-        }
+    for (auto &future : futures) {
+        future.waitForFinished();
     }
 }
 
@@ -1561,7 +4659,7 @@ auto OSTreeRepo::getLayerDir(const package::Reference &ref, bool develop) const
 {
     LINGLONG_TRACE("get dir of " + ref.toString());
     auto dir = this->getLayerQDir(ref, develop);
-    if (!dir.exists()) {
+    if (!this->localIndex.find(ostreeSpecFromReference(ref, develop).toUtf8())) {
         return LINGLONG_ERR(dir.path() + " not exist.");
     }
 
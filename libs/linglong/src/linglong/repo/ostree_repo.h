@@ -8,21 +8,37 @@
 #define LINGLONG_SRC_MODULE_REPO_OSTREE_REPO_H_
 
 #include "ClientApi.h"
+#include "linglong/api/types/v1/LayerInfoDelta.hpp"
 #include "linglong/api/types/v1/RepoConfig.hpp"
 #include "linglong/package/fuzzy_reference.h"
 #include "linglong/package/layer_dir.h"
+#include "linglong/package/layer_file.h"
 #include "linglong/package/reference.h"
 #include "linglong/package_manager/task.h"
+#include "linglong/repo/local_index.h"
 #include "linglong/utils/error/error.h"
+#include "linglong/utils/transaction.h"
 
 #include <ostree.h>
 
+#include <QDeadlineTimer>
+#include <QHash>
 #include <QHttpPart>
 #include <QList>
+#include <QMutex>
 #include <QPointer>
 #include <QProcess>
 #include <QScopedPointer>
+#include <QSet>
 #include <QThread>
+#include <QUrl>
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace linglong::repo {
 
@@ -32,6 +48,36 @@ struct clearReferenceOption
     bool fallbackToRemote = true;
 };
 
+struct pushOption
+{
+    // Upload only the ostree objects missing on the server instead of a
+    // tarball of the whole layer.
+    bool objects = false;
+};
+
+struct verifyOption
+{
+    // Check out the broken layers again, and pull them again if their
+    // objects are corrupted.
+    bool repair = false;
+    // Refspecs of the layers to check, all layers if unset. The local index
+    // may only be used on the thread owning the repository, so a worker is
+    // given the layers, and leaves reindexLayers() of the repaired layers to
+    // that thread.
+    std::optional<QStringList> layers;
+};
+
+struct verifyResult
+{
+    int objects = 0;
+    int layers = 0;
+    // Names of ostree objects, like "<checksum>.file".
+    QStringList corruptedObjects;
+    // Refspecs of layers.
+    QStringList brokenLayers;
+    QStringList repairedLayers;
+};
+
 class OSTreeRepo : public QObject
 {
     Q_OBJECT
@@ -48,32 +94,100 @@ public:
 
     api::types::v1::RepoConfig getConfig() const noexcept;
     utils::error::Result<void> setConfig(const api::types::v1::RepoConfig &cfg) noexcept;
+    // pull() fetches objects from the peers returned by the function first,
+    // see PeerServer. Objects missing on the peers are fetched from the remote.
+    void setPeers(std::function<QList<QUrl>()> peers) noexcept;
+    // Commits of the layers pulled from the remote, which are shared with the
+    // peers, see PeerServer. It can be called from any thread.
+    QByteArrayList sharedCommits() const noexcept;
 
-    utils::error::Result<void> importLayerDir(const package::LayerDir &dir) noexcept;
+    // If delta is given, dir only holds the files changed since the base
+    // layer of the delta, which must be installed.
+    utils::error::Result<void>
+    importLayerDir(const package::LayerDir &dir,
+                   const std::optional<api::types::v1::LayerInfoDelta> &delta = {}) noexcept;
+    // Import the EROFS image of the layer file without mounting it, see
+    // package::ErofsReader. Fails with ENOTSUP if the image can not be read,
+    // unpack the layer file and import the directory in that case.
+    utils::error::Result<void> importLayerFile(package::LayerFile &file) noexcept;
 
     utils::error::Result<package::LayerDir> getLayerDir(const package::Reference &ref,
                                                         bool develop = false) const noexcept;
+    // Checksum of the files of the layer, the same wherever the layer is
+    // committed. It identifies the base layer of a delta layer.
+    utils::error::Result<QString> getLayerChecksum(const package::Reference &ref,
+                                                   bool develop = false) const noexcept;
 
     utils::error::Result<void> push(const package::Reference &reference,
-                                    bool develop = false) const noexcept;
+                                    bool develop = false,
+                                    const pushOption &opts = {}) const noexcept;
 
     void pull(std::shared_ptr<service::InstallTask> taskContext,
               const package::Reference &reference,
               bool develop = false) noexcept;
+    void pull(std::shared_ptr<service::InstallTask> taskContext,
+              const std::vector<package::Reference> &references,
+              bool develop = false) noexcept;
+
+    utils::error::Result<api::types::v1::PackageInfo>
+    getRemoteInfo(const package::Reference &reference,
+                  bool develop = false,
+                  GCancellable *cancellable = nullptr) noexcept;
+    // Fetch info.json of all references in one pull.
+    utils::error::Result<std::vector<api::types::v1::PackageInfo>>
+    getRemoteInfo(const std::vector<package::Reference> &references,
+                  bool develop = false,
+                  GCancellable *cancellable = nullptr) noexcept;
 
     utils::error::Result<package::Reference> clearReference(
       const package::FuzzyReference &fuzz, const clearReferenceOption &opts) const noexcept;
+    // Resolve the latest remote references of all fuzzy references, in their
+    // order, from one listing of the remote index per architecture. Without
+    // a remote index, the server is searched for every reference.
+    std::vector<utils::error::Result<package::Reference>>
+    clearReferences(const std::vector<package::FuzzyReference> &fuzzies) const noexcept;
 
     utils::error::Result<std::vector<api::types::v1::PackageInfo>> listLocal() const noexcept;
     utils::error::Result<std::vector<api::types::v1::PackageInfo>>
     listRemote(const package::FuzzyReference &fuzzyRef) const noexcept;
 
+    // Removal only drops the reference and moves the layer into the trash
+    // directory, call emptyTrash() and prune() afterwards to release the
+    // disk space. emptyTrash() can be called from any thread.
     utils::error::Result<void> remove(const package::Reference &ref, bool develop = false) noexcept;
+    // Remove all the layers, by reference and whether it is the develop
+    // module, or none of them.
+    utils::error::Result<void>
+    remove(const std::vector<std::pair<package::Reference, bool>> &layers) noexcept;
+    utils::error::Result<void> emptyTrash() const noexcept;
+    // Returns the size in bytes of the objects pruned. Objects fetched by
+    // unfinished pulls are kept for a retry, unless they are older than
+    // stagingMaxAge or exceed stagingMaxSize in total.
+    utils::error::Result<quint64> prune() noexcept;
+
+    // Check all objects against their checksums and all layers against
+    // their commits, in parallel.
+    utils::error::Result<verifyResult> verify(const verifyOption &opts = {}) noexcept;
+    // Refspecs of all the layers in the local index.
+    QStringList listLayers() const noexcept;
+    // Read the info of the checked out layers into the local index again.
+    utils::error::Result<void> reindexLayers(const QStringList &refspecs) noexcept;
 
     void removeDanglingXDGIntergation() noexcept;
-    void exportReference(const package::Reference &ref) noexcept;
+    // Exporting a reference replaces the links of its older versions, it is
+    // skipped if a newer version is installed.
+    utils::error::Result<void> exportReference(const package::Reference &ref) noexcept;
     void unexportReference(const package::Reference &ref) noexcept;
-    void updateSharedInfo() noexcept;
+    // Regenerate the caches of the given directories under entries/share,
+    // which may take a while. It can be called from any thread.
+    void updateSharedInfo(const QStringList &dirs = { "applications",
+                                                      "mime",
+                                                      "glib-2.0/schemas" }) const noexcept;
+
+Q_SIGNALS:
+    // Emitted when exporting or unexporting changed the links in the
+    // directories of entries/share, see updateSharedInfo().
+    void sharedInfoChanged(const QStringList &dirs);
 
 private:
     api::types::v1::RepoConfig cfg;
@@ -89,8 +203,122 @@ private:
 
     std::unique_ptr<OstreeRepo, OstreeRepoDeleter> ostreeRepo = nullptr;
     QDir repoDir;
+    LocalIndex localIndex;
     QDir ostreeRepoDir() const noexcept;
+    QDir trashDir() const noexcept;
+    QString linkManifestPath(const package::Reference &ref) const noexcept;
+    utils::error::Result<void> repairLayer(const QString &refspec, bool pull) noexcept;
+    void removeDanglingLinks() noexcept;
+    void markSharedInfoChanged(const QString &link) noexcept;
+    void notifySharedInfoChanged() noexcept;
+    // Remove the links exported for ref, except those listed in keep.
+    void removeExportedLinks(const package::Reference &ref, const QSet<QString> &keep) noexcept;
+    // Publish the layer to the archive mode repository at path, and add it
+    // to the index of the repository.
+    utils::error::Result<void> publish(const package::Reference &ref,
+                                       bool develop,
+                                       const QString &path) const noexcept;
+    QUrl uploadTaskUrl(const QString &taskID, const QString &path) const noexcept;
+    utils::error::Result<void> uploadTarball(const package::Reference &ref,
+                                             bool develop,
+                                             const QString &token,
+                                             const QString &taskID) const noexcept;
+    utils::error::Result<void> uploadObjects(const QString &refspec,
+                                             const QString &token,
+                                             const QString &taskID) const noexcept;
     QDir getLayerQDir(const package::Reference &ref, bool develop = false) const noexcept;
+    utils::error::Result<void> rebuildLocalIndex() noexcept;
+    // Commit the layer of info by commit, and check it out. commit writes the
+    // files into the tree, which holds the files of the base layer of delta.
+    utils::error::Result<void> importLayer(
+      const api::types::v1::PackageInfo &info,
+      const std::optional<api::types::v1::LayerInfoDelta> &delta,
+      const std::function<utils::error::Result<void>(OstreeMutableTree *, const char *)>
+        &commit) noexcept;
+    // Returns the tree of the base layer of delta without the removed files,
+    // after checking the installed base layer is the one delta expects.
+    utils::error::Result<OstreeMutableTree *>
+    deltaBaseTree(const package::Reference &ref,
+                  bool develop,
+                  const api::types::v1::LayerInfoDelta &delta) noexcept;
+    // Returns the commits the refspecs point to on the remote.
+    QByteArrayList recordStaging(const QByteArrayList &refspecs) noexcept;
+    // Returns whether the commits have been fetched from one of the peers,
+    // some of their objects may still be missing.
+    bool pullFromPeers(const QList<QUrl> &peers,
+                       const QByteArrayList &commits,
+                       OstreeAsyncProgress *progress,
+                       GCancellable *cancellable) noexcept;
+    // Run pull in a worker thread inside a transaction of the repository, and
+    // process the events of the calling thread until it finishes.
+    utils::error::Result<void>
+    pullInWorker(const std::function<utils::error::Result<void>()> &pull,
+                 GCancellable *cancellable) noexcept;
+    // Point the remote to the mirror with the lowest latency, probed at most
+    // once per mirrorProbeInterval. Probing blocks for up to 5 seconds, so it
+    // runs in pullInWorker() before the transaction is prepared.
+    void selectMirror() noexcept;
+    utils::error::Result<void> useMirror(const QString &url) noexcept;
+    // Run pull, and run it again with the other mirrors in the order of their
+    // latency until it succeeds. The mirror that worked is moved to the front.
+    utils::error::Result<void>
+    pullWithFailover(const std::function<utils::error::Result<void>()> &pull,
+                     GCancellable *cancellable) noexcept;
+    void keepStaging(GHashTable *reachable) noexcept;
+    // Remove the layer, the transaction restores it if not committed.
+    utils::error::Result<void> removeLayer(const package::Reference &ref,
+                                           bool develop,
+                                           utils::Transaction &transaction) noexcept;
+    std::optional<package::Reference> deltaSourceOf(const package::Reference &ref,
+                                                    bool develop) const noexcept;
+    utils::error::Result<void> updateRemoteIndex() const noexcept;
+    utils::error::Result<std::vector<api::types::v1::PackageInfo>>
+    searchRemote(const package::FuzzyReference &fuzzyRef) const noexcept;
+
+    static constexpr int64_t defaultRemoteCacheTimeout = 300;
+    static constexpr int64_t mirrorProbeInterval = 3600;
+    static constexpr guint peerStallTimeout = 10;
+    static constexpr int64_t stagingMaxAge = 7 * 24 * 3600;
+    static constexpr quint64 stagingMaxSize = 4ULL * 1024 * 1024 * 1024;
+
+    // repo, appId, channel, version, arch
+    using RemoteSearchKey = std::tuple<QString, QString, QString, QString, QString>;
+
+    struct RemoteSearchCacheEntry
+    {
+        QDeadlineTimer deadline;
+        std::vector<api::types::v1::PackageInfo> records;
+    };
+
+    mutable std::map<RemoteSearchKey, RemoteSearchCacheEntry> remoteSearchCache;
+
+    QSet<QString> changedSharedInfo;
+
+    // Index of all references in the default remote repository, see
+    // updateRemoteIndex().
+    mutable LocalIndex remoteIndex;
+    mutable QDeadlineTimer remoteIndexDeadline{ std::chrono::seconds(0) };
+    // Commits of the references in the summary of the default remote
+    // repository, updated with remoteIndex.
+    mutable QHash<QByteArray, QByteArray> remoteCommits;
+
+    // Commits of unfinished pulls by refspec, see pull() and prune().
+    LocalIndex stagingIndex;
+
+    // Commits of the layers pulled from the remote by refspec, see
+    // sharedCommits(). The lock guards it against the threads of PeerServer.
+    LocalIndex sharedIndex;
+    mutable QMutex sharedIndexLock;
+
+    // URL the remote points to, and the mirrors of the default repository
+    // ordered by latency, see selectMirror(). They are guarded by mirrorsLock,
+    // as the mirrors are probed in the worker thread of a pull.
+    QMutex mirrorsLock;
+    QString currentMirror;
+    QStringList mirrors;
+    QDeadlineTimer mirrorsDeadline{ std::chrono::seconds(0) };
+
+    std::function<QList<QUrl>()> peers;
 
     api::client::ClientApi &apiClient;
 };
@@ -0,0 +1,455 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/repo/peer_server.h"
+
+#include <gio/gio.h>
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QNetworkDatagram>
+#include <QUuid>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace linglong::repo {
+
+namespace {
+
+constexpr gsize chunkSize = 64 * 1024;
+constexpr int maxHeaderSize = 8 * 1024;
+constexpr int writeTimeout = 30;
+
+// Listener hands the accepted connections to the handler, which serves them
+// in other threads.
+class Listener : public QTcpServer
+{
+public:
+    Listener(std::function<void(qintptr)> handler, QObject *parent)
+        : QTcpServer(parent)
+        , handler(std::move(handler))
+    {
+    }
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override { this->handler(socketDescriptor); }
+
+private:
+    std::function<void(qintptr)> handler;
+};
+
+QByteArray statusLine(int code)
+{
+    switch (code) {
+    case 200:
+        return "HTTP/1.1 200 OK\r\n";
+    case 404:
+        return "HTTP/1.1 404 Not Found\r\n";
+    case 405:
+        return "HTTP/1.1 405 Method Not Allowed\r\n";
+    default:
+        return "HTTP/1.1 500 Internal Server Error\r\n";
+    }
+}
+
+// Write data, waiting while the peer lags more than a few chunks behind.
+bool writeAll(QTcpSocket &socket, const QByteArray &data)
+{
+    if (socket.write(data) != data.size()) {
+        return false;
+    }
+
+    while (socket.bytesToWrite() > static_cast<qint64>(4 * chunkSize)) {
+        if (!socket.waitForBytesWritten(writeTimeout * 1000)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool reply(QTcpSocket &socket, int code, const QByteArray &body)
+{
+    return writeAll(socket,
+                    statusLine(code)
+                      + "Content-Type: application/octet-stream\r\n"
+                        "Content-Length: "
+                      + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+}
+
+// NOTE: The size of a converted file object is unknown until it is read
+// completely, so the body is sent with the chunked transfer encoding.
+bool replyStream(QTcpSocket &socket, GInputStream *body)
+{
+    if (!writeAll(socket,
+                  statusLine(200)
+                    + "Content-Type: application/octet-stream\r\n"
+                      "Transfer-Encoding: chunked\r\n\r\n")) {
+        return false;
+    }
+
+    QByteArray buffer(static_cast<int>(chunkSize), Qt::Uninitialized);
+    while (true) {
+        g_autoptr(GError) gErr = nullptr;
+        const gssize size = g_input_stream_read(body, buffer.data(), chunkSize, nullptr, &gErr);
+        if (size < 0) {
+            // NOTE: The peer drops the truncated object, and fetches it elsewhere.
+            qWarning() << "failed to read object:" << gErr->message;
+            return false;
+        }
+        if (size == 0) {
+            break;
+        }
+
+        if (!writeAll(socket,
+                      QByteArray::number(static_cast<qint64>(size), 16) + "\r\n"
+                        + QByteArray::fromRawData(buffer.constData(), static_cast<int>(size))
+                        + "\r\n")) {
+            return false;
+        }
+    }
+
+    return writeAll(socket, "0\r\n\r\n");
+}
+
+} // namespace
+
+PeerServer::PeerServer(const QDir &ostreeRepoDir, QObject *parent)
+    : QObject(parent)
+    , ostreeRepoDir(ostreeRepoDir)
+    , id(QUuid::createUuid().toString(QUuid::WithoutBraces))
+    , server(new Listener(
+        [this](qintptr socketDescriptor) {
+            QtConcurrent::run(&this->pool, [this, socketDescriptor]() {
+                this->serve(socketDescriptor);
+            });
+        },
+        this))
+    , discovery(new QUdpSocket(this))
+    , announceTimer(new QTimer(this))
+{
+    this->pool.setMaxThreadCount(maxConnections);
+    QObject::connect(this->discovery, &QUdpSocket::readyRead, this, &PeerServer::onDatagram);
+    QObject::connect(this->announceTimer, &QTimer::timeout, this, &PeerServer::announce);
+}
+
+PeerServer::~PeerServer()
+{
+    this->server->close();
+    this->stopping = true;
+    this->pool.waitForDone();
+}
+
+void PeerServer::setSharedCommits(std::function<QByteArrayList()> sharedCommits) noexcept
+{
+    QMutexLocker locker(&this->sharedMutex);
+    this->sharedCommits = std::move(sharedCommits);
+    this->sharedDeadline = QDeadlineTimer(std::chrono::seconds(0));
+}
+
+utils::error::Result<void> PeerServer::listen(const QHostAddress &address, quint16 port) noexcept
+{
+    LINGLONG_TRACE("share objects of " + this->ostreeRepoDir.absolutePath());
+
+    if (address == QHostAddress::Any || address == QHostAddress::AnyIPv4
+        || address == QHostAddress::AnyIPv6) {
+        return LINGLONG_ERR("refuse to share objects on all network interfaces");
+    }
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) path = g_file_new_for_path(this->ostreeRepoDir.absolutePath().toUtf8());
+    g_autoptr(OstreeRepo) repo = ostree_repo_new(path);
+    if (ostree_repo_open(repo, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_open", gErr);
+    }
+
+    if (!this->server->listen(address, port)) {
+        return LINGLONG_ERR(this->server->errorString());
+    }
+
+    return LINGLONG_OK;
+}
+
+utils::error::Result<void> PeerServer::startDiscovery(const QNetworkAddressEntry &network,
+                                                      quint16 port) noexcept
+{
+    LINGLONG_TRACE(QString("discover peers in %1/%2 on port %3")
+                     .arg(network.ip().toString())
+                     .arg(network.prefixLength())
+                     .arg(port));
+
+    if (network.broadcast().isNull()) {
+        return LINGLONG_ERR("the network has no broadcast address");
+    }
+
+    // NOTE:
+    // Broadcasts are only received by sockets bound to any address. Several
+    // users of the same machine may share their repositories.
+    if (!this->discovery->bind(QHostAddress::AnyIPv4,
+                               port,
+                               QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
+        return LINGLONG_ERR(this->discovery->errorString());
+    }
+
+    this->network = network;
+    this->discoveryPort = port;
+    this->announce();
+    this->announceTimer->start(announceInterval * 1000);
+    return LINGLONG_OK;
+}
+
+QUrl PeerServer::url() const noexcept
+{
+    QUrl url;
+    url.setScheme("http");
+    url.setHost(this->server->serverAddress().toString());
+    url.setPort(this->server->serverPort());
+    return url;
+}
+
+QList<QUrl> PeerServer::peers() const noexcept
+{
+    QMutexLocker locker(&this->mutex);
+
+    const auto expired = QDateTime::currentDateTime().addSecs(-peerTimeout);
+    QList<QUrl> urls;
+    for (const auto &[url, lastSeen] : this->announced) {
+        if (lastSeen > expired) {
+            urls.append(url);
+        }
+    }
+    return urls;
+}
+
+void PeerServer::announce() noexcept
+{
+    QJsonObject announcement{ { "id", this->id }, { "port", this->server->serverPort() } };
+    const auto datagram = QJsonDocument(announcement).toJson(QJsonDocument::Compact);
+    if (this->discovery->writeDatagram(datagram, this->network.broadcast(), this->discoveryPort)
+        < 0) {
+        qWarning() << "failed to announce peer:" << this->discovery->errorString();
+    }
+}
+
+void PeerServer::onDatagram() noexcept
+{
+    while (this->discovery->hasPendingDatagrams()) {
+        const auto datagram = this->discovery->receiveDatagram();
+        const auto sender = QHostAddress(datagram.senderAddress().toIPv4Address());
+        if (!sender.isInSubnet(this->network.ip(), this->network.prefixLength())) {
+            continue;
+        }
+
+        const auto announcement = QJsonDocument::fromJson(datagram.data()).object();
+        const auto peerID = announcement.value("id").toString();
+        const auto port = announcement.value("port").toInt();
+        if (peerID.isEmpty() || peerID == this->id || port <= 0 || port > 65535) {
+            continue;
+        }
+
+        QUrl url;
+        url.setScheme("http");
+        url.setHost(sender.toString());
+        url.setPort(port);
+
+        QMutexLocker locker(&this->mutex);
+        if (!this->announced.contains(peerID)) {
+            qInfo() << "found peer" << url;
+        }
+        this->announced.insert(peerID, { url, QDateTime::currentDateTime() });
+    }
+}
+
+void PeerServer::serve(qintptr socketDescriptor) noexcept
+{
+    QTcpSocket socket;
+    if (!socket.setSocketDescriptor(socketDescriptor)) {
+        qWarning() << "failed to serve peer:" << socket.errorString();
+        ::close(static_cast<int>(socketDescriptor));
+        return;
+    }
+
+    // NOTE: OstreeRepo is not thread safe, every connection opens its own.
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) path = g_file_new_for_path(this->ostreeRepoDir.absolutePath().toUtf8());
+    g_autoptr(OstreeRepo) repo = ostree_repo_new(path);
+    if (ostree_repo_open(repo, nullptr, &gErr) == FALSE) {
+        qWarning() << "failed to serve peer:" << gErr->message;
+        return;
+    }
+
+    // NOTE: ostree keeps the connection alive, requests have no body.
+    QByteArray buffer;
+    int idle = 0;
+    while (!this->stopping && socket.state() == QAbstractSocket::ConnectedState) {
+        const auto headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (buffer.size() > maxHeaderSize || idle >= idleTimeout) {
+                break;
+            }
+            if (!socket.waitForReadyRead(1000)) {
+                if (socket.error() != QAbstractSocket::SocketTimeoutError) {
+                    break;
+                }
+                ++idle;
+                continue;
+            }
+            idle = 0;
+            buffer.append(socket.readAll());
+            continue;
+        }
+
+        const auto requestLine = buffer.left(buffer.indexOf('\n')).trimmed().split(' ');
+        buffer.remove(0, headerEnd + 4);
+        if (requestLine.size() < 2
+            || !this->respond(socket,
+                              repo,
+                              requestLine[0],
+                              QUrl(QString::fromUtf8(requestLine[1])).path().toUtf8())) {
+            break;
+        }
+    }
+
+    socket.disconnectFromHost();
+    if (socket.state() != QAbstractSocket::UnconnectedState) {
+        socket.waitForDisconnected(1000);
+    }
+}
+
+bool PeerServer::respond(QTcpSocket &socket,
+                         OstreeRepo *repo,
+                         const QByteArray &method,
+                         const QByteArray &path) noexcept
+{
+    if (method != "GET") {
+        return reply(socket, 405, {});
+    }
+
+    if (path == "/config") {
+        return reply(socket, 200, "[core]\nrepo_version=1\nmode=archive-z2\n");
+    }
+
+    // objects/xx/<the rest of the checksum>.<type>
+    const auto parts = QString::fromUtf8(path).split('/', Qt::SkipEmptyParts);
+    if (parts.size() != 3 || parts[0] != "objects" || parts[1].size() != 2) {
+        return reply(socket, 404, {});
+    }
+
+    g_autoptr(GInputStream) body = nullptr;
+    const auto code = this->object(repo, parts[1] + parts[2], &body);
+    if (body == nullptr) {
+        return reply(socket, code, {});
+    }
+
+    return replyStream(socket, body);
+}
+
+int PeerServer::object(OstreeRepo *repo, const QString &name, GInputStream **body) noexcept
+{
+    const auto sep = name.indexOf('.');
+    const auto checksum = name.left(sep).toUtf8();
+    const auto ext = name.mid(sep + 1);
+    if (sep < 0 || ostree_validate_checksum_string(checksum, nullptr) == FALSE) {
+        return 404;
+    }
+
+    OstreeObjectType objectType{};
+    if (ext == "filez") {
+        objectType = OSTREE_OBJECT_TYPE_FILE;
+    } else if (ext == "commit") {
+        objectType = OSTREE_OBJECT_TYPE_COMMIT;
+    } else if (ext == "dirtree") {
+        objectType = OSTREE_OBJECT_TYPE_DIR_TREE;
+    } else if (ext == "dirmeta") {
+        objectType = OSTREE_OBJECT_TYPE_DIR_META;
+    } else {
+        return 404;
+    }
+
+    if (!this->isShared(repo, checksum, objectType)) {
+        return 404;
+    }
+
+    g_autoptr(GError) gErr = nullptr;
+    if (objectType == OSTREE_OBJECT_TYPE_FILE) {
+        g_autoptr(GInputStream) input = nullptr;
+        g_autoptr(GFileInfo) fileInfo = nullptr;
+        g_autoptr(GVariant) xattrs = nullptr;
+        if (ostree_repo_load_file(repo, checksum, &input, &fileInfo, &xattrs, nullptr, &gErr)
+            == FALSE) {
+            return 404;
+        }
+
+        // NOTE: The local repository is in bare-user-only mode, ostree
+        // verifies the checksum of the content converted here when pulling.
+        if (ostree_raw_file_to_archive_z2_stream(input, fileInfo, xattrs, body, nullptr, &gErr)
+            == FALSE) {
+            qWarning() << "failed to convert object" << name << gErr->message;
+            return 500;
+        }
+
+        return 200;
+    }
+
+    g_autoptr(GVariant) variant = nullptr;
+    if (ostree_repo_load_variant_if_exists(repo, objectType, checksum, &variant, &gErr) == FALSE) {
+        qWarning() << "failed to load object" << name << gErr->message;
+        return 500;
+    }
+    if (variant == nullptr) {
+        return 404;
+    }
+
+    g_autoptr(GBytes) bytes = g_variant_get_data_as_bytes(variant);
+    *body = g_memory_input_stream_new_from_bytes(bytes);
+    return 200;
+}
+
+bool PeerServer::isShared(OstreeRepo *repo, const char *checksum, OstreeObjectType type) noexcept
+{
+    QMutexLocker locker(&this->sharedMutex);
+
+    if (this->sharedDeadline.hasExpired()) {
+        this->sharedDeadline.setRemainingTime(std::chrono::seconds(sharedRefreshInterval));
+
+        auto commits = this->sharedCommits ? this->sharedCommits() : QByteArrayList();
+        std::sort(commits.begin(), commits.end());
+        if (commits != this->sharedCommitsTraversed) {
+            g_autoptr(GHashTable) reachable = ostree_repo_traverse_new_reachable();
+            for (const auto &commit : commits) {
+                g_autoptr(GError) gErr = nullptr;
+                if (ostree_repo_traverse_commit_union(repo, commit, 0, reachable, nullptr, &gErr)
+                    == FALSE) {
+                    qWarning() << "failed to traverse shared commit" << commit << gErr->message;
+                }
+            }
+
+            this->sharedObjects.clear();
+            GHashTableIter iter;
+            gpointer key = nullptr;
+            g_hash_table_iter_init(&iter, reachable);
+            while (g_hash_table_iter_next(&iter, &key, nullptr) == TRUE) {
+                const char *objectChecksum = nullptr;
+                OstreeObjectType objectType{};
+                ostree_object_name_deserialize(static_cast<GVariant *>(key),
+                                               &objectChecksum,
+                                               &objectType);
+                g_autofree char *name = ostree_object_to_string(objectChecksum, objectType);
+                this->sharedObjects.insert(name);
+            }
+            this->sharedCommitsTraversed = std::move(commits);
+        }
+    }
+
+    g_autofree char *name = ostree_object_to_string(checksum, type);
+    return this->sharedObjects.contains(name);
+}
+
+} // namespace linglong::repo
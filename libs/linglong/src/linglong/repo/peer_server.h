@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_REPO_PEER_SERVER_H_
+#define LINGLONG_REPO_PEER_SERVER_H_
+
+#include "linglong/utils/error/error.h"
+
+#include <ostree.h>
+
+#include <QByteArrayList>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QHostAddress>
+#include <QMap>
+#include <QMutex>
+#include <QNetworkAddressEntry>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QUrl>
+
+#include <atomic>
+#include <functional>
+
+namespace linglong::repo {
+
+// PeerServer shares the objects of a local ostree repository with the other
+// machines on the LAN, and keeps track of the machines sharing theirs.
+//
+// Objects are served over HTTP in the layout of an archive mode repository,
+// which ostree can pull from, see OSTreeRepo::setPeers(). Only the config
+// and the objects reachable from the shared commits are served, a peer can
+// not list the references. Connections are served concurrently by a thread
+// pool, and objects are streamed in chunks.
+//
+// Peers announce the port of their HTTP server by UDP broadcast in the
+// network of the address PeerServer listens on.
+//
+// ostree iterates its own main context while pulling, so PeerServer must run
+// in another thread than the one pulling. All methods except peers() must be
+// called in the thread of the object.
+class PeerServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PeerServer(const QDir &ostreeRepoDir, QObject *parent = nullptr);
+    ~PeerServer() override;
+
+    // Objects reachable from the commits returned by the function are served,
+    // see OSTreeRepo::sharedCommits(). It is called in the serving threads.
+    void setSharedCommits(std::function<QByteArrayList()> sharedCommits) noexcept;
+
+    // The address must belong to a network interface, PeerServer refuses to
+    // listen on all interfaces.
+    utils::error::Result<void> listen(const QHostAddress &address, quint16 port = 0) noexcept;
+    utils::error::Result<void> startDiscovery(const QNetworkAddressEntry &network,
+                                              quint16 port = defaultDiscoveryPort) noexcept;
+    QUrl url() const noexcept;
+
+    // URLs of the peers announced recently, it can be called from any thread.
+    QList<QUrl> peers() const noexcept;
+
+    static constexpr quint16 defaultDiscoveryPort = 45771;
+
+private:
+    void onDatagram() noexcept;
+    void announce() noexcept;
+
+    // These run in the threads of the pool.
+    void serve(qintptr socketDescriptor) noexcept;
+    bool respond(QTcpSocket &socket,
+                 OstreeRepo *repo,
+                 const QByteArray &method,
+                 const QByteArray &path) noexcept;
+    int object(OstreeRepo *repo, const QString &name, GInputStream **body) noexcept;
+    bool isShared(OstreeRepo *repo, const char *checksum, OstreeObjectType type) noexcept;
+
+    QDir ostreeRepoDir;
+    QString id;
+    QTcpServer *server;
+    QUdpSocket *discovery;
+    QTimer *announceTimer;
+    QNetworkAddressEntry network;
+    quint16 discoveryPort = 0;
+    QThreadPool pool;
+    std::atomic_bool stopping{ false };
+
+    // peer id -> url and the time it was last announced
+    mutable QMutex mutex;
+    QMap<QString, std::pair<QUrl, QDateTime>> announced;
+
+    // Objects reachable from the shared commits, by ostree object name. They
+    // are traversed again when the shared commits change.
+    std::function<QByteArrayList()> sharedCommits;
+    QMutex sharedMutex;
+    QByteArrayList sharedCommitsTraversed;
+    QSet<QByteArray> sharedObjects;
+    QDeadlineTimer sharedDeadline{ std::chrono::seconds(0) };
+
+    static constexpr int announceInterval = 30;
+    static constexpr int peerTimeout = 3 * announceInterval;
+    static constexpr int maxConnections = 8;
+    static constexpr int idleTimeout = 10;
+    static constexpr int sharedRefreshInterval = 10;
+};
+
+} // namespace linglong::repo
+
+#endif // LINGLONG_REPO_PEER_SERVER_H_
@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/package/erofs_reader.h"
+#include "linglong/utils/command/env.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <sys/stat.h>
+
+using namespace linglong::package;
+
+namespace {
+
+// Files of the tree, symbolic links are prefixed with "-> ".
+using Tree = QMap<QString, QByteArray>;
+
+Tree sourceTree()
+{
+    QByteArray random(300 * 1024, Qt::Uninitialized);
+    QRandomGenerator generator(42);
+    for (auto &c : random) {
+        c = static_cast<char>(generator.bounded(256));
+    }
+
+    QByteArray text;
+    for (int i = 0; text.size() < 1024 * 1024; ++i) {
+        text.append(QString("line %1 of a compressible file\n").arg(i % 1000).toUtf8());
+    }
+
+    Tree tree = {
+        { "info.json", R"({"appid":"org.deepin.erofs-test"})" },
+        { "files/empty", "" },
+        { "files/bin/random", random },
+        { "files/share/text", text },
+        { "files/share/mixed", text.left(5000) + random.left(70000) + text.left(100) },
+        { "files/lib/link", "-> ../share/text" },
+    };
+    for (int i = 0; i < 300; ++i) {
+        tree.insert(QString("files/share/many/file-with-a-long-name-%1").arg(i),
+                    QByteArray::number(i));
+    }
+    return tree;
+}
+
+void writeTree(const QDir &dir, const Tree &tree)
+{
+    for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
+        const auto path = dir.filePath(it.key());
+        ASSERT_TRUE(QDir().mkpath(QFileInfo(path).path()));
+        if (it.value().startsWith("-> ")) {
+            ASSERT_TRUE(QFile::link(QString::fromUtf8(it.value().mid(3)), path));
+            continue;
+        }
+        QFile file(path);
+        ASSERT_TRUE(file.open(QFile::WriteOnly));
+        ASSERT_EQ(file.write(it.value()), it.value().size());
+    }
+}
+
+void readTree(const ErofsReader &reader,
+              const ErofsReader::Inode &dir,
+              const QString &prefix,
+              Tree &tree)
+{
+    auto entries = reader.readDir(dir);
+    ASSERT_TRUE(entries.has_value()) << entries.error().message().toStdString();
+    for (const auto &entry : *entries) {
+        auto inode = reader.inode(entry.nid);
+        ASSERT_TRUE(inode.has_value()) << inode.error().message().toStdString();
+        const auto path = prefix + QString::fromUtf8(entry.name);
+        if (S_ISDIR(inode->mode)) {
+            readTree(reader, *inode, path + "/", tree);
+            continue;
+        }
+        auto content = reader.read(*inode);
+        ASSERT_TRUE(content.has_value()) << content.error().message().toStdString();
+        tree.insert(path, S_ISLNK(inode->mode) ? "-> " + *content : *content);
+    }
+}
+
+} // namespace
+
+TEST(ErofsReader, ReadImages)
+{
+    if (QStandardPaths::findExecutable("mkfs.erofs").isEmpty()) {
+        GTEST_SKIP() << "mkfs.erofs not found";
+    }
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const auto tree = sourceTree();
+    writeTree(QDir(dir.filePath("layer")), tree);
+
+    // The options of LayerPackager::pack(), and the layouts they may miss.
+    const QList<QStringList> options = {
+        { "-zlz4hc,9" },
+        { "-zlz4hc,9", "-C65536" },
+        { "-zlz4", "-Elegacy-compress" },
+        { "-zlz4hc,9", "-C65536", "-Elegacy-compress" },
+        {},
+    };
+    for (const auto &option : options) {
+        SCOPED_TRACE(option.join(' ').toStdString());
+
+        const auto image = dir.filePath("layer.erofs");
+        QFile::remove(image);
+        auto ret = linglong::utils::command::Exec(
+          "mkfs.erofs",
+          option + QStringList{ image, dir.filePath("layer") });
+        ASSERT_TRUE(ret.has_value()) << ret.error().message().toStdString();
+
+        auto reader = ErofsReader::New(image, 0);
+        ASSERT_TRUE(reader.has_value()) << reader.error().message().toStdString();
+        auto root = (*reader)->root();
+        ASSERT_TRUE(root.has_value()) << root.error().message().toStdString();
+
+        Tree result;
+        readTree(**reader, *root, "", result);
+        EXPECT_EQ(result.keys(), tree.keys());
+        for (auto it = tree.cbegin(); it != tree.cend(); ++it) {
+            EXPECT_TRUE(result.value(it.key()) == it.value()) << it.key().toStdString();
+        }
+    }
+}
+
+TEST(ErofsReader, InvalidImage)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    QFile file(dir.filePath("invalid"));
+    ASSERT_TRUE(file.open(QFile::WriteOnly));
+    file.write(QByteArray(8192, 'x'));
+    file.close();
+
+    EXPECT_FALSE(ErofsReader::New(file.fileName(), 0).has_value());
+    EXPECT_FALSE(ErofsReader::New(file.fileName(), 8192).has_value());
+}
@@ -0,0 +1,226 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/erofs_reader.h"
+#include "linglong/package/layer_packager.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace linglong::package;
+
+// The benchmarks are disabled by default, run them by
+//   ll-tests --gtest_also_run_disabled_tests --gtest_filter='LayerPackagerBenchmark.*'
+
+namespace {
+
+constexpr auto fileSize = 1024 * 1024;
+constexpr auto textFiles = 48;
+constexpr auto binaryFiles = 16;
+
+void writeFile(const QDir &dir, const QString &name, const QByteArray &content)
+{
+    ASSERT_TRUE(dir.mkpath(QFileInfo(dir.filePath(name)).path()));
+    QFile file(dir.filePath(name));
+    ASSERT_TRUE(file.open(QFile::WriteOnly));
+    ASSERT_EQ(file.write(content), content.size());
+}
+
+// Text compresses well, the random data stands for the already compressed
+// resources of an application.
+void writeCorpus(const QDir &dir)
+{
+    QByteArray text;
+    for (auto line = 0; text.size() < fileSize; ++line) {
+        text.append(QString("line %1: the quick brown fox jumps over the lazy dog\n")
+                      .arg(line)
+                      .toUtf8());
+    }
+    text.truncate(fileSize);
+    for (auto i = 0; i < textFiles; ++i) {
+        writeFile(dir, QString("files/share/text/%1.txt").arg(i), text);
+    }
+
+    QRandomGenerator generator(42);
+    QByteArray binary(fileSize, Qt::Uninitialized);
+    for (auto i = 0; i < binaryFiles; ++i) {
+        generator.fillRange(reinterpret_cast<quint32 *>(binary.data()),
+                            binary.size() / sizeof(quint32));
+        writeFile(dir, QString("files/share/binary/%1.bin").arg(i), binary);
+    }
+}
+
+// Drop the pages of the file from the page cache, so that the next read
+// comes from the disk.
+void dropCache(const QString &path)
+{
+    QFile file(path);
+    ASSERT_TRUE(file.open(QFile::ReadOnly));
+    ASSERT_EQ(::fdatasync(file.handle()), 0);
+    ASSERT_EQ(::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED), 0);
+}
+
+// Read every regular file below the inode, returns the bytes read.
+qint64 readTree(const ErofsReader &reader, const ErofsReader::Inode &dir)
+{
+    auto entries = reader.readDir(dir);
+    if (!entries) {
+        ADD_FAILURE() << entries.error().message().toStdString();
+        return 0;
+    }
+
+    qint64 total = 0;
+    for (const auto &entry : *entries) {
+        if (entry.name == "." || entry.name == "..") {
+            continue;
+        }
+        auto inode = reader.inode(entry.nid);
+        if (!inode) {
+            ADD_FAILURE() << inode.error().message().toStdString();
+            continue;
+        }
+        if (S_ISDIR(inode->mode)) {
+            total += readTree(reader, *inode);
+            continue;
+        }
+        if (!S_ISREG(inode->mode)) {
+            continue;
+        }
+        auto ret = reader.read(*inode, [&total](const char *, quint64 size) {
+            total += static_cast<qint64>(size);
+            return linglong::utils::error::Result<void>{};
+        });
+        if (!ret) {
+            ADD_FAILURE() << ret.error().message().toStdString();
+        }
+    }
+    return total;
+}
+
+qint64 readTree(const QDir &dir)
+{
+    qint64 total = 0;
+    QDirIterator it(dir.path(), QDir::Files | QDir::NoSymLinks, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QFile file(it.next());
+        if (!file.open(QFile::ReadOnly)) {
+            ADD_FAILURE() << file.fileName().toStdString() << ": "
+                          << file.errorString().toStdString();
+            continue;
+        }
+        while (!file.atEnd()) {
+            total += file.read(fileSize).size();
+        }
+    }
+    return total;
+}
+
+void report(const QString &profile, const char *name, const QString &value)
+{
+    std::cout << "[ BENCH    ] " << profile.toStdString() << ": " << name << " "
+              << value.toStdString() << std::endl;
+}
+
+} // namespace
+
+TEST(LayerPackagerBenchmark, DISABLED_CompressionProfiles)
+{
+    if (QStandardPaths::findExecutable("mkfs.erofs").isEmpty()) {
+        GTEST_SKIP() << "mkfs.erofs not found";
+    }
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    linglong::api::types::v1::PackageInfo info;
+    info.appid = "org.deepin.packager-benchmark";
+    info.arch = { "x86_64" };
+    info.base = "main:org.deepin.foundation/20.0.0/x86_64";
+    info.channel = "main";
+    info.kind = "app";
+    info.packageInfoModule = "runtime";
+    info.name = "packager-benchmark";
+    info.size = 0;
+    info.version = "1.0.0.0";
+
+    const LayerDir layerDir(dir.filePath("layer"));
+    writeFile(layerDir, "info.json", QByteArray::fromStdString(nlohmann::json(info).dump()));
+    writeCorpus(layerDir);
+    const qint64 corpusSize = static_cast<qint64>(textFiles + binaryFiles) * fileSize;
+
+    LayerPackager packager(QDir(dir.filePath("work")));
+    for (const auto &profile : compressionProfiles) {
+        SCOPED_TRACE(profile.toStdString());
+
+        const auto layerFilePath = dir.filePath(profile + ".layer");
+        QElapsedTimer timer;
+        timer.start();
+        auto layerFile = packager.pack(layerDir, layerFilePath, profile);
+        const auto packTime = timer.elapsed();
+        ASSERT_TRUE(layerFile.has_value()) << layerFile.error().message().toStdString();
+
+        report(profile, "pack time", QString("%1 ms").arg(packTime));
+        report(profile,
+               "layer size",
+               QString("%1 KiB (%2% of %3 KiB)")
+                 .arg(QFileInfo(layerFilePath).size() / 1024)
+                 .arg(QFileInfo(layerFilePath).size() * 100 / corpusSize)
+                 .arg(corpusSize / 1024));
+
+        auto offset = (*layerFile)->binaryDataOffset();
+        ASSERT_TRUE(offset.has_value()) << offset.error().message().toStdString();
+
+        dropCache(layerFilePath);
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        // NOTE: Images ErofsReader does not support are read through the
+        // mount of LayerPackager::unpack, which includes the mount time.
+        qint64 readSize = 0;
+        timer.restart();
+        auto reader = ErofsReader::New(layerFilePath, *offset);
+        if (reader) {
+            auto root = (*reader)->root();
+            ASSERT_TRUE(root.has_value()) << root.error().message().toStdString();
+            readSize = readTree(**reader, *root);
+        } else {
+            ASSERT_EQ(reader.error().code(), ENOTSUP) << reader.error().message().toStdString();
+            LayerPackager unpacker(QDir(dir.filePath("unpack-" + profile)));
+            auto unpacked = unpacker.unpack(**layerFile);
+            if (!unpacked) {
+                report(profile, "cold read", "skipped, " + unpacked.error().message());
+                continue;
+            }
+            readSize = readTree(*unpacked);
+        }
+        const auto readTime = std::max<qint64>(timer.elapsed(), 1);
+        EXPECT_GE(readSize, corpusSize);
+
+        report(profile,
+               "cold read",
+               QString("%1 MiB/s (%2 ms)")
+                 .arg(static_cast<double>(readSize) / 1024 / 1024 * 1000 / readTime, 0, 'f', 1)
+                 .arg(readTime));
+    }
+}
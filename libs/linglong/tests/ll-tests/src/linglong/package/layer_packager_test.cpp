@@ -0,0 +1,125 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/erofs_reader.h"
+#include "linglong/package/layer_packager.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <cerrno>
+
+using namespace linglong::package;
+
+namespace {
+
+void writeFile(const QDir &dir, const QString &name, const QByteArray &content)
+{
+    ASSERT_TRUE(dir.mkpath(QFileInfo(dir.filePath(name)).path()));
+    QFile file(dir.filePath(name));
+    ASSERT_TRUE(file.open(QFile::WriteOnly));
+    ASSERT_EQ(file.write(content), content.size());
+}
+
+// Content of the file at path in the image, or a null QByteArray.
+QByteArray readFile(const ErofsReader &reader, const QString &path)
+{
+    auto inode = reader.root();
+    for (const auto &name : path.split('/')) {
+        if (!inode) {
+            return {};
+        }
+        auto entries = reader.readDir(*inode);
+        if (!entries) {
+            return {};
+        }
+        auto entry = std::find_if(entries->cbegin(), entries->cend(), [&name](const auto &entry) {
+            return entry.name == name.toUtf8();
+        });
+        if (entry == entries->cend()) {
+            return {};
+        }
+        inode = reader.inode(entry->nid);
+    }
+
+    if (!inode) {
+        return {};
+    }
+    auto content = reader.read(*inode);
+    return content ? *content : QByteArray();
+}
+
+} // namespace
+
+TEST(LayerPackager, PackWithCompressionProfiles)
+{
+    if (QStandardPaths::findExecutable("mkfs.erofs").isEmpty()) {
+        GTEST_SKIP() << "mkfs.erofs not found";
+    }
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    linglong::api::types::v1::PackageInfo info;
+    info.appid = "org.deepin.packager-test";
+    info.arch = { "x86_64" };
+    info.base = "main:org.deepin.foundation/20.0.0/x86_64";
+    info.channel = "main";
+    info.kind = "app";
+    info.packageInfoModule = "runtime";
+    info.name = "packager-test";
+    info.size = 0;
+    info.version = "1.0.0.0";
+
+    const LayerDir layerDir(dir.filePath("layer"));
+    const auto content = QByteArray("a compressible line\n").repeated(1000);
+    writeFile(layerDir, "info.json", QByteArray::fromStdString(nlohmann::json(info).dump()));
+    writeFile(layerDir, "files/share/text", content);
+
+    LayerPackager packager(QDir(dir.filePath("work")));
+    for (const auto &profile : compressionProfiles) {
+        SCOPED_TRACE(profile.toStdString());
+
+        const auto layerFilePath = dir.filePath(profile + ".layer");
+        auto layerFile = packager.pack(layerDir, layerFilePath, profile);
+        ASSERT_TRUE(layerFile.has_value()) << layerFile.error().message().toStdString();
+
+        auto metaInfo = (*layerFile)->metaInfo();
+        ASSERT_TRUE(metaInfo.has_value()) << metaInfo.error().message().toStdString();
+        EXPECT_EQ(metaInfo->compression, profile.toStdString());
+
+        auto offset = (*layerFile)->binaryDataOffset();
+        ASSERT_TRUE(offset.has_value()) << offset.error().message().toStdString();
+
+        // NOTE: Images ErofsReader does not support are unpacked by erofsfuse.
+        auto reader = ErofsReader::New(layerFilePath, *offset);
+        if (!reader) {
+            ASSERT_EQ(reader.error().code(), ENOTSUP) << reader.error().message().toStdString();
+            if (QStandardPaths::findExecutable("erofsfuse").isEmpty()) {
+                continue;
+            }
+
+            LayerPackager unpacker(QDir(dir.filePath("unpack-" + profile)));
+            auto unpacked = unpacker.unpack(**layerFile);
+            ASSERT_TRUE(unpacked.has_value()) << unpacked.error().message().toStdString();
+            QFile file(unpacked->filePath("files/share/text"));
+            ASSERT_TRUE(file.open(QFile::ReadOnly));
+            EXPECT_EQ(file.readAll(), content);
+            continue;
+        }
+
+        EXPECT_EQ(readFile(**reader, "files/share/text"), content);
+    }
+
+    EXPECT_FALSE(packager.pack(layerDir, dir.filePath("unknown.layer"), "unknown").has_value());
+}
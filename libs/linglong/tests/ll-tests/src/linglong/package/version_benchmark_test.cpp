@@ -0,0 +1,195 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/package/reference.h"
+#include "linglong/package/version.h"
+
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QSet>
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+#include <vector>
+
+using namespace linglong::package;
+
+namespace {
+
+// The parser Version used before, kept as the baseline of the benchmarks.
+std::optional<Version> parseWithRegex(const QString &raw)
+{
+    static QRegularExpression regexExp(
+      R"(^(0|[1-9]\d*)\.(0|[1-9]\d*)\.(0|[1-9]\d*)(?:\.(0|[1-9]\d*))?$)");
+
+    auto matched = regexExp.match(raw);
+    if (!matched.hasMatch()) {
+        return std::nullopt;
+    }
+
+    bool ok = false;
+    Version version(0, 0, 0);
+    version.major = matched.captured(1).toLongLong(&ok);
+    if (!ok) {
+        return std::nullopt;
+    }
+    version.minor = matched.captured(2).toLongLong(&ok);
+    if (!ok) {
+        return std::nullopt;
+    }
+    version.patch = matched.captured(3).toLongLong(&ok);
+    if (!ok) {
+        return std::nullopt;
+    }
+    if (!matched.captured(4).isNull()) {
+        version.tweak = matched.captured(4).toLongLong(&ok);
+        if (!ok) {
+            return std::nullopt;
+        }
+    }
+
+    return version;
+}
+
+QStringList versionCorpus()
+{
+    QStringList corpus = {
+        "0.0.0",
+        "1.2.3.4",
+        "9223372036854775807.0.0.0",
+        "9223372036854775808.0.0.0",
+        "1.2.3.4.5",
+        "1.2",
+        "01.2.3.4",
+        "1.2.3.04",
+        "1..2.3",
+        "1.2.3.",
+        ".1.2.3",
+        "1.2.3.4-alpha",
+        "1.2.3.4+meta",
+        "a.b.c.d",
+        "",
+    };
+    for (int i = 0; i < 1000; ++i) {
+        corpus.append(QString("%1.%2.%3.%4").arg(i % 7).arg(i % 13).arg(i).arg(i * 31));
+    }
+    return corpus;
+}
+
+void report(const char *name, qint64 nsecs, qint64 operations)
+{
+    std::cout << "[ BENCH    ] " << name << ": " << nsecs / std::max<qint64>(operations, 1)
+              << " ns/op" << std::endl;
+}
+
+} // namespace
+
+TEST(PackageBenchmark, VersionParse)
+{
+    const auto corpus = versionCorpus();
+    constexpr auto rounds = 20;
+
+    for (const auto &raw : corpus) {
+        auto expected = parseWithRegex(raw);
+        auto version = Version::parse(raw);
+        ASSERT_EQ(version.has_value(), expected.has_value()) << raw.toStdString();
+        if (expected) {
+            EXPECT_EQ(*version, *expected) << raw.toStdString();
+            EXPECT_EQ(version->toString(), raw);
+        }
+    }
+
+    QElapsedTimer timer;
+    int valid = 0;
+    timer.start();
+    for (auto round = 0; round < rounds; ++round) {
+        for (const auto &raw : corpus) {
+            valid += parseWithRegex(raw).has_value() ? 1 : 0;
+        }
+    }
+    report("parse version with regex", timer.nsecsElapsed(), rounds * corpus.size());
+
+    timer.restart();
+    for (auto round = 0; round < rounds; ++round) {
+        for (const auto &raw : corpus) {
+            valid -= Version::parse(raw).has_value() ? 1 : 0;
+        }
+    }
+    report("parse version", timer.nsecsElapsed(), rounds * corpus.size());
+    EXPECT_EQ(valid, 0);
+}
+
+TEST(PackageBenchmark, VersionCompare)
+{
+    static_assert(Version(1, 0, 0, 1) > Version(1, 0, 0, 0));
+    static_assert(Version(1, 0, 0) != Version(1, 0, 0, 0));
+    static_assert(Version(1, 0, 0).hash() != Version(1, 0, 0, 0).hash());
+
+    std::vector<Version> versions;
+    for (const auto &raw : versionCorpus()) {
+        if (auto version = Version::parse(raw)) {
+            versions.push_back(*version);
+        }
+    }
+
+    // Comparing the strings was the way to find a version before.
+    std::vector<QString> strings;
+    for (const auto &version : versions) {
+        strings.push_back(version.toString());
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    std::unordered_set<std::string> stringSet;
+    for (const auto &str : strings) {
+        stringSet.insert(str.toStdString());
+    }
+    report("hash version strings", timer.nsecsElapsed(), strings.size());
+
+    timer.restart();
+    std::unordered_set<Version> versionSet(versions.cbegin(), versions.cend());
+    report("hash versions", timer.nsecsElapsed(), versions.size());
+    EXPECT_EQ(versionSet.size(), stringSet.size());
+
+    timer.restart();
+    std::sort(versions.begin(), versions.end());
+    report("sort versions", timer.nsecsElapsed(), versions.size());
+    EXPECT_TRUE(std::is_sorted(versions.cbegin(), versions.cend()));
+}
+
+TEST(PackageBenchmark, ReferenceHash)
+{
+    std::vector<Reference> refs;
+    for (int i = 0; i < 1000; ++i) {
+        auto ref = Reference::create("main",
+                                     QString("org.deepin.app%1").arg(i % 100),
+                                     Version(1, 0, 0, i),
+                                     Architecture(Architecture::X86_64));
+        ASSERT_TRUE(ref.has_value());
+        refs.push_back(*ref);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QSet<QString> stringSet;
+    for (const auto &ref : refs) {
+        stringSet.insert(ref.toString());
+    }
+    report("hash reference strings", timer.nsecsElapsed(), refs.size());
+
+    timer.restart();
+    QSet<Reference> refSet;
+    for (const auto &ref : refs) {
+        refSet.insert(ref);
+    }
+    report("hash references", timer.nsecsElapsed(), refs.size());
+
+    EXPECT_EQ(refSet.size(), stringSet.size());
+    EXPECT_TRUE(refSet.contains(refs.front()));
+}
@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/package_manager/package_manager.h"
+#include "linglong/package_manager/task.h"
+#include "linglong/repo/ostree_repo_fixture.h"
+
+#include <QEventLoop>
+#include <QTimer>
+#include <QUuid>
+
+#include <memory>
+
+namespace linglong::service::test {
+
+namespace {
+
+constexpr auto appID = "org.deepin.upgrade-test";
+
+// "source" publishes its layers to a repository in the file system, which
+// the package manager of "client" installs and upgrades them from.
+class PackageManagerTest : public repo::test::OSTreeRepoFixture
+{
+protected:
+    std::unique_ptr<repo::OSTreeRepo> sourceRepo;
+    std::unique_ptr<repo::OSTreeRepo> clientRepo;
+
+    void SetUp() override
+    {
+        OSTreeRepoFixture::SetUp();
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        // NOTE: The remote index is fetched again for every lookup, so that
+        // the client sees the versions published meanwhile.
+        api::types::v1::RepoConfig config{
+            .defaultRepo = "remote",
+            .remoteCacheTimeout = 0,
+            .repos = { { "remote", "file://" + dir->filePath("remote").toStdString() } },
+            .version = 1,
+        };
+        sourceRepo = std::make_unique<repo::OSTreeRepo>(dir->filePath("source"), config, api);
+        clientRepo = std::make_unique<repo::OSTreeRepo>(dir->filePath("client"), config, api);
+    }
+
+    void TearDown() override
+    {
+        clientRepo.reset();
+        sourceRepo.reset();
+        OSTreeRepoFixture::TearDown();
+    }
+
+    utils::error::Result<package::Reference> publish(const QString &id, const QString &version)
+    {
+        LINGLONG_TRACE("publish " + id + " " + version);
+
+        auto ref = importLayer(*sourceRepo, id, version, 4);
+        if (!ref) {
+            return LINGLONG_ERR(ref);
+        }
+
+        auto result = sourceRepo->push(*ref);
+        if (!result) {
+            return LINGLONG_ERR(result);
+        }
+
+        return ref;
+    }
+
+    // Wait for the task of the reply to finish, returns its last status.
+    static InstallTask::Status waitTask(PackageManager &pm, const QVariantMap &reply)
+    {
+        const auto taskID = reply.value("taskID").toString();
+        auto status = InstallTask::Failed;
+        QEventLoop loop;
+        QObject::connect(&pm,
+                         &PackageManager::TaskChanged,
+                         &loop,
+                         [&](const QString &id, const QString &, const QString &, int current) {
+                             if (id != taskID) {
+                                 return;
+                             }
+
+                             status = static_cast<InstallTask::Status>(current);
+                             if (status == InstallTask::Success || status == InstallTask::Failed
+                                 || status == InstallTask::Canceled) {
+                                 loop.quit();
+                             }
+                         });
+        QTimer::singleShot(std::chrono::minutes(1), &loop, &QEventLoop::quit);
+        loop.exec();
+        return status;
+    }
+};
+
+TEST_F(PackageManagerTest, UpgradeAll)
+{
+    auto base = publish("org.deepin.foundation", "20.0.0.0");
+    ASSERT_TRUE(base.has_value()) << base.error().message().toStdString();
+    auto ref = publish(appID, "1.0.0.0");
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+
+    auto task = std::make_shared<InstallTask>(QUuid::createUuid());
+    clientRepo->pull(task, std::vector<package::Reference>{ *base, *ref });
+    ASSERT_NE(task->currentStatus(), InstallTask::Failed);
+
+    auto newRef = publish(appID, "1.0.0.1");
+    ASSERT_TRUE(newRef.has_value()) << newRef.error().message().toStdString();
+
+    PackageManager pm(*clientRepo, nullptr);
+    auto reply = pm.UpgradeAll();
+    ASSERT_EQ(reply.value("code").toInt(), 0) << reply.value("message").toString().toStdString();
+    ASSERT_FALSE(reply.value("taskID").toString().isEmpty())
+      << reply.value("message").toString().toStdString();
+
+    EXPECT_EQ(waitTask(pm, reply), InstallTask::Success);
+    EXPECT_TRUE(clientRepo->getLayerDir(*newRef).has_value());
+    EXPECT_FALSE(clientRepo->getLayerDir(*ref).has_value());
+    EXPECT_TRUE(clientRepo->getLayerDir(*base).has_value());
+}
+
+} // namespace
+} // namespace linglong::service::test
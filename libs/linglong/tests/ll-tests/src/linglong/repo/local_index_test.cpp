@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/repo/local_index.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+using namespace linglong::repo;
+
+TEST(LocalIndex, InsertFindRemove)
+{
+    QTemporaryDir tmpDir;
+    ASSERT_TRUE(tmpDir.isValid());
+    const auto path = QDir(tmpDir.path()).absoluteFilePath("layers.idx");
+
+    LocalIndex index(path);
+    ASSERT_FALSE(index.open().has_value());
+
+    ASSERT_TRUE(index.replace({}).has_value());
+    EXPECT_EQ(index.size(), 0);
+    EXPECT_FALSE(index.find("main/org.deepin.demo/1.0.0.0/x86_64/runtime"));
+
+    ASSERT_TRUE(index.insert("main/org.deepin.demo/1.0.0.1/x86_64/runtime", "{\"b\":1}"));
+    ASSERT_TRUE(index.insert("main/org.deepin.demo/1.0.0.0/x86_64/runtime", "{\"a\":1}"));
+    ASSERT_TRUE(index.insert("main/org.deepin.demo2/1.0.0.0/x86_64/runtime", "{\"c\":1}"));
+    EXPECT_EQ(index.size(), 3);
+
+    auto value = index.find("main/org.deepin.demo/1.0.0.0/x86_64/runtime");
+    ASSERT_TRUE(value);
+    EXPECT_EQ(*value, QByteArray("{\"a\":1}"));
+
+    auto records = index.findByPrefix("main/org.deepin.demo/");
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[0].first, QByteArray("main/org.deepin.demo/1.0.0.0/x86_64/runtime"));
+    EXPECT_EQ(records[1].first, QByteArray("main/org.deepin.demo/1.0.0.1/x86_64/runtime"));
+
+    ASSERT_TRUE(index.remove("main/org.deepin.demo/1.0.0.0/x86_64/runtime"));
+    ASSERT_TRUE(index.remove("main/org.deepin.demo/1.0.0.0/x86_64/runtime"));
+    EXPECT_EQ(index.size(), 2);
+    EXPECT_FALSE(index.find("main/org.deepin.demo/1.0.0.0/x86_64/runtime"));
+}
+
+TEST(LocalIndex, Persistence)
+{
+    QTemporaryDir tmpDir;
+    ASSERT_TRUE(tmpDir.isValid());
+    const auto path = QDir(tmpDir.path()).absoluteFilePath("layers.idx");
+
+    {
+        LocalIndex index(path);
+        ASSERT_TRUE(index.replace({ { "a", "1" }, { "b", "2" } }).has_value());
+    }
+
+    LocalIndex index(path);
+    ASSERT_TRUE(index.open().has_value());
+    EXPECT_EQ(index.size(), 2);
+    auto value = index.find("b");
+    ASSERT_TRUE(value);
+    EXPECT_EQ(*value, QByteArray("2"));
+}
+
+TEST(LocalIndex, Broken)
+{
+    QTemporaryDir tmpDir;
+    ASSERT_TRUE(tmpDir.isValid());
+    const auto path = QDir(tmpDir.path()).absoluteFilePath("layers.idx");
+
+    QFile file(path);
+    ASSERT_TRUE(file.open(QFile::WriteOnly));
+    file.write("LLINDEX\0garbage", 16);
+    file.close();
+
+    LocalIndex index(path);
+    EXPECT_FALSE(index.open().has_value());
+    EXPECT_EQ(index.size(), 0);
+}
+
+TEST(LocalIndex, Load)
+{
+    QTemporaryDir tmpDir;
+    ASSERT_TRUE(tmpDir.isValid());
+
+    LocalIndex source(QDir(tmpDir.path()).absoluteFilePath("layers.idx"));
+    ASSERT_TRUE(source.replace({ { "a", "1" }, { "b", "2" } }).has_value());
+
+    LocalIndex index(QDir(tmpDir.path()).absoluteFilePath("remote.idx"));
+    EXPECT_FALSE(index.load("LLINDEX\0garbage").has_value());
+    ASSERT_TRUE(index.load(source.content()).has_value());
+    EXPECT_EQ(index.size(), 2);
+    EXPECT_EQ(index.content(), source.content());
+
+    LocalIndex reopened(QDir(tmpDir.path()).absoluteFilePath("remote.idx"));
+    ASSERT_TRUE(reopened.open().has_value());
+    auto value = reopened.find("a");
+    ASSERT_TRUE(value);
+    EXPECT_EQ(*value, QByteArray("1"));
+}
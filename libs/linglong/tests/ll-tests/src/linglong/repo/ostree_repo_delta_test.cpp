@@ -0,0 +1,292 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/erofs_reader.h"
+#include "linglong/package/layer_dir.h"
+#include "linglong/package/layer_packager.h"
+#include "linglong/repo/ostree_repo.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace linglong::repo::test {
+
+namespace {
+
+using Files = QMap<QString, QByteArray>;
+
+api::types::v1::PackageInfo packageInfo(const QString &version)
+{
+    api::types::v1::PackageInfo info;
+    info.appid = "org.deepin.delta-test";
+    info.arch = { "x86_64" };
+    info.base = "main:org.deepin.foundation/20.0.0/x86_64";
+    info.channel = "main";
+    info.kind = "app";
+    info.packageInfoModule = "runtime";
+    info.name = "delta-test";
+    info.size = 0;
+    info.version = version.toStdString();
+    return info;
+}
+
+void writeLayer(const QDir &dir, const QString &version, const Files &files)
+{
+    ASSERT_TRUE(dir.mkpath("."));
+    QFile infoFile(dir.filePath("info.json"));
+    ASSERT_TRUE(infoFile.open(QFile::WriteOnly));
+    infoFile.write(QByteArray::fromStdString(nlohmann::json(packageInfo(version)).dump()));
+    infoFile.close();
+
+    for (auto it = files.cbegin(); it != files.cend(); ++it) {
+        ASSERT_TRUE(dir.mkpath(QFileInfo(it.key()).path()));
+        QFile file(dir.filePath(it.key()));
+        ASSERT_TRUE(file.open(QFile::WriteOnly));
+        file.write(it.value());
+    }
+}
+
+void expectFiles(const QDir &dir, const Files &files)
+{
+    for (auto it = files.cbegin(); it != files.cend(); ++it) {
+        QFile file(dir.filePath(it.key()));
+        ASSERT_TRUE(file.open(QFile::ReadOnly)) << it.key().toStdString();
+        EXPECT_EQ(file.readAll(), it.value()) << it.key().toStdString();
+    }
+}
+
+// Mode of the file at path in the image of the layer file, or 0 if the image
+// can not be read.
+quint32 modeInLayerFile(package::LayerFile &layerFile, const QString &path)
+{
+    auto offset = layerFile.binaryDataOffset();
+    if (!offset) {
+        return 0;
+    }
+    auto reader = package::ErofsReader::New(layerFile.fileName(), *offset);
+    if (!reader) {
+        return 0;
+    }
+
+    auto inode = (*reader)->root();
+    for (const auto &name : path.split('/')) {
+        if (!inode) {
+            return 0;
+        }
+        auto entries = (*reader)->readDir(*inode);
+        if (!entries) {
+            return 0;
+        }
+        auto entry = std::find_if(entries->cbegin(), entries->cend(), [&name](const auto &entry) {
+            return entry.name == name.toUtf8();
+        });
+        if (entry == entries->cend()) {
+            return 0;
+        }
+        inode = (*reader)->inode(entry->nid);
+    }
+
+    return inode ? inode->mode : 0;
+}
+
+const Files baseFiles = {
+    { "files/bin/delta-test", "version 1" },
+    { "files/share/kept", "kept" },
+    { "files/share/removed", "removed" },
+    { "files/lib/removed/file", "removed" },
+};
+
+const Files newFiles = {
+    { "files/bin/delta-test", "version 2" },
+    { "files/share/kept", "kept" },
+    { "files/share/added", "added" },
+};
+
+const Files thirdFiles = {
+    { "files/bin/delta-test", "version 3" },
+    { "files/share/added", "added again" },
+    { "files/lib/restored", "restored" },
+};
+
+class OSTreeRepoDelta : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ASSERT_TRUE(dir.isValid());
+        repo = std::make_unique<OSTreeRepo>(dir.filePath("repo"), config, api);
+
+        writeLayer(dir.filePath("base"), "1.0.0.0", baseFiles);
+        auto result = repo->importLayerDir(package::LayerDir(dir.filePath("base")));
+        ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+    }
+
+    package::Reference reference(const QString &version)
+    {
+        auto ref = package::Reference::fromPackageInfo(packageInfo(version));
+        EXPECT_TRUE(ref.has_value());
+        return *ref;
+    }
+
+    QTemporaryDir dir;
+    api::client::ClientApi api;
+    api::types::v1::RepoConfig config{
+        .defaultRepo = "repo",
+        .repos = { { "repo", "http://127.0.0.1:1" } },
+        .version = 1,
+    };
+    std::unique_ptr<OSTreeRepo> repo;
+};
+
+TEST_F(OSTreeRepoDelta, ImportLayerDir)
+{
+    const auto baseRef = reference("1.0.0.0");
+    auto checksum = repo->getLayerChecksum(baseRef);
+    ASSERT_TRUE(checksum.has_value()) << checksum.error().message().toStdString();
+
+    writeLayer(dir.filePath("delta"),
+               "2.0.0.0",
+               { { "files/bin/delta-test", "version 2" }, { "files/share/added", "added" } });
+
+    api::types::v1::LayerInfoDelta delta;
+    delta.base = baseRef.toString().toStdString();
+    delta.checksum = "0000";
+    delta.removed = std::vector<std::string>{ "files/lib", "files/share/removed" };
+
+    auto result = repo->importLayerDir(package::LayerDir(dir.filePath("delta")), delta);
+    EXPECT_FALSE(result.has_value());
+    EXPECT_FALSE(repo->getLayerDir(reference("2.0.0.0")).has_value());
+
+    delta.checksum = checksum->toStdString();
+    result = repo->importLayerDir(package::LayerDir(dir.filePath("delta")), delta);
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    auto layerDir = repo->getLayerDir(reference("2.0.0.0"));
+    ASSERT_TRUE(layerDir.has_value()) << layerDir.error().message().toStdString();
+    expectFiles(*layerDir, newFiles);
+    EXPECT_FALSE(layerDir->exists("files/share/removed"));
+    EXPECT_FALSE(layerDir->exists("files/lib"));
+
+    auto info = layerDir->info();
+    ASSERT_TRUE(info.has_value()) << info.error().message().toStdString();
+    EXPECT_EQ(info->version, "2.0.0.0");
+}
+
+TEST_F(OSTreeRepoDelta, PackAndImportLayerFile)
+{
+    if (QStandardPaths::findExecutable("mkfs.erofs").isEmpty()) {
+        GTEST_SKIP() << "mkfs.erofs not found";
+    }
+
+    const auto baseRef = reference("1.0.0.0");
+    auto baseDir = repo->getLayerDir(baseRef);
+    ASSERT_TRUE(baseDir.has_value()) << baseDir.error().message().toStdString();
+    auto checksum = repo->getLayerChecksum(baseRef);
+    ASSERT_TRUE(checksum.has_value()) << checksum.error().message().toStdString();
+
+    writeLayer(dir.filePath("new"), "2.0.0.0", newFiles);
+
+    package::LayerPackager packager(QDir(dir.filePath("work")));
+    auto layerFile = packager.packDelta(*baseDir,
+                                        *checksum,
+                                        package::LayerDir(dir.filePath("new")),
+                                        dir.filePath("delta.layer"));
+    ASSERT_TRUE(layerFile.has_value()) << layerFile.error().message().toStdString();
+
+    auto layerInfo = (*layerFile)->metaInfo();
+    ASSERT_TRUE(layerInfo.has_value()) << layerInfo.error().message().toStdString();
+    ASSERT_TRUE(layerInfo->delta.has_value());
+    EXPECT_EQ(layerInfo->delta->base, baseRef.toString().toStdString());
+    EXPECT_EQ(layerInfo->delta->removed,
+              (std::vector<std::string>{ "files/lib", "files/share/removed" }));
+
+    auto result = repo->importLayerFile(**layerFile);
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    auto layerDir = repo->getLayerDir(reference("2.0.0.0"));
+    ASSERT_TRUE(layerDir.has_value()) << layerDir.error().message().toStdString();
+    expectFiles(*layerDir, newFiles);
+    EXPECT_FALSE(layerDir->exists("files/share/removed"));
+    EXPECT_FALSE(layerDir->exists("files/lib"));
+
+    // The same files make the same checksum, wherever they are committed.
+    auto newChecksum = repo->getLayerChecksum(reference("2.0.0.0"));
+    ASSERT_TRUE(newChecksum.has_value()) << newChecksum.error().message().toStdString();
+    result = repo->remove(reference("2.0.0.0"));
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+    result = repo->importLayerDir(package::LayerDir(dir.filePath("new")));
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+    auto fullChecksum = repo->getLayerChecksum(reference("2.0.0.0"));
+    ASSERT_TRUE(fullChecksum.has_value()) << fullChecksum.error().message().toStdString();
+    EXPECT_EQ(*newChecksum, *fullChecksum);
+}
+
+TEST_F(OSTreeRepoDelta, ApplyDeltasInARow)
+{
+    if (QStandardPaths::findExecutable("mkfs.erofs").isEmpty()) {
+        GTEST_SKIP() << "mkfs.erofs not found";
+    }
+
+    writeLayer(dir.filePath("2.0.0.0"), "2.0.0.0", newFiles);
+    writeLayer(dir.filePath("3.0.0.0"), "3.0.0.0", thirdFiles);
+    // NOTE: Only files are changed in files/share, the delta still keeps its mode.
+    ASSERT_TRUE(QFile::setPermissions(dir.filePath("3.0.0.0/files/share"),
+                                      QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner
+                                        | QFile::ReadGroup | QFile::ExeGroup));
+
+    package::LayerPackager packager(QDir(dir.filePath("work")));
+    const std::pair<QString, QString> steps[] = { { "1.0.0.0", "2.0.0.0" },
+                                                  { "2.0.0.0", "3.0.0.0" } };
+    for (const auto &[from, to] : steps) {
+        SCOPED_TRACE(to.toStdString());
+
+        auto baseDir = repo->getLayerDir(reference(from));
+        ASSERT_TRUE(baseDir.has_value()) << baseDir.error().message().toStdString();
+        auto checksum = repo->getLayerChecksum(reference(from));
+        ASSERT_TRUE(checksum.has_value()) << checksum.error().message().toStdString();
+
+        auto layerFile = packager.packDelta(*baseDir,
+                                            *checksum,
+                                            package::LayerDir(dir.filePath(to)),
+                                            dir.filePath(to + ".layer"));
+        ASSERT_TRUE(layerFile.has_value()) << layerFile.error().message().toStdString();
+
+        auto result = repo->importLayerFile(**layerFile);
+        ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+        if (to == "3.0.0.0") {
+            const auto mode = modeInLayerFile(**layerFile, "files/share");
+            if (mode != 0) {
+                EXPECT_EQ(mode & 07777, 0750U);
+            }
+        }
+    }
+
+    auto layerDir = repo->getLayerDir(reference("3.0.0.0"));
+    ASSERT_TRUE(layerDir.has_value()) << layerDir.error().message().toStdString();
+    expectFiles(*layerDir, thirdFiles);
+    EXPECT_FALSE(layerDir->exists("files/share/kept"));
+    EXPECT_FALSE(layerDir->exists("files/share/removed"));
+    EXPECT_FALSE(layerDir->exists("files/lib/removed"));
+
+    auto info = layerDir->info();
+    ASSERT_TRUE(info.has_value()) << info.error().message().toStdString();
+    EXPECT_EQ(info->version, "3.0.0.0");
+}
+
+} // namespace
+} // namespace linglong::repo::test
@@ -0,0 +1,84 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/repo/ostree_repo_fixture.h"
+
+#include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/layer_dir.h"
+
+#include <QDir>
+#include <QFile>
+
+namespace linglong::repo::test {
+
+void OSTreeRepoFixture::SetUp()
+{
+    if (QCoreApplication::instance() == nullptr) {
+        app = std::make_unique<QCoreApplication>(argc, argv);
+    }
+
+    dir = std::make_unique<QTemporaryDir>();
+    ASSERT_TRUE(dir->isValid());
+}
+
+void OSTreeRepoFixture::TearDown()
+{
+    dir.reset();
+}
+
+utils::error::Result<package::Reference> OSTreeRepoFixture::importLayer(OSTreeRepo &repo,
+                                                                        const QString &appID,
+                                                                        const QString &version,
+                                                                        int files)
+{
+    LINGLONG_TRACE("import layer " + appID + " " + version);
+
+    // NOTE: Layers are exported from entries/share, see OSTreeRepo::exportReference().
+    QDir layerDir(dir->filePath(QString("layer-%1-%2").arg(appID, version)));
+    if (!layerDir.mkpath("files") || !layerDir.mkpath("entries/share")) {
+        return LINGLONG_ERR("mkpath " + layerDir.absolutePath());
+    }
+
+    api::types::v1::PackageInfo info;
+    info.appid = appID.toStdString();
+    info.arch = { "x86_64" };
+    info.base = "main:org.deepin.foundation/20.0.0/x86_64";
+    info.channel = "main";
+    info.kind = "app";
+    info.packageInfoModule = "runtime";
+    info.name = appID.section('.', -1).toStdString();
+    info.size = 0;
+    info.version = version.toStdString();
+
+    QFile infoFile(layerDir.filePath("info.json"));
+    if (!infoFile.open(QFile::WriteOnly)) {
+        return LINGLONG_ERR("open", infoFile);
+    }
+    infoFile.write(QByteArray::fromStdString(nlohmann::json(info).dump()));
+    infoFile.close();
+
+    for (auto i = 0; i < files; ++i) {
+        QFile file(layerDir.filePath(QString("files/%1").arg(i)));
+        if (!file.open(QFile::WriteOnly)) {
+            return LINGLONG_ERR("open", file);
+        }
+        file.write(i + 1 == files ? version.toUtf8() : QByteArray::number(i));
+    }
+
+    auto result = repo.importLayerDir(package::LayerDir(layerDir.absolutePath()));
+    if (!result) {
+        return LINGLONG_ERR(result);
+    }
+
+    auto reference = package::Reference::fromPackageInfo(info);
+    if (!reference) {
+        return LINGLONG_ERR(reference);
+    }
+
+    return reference;
+}
+
+} // namespace linglong::repo::test
@@ -0,0 +1,50 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_TESTS_REPO_OSTREE_REPO_FIXTURE_H_
+#define LINGLONG_TESTS_REPO_OSTREE_REPO_FIXTURE_H_
+
+#include <gtest/gtest.h>
+
+#include "linglong/package/reference.h"
+#include "linglong/repo/ostree_repo.h"
+#include "linglong/utils/error/error.h"
+
+#include <QCoreApplication>
+#include <QTemporaryDir>
+
+#include <memory>
+
+namespace linglong::repo::test {
+
+// Fixture of the tests which exchange objects with servers. The servers run
+// on the event loop of QCoreApplication, and the repositories are created in
+// a temporary directory.
+class OSTreeRepoFixture : public ::testing::Test
+{
+protected:
+    void SetUp() override;
+    void TearDown() override;
+
+    // Create a layer of appID with the given number of files and import it
+    // into repo. The content of the last file depends on the version.
+    utils::error::Result<package::Reference>
+    importLayer(OSTreeRepo &repo, const QString &appID, const QString &version, int files);
+
+    std::unique_ptr<QCoreApplication> app;
+    std::unique_ptr<QTemporaryDir> dir;
+    api::client::ClientApi api;
+
+private:
+    // NOTE: QCoreApplication keeps references to argc and argv.
+    int argc = 1;
+    char arg0[9] = "ll-tests";
+    char *argv[2] = { arg0, nullptr };
+};
+
+} // namespace linglong::repo::test
+
+#endif // LINGLONG_TESTS_REPO_OSTREE_REPO_FIXTURE_H_
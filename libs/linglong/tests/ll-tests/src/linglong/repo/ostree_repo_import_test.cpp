@@ -0,0 +1,141 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/erofs_reader.h"
+#include "linglong/package/layer_dir.h"
+#include "linglong/package/layer_file.h"
+#include "linglong/package/layer_packager.h"
+#include "linglong/package/reference.h"
+#include "linglong/repo/ostree_repo.h"
+
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace linglong::repo::test {
+
+namespace {
+
+// nid of the entry name in the directory dir.
+quint64 findEntry(const package::ErofsReader &reader,
+                  const package::ErofsReader::Inode &dir,
+                  const QByteArray &name)
+{
+    auto entries = reader.readDir(dir);
+    EXPECT_TRUE(entries.has_value());
+    if (!entries) {
+        return 0;
+    }
+
+    auto entry = std::find_if(entries->cbegin(), entries->cend(), [&name](const auto &entry) {
+        return entry.name == name;
+    });
+    EXPECT_NE(entry, entries->cend()) << name.toStdString();
+    return entry == entries->cend() ? 0 : entry->nid;
+}
+
+TEST(OSTreeRepoImport, RejectDirectoryLoop)
+{
+    if (QStandardPaths::findExecutable("mkfs.erofs").isEmpty()) {
+        GTEST_SKIP() << "mkfs.erofs not found";
+    }
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    api::types::v1::PackageInfo info;
+    info.appid = "org.deepin.loop-test";
+    info.arch = { "x86_64" };
+    info.base = "main:org.deepin.foundation/20.0.0/x86_64";
+    info.channel = "main";
+    info.kind = "app";
+    info.packageInfoModule = "runtime";
+    info.name = "loop-test";
+    info.size = 0;
+    info.version = "1.0.0.0";
+
+    QDir layerDir(dir.filePath("layer"));
+    ASSERT_TRUE(layerDir.mkpath("files/lib"));
+    QFile infoFile(layerDir.filePath("info.json"));
+    ASSERT_TRUE(infoFile.open(QFile::WriteOnly));
+    infoFile.write(QByteArray::fromStdString(nlohmann::json(info).dump()));
+    infoFile.close();
+    QFile libFile(layerDir.filePath("files/lib/loop-test.so"));
+    ASSERT_TRUE(libFile.open(QFile::WriteOnly));
+    libFile.write("library");
+    libFile.close();
+
+    package::LayerPackager packager(QDir(dir.filePath("work")));
+    auto packed =
+      packager.pack(package::LayerDir(layerDir.absolutePath()), dir.filePath("loop.layer"));
+    ASSERT_TRUE(packed.has_value()) << packed.error().message().toStdString();
+    auto offset = (*packed)->binaryDataOffset();
+    ASSERT_TRUE(offset.has_value()) << offset.error().message().toStdString();
+
+    auto reader = package::ErofsReader::New(dir.filePath("loop.layer"), *offset);
+    if (!reader && reader.error().code() == ENOTSUP) {
+        GTEST_SKIP() << reader.error().message().toStdString();
+    }
+    ASSERT_TRUE(reader.has_value()) << reader.error().message().toStdString();
+    auto root = (*reader)->root();
+    ASSERT_TRUE(root.has_value());
+    const auto filesNid = findEntry(**reader, *root, "files");
+    auto files = (*reader)->inode(filesNid);
+    ASSERT_TRUE(files.has_value());
+    const auto libNid = findEntry(**reader, *files, "lib");
+    ASSERT_NE(libNid, 0U);
+
+    // Point the dirents of files/lib, which are of the directory type, to
+    // files, so that files/lib/lib/... never ends.
+    QFile layerFile(dir.filePath("loop.layer"));
+    ASSERT_TRUE(layerFile.open(QFile::ReadWrite));
+    auto content = layerFile.readAll();
+    QByteArray from(8, Qt::Uninitialized);
+    QByteArray to(8, Qt::Uninitialized);
+    qToLittleEndian<quint64>(libNid, from.data());
+    qToLittleEndian<quint64>(filesNid, to.data());
+    constexpr char direntTypeDir = 2;
+    int patched = 0;
+    auto pos = content.indexOf(from, static_cast<int>(*offset));
+    for (; pos >= 0; pos = content.indexOf(from, pos + 1)) {
+        if (pos + 10 < content.size() && content[pos + 10] == direntTypeDir) {
+            content.replace(pos, to.size(), to);
+            ++patched;
+        }
+    }
+    ASSERT_GT(patched, 0);
+    ASSERT_TRUE(layerFile.seek(0));
+    ASSERT_EQ(layerFile.write(content), content.size());
+    layerFile.close();
+
+    api::client::ClientApi api;
+    api::types::v1::RepoConfig config{
+        .defaultRepo = "repo",
+        .repos = { { "repo", "http://127.0.0.1:1" } },
+        .version = 1,
+    };
+    OSTreeRepo repo(dir.filePath("repo"), config, api);
+
+    auto loopFile = package::LayerFile::New(dir.filePath("loop.layer"));
+    ASSERT_TRUE(loopFile.has_value()) << loopFile.error().message().toStdString();
+    auto result = repo.importLayerFile(**loopFile);
+    EXPECT_FALSE(result.has_value());
+
+    auto ref = package::Reference::fromPackageInfo(info);
+    ASSERT_TRUE(ref.has_value());
+    EXPECT_FALSE(repo.getLayerDir(*ref).has_value());
+}
+
+} // namespace
+} // namespace linglong::repo::test
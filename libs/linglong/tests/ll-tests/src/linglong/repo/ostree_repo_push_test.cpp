@@ -0,0 +1,172 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/repo/ostree_repo_fixture.h"
+#include "linglong/repo/stand_in_repo_server.h"
+
+#include <memory>
+
+namespace linglong::repo::test {
+
+namespace {
+
+class PushTest : public OSTreeRepoFixture
+{
+protected:
+    std::unique_ptr<StandInRepoServer> server;
+    std::unique_ptr<OSTreeRepo> ostreeRepo;
+
+    void SetUp() override
+    {
+        OSTreeRepoFixture::SetUp();
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        server = std::make_unique<StandInRepoServer>(dir->filePath("server"));
+        auto result = server->listen();
+        ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+        api::types::v1::RepoConfig config{
+            .defaultRepo = "stand-in",
+            .repos = { { "stand-in", server->url().toString().toStdString() } },
+            .version = 1,
+        };
+        ostreeRepo = std::make_unique<OSTreeRepo>(dir->filePath("client"), config, api);
+        api.setNewServerForAllOperations(server->url());
+    }
+
+    void TearDown() override
+    {
+        ostreeRepo.reset();
+        server.reset();
+        OSTreeRepoFixture::TearDown();
+    }
+
+    utils::error::Result<package::Reference> importLayer(const QString &version, int files)
+    {
+        return OSTreeRepoFixture::importLayer(*ostreeRepo, "org.deepin.push-test", version, files);
+    }
+};
+
+TEST_F(PushTest, Objects)
+{
+    constexpr auto files = 32;
+
+    auto ref = importLayer("1.0.0.0", files);
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+
+    auto result = ostreeRepo->push(*ref, false, { .objects = true });
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+    EXPECT_EQ(server->uploadedTarballs(), 0);
+    // files, dirtree and dirmeta objects of the layer and the commit
+    EXPECT_GT(server->uploadedObjects(), files);
+    EXPECT_FALSE(server->resolve("main/org.deepin.push-test/1.0.0.0/x86_64/runtime").isEmpty());
+
+    server->resetCounters();
+
+    auto newRef = importLayer("1.0.0.1", files);
+    ASSERT_TRUE(newRef.has_value()) << newRef.error().message().toStdString();
+
+    result = ostreeRepo->push(*newRef, false, { .objects = true });
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+    // Only the changed files, the directories containing them and the commit
+    // are uploaded again.
+    EXPECT_GT(server->uploadedObjects(), 0);
+    EXPECT_LT(server->uploadedObjects(), files / 2);
+    EXPECT_FALSE(server->resolve("main/org.deepin.push-test/1.0.0.1/x86_64/runtime").isEmpty());
+}
+
+// "source" publishes its layers to a repository in the file system, which
+// "client" resolves references from.
+class PublishTest : public OSTreeRepoFixture
+{
+protected:
+    std::unique_ptr<OSTreeRepo> sourceRepo;
+    std::unique_ptr<OSTreeRepo> clientRepo;
+
+    void SetUp() override
+    {
+        OSTreeRepoFixture::SetUp();
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        api::types::v1::RepoConfig config{
+            .defaultRepo = "remote",
+            .repos = { { "remote", "file://" + dir->filePath("remote").toStdString() } },
+            .version = 1,
+        };
+        sourceRepo = std::make_unique<OSTreeRepo>(dir->filePath("source"), config, api);
+        clientRepo = std::make_unique<OSTreeRepo>(dir->filePath("client"), config, api);
+    }
+
+    void TearDown() override
+    {
+        clientRepo.reset();
+        sourceRepo.reset();
+        OSTreeRepoFixture::TearDown();
+    }
+
+    utils::error::Result<package::Reference> importLayer(const QString &version)
+    {
+        return OSTreeRepoFixture::importLayer(*sourceRepo, "org.deepin.publish-test", version, 8);
+    }
+};
+
+TEST_F(PublishTest, ResolveFromIndex)
+{
+    auto ref = importLayer("1.0.0.0");
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+    auto result = sourceRepo->push(*ref);
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    auto newRef = importLayer("1.0.0.1");
+    ASSERT_TRUE(newRef.has_value()) << newRef.error().message().toStdString();
+    result = sourceRepo->push(*newRef);
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    auto fuzzyRef = package::FuzzyReference::create(std::nullopt,
+                                                    "publish-test",
+                                                    std::nullopt,
+                                                    newRef->arch);
+    ASSERT_TRUE(fuzzyRef.has_value());
+    auto pkgInfos = clientRepo->listRemote(*fuzzyRef);
+    ASSERT_TRUE(pkgInfos.has_value()) << pkgInfos.error().message().toStdString();
+    EXPECT_EQ(pkgInfos->size(), 2U);
+
+    fuzzyRef->id = newRef->id;
+    auto resolved = clientRepo->clearReference(*fuzzyRef, { .forceRemote = true });
+    ASSERT_TRUE(resolved.has_value()) << resolved.error().message().toStdString();
+    EXPECT_EQ(resolved->toString(), newRef->toString());
+}
+
+TEST_F(PublishTest, GenerateStaticDelta)
+{
+    auto ref = importLayer("1.0.0.0");
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+    auto result = sourceRepo->push(*ref);
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    auto newRef = importLayer("1.0.0.1");
+    ASSERT_TRUE(newRef.has_value()) << newRef.error().message().toStdString();
+    result = sourceRepo->push(*newRef);
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) path = g_file_new_for_path(dir->filePath("remote/repos/remote").toUtf8());
+    g_autoptr(OstreeRepo) remote = ostree_repo_new(path);
+    ASSERT_TRUE(ostree_repo_open(remote, nullptr, &gErr)) << gErr->message;
+    g_autoptr(GPtrArray) deltas = nullptr;
+    ASSERT_TRUE(ostree_repo_list_static_delta_names(remote, &deltas, nullptr, &gErr))
+      << gErr->message;
+    EXPECT_EQ(deltas->len, 1U);
+}
+
+} // namespace
+} // namespace linglong::repo::test
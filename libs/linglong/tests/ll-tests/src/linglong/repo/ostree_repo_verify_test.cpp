@@ -0,0 +1,103 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/api/types/v1/Generators.hpp"
+#include "linglong/package/layer_dir.h"
+#include "linglong/repo/ostree_repo.h"
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtConcurrent>
+
+namespace linglong::repo::test {
+
+namespace {
+
+TEST(OSTreeRepoVerify, RepairCheckout)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    api::client::ClientApi api;
+    api::types::v1::RepoConfig config{
+        .defaultRepo = "repo",
+        .repos = { { "repo", "http://127.0.0.1:1" } },
+        .version = 1,
+    };
+    OSTreeRepo repo(dir.filePath("repo"), config, api);
+
+    QDir layerDir(dir.filePath("layer"));
+    ASSERT_TRUE(layerDir.mkpath("files/bin"));
+
+    api::types::v1::PackageInfo info;
+    info.appid = "org.deepin.verify-test";
+    info.arch = { "x86_64" };
+    info.base = "main:org.deepin.foundation/20.0.0/x86_64";
+    info.channel = "main";
+    info.kind = "app";
+    info.packageInfoModule = "runtime";
+    info.name = "verify-test";
+    info.size = 0;
+    info.version = "1.0.0.0";
+
+    QFile infoFile(layerDir.filePath("info.json"));
+    ASSERT_TRUE(infoFile.open(QFile::WriteOnly));
+    infoFile.write(QByteArray::fromStdString(nlohmann::json(info).dump()));
+    infoFile.close();
+
+    QFile binFile(layerDir.filePath("files/bin/verify-test"));
+    ASSERT_TRUE(binFile.open(QFile::WriteOnly));
+    binFile.write("#!/bin/sh\n");
+    binFile.close();
+
+    auto result = repo.importLayerDir(package::LayerDir(layerDir.absolutePath()));
+    ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+    auto verified = repo.verify();
+    ASSERT_TRUE(verified.has_value()) << verified.error().message().toStdString();
+    EXPECT_GT(verified->objects, 0);
+    EXPECT_EQ(verified->layers, 1);
+    EXPECT_TRUE(verified->corruptedObjects.isEmpty());
+    EXPECT_TRUE(verified->brokenLayers.isEmpty());
+
+    const auto refspec = QString("main/org.deepin.verify-test/1.0.0.0/x86_64/runtime");
+    QDir checkout(dir.filePath("repo/layers/" + refspec));
+    ASSERT_TRUE(QFile::remove(checkout.filePath("files/bin/verify-test")));
+
+    verified = repo.verify();
+    ASSERT_TRUE(verified.has_value()) << verified.error().message().toStdString();
+    EXPECT_EQ(verified->brokenLayers, QStringList{ refspec });
+    EXPECT_TRUE(verified->repairedLayers.isEmpty());
+
+    verified = repo.verify({ .repair = true });
+    ASSERT_TRUE(verified.has_value()) << verified.error().message().toStdString();
+    EXPECT_EQ(verified->repairedLayers, QStringList{ refspec });
+    EXPECT_TRUE(QFile::exists(checkout.filePath("files/bin/verify-test")));
+
+    verified = repo.verify();
+    ASSERT_TRUE(verified.has_value()) << verified.error().message().toStdString();
+    EXPECT_TRUE(verified->brokenLayers.isEmpty());
+
+    // A worker is given the layers, and the repaired ones are reindexed on
+    // the thread owning the repository.
+    EXPECT_EQ(repo.listLayers(), QStringList{ refspec });
+    ASSERT_TRUE(QFile::remove(checkout.filePath("files/bin/verify-test")));
+    verified = QtConcurrent::run([&repo, layers = repo.listLayers()]() {
+                   return repo.verify({ .repair = true, .layers = layers });
+               }).result();
+    ASSERT_TRUE(verified.has_value()) << verified.error().message().toStdString();
+    EXPECT_EQ(verified->repairedLayers, QStringList{ refspec });
+    auto reindexed = repo.reindexLayers(verified->repairedLayers);
+    ASSERT_TRUE(reindexed.has_value()) << reindexed.error().message().toStdString();
+    EXPECT_EQ(repo.listLayers(), QStringList{ refspec });
+    EXPECT_TRUE(QFile::exists(checkout.filePath("files/bin/verify-test")));
+}
+
+} // namespace
+} // namespace linglong::repo::test
@@ -0,0 +1,209 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "linglong/package_manager/task.h"
+#include "linglong/repo/ostree_repo_fixture.h"
+#include "linglong/repo/peer_server.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QThread>
+#include <QUuid>
+
+#include <memory>
+
+namespace linglong::repo::test {
+
+namespace {
+
+constexpr auto appID = "org.deepin.peer-test";
+constexpr auto files = 8;
+
+// "peer" shares the objects of the layers it pulled with "client" by a
+// PeerServer on the loopback interface. The remote is an archive repository
+// in the file system, which the layers are published to from "source".
+class PeerServerTest : public OSTreeRepoFixture
+{
+protected:
+    std::unique_ptr<OSTreeRepo> sourceRepo;
+    std::unique_ptr<OSTreeRepo> peerRepo;
+    std::unique_ptr<OSTreeRepo> clientRepo;
+    QThread serverThread;
+    PeerServer *server = nullptr;
+
+    void SetUp() override
+    {
+        OSTreeRepoFixture::SetUp();
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        api::types::v1::RepoConfig config{
+            .defaultRepo = "remote",
+            .peerSharing = true,
+            .repos = { { "remote", "file://" + dir->filePath("remote").toStdString() } },
+            .version = 1,
+        };
+        sourceRepo = std::make_unique<OSTreeRepo>(dir->filePath("source"), config, api);
+        peerRepo = std::make_unique<OSTreeRepo>(dir->filePath("peer"), config, api);
+        clientRepo = std::make_unique<OSTreeRepo>(dir->filePath("client"), config, api);
+
+        // NOTE: ostree iterates its own main context while pulling.
+        server = new PeerServer(QDir(dir->filePath("peer/repo")));
+        server->setSharedCommits([repo = peerRepo.get()]() {
+            return repo->sharedCommits();
+        });
+        server->moveToThread(&serverThread);
+        serverThread.start();
+
+        utils::error::Result<void> anyResult;
+        utils::error::Result<void> result;
+        QMetaObject::invokeMethod(
+          server,
+          [this, &anyResult, &result]() {
+              anyResult = server->listen(QHostAddress::Any);
+              result = server->listen(QHostAddress::LocalHost);
+          },
+          Qt::BlockingQueuedConnection);
+        EXPECT_FALSE(anyResult.has_value());
+        ASSERT_TRUE(result.has_value()) << result.error().message().toStdString();
+
+        const auto url = server->url();
+        clientRepo->setPeers([url]() {
+            return QList<QUrl>{ url };
+        });
+    }
+
+    void TearDown() override
+    {
+        if (server != nullptr) {
+            QMetaObject::invokeMethod(
+              server,
+              [this]() {
+                  delete server;
+              },
+              Qt::BlockingQueuedConnection);
+        }
+        serverThread.quit();
+        serverThread.wait();
+        clientRepo.reset();
+        peerRepo.reset();
+        sourceRepo.reset();
+        OSTreeRepoFixture::TearDown();
+    }
+
+    // Publish the layer of the ostree repository at repoPath in the remote.
+    void publishLayer(const QString &repoPath, const package::Reference &reference)
+    {
+        g_autoptr(GError) gErr = nullptr;
+        const auto remotePath = dir->filePath("remote/repos/remote");
+        ASSERT_TRUE(QDir().mkpath(remotePath));
+        g_autoptr(GFile) path = g_file_new_for_path(remotePath.toUtf8());
+        g_autoptr(OstreeRepo) remote = ostree_repo_new(path);
+        ASSERT_TRUE(ostree_repo_create(remote, OSTREE_REPO_MODE_ARCHIVE, nullptr, &gErr))
+          << gErr->message;
+
+        const auto source = "file://" + repoPath.toUtf8();
+        const auto ref = QString("%1/%2/%3/%4/runtime")
+                           .arg(reference.channel,
+                                reference.id,
+                                reference.version.toString(),
+                                reference.arch.toString())
+                           .toUtf8();
+        const char *refs[] = { ref.constData(), nullptr };
+        GVariantBuilder builder{};
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+        g_variant_builder_add(&builder,
+                              "{s@v}",
+                              "refs",
+                              g_variant_new_variant(g_variant_new_strv(refs, -1)));
+        g_autoptr(GVariant) options = g_variant_ref_sink(g_variant_builder_end(&builder));
+        ASSERT_TRUE(
+          ostree_repo_pull_with_options(remote, source, options, nullptr, nullptr, &gErr))
+          << gErr->message;
+        ASSERT_TRUE(ostree_repo_regenerate_summary(remote, nullptr, nullptr, &gErr))
+          << gErr->message;
+    }
+
+    // Remove the file objects from the remote, so that only peers have them.
+    void stripRemoteFiles()
+    {
+        QDirIterator it(dir->filePath("remote/repos/remote/objects"),
+                        { "*.filez" },
+                        QDir::Files,
+                        QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            ASSERT_TRUE(QFile::remove(it.next()));
+        }
+    }
+
+    static service::InstallTask::Status pull(OSTreeRepo &repo,
+                                             const package::Reference &reference)
+    {
+        auto task = std::make_shared<service::InstallTask>(QUuid::createUuid());
+        repo.pull(task, reference);
+        return task->currentStatus();
+    }
+};
+
+TEST_F(PeerServerTest, FetchObjectsFromPeers)
+{
+    auto ref = importLayer(*sourceRepo, appID, "1.0.0.0", files);
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+    publishLayer(dir->filePath("source/repo"), *ref);
+    ASSERT_NE(pull(*peerRepo, *ref), service::InstallTask::Failed);
+    stripRemoteFiles();
+
+    EXPECT_NE(pull(*clientRepo, *ref), service::InstallTask::Failed);
+
+    auto layerDir = clientRepo->getLayerDir(*ref);
+    ASSERT_TRUE(layerDir.has_value()) << layerDir.error().message().toStdString();
+    QFile file(layerDir->filePath("files/0"));
+    ASSERT_TRUE(file.open(QFile::ReadOnly));
+    EXPECT_EQ(file.readAll(), "0");
+}
+
+TEST_F(PeerServerTest, FallbackToRemote)
+{
+    auto ref = importLayer(*sourceRepo, appID, "1.0.0.0", files);
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+    publishLayer(dir->filePath("source/repo"), *ref);
+
+    // NOTE: The peer has none of the objects.
+    EXPECT_NE(pull(*clientRepo, *ref), service::InstallTask::Failed);
+    EXPECT_TRUE(clientRepo->getLayerDir(*ref).has_value());
+}
+
+TEST_F(PeerServerTest, WithoutPeers)
+{
+    auto ref = importLayer(*sourceRepo, appID, "1.0.0.0", files);
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+    publishLayer(dir->filePath("source/repo"), *ref);
+    ASSERT_NE(pull(*peerRepo, *ref), service::InstallTask::Failed);
+    stripRemoteFiles();
+
+    clientRepo->setPeers(nullptr);
+
+    // The remote misses the file objects, which only the peer has.
+    EXPECT_EQ(pull(*clientRepo, *ref), service::InstallTask::Failed);
+}
+
+TEST_F(PeerServerTest, ImportedLayersAreNotShared)
+{
+    auto ref = importLayer(*peerRepo, appID, "1.0.0.0", files);
+    ASSERT_TRUE(ref.has_value()) << ref.error().message().toStdString();
+    publishLayer(dir->filePath("peer/repo"), *ref);
+    stripRemoteFiles();
+
+    EXPECT_TRUE(peerRepo->sharedCommits().isEmpty());
+    EXPECT_EQ(pull(*clientRepo, *ref), service::InstallTask::Failed);
+}
+
+} // namespace
+} // namespace linglong::repo::test
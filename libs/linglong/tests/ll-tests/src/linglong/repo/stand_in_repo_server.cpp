@@ -0,0 +1,293 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "linglong/repo/stand_in_repo_server.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QUuid>
+
+namespace linglong::repo::test {
+
+namespace {
+
+QByteArray toJson(const QJsonObject &obj)
+{
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+} // namespace
+
+StandInRepoServer::StandInRepoServer(const QString &repoPath, QObject *parent)
+    : QObject(parent)
+    , repoPath(repoPath)
+{
+    QObject::connect(&this->server,
+                     &QTcpServer::newConnection,
+                     this,
+                     &StandInRepoServer::onNewConnection);
+}
+
+StandInRepoServer::~StandInRepoServer() = default;
+
+utils::error::Result<void> StandInRepoServer::listen() noexcept
+{
+    LINGLONG_TRACE("listen stand-in repo server");
+
+    g_autoptr(GError) gErr = nullptr;
+
+    QDir().mkpath(this->repoPath);
+    g_autoptr(GFile) path = g_file_new_for_path(this->repoPath.toUtf8());
+    g_autoptr(OstreeRepo) ostreeRepo = ostree_repo_new(path);
+    if (ostree_repo_create(ostreeRepo, OSTREE_REPO_MODE_ARCHIVE, nullptr, &gErr) == FALSE) {
+        return LINGLONG_ERR("ostree_repo_create", gErr);
+    }
+    this->repo.reset(static_cast<OstreeRepo *>(g_steal_pointer(&ostreeRepo)));
+
+    if (!this->server.listen(QHostAddress::LocalHost)) {
+        return LINGLONG_ERR(this->server.errorString());
+    }
+
+    return LINGLONG_OK;
+}
+
+QUrl StandInRepoServer::url() const noexcept
+{
+    return QUrl(QString("http://127.0.0.1:%1").arg(this->server.serverPort()));
+}
+
+QString StandInRepoServer::resolve(const QString &ref) const noexcept
+{
+    g_autofree char *commit = nullptr;
+    if (ostree_repo_resolve_rev(this->repo.get(), ref.toUtf8(), TRUE, &commit, nullptr) == FALSE
+        || commit == nullptr) {
+        return {};
+    }
+
+    return QString::fromUtf8(commit);
+}
+
+void StandInRepoServer::onNewConnection() noexcept
+{
+    while (auto *socket = this->server.nextPendingConnection()) {
+        this->buffers.insert(socket, {});
+        QObject::connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            this->onReadyRead(socket);
+        });
+        QObject::connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            this->buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void StandInRepoServer::onReadyRead(QTcpSocket *socket) noexcept
+{
+    auto &buffer = this->buffers[socket];
+    buffer.append(socket->readAll());
+
+    // NOTE: Clients keep the connection alive, so serve every complete request
+    // in the buffer and keep the rest for the next read.
+    while (true) {
+        const auto headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            return;
+        }
+
+        const auto lines = buffer.left(headerEnd).split('\n');
+        const auto requestLine = lines.first().trimmed().split(' ');
+        if (requestLine.size() < 2) {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        int contentLength = 0;
+        for (const auto &line : lines.mid(1)) {
+            const auto sep = line.indexOf(':');
+            if (line.left(sep).trimmed().toLower() == "content-length") {
+                contentLength = line.mid(sep + 1).trimmed().toInt();
+            }
+        }
+
+        const auto bodyBegin = headerEnd + 4;
+        if (buffer.size() < bodyBegin + contentLength) {
+            return;
+        }
+
+        Request request{ requestLine[0],
+                         QUrl(QString::fromUtf8(requestLine[1])).path().toUtf8(),
+                         buffer.mid(bodyBegin, contentLength) };
+        buffer.remove(0, bodyBegin + contentLength);
+
+        const auto resp = this->handle(request);
+        QJsonObject obj{ { "code", resp.code }, { "msg", resp.msg }, { "data", resp.data } };
+        const auto body = toJson(obj);
+        socket->write("HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Content-Length: "
+                      + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+    }
+}
+
+StandInRepoServer::Response StandInRepoServer::handle(const Request &request) noexcept
+{
+    const auto path = QString::fromUtf8(request.path).split('/', Qt::SkipEmptyParts);
+    // api/v1/...
+    if (path.size() < 3 || path[0] != "api" || path[1] != "v1") {
+        return { 404, "not found", {} };
+    }
+
+    if (path[2] == "sign-in" && request.method == "POST") {
+        return { 200, "", { { "token", "stand-in-token" } } };
+    }
+
+    if (path[2] != "upload-tasks") {
+        return { 404, "not found", {} };
+    }
+
+    if (path.size() == 3 && request.method == "POST") {
+        const auto req = QJsonDocument::fromJson(request.body).object();
+        const auto taskID = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        this->tasks.insert(taskID, req.value("ref").toString());
+        return { 200, "", { { "id", taskID } } };
+    }
+
+    if (path.size() < 5 || !this->tasks.contains(path[3])) {
+        return { 404, "task not found", {} };
+    }
+
+    const auto &action = path[4];
+    if (action == "status" && request.method == "GET") {
+        return { 200, "", { { "status", "complete" } } };
+    }
+    if (action == "tar" && request.method == "PUT") {
+        // NOTE: Tarballs are only counted, the objects tests check the repo.
+        ++this->tarCount;
+        return { 200, "", { { "watchId", path[3] } } };
+    }
+    if (action == "objects" && path.size() == 6) {
+        if (path[5] == "missing" && request.method == "POST") {
+            return this->missingObjects(request.body);
+        }
+        if (request.method == "PUT") {
+            return this->writeObject(path[5], request.body);
+        }
+    }
+    if (action == "commit" && request.method == "POST") {
+        return this->commit(path[3], request.body);
+    }
+
+    return { 404, "not found", {} };
+}
+
+StandInRepoServer::Response StandInRepoServer::missingObjects(const QByteArray &body) noexcept
+{
+    const auto objects = QJsonDocument::fromJson(body).object().value("objects").toArray();
+
+    QJsonArray missing;
+    for (const auto &object : objects) {
+        g_autofree char *checksum = nullptr;
+        OstreeObjectType objectType{};
+        ostree_object_from_string(object.toString().toUtf8(), &checksum, &objectType);
+
+        gboolean exists = FALSE;
+        g_autoptr(GError) gErr = nullptr;
+        if (ostree_repo_has_object(this->repo.get(),
+                                   objectType,
+                                   checksum,
+                                   &exists,
+                                   nullptr,
+                                   &gErr)
+            == FALSE) {
+            return { 500, gErr->message, {} };
+        }
+        if (exists == FALSE) {
+            missing.append(object);
+        }
+    }
+
+    return { 200, "", { { "missing", missing } } };
+}
+
+StandInRepoServer::Response StandInRepoServer::writeObject(const QString &object,
+                                                           const QByteArray &body) noexcept
+{
+    g_autoptr(GError) gErr = nullptr;
+
+    g_autofree char *checksum = nullptr;
+    OstreeObjectType objectType{};
+    ostree_object_from_string(object.toUtf8(), &checksum, &objectType);
+
+    g_autoptr(GBytes) bytes = g_bytes_new(body.constData(), body.size());
+    g_autoptr(GInputStream) input = g_memory_input_stream_new_from_bytes(bytes);
+
+    if (ostree_repo_prepare_transaction(this->repo.get(), nullptr, nullptr, &gErr) == FALSE) {
+        return { 500, gErr->message, {} };
+    }
+
+    g_autofree guchar *csum = nullptr;
+    gboolean ret = FALSE;
+    if (objectType == OSTREE_OBJECT_TYPE_FILE) {
+        ret = ostree_repo_write_content(this->repo.get(),
+                                        checksum,
+                                        input,
+                                        body.size(),
+                                        &csum,
+                                        nullptr,
+                                        &gErr);
+    } else {
+        ret = ostree_repo_write_metadata_stream(this->repo.get(),
+                                                objectType,
+                                                checksum,
+                                                input,
+                                                body.size(),
+                                                &csum,
+                                                nullptr,
+                                                &gErr);
+    }
+    if (ret == FALSE) {
+        ostree_repo_abort_transaction(this->repo.get(), nullptr, nullptr);
+        return { 400, gErr->message, {} };
+    }
+
+    if (ostree_repo_commit_transaction(this->repo.get(), nullptr, nullptr, &gErr) == FALSE) {
+        return { 500, gErr->message, {} };
+    }
+
+    ++this->objectCount;
+    return {};
+}
+
+StandInRepoServer::Response StandInRepoServer::commit(const QString &taskID,
+                                                      const QByteArray &body) noexcept
+{
+    g_autoptr(GError) gErr = nullptr;
+
+    const auto commit =
+      QJsonDocument::fromJson(body).object().value("commit").toString().toUtf8();
+
+    // NOTE: Refuse to move the reference to a commit with missing objects.
+    g_autoptr(GHashTable) reachable = nullptr;
+    if (ostree_repo_traverse_commit(this->repo.get(), commit, 0, &reachable, nullptr, &gErr)
+        == FALSE) {
+        return { 400, gErr->message, {} };
+    }
+
+    if (ostree_repo_set_ref_immediate(this->repo.get(),
+                                      nullptr,
+                                      this->tasks.value(taskID).toUtf8(),
+                                      commit,
+                                      nullptr,
+                                      &gErr)
+        == FALSE) {
+        return { 500, gErr->message, {} };
+    }
+
+    return {};
+}
+
+} // namespace linglong::repo::test
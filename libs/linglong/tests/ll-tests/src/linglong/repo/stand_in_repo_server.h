@@ -0,0 +1,91 @@
+/*
+ * SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_TESTS_REPO_STAND_IN_REPO_SERVER_H_
+#define LINGLONG_TESTS_REPO_STAND_IN_REPO_SERVER_H_
+
+#include "linglong/utils/error/error.h"
+
+#include <ostree.h>
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QMap>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrl>
+
+#include <memory>
+
+namespace linglong::repo::test {
+
+// A minimal repository server which implements the upload endpoints used by
+// OSTreeRepo::push, backed by an archive mode ostree repository. It runs on
+// the event loop of the calling thread, so it can serve the blocking requests
+// made by OSTreeRepo.
+class StandInRepoServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StandInRepoServer(const QString &repoPath, QObject *parent = nullptr);
+    ~StandInRepoServer() override;
+
+    utils::error::Result<void> listen() noexcept;
+    QUrl url() const noexcept;
+
+    // Returns the commit checksum of the reference, or an empty string.
+    QString resolve(const QString &ref) const noexcept;
+
+    int uploadedObjects() const noexcept { return this->objectCount; }
+
+    int uploadedTarballs() const noexcept { return this->tarCount; }
+
+    void resetCounters() noexcept
+    {
+        this->objectCount = 0;
+        this->tarCount = 0;
+    }
+
+private:
+    struct Request
+    {
+        QByteArray method;
+        QByteArray path;
+        QByteArray body;
+    };
+
+    struct Response
+    {
+        int code = 200;
+        QString msg;
+        QJsonObject data;
+    };
+
+    void onNewConnection() noexcept;
+    void onReadyRead(QTcpSocket *socket) noexcept;
+    Response handle(const Request &request) noexcept;
+    Response missingObjects(const QByteArray &body) noexcept;
+    Response writeObject(const QString &object, const QByteArray &body) noexcept;
+    Response commit(const QString &taskID, const QByteArray &body) noexcept;
+
+    struct OstreeRepoDeleter
+    {
+        void operator()(OstreeRepo *repo) { g_clear_object(&repo); }
+    };
+
+    std::unique_ptr<OstreeRepo, OstreeRepoDeleter> repo;
+    QString repoPath;
+    QTcpServer server;
+    QMap<QTcpSocket *, QByteArray> buffers;
+    // task id -> reference
+    QMap<QString, QString> tasks;
+    int objectCount = 0;
+    int tarCount = 0;
+};
+
+} // namespace linglong::repo::test
+
+#endif // LINGLONG_TESTS_REPO_STAND_IN_REPO_SERVER_H_
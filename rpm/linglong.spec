@@ -9,7 +9,7 @@ Source0:        %{url}/archive/%{version}/linglong-%{version}.tar.gz
 BuildRequires:  cmake gcc-c++ 
 BuildRequires:  qt5-qtbase-devel qt5-qtwebsockets-devel qt5-qtbase-private-devel 
 BuildRequires:  glib2-devel nlohmann-json-devel ostree-devel yaml-cpp-devel
-BuildRequires:  systemd-devel gtest-devel libseccomp-devel
+BuildRequires:  systemd-devel gtest-devel libseccomp-devel lz4-devel
 Requires:       linglong-bin = %{version}-%{release}
 
 %description